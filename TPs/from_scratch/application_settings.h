@@ -8,9 +8,32 @@
 struct ApplicationSettings
 {
 	bool enable_vsync = true;
+    //0 for CPU, 1 for GPU, 2 for CPU with the culling BVH
     int gpu_frustum_culling = 1;
     bool draw_mesh_bboxes = false;
 
+    //Back face culling of the triangles by OpenGL and of whole clusters
+    //by the culling passes with the normal cones of the clusters
+    bool backface_culling = false;
+
+    //Selection of the level of detail of the triangle groups: the coarsest level whose
+    //simplification error projects to less than lod_error_threshold pixels is drawn
+    bool lod_selection = true;
+    float lod_error_threshold = 1.0f;
+
+    //Occlusion culling against a depth buffer rasterized on the CPU from
+    //a subset of the triangle groups instead of the z-buffer of the GPU
+    bool software_occlusion_culling = false;
+    int occluder_triangle_budget = 100000;
+
+    //Two-phase occlusion culling that stays on the GPU: the visibility of the objects
+    //is kept in a buffer from one frame to the next, no readback of the culling results
+    bool gpu_resident_occlusion_culling = true;
+
+    //Compressed vertex attributes (quantized positions and texcoords, octahedral
+    //normals, cf vertex_format.h) instead of floats. Only read at startup
+    bool packed_vertices = true;
+
     bool use_irradiance_map = true;
 
 	//1 for cubemap, 0 for skysphere
@@ -39,6 +62,9 @@ struct ApplicationSettings
 //    int irradiance_map_precomputation_downscale_factor = 64;
 //    std::string irradiance_map_file_path = "../data/skyspheres/above_clouds_4k.hdr";
 
+    //Spherical harmonics projection (fast) or Monte Carlo integration (reference, uses
+    //irradiance_map_precomputation_samples) for the precomputation of the irradiance map
+    bool irradiance_map_use_spherical_harmonics = true;
     int irradiance_map_precomputation_samples = 16384 / 4;
     int irradiance_map_precomputation_downscale_factor = 1;
     std::string irradiance_map_file_path = "../data/skyspheres/above_clouds_4k.hdr";
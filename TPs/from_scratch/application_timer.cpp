@@ -9,12 +9,15 @@ ApplicationTimer::ApplicationTimer(TP2* main_app)
 
     m_frame = 0;
     glGenQueries(MAX_FRAMES, m_time_query);
+    glGenQueries(MAX_FRAMES, m_vertex_invocations_query);
 
     // initialise les queries, plus simple pour demarrer
     for (int i = 0; i < MAX_FRAMES; i++)
     {
         glBeginQuery(GL_TIME_ELAPSED, m_time_query[i]);
         glEndQuery(GL_TIME_ELAPSED);
+        glBeginQuery(GL_VERTEX_SHADER_INVOCATIONS_ARB, m_vertex_invocations_query[i]);
+        glEndQuery(GL_VERTEX_SHADER_INVOCATIONS_ARB);
     }
 
     // affichage du temps  dans la fenetre
@@ -36,9 +39,12 @@ void ApplicationTimer::prerender()
 		// recupere la mesure precedente...
 		m_frame_time = 0;
 		glGetQueryObjecti64v(m_time_query[m_frame], GL_QUERY_RESULT, &m_frame_time);
+		m_vertex_invocations = 0;
+		glGetQueryObjecti64v(m_vertex_invocations_query[m_frame], GL_QUERY_RESULT, &m_vertex_invocations);
 
 		// prepare la mesure de la frame courante...
 		glBeginQuery(GL_TIME_ELAPSED, m_time_query[m_frame]);
+		glBeginQuery(GL_VERTEX_SHADER_INVOCATIONS_ARB, m_vertex_invocations_query[m_frame]);
 
 		// mesure le temps d'execution du draw pour le cpu
 		// utilise std::chrono pour mesurer le temps cpu 
@@ -51,6 +57,7 @@ void ApplicationTimer::postrender()
 	int cpu_time = std::chrono::duration_cast<std::chrono::microseconds>(m_cpu_stop - m_cpu_start).count();
 
 	glEndQuery(GL_TIME_ELAPSED);
+	glEndQuery(GL_VERTEX_SHADER_INVOCATIONS_ARB);
 
 	// selectionne une requete pour la frame suivante...
 	m_frame = (m_frame + 1) % MAX_FRAMES;
@@ -60,7 +67,9 @@ void ApplicationTimer::postrender()
 	clear(m_console);
 	printf(m_console, 0, 1, "cpu  %02dms %03dus (%04d FPS)", cpu_time / 1000, cpu_time % 1000, (int)(1000000.0f / cpu_time));
     printf(m_console, 0, 2, "gpu  %02dms %03dus (%04d FPS)", int(m_frame_time / 1000000), int((m_frame_time / 1000) % 1000), int(1000000000.0f / m_frame_time));
-    printf(m_console, 0, 3, "Triangle groups drawn: %d / %d", m_tp2->mesh_groups_drawn(), m_tp2->mesh_groups_count());
+    printf(m_console, 0, 3, "Clusters drawn: %d / %d", m_tp2->mesh_groups_drawn(), m_tp2->mesh_groups_count());
+    printf(m_console, 0, 4, "Vertex shader invocations: %lld", (long long)m_vertex_invocations);
+    printf(m_console, 0, 5, "Culling: cpu %02dms %03dus, %d blocking readbacks", m_tp2->culling_cpu_time() / 1000, m_tp2->culling_cpu_time() % 1000, m_tp2->blocking_readbacks());
 
 	// affiche le temps dans le terminal 
 	//~ printf("cpu  %02dms %03dus    ", cpu_time / 1000, cpu_time % 1000);
@@ -32,6 +32,9 @@ private:
 
 	GLuint m_time_query[MAX_FRAMES];
 	GLint64 m_frame_time;
+	//Number of times the vertex shaders were run during the frame (ARB_pipeline_statistics_query)
+	GLuint m_vertex_invocations_query[MAX_FRAMES];
+	GLint64 m_vertex_invocations;
 	int m_frame;
 
 	Text m_console;
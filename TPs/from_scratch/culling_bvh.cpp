@@ -0,0 +1,158 @@
+#include "culling_bvh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+void CullingBVH::build(const std::vector<vec3>& bbox_mins, const std::vector<vec3>& bbox_maxs)
+{
+    int count = bbox_mins.size();
+
+    m_nodes.clear();
+    m_object_ids.resize(count);
+    std::iota(m_object_ids.begin(), m_object_ids.end(), 0);
+    if (count == 0)
+    {
+        m_object_mins.clear();
+        m_object_maxs.clear();
+
+        return;
+    }
+
+    std::vector<vec3> centers(count);
+    for (int i = 0; i < count; i++)
+        centers[i] = vec3((bbox_mins[i].x + bbox_maxs[i].x) * 0.5f, (bbox_mins[i].y + bbox_maxs[i].y) * 0.5f, (bbox_mins[i].z + bbox_maxs[i].z) * 0.5f);
+
+    //The objects are sorted by build_node(), the boxes are copied after in the same order
+    m_object_mins = bbox_mins;
+    m_object_maxs = bbox_maxs;
+
+    m_nodes.reserve(2 * (count / MAX_LEAF_OBJECTS + 1));
+    m_nodes.push_back(Node());
+    build_node(0, 0, count, 0, centers);
+
+    std::vector<vec3> sorted_mins(count), sorted_maxs(count);
+    for (int i = 0; i < count; i++)
+    {
+        sorted_mins[i] = bbox_mins[m_object_ids[i]];
+        sorted_maxs[i] = bbox_maxs[m_object_ids[i]];
+    }
+    m_object_mins = std::move(sorted_mins);
+    m_object_maxs = std::move(sorted_maxs);
+}
+
+int CullingBVH::build_node(int node_index, int first, int count, int depth, std::vector<vec3>& centers)
+{
+    vec3 node_min = vec3(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+    vec3 node_max = vec3(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max());
+    vec3 centers_min = node_min;
+    vec3 centers_max = node_max;
+    for (int i = first; i < first + count; i++)
+    {
+        int object_id = m_object_ids[i];
+
+        node_min = min(node_min, m_object_mins[object_id]);
+        node_max = max(node_max, m_object_maxs[object_id]);
+        centers_min = min(centers_min, centers[object_id]);
+        centers_max = max(centers_max, centers[object_id]);
+    }
+
+    Node node;
+    node.min = node_min;
+    node.max = node_max;
+    node.first = first;
+    node.count = count;
+    node.children = -1;
+
+    if (count <= MAX_LEAF_OBJECTS || depth >= MAX_DEPTH - 1)
+    {
+        m_nodes[node_index] = node;
+
+        return node_index;
+    }
+
+    //Median split along the largest axis of the centers, the tree is balanced and
+    //the traversal stack is bounded
+    vec3 extent = vec3(centers_max.x - centers_min.x, centers_max.y - centers_min.y, centers_max.z - centers_min.z);
+    int axis = 0;
+    if (extent.y > extent.x && extent.y >= extent.z)
+        axis = 1;
+    else if (extent.z > extent.x && extent.z > extent.y)
+        axis = 2;
+
+    int middle = first + count / 2;
+    std::nth_element(m_object_ids.begin() + first, m_object_ids.begin() + middle, m_object_ids.begin() + first + count,
+                     [&centers, axis](int a, int b) { return centers[a](axis) < centers[b](axis); });
+
+    node.children = m_nodes.size();
+    m_nodes[node_index] = node;
+    m_nodes.push_back(Node());
+    m_nodes.push_back(Node());
+
+    build_node(node.children, first, middle - first, depth + 1, centers);
+    build_node(node.children + 1, middle, first + count - middle, depth + 1, centers);
+
+    return node_index;
+}
+
+void CullingBVH::extract_frustum_planes(const Transform& mvp_matrix, float planes[6][4])
+{
+    //-w <= x <= w, -w <= y <= w, -w <= z <= w in clip space
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 4; j++)
+        {
+            planes[i * 2 + 0][j] = mvp_matrix.m[3][j] + mvp_matrix.m[i][j];
+            planes[i * 2 + 1][j] = mvp_matrix.m[3][j] - mvp_matrix.m[i][j];
+        }
+    }
+}
+
+int CullingBVH::test_box_planes(const vec3& bbox_min, const vec3& bbox_max, const float planes[6][4], int plane_mask)
+{
+    vec3 center = vec3((bbox_min.x + bbox_max.x) * 0.5f, (bbox_min.y + bbox_max.y) * 0.5f, (bbox_min.z + bbox_max.z) * 0.5f);
+    vec3 extent = vec3((bbox_max.x - bbox_min.x) * 0.5f, (bbox_max.y - bbox_min.y) * 0.5f, (bbox_max.z - bbox_min.z) * 0.5f);
+
+    int crossed_planes = 0;
+    for (int plane = 0; plane < 6; plane++)
+    {
+        if (!(plane_mask & (1 << plane)))
+            continue;
+
+        float distance = planes[plane][0] * center.x + planes[plane][1] * center.y + planes[plane][2] * center.z + planes[plane][3];
+        float radius = std::abs(planes[plane][0]) * extent.x + std::abs(planes[plane][1]) * extent.y + std::abs(planes[plane][2]) * extent.z;
+
+        //Small tolerance for the rounding errors, a box touching the plane is not culled
+        radius += 1.0e-5f * (std::abs(distance) + radius);
+
+        if (distance + radius < 0)
+            return -1;
+        else if (distance - radius < 0)
+            crossed_planes |= 1 << plane;
+    }
+
+    return crossed_planes;
+}
+
+int CullingBVH::cull(const Transform& mvp_matrix, std::vector<int>& visible_ids)
+{
+    auto always_visible = [](const Point&, const Point&) { return true; };
+
+    return cull_hierarchy(mvp_matrix, always_visible, true, visible_ids);
+}
+
+const CullingBVH::CullingStats& CullingBVH::stats() const
+{
+    return m_stats;
+}
+
+int CullingBVH::node_count() const
+{
+    return m_nodes.size();
+}
+
+int CullingBVH::object_count() const
+{
+    return m_object_ids.size();
+}
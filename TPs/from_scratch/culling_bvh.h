@@ -0,0 +1,181 @@
+#ifndef CULLING_BVH_H
+#define CULLING_BVH_H
+
+#include "mat.h"
+#include "vec.h"
+
+#include <utility>
+#include <vector>
+
+/**
+ * Bounding volume hierarchy over the bounding boxes of the objects of the scene,
+ * used to cull whole parts of the scene at once.
+ *
+ * The hierarchy is traversed from the root with a mask of the frustum planes
+ * that still need to be tested: when a node is entirely on the inside of a plane,
+ * its children don't test this plane again and when a node is entirely inside
+ * the frustum, all the objects of its subtree are accepted without visiting its children.
+ * The objects of a subtree are contiguous in the list of objects of the hierarchy.
+ */
+class CullingBVH
+{
+public:
+    struct CullingStats
+    {
+        int nodes_visited = 0;
+        //Nodes entirely inside the frustum whose objects were accepted without visiting the children
+        int subtrees_accepted = 0;
+        //Objects whose bounding box was tested individually
+        int objects_tested = 0;
+        int objects_accepted = 0;
+    };
+
+    /**
+     * Builds the hierarchy. T must have 'min' and 'max' vec3 members (TP2::CullObject for example)
+     */
+    template <typename T>
+    void build(const std::vector<T>& objects)
+    {
+        std::vector<vec3> mins(objects.size()), maxs(objects.size());
+        for (int i = 0; i < int(objects.size()); i++)
+        {
+            mins[i] = objects[i].min;
+            maxs[i] = objects[i].max;
+        }
+
+        build(mins, maxs);
+    }
+
+    void build(const std::vector<vec3>& bbox_mins, const std::vector<vec3>& bbox_maxs);
+
+    /**
+     * Frustum culling of the objects.
+     *
+     * @param visible_ids The ids of the objects (index in the vector given to build())
+     * that are inside the frustum. The vector is cleared first
+     * @return The number of visible objects
+     */
+    int cull(const Transform& mvp_matrix, std::vector<int>& visible_ids);
+
+    /**
+     * Frustum culling and hierarchical occlusion culling: is_visible(bbox_min, bbox_max) is called
+     * on the nodes and on the objects that are inside the frustum and the subtree / object
+     * is rejected if it returns false
+     */
+    template <typename VisibilityTest>
+    int cull(const Transform& mvp_matrix, VisibilityTest is_visible, std::vector<int>& visible_ids)
+    {
+        return cull_hierarchy(mvp_matrix, is_visible, false, visible_ids);
+    }
+
+    /**
+     * Statistics of the last call to cull()
+     */
+    const CullingStats& stats() const;
+    int node_count() const;
+    int object_count() const;
+
+private:
+    struct Node
+    {
+        vec3 min;
+        //Objects of the subtree: m_object_ids[first .. first + count[
+        int first;
+        vec3 max;
+        int count;
+        //Index of the first child, the second child is right after it. -1 for a leaf
+        int children;
+    };
+
+    inline static const int MAX_LEAF_OBJECTS = 4;
+    inline static const int MAX_DEPTH = 64;
+
+    int build_node(int node_index, int first, int count, int depth, std::vector<vec3>& centers);
+
+    /**
+     * Planes of the frustum: a point is inside if dot(plane.xyz, p) + plane.w >= 0
+     */
+    static void extract_frustum_planes(const Transform& mvp_matrix, float planes[6][4]);
+
+    /**
+     * @return -1 if the box is outside of one of the planes of the mask. Otherwise, the
+     * mask of the planes that the box crosses
+     */
+    static int test_box_planes(const vec3& bbox_min, const vec3& bbox_max, const float planes[6][4], int plane_mask);
+
+    template <typename VisibilityTest>
+    int cull_hierarchy(const Transform& mvp_matrix, VisibilityTest& is_visible, bool accept_inside_subtrees, std::vector<int>& visible_ids)
+    {
+        visible_ids.clear();
+        m_stats = CullingStats();
+        if (m_nodes.empty())
+            return 0;
+
+        float planes[6][4];
+        extract_frustum_planes(mvp_matrix, planes);
+
+        //Node to visit and the planes that its box may cross
+        std::pair<int, int> stack[MAX_DEPTH + 1];
+        int stack_size = 0;
+        stack[stack_size++] = std::make_pair(0, 0x3F);
+        while (stack_size > 0)
+        {
+            std::pair<int, int> entry = stack[--stack_size];
+            const Node& node = m_nodes[entry.first];
+
+            m_stats.nodes_visited++;
+
+            int plane_mask = test_box_planes(node.min, node.max, planes, entry.second);
+            if (plane_mask == -1)
+                continue;
+
+            if (!is_visible(Point(node.min), Point(node.max)))
+                continue;
+
+            if (plane_mask == 0 && accept_inside_subtrees)
+            {
+                //The whole subtree is inside the frustum
+                visible_ids.insert(visible_ids.end(), m_object_ids.begin() + node.first, m_object_ids.begin() + node.first + node.count);
+                m_stats.subtrees_accepted++;
+
+                continue;
+            }
+
+            if (node.children == -1)
+            {
+                for (int i = node.first; i < node.first + node.count; i++)
+                {
+                    int object_id = m_object_ids[i];
+
+                    m_stats.objects_tested++;
+                    if (test_box_planes(m_object_mins[i], m_object_maxs[i], planes, plane_mask) == -1)
+                        continue;
+                    if (!is_visible(Point(m_object_mins[i]), Point(m_object_maxs[i])))
+                        continue;
+
+                    visible_ids.push_back(object_id);
+                }
+
+                continue;
+            }
+
+            stack[stack_size++] = std::make_pair(node.children + 1, plane_mask);
+            stack[stack_size++] = std::make_pair(node.children, plane_mask);
+        }
+
+        m_stats.objects_accepted = visible_ids.size();
+
+        return visible_ids.size();
+    }
+
+    std::vector<Node> m_nodes;
+
+    //Objects in the order of the leaves, with their bounding boxes
+    std::vector<int> m_object_ids;
+    std::vector<vec3> m_object_mins;
+    std::vector<vec3> m_object_maxs;
+
+    CullingStats m_stats;
+};
+
+#endif
@@ -0,0 +1,267 @@
+#include "frustum_culler.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+//The vector path also uses FMA and POPCNT, -mavx2 alone does not enable them
+#if defined(__AVX2__) && defined(__FMA__) && defined(__POPCNT__)
+#define FRUSTUM_CULLER_AVX2
+#include <immintrin.h>
+#endif
+
+void FrustumCuller::resize(int count)
+{
+    m_count = count;
+
+    int padded_count = (count + 7) & ~7;
+    m_center_x.assign(padded_count, 0.0f);
+    m_center_y.assign(padded_count, 0.0f);
+    m_center_z.assign(padded_count, 0.0f);
+    m_extent_x.assign(padded_count, 0.0f);
+    m_extent_y.assign(padded_count, 0.0f);
+    m_extent_z.assign(padded_count, 0.0f);
+    m_first_index.assign(padded_count, 0);
+    m_index_count.assign(padded_count, 0);
+
+    int block_count = (count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    m_visible_ids.resize(count + block_count * 8);
+    m_draw_commands.resize(count + block_count * 8);
+}
+
+int FrustumCuller::size() const
+{
+    return m_count;
+}
+
+void FrustumCuller::set_object(int index, const vec3& bbox_min, const vec3& bbox_max, unsigned int first_index, unsigned int index_count)
+{
+    m_center_x[index] = (bbox_min.x + bbox_max.x) * 0.5f;
+    m_center_y[index] = (bbox_min.y + bbox_max.y) * 0.5f;
+    m_center_z[index] = (bbox_min.z + bbox_max.z) * 0.5f;
+    //The boxes are very slightly enlarged: the test with the center and the extent doesn't round the same way
+    //as the test of the 8 vertices and a box touching a plane of the frustum could be culled
+    m_extent_x[index] = (bbox_max.x - bbox_min.x) * 0.5f + 1.0e-5f * (std::abs(m_center_x[index]) + (bbox_max.x - bbox_min.x));
+    m_extent_y[index] = (bbox_max.y - bbox_min.y) * 0.5f + 1.0e-5f * (std::abs(m_center_y[index]) + (bbox_max.y - bbox_min.y));
+    m_extent_z[index] = (bbox_max.z - bbox_min.z) * 0.5f + 1.0e-5f * (std::abs(m_center_z[index]) + (bbox_max.z - bbox_min.z));
+    m_first_index[index] = first_index;
+    m_index_count[index] = index_count;
+}
+
+const std::vector<int>& FrustumCuller::visible_ids() const
+{
+    return m_visible_ids;
+}
+
+const std::vector<DrawElementsIndirectCommand>& FrustumCuller::draw_commands() const
+{
+    return m_draw_commands;
+}
+
+int FrustumCuller::cull(const Transform& mvp_matrix, const int* object_ids, int count)
+{
+    if (object_ids == nullptr)
+        count = m_count;
+
+    //Planes of the frustum in world space, extracted from the rows of the mvp matrix.
+    //A point p is inside if dot(plane.xyz, p) + plane.w >= 0 for the 6 planes,
+    //that is -w <= x <= w, -w <= y <= w and -w <= z <= w in clip space
+    float planes[6][4];
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 4; j++)
+        {
+            planes[i * 2 + 0][j] = mvp_matrix.m[3][j] + mvp_matrix.m[i][j];
+            planes[i * 2 + 1][j] = mvp_matrix.m[3][j] - mvp_matrix.m[i][j];
+        }
+    }
+
+    //Each block writes the objects that pass the test at the beginning of its own part
+    //of the output arrays, the blocks are then packed together.
+    //The parts are 8 elements larger than the blocks because the compaction always writes 8 elements
+    int block_count = (count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    std::vector<int> block_visible_count(block_count);
+    if ((int)m_visible_ids.size() < count + block_count * 8)
+    {
+        m_visible_ids.resize(count + block_count * 8);
+        m_draw_commands.resize(count + block_count * 8);
+    }
+
+#pragma omp parallel for schedule(dynamic)
+    for (int block = 0; block < block_count; block++)
+    {
+        int begin = block * BLOCK_SIZE;
+        int end = std::min(count, begin + BLOCK_SIZE);
+        int output = begin + block * 8;
+
+        block_visible_count[block] = cull_block(planes, begin, end, object_ids, &m_visible_ids[output], &m_draw_commands[output]);
+    }
+
+    int visible_count = block_count > 0 ? block_visible_count[0] : 0;
+    for (int block = 1; block < block_count; block++)
+    {
+        int begin = block * BLOCK_SIZE + block * 8;
+
+        //The destination is always before the source
+        std::copy(m_visible_ids.begin() + begin, m_visible_ids.begin() + begin + block_visible_count[block], m_visible_ids.begin() + visible_count);
+        std::copy(m_draw_commands.begin() + begin, m_draw_commands.begin() + begin + block_visible_count[block], m_draw_commands.begin() + visible_count);
+
+        visible_count += block_visible_count[block];
+    }
+
+    return visible_count;
+}
+
+#ifdef FRUSTUM_CULLER_AVX2
+/**
+ * For each 8 bits mask, the indices of the lanes whose bit is set, packed at the beginning.
+ * Used with _mm256_permutevar8x32 to compact 8 values
+ */
+static const std::array<unsigned long long, 256>& compaction_table()
+{
+    static const std::array<unsigned long long, 256> table = []()
+    {
+        std::array<unsigned long long, 256> table;
+        for (int mask = 0; mask < 256; mask++)
+        {
+            unsigned long long indices = 0;
+            int count = 0;
+            for (int lane = 0; lane < 8; lane++)
+                if (mask & (1 << lane))
+                    indices |= (unsigned long long)lane << (8 * count++);
+
+            table[mask] = indices;
+        }
+
+        return table;
+    }();
+
+    return table;
+}
+
+int FrustumCuller::cull_block(const float planes[6][4], int begin, int end, const int* object_ids, int* out_ids, DrawElementsIndirectCommand* out_commands) const
+{
+    const std::array<unsigned long long, 256>& table = compaction_table();
+
+    __m256 plane_x[6], plane_y[6], plane_z[6], plane_w[6];
+    __m256 abs_plane_x[6], abs_plane_y[6], abs_plane_z[6];
+    for (int i = 0; i < 6; i++)
+    {
+        plane_x[i] = _mm256_set1_ps(planes[i][0]);
+        plane_y[i] = _mm256_set1_ps(planes[i][1]);
+        plane_z[i] = _mm256_set1_ps(planes[i][2]);
+        plane_w[i] = _mm256_set1_ps(planes[i][3]);
+        abs_plane_x[i] = _mm256_set1_ps(std::abs(planes[i][0]));
+        abs_plane_y[i] = _mm256_set1_ps(std::abs(planes[i][1]));
+        abs_plane_z[i] = _mm256_set1_ps(std::abs(planes[i][2]));
+    }
+
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i zeros = _mm256_setzero_si256();
+
+    int visible_count = 0;
+    for (int i = begin; i < end; i += 8)
+    {
+        //Lanes that contain an object, the last group of 8 may be incomplete
+        __m256i valid = _mm256_cmpgt_epi32(_mm256_set1_epi32(end - i), lanes);
+
+        __m256i ids;
+        __m256 center_x, center_y, center_z, extent_x, extent_y, extent_z;
+        __m256i first_index, index_count;
+        if (object_ids == nullptr)
+        {
+            //The arrays are padded, no need to mask the loads
+            ids = _mm256_add_epi32(_mm256_set1_epi32(i), lanes);
+            center_x = _mm256_loadu_ps(&m_center_x[i]);
+            center_y = _mm256_loadu_ps(&m_center_y[i]);
+            center_z = _mm256_loadu_ps(&m_center_z[i]);
+            extent_x = _mm256_loadu_ps(&m_extent_x[i]);
+            extent_y = _mm256_loadu_ps(&m_extent_y[i]);
+            extent_z = _mm256_loadu_ps(&m_extent_z[i]);
+            first_index = _mm256_loadu_si256((const __m256i*)&m_first_index[i]);
+            index_count = _mm256_loadu_si256((const __m256i*)&m_index_count[i]);
+        }
+        else
+        {
+            ids = _mm256_maskload_epi32(object_ids + i, valid);
+
+            __m256 valid_ps = _mm256_castsi256_ps(valid);
+            __m256 zero_ps = _mm256_setzero_ps();
+            center_x = _mm256_mask_i32gather_ps(zero_ps, m_center_x.data(), ids, valid_ps, 4);
+            center_y = _mm256_mask_i32gather_ps(zero_ps, m_center_y.data(), ids, valid_ps, 4);
+            center_z = _mm256_mask_i32gather_ps(zero_ps, m_center_z.data(), ids, valid_ps, 4);
+            extent_x = _mm256_mask_i32gather_ps(zero_ps, m_extent_x.data(), ids, valid_ps, 4);
+            extent_y = _mm256_mask_i32gather_ps(zero_ps, m_extent_y.data(), ids, valid_ps, 4);
+            extent_z = _mm256_mask_i32gather_ps(zero_ps, m_extent_z.data(), ids, valid_ps, 4);
+            first_index = _mm256_mask_i32gather_epi32(zeros, m_first_index.data(), ids, valid, 4);
+            index_count = _mm256_mask_i32gather_epi32(zeros, m_index_count.data(), ids, valid, 4);
+        }
+
+        //Distance of the vertex of the box that is the farthest along the normal of the plane
+        //The box is outside of the frustum if this vertex is behind one of the planes
+        __m256 inside = _mm256_castsi256_ps(valid);
+        for (int plane = 0; plane < 6; plane++)
+        {
+            __m256 distance = _mm256_fmadd_ps(plane_x[plane], center_x, plane_w[plane]);
+            distance = _mm256_fmadd_ps(plane_y[plane], center_y, distance);
+            distance = _mm256_fmadd_ps(plane_z[plane], center_z, distance);
+            distance = _mm256_fmadd_ps(abs_plane_x[plane], extent_x, distance);
+            distance = _mm256_fmadd_ps(abs_plane_y[plane], extent_y, distance);
+            distance = _mm256_fmadd_ps(abs_plane_z[plane], extent_z, distance);
+
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_GE_OQ));
+        }
+
+        int mask = _mm256_movemask_ps(inside);
+        if (mask == 0)
+            continue;
+
+        //Packing the visible lanes at the beginning of the registers
+        __m256i permutation = _mm256_cvtepu8_epi32(_mm_cvtsi64_si128((long long)table[mask]));
+        ids = _mm256_permutevar8x32_epi32(ids, permutation);
+        first_index = _mm256_permutevar8x32_epi32(first_index, permutation);
+        index_count = _mm256_permutevar8x32_epi32(index_count, permutation);
+
+        _mm256_storeu_si256((__m256i*)(out_ids + visible_count), ids);
+
+        //The commands have 5 members and can't be interleaved in registers like the ids, the 8 commands
+        //are always written (like the ids) so that the loop has a fixed length and is unrolled
+        alignas(32) unsigned int packed_first_index[8], packed_index_count[8];
+        _mm256_store_si256((__m256i*)packed_first_index, first_index);
+        _mm256_store_si256((__m256i*)packed_index_count, index_count);
+
+        DrawElementsIndirectCommand* out = out_commands + visible_count;
+        for (int k = 0; k < 8; k++)
+            out[k] = DrawElementsIndirectCommand{ packed_index_count[k], 1, packed_first_index[k], 0, 0 };
+
+        visible_count += _mm_popcnt_u32(mask);
+    }
+
+    return visible_count;
+}
+#else
+int FrustumCuller::cull_block(const float planes[6][4], int begin, int end, const int* object_ids, int* out_ids, DrawElementsIndirectCommand* out_commands) const
+{
+    int visible_count = 0;
+    for (int i = begin; i < end; i++)
+    {
+        int id = object_ids == nullptr ? i : object_ids[i];
+
+        bool inside = true;
+        for (int plane = 0; plane < 6; plane++)
+        {
+            float distance = planes[plane][0] * m_center_x[id] + planes[plane][1] * m_center_y[id] + planes[plane][2] * m_center_z[id] + planes[plane][3]
+                           + std::abs(planes[plane][0]) * m_extent_x[id] + std::abs(planes[plane][1]) * m_extent_y[id] + std::abs(planes[plane][2]) * m_extent_z[id];
+
+            inside &= distance >= 0;
+        }
+
+        //Always writing the object, the next one overwrites it if it is not visible
+        out_ids[visible_count] = id;
+        out_commands[visible_count] = DrawElementsIndirectCommand{ (unsigned int)m_index_count[id], 1, (unsigned int)m_first_index[id], 0, 0 };
+        visible_count += inside;
+    }
+
+    return visible_count;
+}
+#endif
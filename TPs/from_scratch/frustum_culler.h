@@ -0,0 +1,78 @@
+#ifndef FRUSTUM_CULLER_H
+#define FRUSTUM_CULLER_H
+
+#include "mat.h"
+#include "vec.h"
+
+#include <vector>
+
+/**
+ * Same layout as the commands read by glMultiDrawElementsIndirect()
+ */
+struct alignas(4) DrawElementsIndirectCommand
+{
+    unsigned int index_count;
+    unsigned int instance_count;
+    unsigned int first_index;
+    unsigned int base_vertex;
+    unsigned int instance_base;
+};
+
+/**
+ * Frustum culling of many bounding boxes on the CPU.
+ *
+ * The bounding boxes are stored as structure of arrays (center and half extent
+ * of each box along each axis) so that 8 boxes are tested at once against the 6 planes
+ * of the frustum with AVX2 when it is available along with FMA and POPCNT (-march=native). The ids of the visible
+ * boxes are compacted with vector stores and the objects are split in blocks that are
+ * culled in parallel.
+ */
+class FrustumCuller
+{
+public:
+    /**
+     * Allocates the space for 'count' objects
+     */
+    void resize(int count);
+    int size() const;
+
+    /**
+     * @param first_index, index_count Range of the index buffer drawn for the object
+     */
+    void set_object(int index, const vec3& bbox_min, const vec3& bbox_max, unsigned int first_index, unsigned int index_count);
+
+    /**
+     * Culls the objects against the frustum of the mvp matrix.
+     *
+     * @param object_ids If not null, only the 'count' objects of this list are tested.
+     * All the objects are tested otherwise
+     * @return The number of visible objects. Their ids are in visible_ids() and
+     * the commands to draw them are in draw_commands()
+     */
+    int cull(const Transform& mvp_matrix, const int* object_ids = nullptr, int count = 0);
+
+    /**
+     * The first 'n' elements are valid, 'n' being the value returned by the last call to cull()
+     */
+    const std::vector<int>& visible_ids() const;
+    const std::vector<DrawElementsIndirectCommand>& draw_commands() const;
+
+private:
+    //Number of objects culled by a thread at once, multiple of 8
+    inline static const int BLOCK_SIZE = 4096;
+
+    int cull_block(const float planes[6][4], int begin, int end, const int* object_ids, int* out_ids, DrawElementsIndirectCommand* out_commands) const;
+
+    int m_count = 0;
+
+    //The arrays are padded to a multiple of 8 objects
+    std::vector<float> m_center_x, m_center_y, m_center_z;
+    std::vector<float> m_extent_x, m_extent_y, m_extent_z;
+    std::vector<int> m_first_index, m_index_count;
+
+    //8 more elements per block because the compaction always writes 8 elements
+    std::vector<int> m_visible_ids;
+    std::vector<DrawElementsIndirectCommand> m_draw_commands;
+};
+
+#endif
@@ -0,0 +1,187 @@
+#include "hiz_pyramid.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+//Number of rows of the finest level of a pass reduced by a thread at once
+static const int BAND_ROWS = 16;
+//Below this number of texels in the finest level of a pass, the pass is done by a single thread
+static const int MIN_PARALLEL_TEXELS = 128 * 128;
+
+HiZPyramid::HiZPyramid(int width, int height)
+{
+    resize(width, height);
+}
+
+void HiZPyramid::resize(int width, int height)
+{
+    if (!m_widths.empty() && m_widths[0] == width && m_heights[0] == height)
+        return;
+
+    m_widths.clear();
+    m_heights.clear();
+    m_offsets.clear();
+
+    size_t size = 0;
+    m_widths.push_back(width);
+    m_heights.push_back(height);
+    m_offsets.push_back(size);
+    size += (size_t)width * height;
+    while (width > 4 && height > 4)//Stop at a 4*4 mipmap
+    {
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+
+        m_widths.push_back(width);
+        m_heights.push_back(height);
+        m_offsets.push_back(size);
+        size += (size_t)width * height;
+    }
+
+    m_data.resize(size);
+}
+
+void HiZPyramid::build(const float* depth, int width, int height)
+{
+    resize(width, height);
+    std::memcpy(level(0), depth, sizeof(float) * width * height);
+
+    build();
+}
+
+void HiZPyramid::build(const std::vector<float>& depth, int width, int height)
+{
+    assert(depth.size() >= (size_t)width * height);
+
+    build(depth.data(), width, height);
+}
+
+void HiZPyramid::build()
+{
+    for (int first_level = 1; first_level < level_count(); first_level += m_levels_per_pass)
+        build_pass(first_level, std::min(first_level + m_levels_per_pass, level_count()) - 1);
+}
+
+void HiZPyramid::set_levels_per_pass(int levels_per_pass)
+{
+    m_levels_per_pass = std::max(1, levels_per_pass);
+}
+
+int HiZPyramid::level_count() const
+{
+    return m_widths.size();
+}
+
+int HiZPyramid::width(int level) const
+{
+    return m_widths[level];
+}
+
+int HiZPyramid::height(int level) const
+{
+    return m_heights[level];
+}
+
+float* HiZPyramid::level(int level)
+{
+    return m_data.data() + m_offsets[level];
+}
+
+const float* HiZPyramid::level(int level) const
+{
+    return m_data.data() + m_offsets[level];
+}
+
+float HiZPyramid::depth(int level, int x, int y) const
+{
+    return m_data[m_offsets[level] + (size_t)y * m_widths[level] + x];
+}
+
+void HiZPyramid::build_pass(int first_level, int last_level)
+{
+    //The bands are made of rows of the coarsest level of the pass
+    int band_rows = std::max(1, BAND_ROWS >> (last_level - first_level));
+    int last_height = m_heights[last_level];
+    int band_count = (last_height + band_rows - 1) / band_rows;
+
+#pragma omp parallel for schedule(dynamic) if (m_widths[first_level] * m_heights[first_level] >= MIN_PARALLEL_TEXELS)
+    for (int band = 0; band < band_count; band++)
+    {
+        int begin_y = band * band_rows;
+        int end_y = std::min(begin_y + band_rows, last_height);
+
+        //Rows of each level of the pass covered by the band. The last band also
+        //covers the rows absorbed by the last row of the coarser levels
+        for (int level = first_level; level <= last_level; level++)
+        {
+            int shift = last_level - level;
+            int level_begin_y = begin_y << shift;
+            int level_end_y = (end_y == last_height) ? m_heights[level] : end_y << shift;
+
+            reduce_rows(level, level_begin_y, level_end_y);
+        }
+    }
+}
+
+void HiZPyramid::reduce_rows(int level, int begin_y, int end_y)
+{
+    const int input_width = m_widths[level - 1];
+    const int input_height = m_heights[level - 1];
+    const int output_width = m_widths[level];
+    const int output_height = m_heights[level];
+    const float* input = this->level(level - 1);
+    float* output = this->level(level);
+
+    for (int y = begin_y; y < end_y; y++)
+    {
+        const float* row0 = input + (size_t)(2 * y) * input_width;
+        const float* row1 = row0 + input_width;
+        float* output_row = output + (size_t)y * output_width;
+
+        int x = 0;
+#ifdef __AVX2__
+        //8 output texels from 16 texels of each input row: vertical max of the 2 rows
+        //and horizontal max of the even and odd columns
+        for (; x + 8 <= output_width; x += 8)
+        {
+            __m256 a = _mm256_max_ps(_mm256_loadu_ps(row0 + 2 * x), _mm256_loadu_ps(row1 + 2 * x));
+            __m256 b = _mm256_max_ps(_mm256_loadu_ps(row0 + 2 * x + 8), _mm256_loadu_ps(row1 + 2 * x + 8));
+
+            //a0 a2 b0 b2 | a4 a6 b4 b6 and a1 a3 b1 b3 | a5 a7 b5 b7
+            __m256 even = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+            __m256 odd = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+            __m256 reduced = _mm256_max_ps(even, odd);
+
+            //Back in the order of the columns
+            reduced = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(reduced), _MM_SHUFFLE(3, 1, 2, 0)));
+            _mm256_storeu_ps(output_row + x, reduced);
+        }
+#endif
+
+#pragma omp simd
+        for (int i = x; i < output_width; i++)
+            output_row[i] = std::max(std::max(row0[2 * i], row0[2 * i + 1]), std::max(row1[2 * i], row1[2 * i + 1]));
+
+        //Odd input width: the last column also covers the last input column
+        if (input_width & 1)
+            output_row[output_width - 1] = std::max(output_row[output_width - 1], std::max(row0[input_width - 1], row1[input_width - 1]));
+
+        //Odd input height: the last row also covers the last input row
+        if ((input_height & 1) && y == output_height - 1)
+        {
+            const float* row2 = row1 + input_width;
+
+#pragma omp simd
+            for (int i = 0; i < output_width; i++)
+                output_row[i] = std::max(output_row[i], std::max(row2[2 * i], row2[2 * i + 1]));
+
+            if (input_width & 1)
+                output_row[output_width - 1] = std::max(output_row[output_width - 1], row2[input_width - 1]);
+        }
+    }
+}
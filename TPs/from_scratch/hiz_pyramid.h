@@ -0,0 +1,91 @@
+#ifndef HIZ_PYRAMID_H
+#define HIZ_PYRAMID_H
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * Hierarchical z-buffer built on the CPU: each level keeps the farthest depth
+ * (the max, OpenGL convention) of the texels of the previous level that it covers.
+ *
+ * The dimensions of a level are the dimensions of the previous level divided by 2
+ * and rounded down, as for the mipmaps of a texture. When the previous level has an odd
+ * width (resp. height), the last column (resp. row) of the level covers 3 texels instead
+ * of 2 so that no texel is dropped and the pyramid stays conservative: the corner texel
+ * covers 3x3 texels when both dimensions are odd. A pixel (x, y) of the level 0 is then
+ * always covered by the texel min(x >> level, width - 1), min(y >> level, height - 1).
+ *
+ * All the levels are stored in a single allocation that is kept from one build
+ * to the other and only reallocated when the resolution changes. The levels are reduced
+ * one band of rows at a time, the bands are processed in parallel. Multiple levels
+ * are built in the same pass: a band of the coarsest level of the pass only needs the
+ * rows of its own band in the finer levels, which are still in the cache of the thread.
+ * The 2x2 reductions of a row are vectorized with AVX2 when it is available (-march=native).
+ *
+ * TP2 doesn't own a pyramid: it builds its Hi-Z on the GPU and culls on the CPU with
+ * OcclusionRasterizer. Only bench_hiz builds a pyramid, it is the input of
+ * TP2::occlusion_cull_cpu() which TP2 doesn't call either.
+ */
+class HiZPyramid
+{
+public:
+    HiZPyramid() {}
+    HiZPyramid(int width, int height);
+
+    /**
+     * Allocates the levels of the pyramid of a 'width' x 'height' depth buffer.
+     * Doesn't do anything if the resolution doesn't change.
+     *
+     * The levels are built down to a 4x4 level, same as the mipmaps of the
+     * z-buffer computed on the GPU, see Utils::compute_mipmaps_gpu()
+     */
+    void resize(int width, int height);
+
+    /**
+     * Copies 'depth' in the level 0 and builds the other levels
+     */
+    void build(const float* depth, int width, int height);
+    void build(const std::vector<float>& depth, int width, int height);
+
+    /**
+     * Builds the levels from the depth already written in level(0)
+     */
+    void build();
+
+    /**
+     * @param levels_per_pass Number of levels reduced by each pass over the bands, at least 1
+     */
+    void set_levels_per_pass(int levels_per_pass);
+
+    int level_count() const;
+    int width(int level = 0) const;
+    int height(int level = 0) const;
+
+    float* level(int level);
+    const float* level(int level) const;
+
+    /**
+     * @return The depth of the texel (x, y) of the level
+     */
+    float depth(int level, int x, int y) const;
+
+private:
+    /**
+     * Reduces the rows [begin_y, end_y[ of the level 'level' from the level 'level - 1'
+     */
+    void reduce_rows(int level, int begin_y, int end_y);
+
+    /**
+     * Builds the levels [first_level, last_level] in a single pass. 'first_level - 1' must be complete
+     */
+    void build_pass(int first_level, int last_level);
+
+    int m_levels_per_pass = 2;
+
+    std::vector<int> m_widths, m_heights;
+    //Offset of each level in m_data
+    std::vector<size_t> m_offsets;
+    std::vector<float> m_data;
+};
+
+#endif
@@ -0,0 +1,257 @@
+#include "mesh_clusters.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+std::vector<MeshCluster> ClusterBuilder::build(Mesh& mesh, std::vector<TriangleGroup>& groups, int max_triangles)
+{
+    if (mesh.triangle_count() == 0 || groups.empty())
+        return std::vector<MeshCluster>();
+
+    max_triangles = std::max(1, max_triangles);
+
+    //Clusters of each group, built in parallel. The ids of the triangles are in 'group_triangles'
+    //in the order of the clusters
+    std::vector<std::vector<MeshCluster>> group_clusters(groups.size());
+    std::vector<std::vector<int>> group_triangles(groups.size());
+
+#pragma omp parallel for schedule(dynamic)
+    for (int group_index = 0; group_index < int(groups.size()); group_index++)
+    {
+        const TriangleGroup& group = groups[group_index];
+
+        int first_triangle = group.first / 3;
+        int triangle_count = group.n / 3;
+
+        std::vector<vec3> centers(triangle_count);
+        std::vector<vec3> normals(triangle_count);
+        std::vector<int>& triangles = group_triangles[group_index];
+        triangles.resize(triangle_count);
+        for (int i = 0; i < triangle_count; i++)
+        {
+            TriangleData triangle = mesh.triangle(first_triangle + i);
+
+            centers[i] = vec3((triangle.a.x + triangle.b.x + triangle.c.x) / 3.0f,
+                              (triangle.a.y + triangle.b.y + triangle.c.y) / 3.0f,
+                              (triangle.a.z + triangle.b.z + triangle.c.z) / 3.0f);
+            triangles[i] = i;
+
+            Vector normal = cross(Point(triangle.b) - Point(triangle.a), Point(triangle.c) - Point(triangle.a));
+            float normal_length = length(normal);
+            normals[i] = normal_length > 0 ? vec3(normal / normal_length) : vec3(0, 0, 0);
+        }
+
+        std::vector<std::pair<int, int>> cluster_ranges;
+        split_triangles(triangles, centers, normals, 0, triangle_count, max_triangles, cluster_ranges);
+
+        for (int& triangle : triangles)
+            triangle += first_triangle;
+
+        for (const std::pair<int, int>& range : cluster_ranges)
+        {
+            MeshCluster cluster;
+            cluster.group = group_index;
+            compute_bounds(mesh, triangles.data() + range.first, range.second - range.first, cluster);
+
+            group_clusters[group_index].push_back(cluster);
+        }
+    }
+
+    //Numbering the clusters group after group and reordering the triangles of the mesh
+    //so that the triangles of a cluster are contiguous
+    std::vector<unsigned int> triangle_clusters(mesh.triangle_count(), 0);
+    std::vector<MeshCluster> clusters;
+    for (int group_index = 0; group_index < int(groups.size()); group_index++)
+    {
+        int triangle_index = 0;
+        for (MeshCluster& cluster : group_clusters[group_index])
+        {
+            int cluster_triangles = cluster.n / 3;
+            for (int i = 0; i < cluster_triangles; i++)
+                triangle_clusters[group_triangles[group_index][triangle_index++]] = clusters.size();
+
+            clusters.push_back(cluster);
+        }
+    }
+
+    std::vector<TriangleGroup> cluster_ranges = mesh.groups(triangle_clusters);
+    for (const TriangleGroup& range : cluster_ranges)
+    {
+        clusters[range.index].first = range.first;
+        clusters[range.index].n = range.n;
+    }
+
+    //Updating the groups from the new positions of their clusters
+    for (TriangleGroup& group : groups)
+        group.n = 0;
+    for (const MeshCluster& cluster : clusters)
+    {
+        TriangleGroup& group = groups[cluster.group];
+        if (group.n == 0)
+            group.first = cluster.first;
+        group.n += cluster.n;
+    }
+
+    return clusters;
+}
+
+void ClusterBuilder::split_triangles(std::vector<int>& triangles, const std::vector<vec3>& centers, const std::vector<vec3>& normals, int begin, int end, int max_triangles, std::vector<std::pair<int, int>>& cluster_ranges)
+{
+    //Ranges still to split, the ranges are split in order so that the clusters
+    //are numbered in the order of the triangles
+    std::vector<std::pair<int, int>> stack;
+    stack.push_back(std::make_pair(begin, end));
+    while (!stack.empty())
+    {
+        std::pair<int, int> range = stack.back();
+        stack.pop_back();
+
+        int count = range.second - range.first;
+        if (count <= max_triangles)
+        {
+            if (count > 0)
+                cluster_ranges.push_back(range);
+
+            continue;
+        }
+
+        vec3 centers_min = centers[triangles[range.first]];
+        vec3 centers_max = centers_min;
+        vec3 normals_min = normals[triangles[range.first]];
+        vec3 normals_max = normals_min;
+        for (int i = range.first + 1; i < range.second; i++)
+        {
+            centers_min = min(centers_min, centers[triangles[i]]);
+            centers_max = max(centers_max, centers[triangles[i]]);
+            normals_min = min(normals_min, normals[triangles[i]]);
+            normals_max = max(normals_max, normals[triangles[i]]);
+        }
+
+        //The triangles are split along one of the axes of the centers or, close to the leaves, along one
+        //of the axes of the normals. The extent of the normals is scaled by the size of the range
+        //so that the normals are only split when the triangles are close to each other
+        int cluster_count = (count + max_triangles - 1) / max_triangles;
+        vec3 extent = vec3(centers_max.x - centers_min.x, centers_max.y - centers_min.y, centers_max.z - centers_min.z);
+        float normal_scale = cluster_count <= NORMAL_SPLIT_CLUSTERS ? NORMAL_WEIGHT * std::max(extent.x, std::max(extent.y, extent.z)) : 0.0f;
+
+        int axis = 0;
+        float axis_extent = -1;
+        for (int i = 0; i < 3; i++)
+        {
+            if (extent(i) > axis_extent)
+            {
+                axis = i;
+                axis_extent = extent(i);
+            }
+        }
+        for (int i = 0; i < 3; i++)
+        {
+            if ((normals_max(i) - normals_min(i)) * normal_scale > axis_extent)
+            {
+                axis = i + 3;
+                axis_extent = (normals_max(i) - normals_min(i)) * normal_scale;
+            }
+        }
+
+        const std::vector<vec3>& keys = axis < 3 ? centers : normals;
+        axis = axis % 3;
+
+        //The left half gets a multiple of max_triangles triangles so that
+        //all the clusters but the last one of a group are full
+        int middle = range.first + (cluster_count + 1) / 2 * max_triangles;
+        std::nth_element(triangles.begin() + range.first, triangles.begin() + middle, triangles.begin() + range.second,
+                         [&keys, axis](int a, int b) { return keys[a](axis) < keys[b](axis); });
+
+        stack.push_back(std::make_pair(middle, range.second));
+        stack.push_back(std::make_pair(range.first, middle));
+    }
+}
+
+void ClusterBuilder::compute_bounds(const Mesh& mesh, const int* triangles, int count, MeshCluster& cluster)
+{
+    cluster.min = vec3(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+    cluster.max = vec3(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max());
+    cluster.n = count * 3;
+    cluster.first = 0;
+
+    std::vector<Vector> normals;
+    normals.reserve(count);
+    Vector normals_sum = Vector(0, 0, 0);
+    for (int i = 0; i < count; i++)
+    {
+        TriangleData triangle = mesh.triangle(triangles[i]);
+
+        cluster.min = min(cluster.min, min(triangle.a, min(triangle.b, triangle.c)));
+        cluster.max = max(cluster.max, max(triangle.a, max(triangle.b, triangle.c)));
+
+        //Geometric normal, the shading normals don't tell which side of the triangle is culled
+        Vector normal = cross(Point(triangle.b) - Point(triangle.a), Point(triangle.c) - Point(triangle.a));
+        float normal_length = length(normal);
+        if (normal_length == 0)
+            normal = Vector(0, 0, 0);
+        else
+            normal = normal / normal_length;
+
+        normals.push_back(normal);
+        normals_sum = normals_sum + normal;
+    }
+
+    //Bounding sphere centered on the bounding box
+    Point center = Point((cluster.min.x + cluster.max.x) * 0.5f, (cluster.min.y + cluster.max.y) * 0.5f, (cluster.min.z + cluster.max.z) * 0.5f);
+    float radius2 = 0;
+    for (int i = 0; i < count; i++)
+    {
+        TriangleData triangle = mesh.triangle(triangles[i]);
+
+        radius2 = std::max(radius2, distance2(center, Point(triangle.a)));
+        radius2 = std::max(radius2, distance2(center, Point(triangle.b)));
+        radius2 = std::max(radius2, distance2(center, Point(triangle.c)));
+    }
+    cluster.sphere_center = vec3(center);
+    cluster.sphere_radius = std::sqrt(radius2);
+
+    //Normal cone: the axis is the average normal and the cone contains all the normals
+    cluster.cone_apex = vec3(center);
+    cluster.cone_axis = vec3(0, 0, 1);
+    cluster.cone_cutoff = 1.0f;
+
+    float sum_length = length(normals_sum);
+    if (sum_length == 0)
+        return;
+
+    Vector axis = normals_sum / sum_length;
+    float min_dot = 1.0f;
+    for (const Vector& normal : normals)
+        if (normal.x != 0 || normal.y != 0 || normal.z != 0)
+            min_dot = std::min(min_dot, dot(axis, normal));
+
+    //The cone is more than ~85 degrees wide, the cluster is almost never entirely back facing
+    if (min_dot <= 0.1f)
+        return;
+
+    //The apex is moved back along the axis until all the planes of the triangles
+    //are in front of it: a camera in the cone of the apex sees the back of all the triangles
+    float max_t = 0;
+    for (int i = 0; i < count; i++)
+    {
+        const Vector& normal = normals[i];
+        if (normal.x == 0 && normal.y == 0 && normal.z == 0)
+            continue;
+
+        TriangleData triangle = mesh.triangle(triangles[i]);
+        float t = dot(center - Point(triangle.a), normal) / dot(axis, normal);
+        max_t = std::max(max_t, t);
+    }
+
+    cluster.cone_apex = vec3(center - axis * max_t);
+    cluster.cone_axis = vec3(axis);
+    cluster.cone_cutoff = std::sqrt(1.0f - min_dot * min_dot);
+}
+
+bool ClusterBuilder::is_backfacing(const MeshCluster& cluster, const Point& camera_position)
+{
+    Vector to_apex = Point(cluster.cone_apex) - camera_position;
+
+    return dot(to_apex, Vector(cluster.cone_axis)) > cluster.cone_cutoff * length(to_apex);
+}
@@ -0,0 +1,78 @@
+#ifndef MESH_CLUSTERS_H
+#define MESH_CLUSTERS_H
+
+#include "mat.h"
+#include "mesh.h"
+#include "vec.h"
+
+#include <vector>
+
+/**
+ * Small part of a triangle group (at most ClusterBuilder::MAX_TRIANGLES triangles)
+ * culled and drawn on its own
+ */
+struct MeshCluster
+{
+    vec3 min;
+    vec3 max;
+
+    vec3 sphere_center;
+    float sphere_radius;
+
+    //Normal cone of the triangles of the cluster: the cluster is back facing for every camera
+    //position such that dot(normalize(cone_apex - camera_position), cone_axis) > cone_cutoff.
+    //cone_cutoff is 1 when the normals are too spread out for the cluster to ever be back facing
+    vec3 cone_apex;
+    vec3 cone_axis;
+    float cone_cutoff;
+
+    //Index of the triangle group (in the vector given to ClusterBuilder::build()) that contains the cluster
+    int group;
+    //Same convention as TriangleGroup: first vertex (or index) and number of vertices (or indices)
+    int first;
+    int n;
+};
+
+/**
+ * Splits the triangle groups of a mesh into spatially coherent clusters.
+ *
+ * The triangles of each group are split recursively along the longest axis
+ * of the bounding box of their centers (or of their normals close to the leaves,
+ * for narrower normal cones) until there are at most MAX_TRIANGLES triangles
+ * per cluster. The triangles of the mesh are then reordered so that
+ * the triangles of a cluster are contiguous and each cluster can be drawn with
+ * a single draw command. The triangles stay in their group.
+ */
+class ClusterBuilder
+{
+public:
+    inline static const int MAX_TRIANGLES = 128;
+    //Importance of the orientation of the triangles compared to their position
+    //when splitting, the normal cones of the clusters are narrower with a bigger weight
+    inline static const float NORMAL_WEIGHT = 1.0f;
+    //The normals are only split in ranges of less than NORMAL_SPLIT_CLUSTERS * MAX_TRIANGLES triangles
+    inline static const int NORMAL_SPLIT_CLUSTERS = 4;
+
+    /**
+     * @param groups The triangle groups of the mesh, their 'first' member is updated
+     * if the reordering of the triangles moves the groups
+     * @return The clusters, sorted by group
+     */
+    static std::vector<MeshCluster> build(Mesh& mesh, std::vector<TriangleGroup>& groups, int max_triangles = MAX_TRIANGLES);
+
+    /**
+     * @return True if all the triangles of the cluster are facing away from the camera
+     */
+    static bool is_backfacing(const MeshCluster& cluster, const Point& camera_position);
+
+private:
+    /**
+     * Splits the triangles [begin, end[ of 'triangles' (whose centers and normals are given) and appends the ranges of the clusters
+     * to 'cluster_ranges'. The triangles are reordered so that each cluster is contiguous
+     */
+    static void split_triangles(std::vector<int>& triangles, const std::vector<vec3>& centers, const std::vector<vec3>& normals, int begin, int end, int max_triangles, std::vector<std::pair<int, int>>& cluster_ranges);
+
+    static void compute_bounds(const Mesh& mesh, const int* triangles, int count, MeshCluster& cluster);
+};
+
+#endif
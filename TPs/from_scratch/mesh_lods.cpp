@@ -0,0 +1,273 @@
+#include "mesh_lods.h"
+#include "mesh_simplifier.h"
+
+#include "files.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <type_traits>
+
+namespace
+{
+    const char gklod_magic[8] = { 'g', 'k', 'l', 'o', 'd', 0, 0, 0 };
+    const uint32_t gklod_version = 2;
+
+    struct gklod_header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t pad;
+        //timestamp() of the OBJ file
+        uint64_t source_timestamp;
+        uint64_t base_triangle_count;
+
+        uint64_t positions;
+        uint64_t texcoords;
+        uint64_t normals;
+        uint64_t indices;
+        uint64_t lods;
+    };
+
+    static_assert(std::is_trivially_copyable<MeshLOD>::value, "MeshLOD is written as is");
+
+    template <typename T>
+    bool write_array(FILE* out, const std::vector<T>& array)
+    {
+        return array.empty() || fwrite(array.data(), sizeof(T), array.size(), out) == array.size();
+    }
+
+    template <typename T>
+    bool read_array(FILE* in, std::vector<T>& array, uint64_t size)
+    {
+        array.resize(size);
+        return array.empty() || fread(array.data(), sizeof(T), array.size(), in) == array.size();
+    }
+
+    /**
+     * Indexes the triangles [first_triangle, first_triangle + count[ of the mesh: the vertices
+     * with exactly the same attributes are merged
+     */
+    void weld_triangles(const Mesh& mesh, int first_triangle, int count, bool has_normals, bool has_texcoords,
+                        std::vector<vec3>& positions, std::vector<vec3>& normals, std::vector<vec2>& texcoords, std::vector<unsigned int>& indices)
+    {
+        struct Vertex
+        {
+            vec3 position;
+            vec3 normal;
+            vec2 texcoord;
+        };
+
+        std::vector<Vertex> vertices(count * 3);
+        for (int i = 0; i < count; i++)
+        {
+            TriangleData triangle = mesh.triangle(first_triangle + i);
+
+            vertices[i * 3 + 0] = Vertex{ triangle.a, has_normals ? triangle.na : vec3(), has_texcoords ? triangle.ta : vec2() };
+            vertices[i * 3 + 1] = Vertex{ triangle.b, has_normals ? triangle.nb : vec3(), has_texcoords ? triangle.tb : vec2() };
+            vertices[i * 3 + 2] = Vertex{ triangle.c, has_normals ? triangle.nc : vec3(), has_texcoords ? triangle.tc : vec2() };
+        }
+
+        auto vertex_less = [&vertices](int a, int b)
+        {
+            const float* va = &vertices[a].position.x;
+            const float* vb = &vertices[b].position.x;
+            for (int k = 0; k < 8; k++)
+                if (va[k] != vb[k])
+                    return va[k] < vb[k];
+
+            return false;
+        };
+
+        std::vector<int> order(vertices.size());
+        for (int i = 0; i < int(order.size()); i++)
+            order[i] = i;
+        std::sort(order.begin(), order.end(), vertex_less);
+
+        indices.resize(vertices.size());
+        for (int i = 0; i < int(order.size()); i++)
+        {
+            if (i == 0 || vertex_less(order[i - 1], order[i]))
+            {
+                const Vertex& vertex = vertices[order[i]];
+
+                positions.push_back(vertex.position);
+                if (has_normals)
+                    normals.push_back(vertex.normal);
+                if (has_texcoords)
+                    texcoords.push_back(vertex.texcoord);
+            }
+
+            indices[order[i]] = positions.size() - 1;
+        }
+    }
+}
+
+LODChain LODBuilder::build(const Mesh& mesh, const std::vector<TriangleGroup>& groups)
+{
+    bool has_normals = mesh.has_normal();
+    bool has_texcoords = mesh.has_texcoord();
+
+    //Levels of each group, simplified in parallel
+    std::vector<LODChain> group_chains(groups.size());
+
+#pragma omp parallel for schedule(dynamic)
+    for (int group_index = 0; group_index < int(groups.size()); group_index++)
+    {
+        const TriangleGroup& group = groups[group_index];
+
+        int triangle_count = group.n / 3;
+        if (triangle_count < MIN_TRIANGLES)
+            continue;
+
+        std::vector<vec3> positions, normals;
+        std::vector<vec2> texcoords;
+        std::vector<unsigned int> indices;
+        weld_triangles(mesh, group.first / 3, triangle_count, has_normals, has_texcoords, positions, normals, texcoords, indices);
+
+        std::vector<unsigned char> locked = MeshSimplifier::lock_borders(positions, indices);
+
+        LODChain& chain = group_chains[group_index];
+        //Vertex of the chain of each welded vertex, the coarser levels only use vertices of the finer ones
+        std::vector<unsigned int> chain_vertices(positions.size(), ~0u);
+        float error = 0;
+        int previous_triangle_count = triangle_count;
+        for (int level = 1; level <= MAX_LEVELS; level++)
+        {
+            //Each level is simplified from the previous one, its error is at least the error of the previous level
+            error = std::max(error, MeshSimplifier::simplify(positions, normals, texcoords, locked, indices, previous_triangle_count / 2));
+
+            int level_triangle_count = indices.size() / 3;
+            if (level_triangle_count == 0 || level_triangle_count > previous_triangle_count * MAX_LEVEL_RATIO)
+                break;
+
+            chain.lods.push_back(MeshLOD{ group_index, level, (int)chain.indices.size(), level_triangle_count * 3, error });
+            for (unsigned int index : indices)
+            {
+                if (chain_vertices[index] == ~0u)
+                {
+                    chain_vertices[index] = chain.positions.size();
+
+                    chain.positions.push_back(positions[index]);
+                    if (has_normals)
+                        chain.normals.push_back(normals[index]);
+                    if (has_texcoords)
+                        chain.texcoords.push_back(texcoords[index]);
+                }
+
+                chain.indices.push_back(chain_vertices[index]);
+            }
+
+            previous_triangle_count = level_triangle_count;
+        }
+    }
+
+    LODChain chain;
+    for (LODChain& group_chain : group_chains)
+    {
+        for (MeshLOD lod : group_chain.lods)
+        {
+            lod.first += chain.indices.size();
+            chain.lods.push_back(lod);
+        }
+
+        unsigned int base_vertex = chain.positions.size();
+        for (unsigned int index : group_chain.indices)
+            chain.indices.push_back(base_vertex + index);
+
+        chain.positions.insert(chain.positions.end(), group_chain.positions.begin(), group_chain.positions.end());
+        chain.normals.insert(chain.normals.end(), group_chain.normals.begin(), group_chain.normals.end());
+        chain.texcoords.insert(chain.texcoords.end(), group_chain.texcoords.begin(), group_chain.texcoords.end());
+    }
+
+    return chain;
+}
+
+std::string LODBuilder::cache_filename(const std::string& filename)
+{
+    size_t dot = filename.rfind('.');
+    size_t slash = filename.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return filename + ".gklod";
+
+    return filename.substr(0, dot) + ".gklod";
+}
+
+bool LODBuilder::read_cache(const char* filename, int base_triangle_count, LODChain& chain)
+{
+    std::string cache = cache_filename(filename);
+    FILE* in = fopen(cache.c_str(), "rb");
+    if (in == nullptr)
+        return false;
+
+    gklod_header header;
+    bool valid = fread(&header, sizeof(header), 1, in) == 1
+        && memcmp(header.magic, gklod_magic, sizeof(header.magic)) == 0
+        && header.version == gklod_version
+        //The OBJ file was modified or the cache was written for another mesh
+        && header.source_timestamp == timestamp(filename)
+        && header.base_triangle_count == (uint64_t)base_triangle_count;
+
+    LODChain read_chain;
+    valid = valid
+        && read_array(in, read_chain.positions, header.positions)
+        && read_array(in, read_chain.texcoords, header.texcoords)
+        && read_array(in, read_chain.normals, header.normals)
+        && read_array(in, read_chain.indices, header.indices)
+        && read_array(in, read_chain.lods, header.lods);
+    fclose(in);
+
+    if (!valid)
+    {
+        std::cout << "LOD cache '" << cache << "' is invalid or out of date" << std::endl;
+
+        return false;
+    }
+
+    chain = std::move(read_chain);
+
+    return true;
+}
+
+bool LODBuilder::write_cache(const char* filename, int base_triangle_count, const LODChain& chain)
+{
+    size_t source_timestamp = timestamp(filename);
+    if (source_timestamp == 0)
+        return false;
+
+    std::string cache = cache_filename(filename);
+    FILE* out = fopen(cache.c_str(), "wb");
+    if (out == nullptr)
+    {
+        std::cout << "Error writing the LOD cache '" << cache << "'" << std::endl;
+
+        return false;
+    }
+
+    gklod_header header = { };
+    memcpy(header.magic, gklod_magic, sizeof(header.magic));
+    header.version = gklod_version;
+    header.source_timestamp = source_timestamp;
+    header.base_triangle_count = base_triangle_count;
+    header.positions = chain.positions.size();
+    header.texcoords = chain.texcoords.size();
+    header.normals = chain.normals.size();
+    header.indices = chain.indices.size();
+    header.lods = chain.lods.size();
+
+    bool written = fwrite(&header, sizeof(header), 1, out) == 1
+        && write_array(out, chain.positions)
+        && write_array(out, chain.texcoords)
+        && write_array(out, chain.normals)
+        && write_array(out, chain.indices)
+        && write_array(out, chain.lods);
+    fclose(out);
+
+    //A partial cache would be rejected by read_cache() but there's no need to keep it
+    if (!written)
+        std::remove(cache.c_str());
+
+    return written;
+}
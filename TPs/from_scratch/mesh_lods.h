@@ -0,0 +1,75 @@
+#ifndef MESH_LODS_H
+#define MESH_LODS_H
+
+#include "mesh.h"
+#include "vec.h"
+
+#include <string>
+#include <vector>
+
+/**
+ * Simplified version of a triangle group
+ */
+struct MeshLOD
+{
+    //Index of the triangle group in the vector given to LODBuilder::build()
+    int group;
+    //1 for the first simplified level, the full resolution group is the level 0
+    int level;
+    //First index and number of indices in the index buffer of the LODChain
+    int first;
+    int n;
+    //Largest distance between the simplified triangles and the full resolution ones
+    float error;
+};
+
+/**
+ * Simplified levels of all the triangle groups of a mesh, the triangles
+ * are indexed and have the same attributes as the mesh. The levels of
+ * a group share their vertices
+ */
+struct LODChain
+{
+    std::vector<vec3> positions;
+    std::vector<vec2> texcoords;
+    std::vector<vec3> normals;
+    std::vector<unsigned int> indices;
+
+    //Sorted by group and by level
+    std::vector<MeshLOD> lods;
+};
+
+/**
+ * Builds the levels of detail of the triangle groups of a mesh with MeshSimplifier.
+ *
+ * Each level has about half the triangles of the previous one. The groups are simplified
+ * independently of each other and their borders are locked so that the levels of
+ * neighboring groups (materials) always match. The chain is cached next to the OBJ file.
+ */
+class LODBuilder
+{
+public:
+    //Maximum number of simplified levels per group
+    inline static const int MAX_LEVELS = 3;
+    //Groups with less triangles are not simplified
+    inline static const int MIN_TRIANGLES = 64;
+    //A level is only kept if it has less than MAX_LEVEL_RATIO times the triangles of the previous level
+    inline static const float MAX_LEVEL_RATIO = 0.75f;
+
+    static LODChain build(const Mesh& mesh, const std::vector<TriangleGroup>& groups);
+
+    /**
+     * Name of the cache of the levels of an OBJ file: data/bistro.obj -> data/bistro.gklod
+     */
+    static std::string cache_filename(const std::string& filename);
+
+    /**
+     * @param base_triangle_count Number of triangles of the full resolution mesh, the cache
+     * is rejected if it doesn't match
+     * @return False if the cache doesn't exist or is out of date
+     */
+    static bool read_cache(const char* filename, int base_triangle_count, LODChain& chain);
+    static bool write_cache(const char* filename, int base_triangle_count, const LODChain& chain);
+};
+
+#endif
@@ -0,0 +1,325 @@
+#include "mesh_simplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <queue>
+
+namespace
+{
+    /**
+     * Sum of the squared distances to planes, weighted by the area of the triangles
+     */
+    struct Quadric
+    {
+        double a2 = 0, ab = 0, ac = 0, ad = 0;
+        double b2 = 0, bc = 0, bd = 0;
+        double c2 = 0, cd = 0;
+        double d2 = 0;
+        double weight = 0;
+
+        void add_plane(double a, double b, double c, double d, double plane_weight)
+        {
+            a2 += a * a * plane_weight; ab += a * b * plane_weight; ac += a * c * plane_weight; ad += a * d * plane_weight;
+            b2 += b * b * plane_weight; bc += b * c * plane_weight; bd += b * d * plane_weight;
+            c2 += c * c * plane_weight; cd += c * d * plane_weight;
+            d2 += d * d * plane_weight;
+            weight += plane_weight;
+        }
+
+        void add(const Quadric& q)
+        {
+            a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+            b2 += q.b2; bc += q.bc; bd += q.bd;
+            c2 += q.c2; cd += q.cd;
+            d2 += q.d2;
+            weight += q.weight;
+        }
+
+        double evaluate(const vec3& p) const
+        {
+            double x = p.x, y = p.y, z = p.z;
+
+            return a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+                 + b2 * y * y + 2 * bc * y * z + 2 * bd * y
+                 + c2 * z * z + 2 * cd * z
+                 + d2;
+        }
+    };
+
+    struct Collapse
+    {
+        float error;
+        unsigned int from;
+        unsigned int to;
+        unsigned int from_version;
+        unsigned int to_version;
+
+        bool operator >(const Collapse& other) const { return error > other.error; }
+    };
+
+    float squared_length(const vec3& v) { return v.x * v.x + v.y * v.y + v.z * v.z; }
+    vec3 sub(const vec3& a, const vec3& b) { return vec3(a.x - b.x, a.y - b.y, a.z - b.z); }
+    vec3 triangle_normal(const vec3& a, const vec3& b, const vec3& c)
+    {
+        vec3 ab = sub(b, a);
+        vec3 ac = sub(c, a);
+
+        return vec3(ab.y * ac.z - ab.z * ac.y, ab.z * ac.x - ab.x * ac.z, ab.x * ac.y - ab.y * ac.x);
+    }
+}
+
+std::vector<unsigned char> MeshSimplifier::lock_borders(const std::vector<vec3>& positions, const std::vector<unsigned int>& indices)
+{
+    int vertex_count = positions.size();
+    std::vector<unsigned char> locked(vertex_count, 0);
+
+    //Numbering the distinct positions
+    std::vector<int> sorted_vertices(vertex_count);
+    for (int i = 0; i < vertex_count; i++)
+        sorted_vertices[i] = i;
+    auto position_less = [&positions](int a, int b)
+    {
+        const vec3& pa = positions[a];
+        const vec3& pb = positions[b];
+        if (pa.x != pb.x) return pa.x < pb.x;
+        if (pa.y != pb.y) return pa.y < pb.y;
+        return pa.z < pb.z;
+    };
+    std::sort(sorted_vertices.begin(), sorted_vertices.end(), position_less);
+
+    std::vector<int> position_ids(vertex_count);
+    std::vector<int> position_vertex;
+    for (int i = 0; i < vertex_count; i++)
+    {
+        int vertex = sorted_vertices[i];
+        if (i > 0 && !position_less(sorted_vertices[i - 1], vertex))
+        {
+            //Same position as the previous vertex, attribute seam
+            position_ids[vertex] = position_ids[sorted_vertices[i - 1]];
+            locked[vertex] = 1;
+            locked[position_vertex[position_ids[vertex]]] = 1;
+        }
+        else
+        {
+            position_ids[vertex] = position_vertex.size();
+            position_vertex.push_back(vertex);
+        }
+    }
+
+    //The edges that are not shared by exactly 2 triangles are open or non manifold
+    std::vector<std::pair<int, int>> edges;
+    edges.reserve(indices.size());
+    for (int i = 0; i + 2 < int(indices.size()); i += 3)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            int a = position_ids[indices[i + k]];
+            int b = position_ids[indices[i + (k + 1) % 3]];
+            edges.push_back(std::make_pair(std::min(a, b), std::max(a, b)));
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+
+    for (int i = 0; i < int(edges.size());)
+    {
+        int j = i + 1;
+        while (j < int(edges.size()) && edges[j] == edges[i])
+            j++;
+
+        if (j - i != 2)
+        {
+            locked[position_vertex[edges[i].first]] = 1;
+            locked[position_vertex[edges[i].second]] = 1;
+        }
+
+        i = j;
+    }
+
+    //The seams are locked with all their vertices, not only the first one of each position
+    for (int i = 0; i < vertex_count; i++)
+        if (locked[position_vertex[position_ids[i]]])
+            locked[i] = 1;
+
+    return locked;
+}
+
+float MeshSimplifier::simplify(const std::vector<vec3>& positions, const std::vector<vec3>& normals, const std::vector<vec2>& texcoords,
+                               const std::vector<unsigned char>& locked, std::vector<unsigned int>& indices, int target_triangle_count)
+{
+    int vertex_count = positions.size();
+    int triangle_count = indices.size() / 3;
+    if (triangle_count <= target_triangle_count)
+        return 0.0f;
+
+    bool has_normals = normals.size() == positions.size();
+    bool has_texcoords = texcoords.size() == positions.size();
+
+    std::vector<Quadric> quadrics(vertex_count);
+    std::vector<std::vector<int>> vertex_triangles(vertex_count);
+    for (int triangle = 0; triangle < triangle_count; triangle++)
+    {
+        unsigned int a = indices[triangle * 3 + 0];
+        unsigned int b = indices[triangle * 3 + 1];
+        unsigned int c = indices[triangle * 3 + 2];
+
+        vertex_triangles[a].push_back(triangle);
+        vertex_triangles[b].push_back(triangle);
+        vertex_triangles[c].push_back(triangle);
+
+        vec3 normal = triangle_normal(positions[a], positions[b], positions[c]);
+        double length = std::sqrt((double)squared_length(normal));
+        if (length == 0)
+            continue;
+
+        double nx = normal.x / length, ny = normal.y / length, nz = normal.z / length;
+        double d = -(nx * positions[a].x + ny * positions[a].y + nz * positions[a].z);
+        double area = length * 0.5;
+        quadrics[a].add_plane(nx, ny, nz, d, area);
+        quadrics[b].add_plane(nx, ny, nz, d, area);
+        quadrics[c].add_plane(nx, ny, nz, d, area);
+    }
+
+    std::vector<unsigned int> versions(vertex_count, 0);
+    std::vector<unsigned char> removed_vertices(vertex_count, 0);
+    std::vector<unsigned char> removed_triangles(triangle_count, 0);
+
+    //Error of moving 'from' onto 'to', as a distance
+    auto collapse_error = [&](unsigned int from, unsigned int to) -> float
+    {
+        Quadric quadric = quadrics[from];
+        quadric.add(quadrics[to]);
+
+        double error = quadric.weight > 0 ? std::max(0.0, quadric.evaluate(positions[to])) / quadric.weight : 0.0;
+
+        float attribute_difference = 0;
+        if (has_normals)
+            attribute_difference += squared_length(sub(normals[from], normals[to])) * 0.25f;
+        if (has_texcoords)
+        {
+            vec2 uv = vec2(texcoords[from].x - texcoords[to].x, texcoords[from].y - texcoords[to].y);
+            attribute_difference += uv.x * uv.x + uv.y * uv.y;
+        }
+        error += ATTRIBUTE_WEIGHT * squared_length(sub(positions[from], positions[to])) * attribute_difference;
+
+        return (float)std::sqrt(error);
+    };
+
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> queue;
+    auto push_collapse = [&](unsigned int from, unsigned int to)
+    {
+        if (locked[from] || from == to)
+            return;
+
+        queue.push(Collapse{ collapse_error(from, to), from, to, versions[from], versions[to] });
+    };
+
+    for (int triangle = 0; triangle < triangle_count; triangle++)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int a = indices[triangle * 3 + k];
+            unsigned int b = indices[triangle * 3 + (k + 1) % 3];
+
+            push_collapse(a, b);
+            push_collapse(b, a);
+        }
+    }
+
+    float max_error = 0;
+    int remaining_triangles = triangle_count;
+    while (remaining_triangles > target_triangle_count && !queue.empty())
+    {
+        Collapse collapse = queue.top();
+        queue.pop();
+
+        unsigned int from = collapse.from;
+        unsigned int to = collapse.to;
+        if (removed_vertices[from] || removed_vertices[to] || versions[from] != collapse.from_version || versions[to] != collapse.to_version)
+            //The collapse was computed before one of the vertices changed
+            continue;
+
+        //The edge must still exist and the triangles that are moved must not flip
+        bool edge_exists = false;
+        bool flips = false;
+        for (int triangle : vertex_triangles[from])
+        {
+            if (removed_triangles[triangle])
+                continue;
+
+            unsigned int* triangle_indices = &indices[triangle * 3];
+            if (triangle_indices[0] == to || triangle_indices[1] == to || triangle_indices[2] == to)
+            {
+                edge_exists = true;
+                continue;
+            }
+
+            vec3 p[3], moved[3];
+            for (int k = 0; k < 3; k++)
+            {
+                p[k] = positions[triangle_indices[k]];
+                moved[k] = triangle_indices[k] == from ? positions[to] : p[k];
+            }
+
+            vec3 normal = triangle_normal(p[0], p[1], p[2]);
+            vec3 moved_normal = triangle_normal(moved[0], moved[1], moved[2]);
+            if (normal.x * moved_normal.x + normal.y * moved_normal.y + normal.z * moved_normal.z <= 0)
+            {
+                flips = true;
+                break;
+            }
+        }
+        if (!edge_exists || flips)
+            continue;
+
+        for (int triangle : vertex_triangles[from])
+        {
+            if (removed_triangles[triangle])
+                continue;
+
+            unsigned int* triangle_indices = &indices[triangle * 3];
+            if (triangle_indices[0] == to || triangle_indices[1] == to || triangle_indices[2] == to)
+            {
+                removed_triangles[triangle] = 1;
+                remaining_triangles--;
+
+                continue;
+            }
+
+            for (int k = 0; k < 3; k++)
+                if (triangle_indices[k] == from)
+                    triangle_indices[k] = to;
+            vertex_triangles[to].push_back(triangle);
+        }
+
+        quadrics[to].add(quadrics[from]);
+        removed_vertices[from] = 1;
+        vertex_triangles[from].clear();
+        versions[to]++;
+        max_error = std::max(max_error, collapse.error);
+
+        //The errors of the edges around 'to' changed with its quadric
+        std::vector<int>& to_triangles = vertex_triangles[to];
+        to_triangles.erase(std::remove_if(to_triangles.begin(), to_triangles.end(), [&removed_triangles](int triangle) { return removed_triangles[triangle]; }), to_triangles.end());
+        for (int triangle : to_triangles)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                unsigned int other = indices[triangle * 3 + k];
+                if (other == to)
+                    continue;
+
+                push_collapse(other, to);
+                push_collapse(to, other);
+            }
+        }
+    }
+
+    std::vector<unsigned int> simplified;
+    simplified.reserve(remaining_triangles * 3);
+    for (int triangle = 0; triangle < triangle_count; triangle++)
+        if (!removed_triangles[triangle])
+            simplified.insert(simplified.end(), indices.begin() + triangle * 3, indices.begin() + triangle * 3 + 3);
+    indices = std::move(simplified);
+
+    return max_error;
+}
@@ -0,0 +1,44 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include "vec.h"
+
+#include <vector>
+
+/**
+ * Simplification of indexed triangles with the quadric error metric (Garland & Heckbert).
+ *
+ * The edges are collapsed onto one of their vertices (half edge collapse) in the order
+ * of the error of the collapse so no new vertex is created and the attributes of the
+ * remaining vertices are kept as is. The error of a collapse is the distance
+ * to the planes of the triangles around the removed vertex plus a penalty for the
+ * difference of the attributes (normals and texture coordinates) of the two vertices.
+ * Locked vertices never move: the open edges, the attribute seams and the borders
+ * with the other materials are preserved.
+ */
+class MeshSimplifier
+{
+public:
+    //Weight of the difference of the attributes relative to the length of the edge in the error of a collapse
+    inline static const float ATTRIBUTE_WEIGHT = 0.5f;
+
+    /**
+     * @param normals, texcoords Attributes of the vertices, may be empty
+     * @param locked 1 for the vertices that can't be removed
+     * @param indices Triangles to simplify, replaced by the simplified triangles
+     * @param target_triangle_count The simplification stops when there are at most that many triangles
+     * or when no more edges can be collapsed
+     * @return The largest error of the collapses, in the units of the positions
+     */
+    static float simplify(const std::vector<vec3>& positions, const std::vector<vec3>& normals, const std::vector<vec2>& texcoords,
+                          const std::vector<unsigned char>& locked, std::vector<unsigned int>& indices, int target_triangle_count);
+
+    /**
+     * Locks the vertices that are on open or non manifold edges and the vertices whose
+     * position is shared with another vertex (attribute seams). The topology is computed
+     * from the positions only
+     */
+    static std::vector<unsigned char> lock_borders(const std::vector<vec3>& positions, const std::vector<unsigned int>& indices);
+};
+
+#endif
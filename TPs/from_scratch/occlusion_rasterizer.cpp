@@ -0,0 +1,392 @@
+#include "occlusion_rasterizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+OcclusionRasterizer::OcclusionRasterizer(int width, int height)
+{
+    resize(width, height);
+}
+
+void OcclusionRasterizer::resize(int width, int height)
+{
+    m_tiles_x = std::max(1, (width + TILE_SIZE - 1) / TILE_SIZE);
+    m_tiles_y = std::max(1, (height + TILE_SIZE - 1) / TILE_SIZE);
+    m_width = m_tiles_x * TILE_SIZE;
+    m_height = m_tiles_y * TILE_SIZE;
+
+    m_depth_buffer.resize(m_width * m_height);
+    m_tiles_max_depth.resize(m_tiles_x * m_tiles_y);
+    m_bins.resize(m_tiles_x * m_tiles_y);
+
+    clear();
+}
+
+int OcclusionRasterizer::width() const
+{
+    return m_width;
+}
+
+int OcclusionRasterizer::height() const
+{
+    return m_height;
+}
+
+void OcclusionRasterizer::clear()
+{
+    std::fill(m_depth_buffer.begin(), m_depth_buffer.end(), 1.0f);
+    std::fill(m_tiles_max_depth.begin(), m_tiles_max_depth.end(), 1.0f);
+}
+
+int OcclusionRasterizer::triangles_rasterized() const
+{
+    return m_triangles_rasterized;
+}
+
+const std::vector<float>& OcclusionRasterizer::depth_buffer() const
+{
+    return m_depth_buffer;
+}
+
+bool OcclusionRasterizer::setup_screen_triangle(const vec4& a, const vec4& b, const vec4& c, ScreenTriangle& triangle) const
+{
+    //Projecting the vertices on the screen, the origin of the depth buffer is the bottom left corner
+    //like the OpenGL viewport
+    float x[3], y[3], z[3];
+    const vec4* vertices[3] = { &a, &b, &c };
+    for (int i = 0; i < 3; i++)
+    {
+        const vec4& v = *vertices[i];
+        float inverse_w = 1.0f / v.w;
+
+        x[i] = (v.x * inverse_w * 0.5f + 0.5f) * m_width;
+        y[i] = (v.y * inverse_w * 0.5f + 0.5f) * m_height;
+        z[i] = std::max(0.0f, v.z * inverse_w * 0.5f + 0.5f);
+    }
+
+    //Pixels whose center is inside the bounding rectangle of the triangle
+    float min_x = std::min(x[0], std::min(x[1], x[2]));
+    float max_x = std::max(x[0], std::max(x[1], x[2]));
+    float min_y = std::min(y[0], std::min(y[1], y[2]));
+    float max_y = std::max(y[0], std::max(y[1], y[2]));
+    if (max_x < 0 || max_y < 0 || min_x > m_width || min_y > m_height)
+        return false;
+
+    triangle.min_x = std::max(0, (int)std::ceil(min_x - 0.5f));
+    triangle.max_x = std::min(m_width - 1, (int)std::floor(max_x - 0.5f));
+    triangle.min_y = std::max(0, (int)std::ceil(min_y - 0.5f));
+    triangle.max_y = std::min(m_height - 1, (int)std::floor(max_y - 0.5f));
+    if (triangle.min_x > triangle.max_x || triangle.min_y > triangle.max_y)
+        //The triangle doesn't cover any pixel center
+        return false;
+
+    //Edge i goes from vertex i + 1 to vertex i + 2 and is 0 on these two vertices.
+    //Its value on vertex i is twice the signed area of the triangle
+    float area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+    if (area == 0 || !std::isfinite(area))
+        return false;
+
+    //Both orientations are rasterized, the occluders aren't necessarily closed meshes
+    float sign = area > 0 ? 1.0f : -1.0f;
+    for (int i = 0; i < 3; i++)
+    {
+        int i1 = (i + 1) % 3;
+        int i2 = (i + 2) % 3;
+
+        float A = -(y[i2] - y[i1]) * sign;
+        float B = (x[i2] - x[i1]) * sign;
+        float C = -(A * x[i1] + B * y[i1]);
+
+        triangle.edges[i][0] = A;
+        triangle.edges[i][1] = B;
+        triangle.edges[i][2] = C;
+    }
+
+    //The depth is interpolated with the barycentric coordinates edge_i / area
+    float inverse_area = 1.0f / std::abs(area);
+    for (int j = 0; j < 3; j++)
+        triangle.depth[j] = (triangle.edges[0][j] * z[0] + triangle.edges[1][j] * z[1] + triangle.edges[2][j] * z[2]) * inverse_area;
+
+    return true;
+}
+
+int OcclusionRasterizer::setup_triangle(const vec4 clip[3], ScreenTriangle triangles[2]) const
+{
+    //Distance to the near plane z = -w
+    float distances[3];
+    int inside_count = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        distances[i] = clip[i].z + clip[i].w;
+        if (distances[i] >= 0)
+            inside_count++;
+    }
+
+    if (inside_count == 0)
+        return 0;
+    else if (inside_count == 3)
+        return setup_screen_triangle(clip[0], clip[1], clip[2], triangles[0]) ? 1 : 0;
+
+    //Clipping the triangle against the near plane, this gives a polygon of 3 or 4 vertices
+    vec4 polygon[4];
+    int polygon_size = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        int next = (i + 1) % 3;
+        if (distances[i] >= 0)
+            polygon[polygon_size++] = clip[i];
+
+        if ((distances[i] >= 0) != (distances[next] >= 0))
+        {
+            float t = distances[i] / (distances[i] - distances[next]);
+            const vec4& a = clip[i];
+            const vec4& b = clip[next];
+
+            polygon[polygon_size++] = vec4(a.x + t * (b.x - a.x), a.y + t * (b.y - a.y), a.z + t * (b.z - a.z), a.w + t * (b.w - a.w));
+        }
+    }
+
+    int count = 0;
+    for (int i = 2; i < polygon_size; i++)
+        if (setup_screen_triangle(polygon[0], polygon[i - 1], polygon[i], triangles[count]))
+            count++;
+
+    return count;
+}
+
+void OcclusionRasterizer::rasterize(const std::vector<vec3>& positions, const std::vector<unsigned int>& indices,
+                                    const std::vector<TriangleGroup>& groups, const std::vector<int>& group_ids,
+                                    const Transform& mvp_matrix)
+{
+    //Index of the first triangle of each group in the list of the triangles to rasterize
+    std::vector<int> first_triangles(group_ids.size() + 1);
+    first_triangles[0] = 0;
+    for (int i = 0; i < int(group_ids.size()); i++)
+        first_triangles[i + 1] = first_triangles[i] + groups[group_ids[i]].n / 3;
+
+    int triangle_count = first_triangles.back();
+    if (triangle_count == 0)
+        return;
+
+    //A triangle clipped by the near plane may give 2 triangles
+    m_triangles.resize(triangle_count * 2);
+    m_triangles_count.resize(triangle_count);
+
+    //Transforming and setting up the triangles
+#pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < int(group_ids.size()); i++)
+    {
+        const TriangleGroup& group = groups[group_ids[i]];
+
+        for (int triangle = 0; triangle < group.n / 3; triangle++)
+        {
+            vec4 clip[3];
+            for (int vertex = 0; vertex < 3; vertex++)
+            {
+                int index = group.first + triangle * 3 + vertex;
+                if (!indices.empty())
+                    index = indices[index];
+
+                clip[vertex] = mvp_matrix(vec4(positions[index], 1));
+            }
+
+            int triangle_index = first_triangles[i] + triangle;
+            m_triangles_count[triangle_index] = setup_triangle(clip, &m_triangles[triangle_index * 2]);
+        }
+    }
+
+    //Binning the triangles in the tiles they overlap
+    for (std::vector<int>& bin : m_bins)
+        bin.clear();
+
+    m_triangles_rasterized = 0;
+    for (int i = 0; i < triangle_count; i++)
+    {
+        for (int j = 0; j < m_triangles_count[i]; j++)
+        {
+            const ScreenTriangle& triangle = m_triangles[i * 2 + j];
+
+            for (int tile_y = triangle.min_y / TILE_SIZE; tile_y <= triangle.max_y / TILE_SIZE; tile_y++)
+                for (int tile_x = triangle.min_x / TILE_SIZE; tile_x <= triangle.max_x / TILE_SIZE; tile_x++)
+                    m_bins[tile_x + tile_y * m_tiles_x].push_back(i * 2 + j);
+
+            m_triangles_rasterized++;
+        }
+    }
+
+    //The tiles are independent from each other
+#pragma omp parallel for schedule(dynamic)
+    for (int tile_index = 0; tile_index < m_tiles_x * m_tiles_y; tile_index++)
+        rasterize_tile(tile_index);
+}
+
+void OcclusionRasterizer::rasterize_tile(int tile_index)
+{
+    const std::vector<int>& bin = m_bins[tile_index];
+    if (bin.empty())
+        return;
+
+    int tile_x0 = (tile_index % m_tiles_x) * TILE_SIZE;
+    int tile_y0 = (tile_index / m_tiles_x) * TILE_SIZE;
+
+    for (int triangle_index : bin)
+    {
+        const ScreenTriangle& triangle = m_triangles[triangle_index];
+
+        //Copying the coefficients in local variables, the compiler cannot
+        //keep them in registers otherwise because the depth buffer is also made of floats
+        const float A0 = triangle.edges[0][0], B0 = triangle.edges[0][1], C0 = triangle.edges[0][2];
+        const float A1 = triangle.edges[1][0], B1 = triangle.edges[1][1], C1 = triangle.edges[1][2];
+        const float A2 = triangle.edges[2][0], B2 = triangle.edges[2][1], C2 = triangle.edges[2][2];
+        const float Az = triangle.depth[0], Bz = triangle.depth[1], Cz = triangle.depth[2];
+
+        int min_y = std::max(tile_y0, triangle.min_y);
+        int max_y = std::min(tile_y0 + TILE_SIZE - 1, triangle.max_y);
+        for (int y = min_y; y <= max_y; y++)
+        {
+            float py = y + 0.5f;
+            float* row = &m_depth_buffer[y * m_width + tile_x0];
+
+            float row_edge0 = B0 * py + C0;
+            float row_edge1 = B1 * py + C1;
+            float row_edge2 = B2 * py + C2;
+            float row_depth = Bz * py + Cz;
+
+            //The whole row of the tile is evaluated at once, the pixels outside
+            //of the triangle are rejected by the edge functions
+#pragma omp simd
+            for (int lane = 0; lane < TILE_SIZE; lane++)
+            {
+                float px = tile_x0 + lane + 0.5f;
+
+                float edge0 = A0 * px + row_edge0;
+                float edge1 = A1 * px + row_edge1;
+                float edge2 = A2 * px + row_edge2;
+                float depth = Az * px + row_depth;
+
+                //No std::min() here, it takes references to the variables of the lane
+                //and GCC doesn't vectorize the loop anymore
+                bool inside = (edge0 >= 0) & (edge1 >= 0) & (edge2 >= 0);
+                float current = row[lane];
+                row[lane] = (inside & (depth < current)) ? depth : current;
+            }
+        }
+    }
+
+    float tile_max_depth = 0;
+    for (int y = tile_y0; y < tile_y0 + TILE_SIZE; y++)
+    {
+        const float* row = &m_depth_buffer[y * m_width + tile_x0];
+
+#pragma omp simd reduction(max:tile_max_depth)
+        for (int lane = 0; lane < TILE_SIZE; lane++)
+            tile_max_depth = row[lane] > tile_max_depth ? row[lane] : tile_max_depth;
+    }
+
+    m_tiles_max_depth[tile_index] = tile_max_depth;
+}
+
+bool OcclusionRasterizer::test_box(const Point& bbox_min, const Point& bbox_max, const Transform& mvp_matrix) const
+{
+    float min_x = std::numeric_limits<float>::max(), max_x = -std::numeric_limits<float>::max();
+    float min_y = std::numeric_limits<float>::max(), max_y = -std::numeric_limits<float>::max();
+    float nearest_depth = std::numeric_limits<float>::max();
+    for (int i = 0; i < 8; i++)
+    {
+        vec4 corner = mvp_matrix(vec4(i & 1 ? bbox_max.x : bbox_min.x,
+                                      i & 2 ? bbox_max.y : bbox_min.y,
+                                      i & 4 ? bbox_max.z : bbox_min.z, 1));
+
+        //A corner is behind the near plane, we cannot compute the screen space rectangle of the box,
+        //it is considered visible
+        if (corner.z < -corner.w)
+            return true;
+
+        float inverse_w = 1.0f / corner.w;
+        float x = (corner.x * inverse_w * 0.5f + 0.5f) * m_width;
+        float y = (corner.y * inverse_w * 0.5f + 0.5f) * m_height;
+
+        min_x = std::min(min_x, x);
+        max_x = std::max(max_x, x);
+        min_y = std::min(min_y, y);
+        max_y = std::max(max_y, y);
+        nearest_depth = std::min(nearest_depth, corner.z * inverse_w * 0.5f + 0.5f);
+    }
+
+    //Outside of the frustum
+    if (max_x < 0 || max_y < 0 || min_x > m_width || min_y > m_height || nearest_depth > 1)
+        return false;
+
+    //All the pixels touched by the rectangle of the box, not only the ones whose center is inside
+    //the rectangle so that small boxes are tested against at least one pixel
+    int x0 = std::max(0, (int)std::floor(min_x));
+    int x1 = std::min(m_width - 1, (int)std::floor(max_x));
+    int y0 = std::max(0, (int)std::floor(min_y));
+    int y1 = std::min(m_height - 1, (int)std::floor(max_y));
+
+    for (int tile_y = y0 / TILE_SIZE; tile_y <= y1 / TILE_SIZE; tile_y++)
+    {
+        for (int tile_x = x0 / TILE_SIZE; tile_x <= x1 / TILE_SIZE; tile_x++)
+        {
+            //Every pixel of the tile is in front of the box
+            if (m_tiles_max_depth[tile_x + tile_y * m_tiles_x] < nearest_depth)
+                continue;
+
+            int pixel_y0 = std::max(y0, tile_y * TILE_SIZE), pixel_y1 = std::min(y1, tile_y * TILE_SIZE + TILE_SIZE - 1);
+            int pixel_x0 = std::max(x0, tile_x * TILE_SIZE), pixel_x1 = std::min(x1, tile_x * TILE_SIZE + TILE_SIZE - 1);
+            for (int y = pixel_y0; y <= pixel_y1; y++)
+                for (int x = pixel_x0; x <= pixel_x1; x++)
+                    if (m_depth_buffer[x + y * m_width] >= nearest_depth)
+                        return true;
+        }
+    }
+
+    return false;
+}
+
+std::vector<int> OcclusionRasterizer::select_occluders(const std::vector<vec3>& positions, const std::vector<unsigned int>& indices,
+                                                       const std::vector<TriangleGroup>& groups, int triangle_budget)
+{
+    //Surface of the bounding box of each group, big objects are the most likely to hide something
+    std::vector<float> surfaces(groups.size());
+
+#pragma omp parallel for schedule(dynamic)
+    for (int group_index = 0; group_index < int(groups.size()); group_index++)
+    {
+        const TriangleGroup& group = groups[group_index];
+
+        vec3 bbox_min = vec3(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+        vec3 bbox_max = vec3(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max());
+        for (int i = group.first; i < group.first + group.n; i++)
+        {
+            const vec3& position = positions[indices.empty() ? i : indices[i]];
+
+            bbox_min = min(bbox_min, position);
+            bbox_max = max(bbox_max, position);
+        }
+
+        vec3 extent = vec3(bbox_max.x - bbox_min.x, bbox_max.y - bbox_min.y, bbox_max.z - bbox_min.z);
+        surfaces[group_index] = group.n > 0 ? extent.x * extent.y + extent.y * extent.z + extent.z * extent.x : 0;
+    }
+
+    std::vector<int> sorted_groups(groups.size());
+    for (int i = 0; i < int(groups.size()); i++)
+        sorted_groups[i] = i;
+    std::sort(sorted_groups.begin(), sorted_groups.end(), [&surfaces](int a, int b) { return surfaces[a] > surfaces[b]; });
+
+    //Taking the biggest groups that fit in the budget
+    std::vector<int> occluders;
+    int triangles = 0;
+    for (int group_index : sorted_groups)
+    {
+        int group_triangles = groups[group_index].n / 3;
+        if (group_triangles == 0 || triangles + group_triangles > triangle_budget)
+            continue;
+
+        occluders.push_back(group_index);
+        triangles += group_triangles;
+    }
+
+    return occluders;
+}
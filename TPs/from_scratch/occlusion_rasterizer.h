@@ -0,0 +1,113 @@
+#ifndef OCCLUSION_RASTERIZER_H
+#define OCCLUSION_RASTERIZER_H
+
+#include "mat.h"
+#include "mesh.h"
+#include "vec.h"
+
+#include <vector>
+
+/**
+ * Software depth rasterizer used to cull objects on the CPU without reading
+ * back the z-buffer of the GPU.
+ *
+ * A subset of the triangle groups of the scene (the occluders, see select_occluders())
+ * is rasterized into a low resolution depth buffer. The depth buffer is split in tiles
+ * of TILE_SIZE x TILE_SIZE pixels: triangles are first binned into the tiles they overlap
+ * and the tiles are then rasterized in parallel, one row of 8 pixels at a time with
+ * vectorized edge functions. The farthest depth of each tile is kept so that most of
+ * the bounding box tests can be answered without looking at the pixels.
+ *
+ * Coverage is sampled at the center of the pixels (as in masked occlusion culling)
+ * and the depth uses the OpenGL convention: 0 on the near plane, 1 on the far plane.
+ */
+class OcclusionRasterizer
+{
+public:
+    inline static const int TILE_SIZE = 8;
+
+    OcclusionRasterizer(int width = 320, int height = 192);
+
+    /**
+     * Changes the resolution of the depth buffer. The resolution is rounded up
+     * to a multiple of TILE_SIZE
+     */
+    void resize(int width, int height);
+
+    int width() const;
+    int height() const;
+
+    /**
+     * Resets the depth buffer to the far plane
+     */
+    void clear();
+
+    /**
+     * Rasterizes the triangles of the groups 'group_ids' into the depth buffer.
+     *
+     * @param positions The vertices of the mesh
+     * @param indices The indices of the mesh. Can be empty for a non-indexed mesh in which
+     * case the 'first' and 'n' fields of the groups directly are vertex indices
+     * @param groups The triangle groups of the mesh
+     * @param group_ids The indices of the groups to rasterize
+     */
+    void rasterize(const std::vector<vec3>& positions, const std::vector<unsigned int>& indices,
+                   const std::vector<TriangleGroup>& groups, const std::vector<int>& group_ids,
+                   const Transform& mvp_matrix);
+
+    /**
+     * @return True if the bounding box may be visible, false if it is
+     * entirely hidden by the rasterized occluders
+     */
+    bool test_box(const Point& bbox_min, const Point& bbox_max, const Transform& mvp_matrix) const;
+
+    /**
+     * @return Number of triangles written to the tiles during the last call to rasterize()
+     */
+    int triangles_rasterized() const;
+
+    const std::vector<float>& depth_buffer() const;
+
+    /**
+     * Chooses the groups of the mesh that are going to be used as occluders: the groups
+     * with the largest bounding boxes are selected first until 'triangle_budget' triangles
+     * have been selected
+     */
+    static std::vector<int> select_occluders(const std::vector<vec3>& positions, const std::vector<unsigned int>& indices,
+                                             const std::vector<TriangleGroup>& groups, int triangle_budget);
+
+private:
+    struct ScreenTriangle
+    {
+        //Coefficients A, B, C of the 3 edge functions A * x + B * y + C
+        float edges[3][3];
+        //Depth plane z = A * x + B * y + C
+        float depth[3];
+
+        int min_x, min_y, max_x, max_y;
+    };
+
+    /**
+     * Clips the triangle against the near plane and computes the edge functions
+     * and depth plane of the resulting triangles.
+     *
+     * @return The number of triangles written in 'triangles' (0, 1 or 2)
+     */
+    int setup_triangle(const vec4 clip[3], ScreenTriangle triangles[2]) const;
+    bool setup_screen_triangle(const vec4& a, const vec4& b, const vec4& c, ScreenTriangle& triangle) const;
+    void rasterize_tile(int tile_index);
+
+    int m_width, m_height;
+    int m_tiles_x, m_tiles_y;
+    int m_triangles_rasterized = 0;
+
+    std::vector<float> m_depth_buffer;
+    std::vector<float> m_tiles_max_depth;
+
+    //Buffers kept from one frame to the other to avoid reallocations
+    std::vector<ScreenTriangle> m_triangles;
+    std::vector<unsigned char> m_triangles_count;
+    std::vector<std::vector<int>> m_bins;
+};
+
+#endif
@@ -0,0 +1,305 @@
+#include "texture_streamer.h"
+#include "tutos/ktx2/ktx2_texture.h"
+
+#include <algorithm>
+#include <cstring>
+
+//Alignment of the images in the unpack buffers
+static const size_t UNPACK_ALIGNMENT = 256;
+
+TextureStreamer::TextureStreamer(int worker_count, size_t frame_upload_budget) : m_frame_upload_budget(frame_upload_budget)
+{
+    if (worker_count <= 0)
+        worker_count = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+
+    for (int i = 0; i < worker_count; i++)
+        m_workers.push_back(std::thread(&TextureStreamer::worker_function, this));
+}
+
+TextureStreamer::~TextureStreamer()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_request_condition.notify_all();
+
+    for (std::thread& worker : m_workers)
+        worker.join();
+}
+
+void TextureStreamer::init()
+{
+    if (!GLEW_ARB_buffer_storage)
+        //The images will be uploaded directly from their decoded pixels
+        return;
+
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    glGenBuffers(1, &m_unpack_buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_unpack_buffer);
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, m_frame_upload_budget * RING_FRAMES, nullptr, flags);
+    m_unpack_buffer_mapping = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, m_frame_upload_budget * RING_FRAMES, flags);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void TextureStreamer::release()
+{
+    for (GLsync& fence : m_fences)
+    {
+        if (fence)
+            glDeleteSync(fence);
+        fence = 0;
+    }
+
+    if (m_unpack_buffer)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_unpack_buffer);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &m_unpack_buffer);
+    }
+
+    m_unpack_buffer = 0;
+    m_unpack_buffer_mapping = nullptr;
+}
+
+void TextureStreamer::request(const std::string& filename, GLint internal_format, KTX2Usage usage, GLuint* target)
+{
+    if (m_requested_count == 0)
+        m_first_request_time = std::chrono::high_resolution_clock::now();
+    m_requested_count++;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_requests.push_back(Request{ filename, internal_format, usage, target });
+    }
+    m_request_condition.notify_one();
+}
+
+void TextureStreamer::worker_function()
+{
+    while (true)
+    {
+        Request request;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_request_condition.wait(lock, [this]() { return m_stop || !m_requests.empty(); });
+            if (m_stop)
+                return;
+
+            request = m_requests.front();
+            m_requests.pop_front();
+        }
+
+        DecodedImage decoded;
+        decoded.request = request;
+        //The workers already load several textures at the same time, the levels are decompressed sequentially
+        if (!read_ktx2_cache(request.filename.c_str(), request.usage, decoded.compressed, false))
+        {
+            decoded.image = read_image_data(request.filename.c_str());
+            m_missing_cache_count++;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_decoded_images.push_back(std::move(decoded));
+    }
+}
+
+int TextureStreamer::upload()
+{
+    //The part of the ring of this frame may still be read by the GPU
+    if (m_unpack_buffer_mapping && m_fences[m_ring_index])
+    {
+        if (glClientWaitSync(m_fences[m_ring_index], 0, 0) == GL_TIMEOUT_EXPIRED)
+            return 0;
+
+        glDeleteSync(m_fences[m_ring_index]);
+        m_fences[m_ring_index] = 0;
+    }
+
+    size_t ring_offset = m_ring_index * m_frame_upload_budget;
+    size_t frame_bytes = 0;
+    int created = 0;
+    while (true)
+    {
+        DecodedImage decoded;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_decoded_images.empty())
+                break;
+
+            //An image that doesn't fit in what remains of the budget waits for the next frame
+            size_t size = (m_decoded_images.front().size() + UNPACK_ALIGNMENT - 1) & ~(UNPACK_ALIGNMENT - 1);
+            if (frame_bytes > 0 && frame_bytes + size > m_frame_upload_budget)
+                break;
+
+            decoded = std::move(m_decoded_images.front());
+            m_decoded_images.pop_front();
+        }
+
+        size_t size = decoded.size();
+        if (!decoded.compressed.levels.empty())
+        {
+            if (m_unpack_buffer_mapping && size <= m_frame_upload_budget)
+            {
+                size_t offset = ring_offset + frame_bytes;
+                for (const KTX2Level& level : decoded.compressed.levels)
+                {
+                    std::memcpy(m_unpack_buffer_mapping + offset, level.data.data(), level.data.size());
+                    offset += level.data.size();
+                }
+
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_unpack_buffer);
+                *decoded.request.target = create_compressed_texture(decoded.compressed, ring_offset + frame_bytes);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            }
+            else
+                *decoded.request.target = create_compressed_texture(decoded.compressed, -1);
+
+            created++;
+            m_compressed_count++;
+            m_uploaded_bytes += size;
+            m_texture_memory += size;
+        }
+        else if (decoded.image.width > 0)
+        {
+            if (m_unpack_buffer_mapping && size <= m_frame_upload_budget)
+            {
+                std::memcpy(m_unpack_buffer_mapping + ring_offset + frame_bytes, decoded.image.data(), size);
+
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_unpack_buffer);
+                *decoded.request.target = create_texture(decoded, (const void*)(ring_offset + frame_bytes));
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            }
+            else
+                *decoded.request.target = create_texture(decoded, decoded.image.data());
+
+            created++;
+            m_uploaded_bytes += size;
+            //The driver stores the RGB textures as RGBA
+            m_texture_memory += rgba8_mipmapped_size(decoded.image.width, decoded.image.height);
+        }
+
+        //A failed decode keeps the default texture but is done as well
+        m_uploaded_count++;
+        m_last_upload_time = std::chrono::high_resolution_clock::now();
+
+        frame_bytes += (size + UNPACK_ALIGNMENT - 1) & ~(UNPACK_ALIGNMENT - 1);
+        if (frame_bytes >= m_frame_upload_budget)
+            break;
+    }
+
+    if (m_unpack_buffer_mapping && frame_bytes > 0)
+    {
+        m_fences[m_ring_index] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        m_ring_index = (m_ring_index + 1) % RING_FRAMES;
+    }
+
+    return created;
+}
+
+GLuint TextureStreamer::create_texture(const DecodedImage& decoded, const void* pixels)
+{
+    const ImageData& image = decoded.image;
+
+    GLuint texture_id;
+    glGenTextures(1, &texture_id);
+    glBindTexture(GL_TEXTURE_2D, texture_id);
+
+    //The rows of the RGB images are not aligned on 4 bytes
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, decoded.request.internal_format,
+                 image.width, image.height, 0,
+                 image.channels == 3 ? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE,
+                 pixels);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    return texture_id;
+}
+
+GLuint TextureStreamer::create_compressed_texture(const KTX2Texture& texture, ptrdiff_t unpack_offset)
+{
+    GLenum internal_format = ktx2_internal_format(texture);
+
+    GLuint texture_id;
+    glGenTextures(1, &texture_id);
+    glBindTexture(GL_TEXTURE_2D, texture_id);
+
+    //All the levels are uploaded, the mipmaps have been filtered when baking the cache
+    for (int i = 0; i < (int)texture.levels.size(); i++)
+    {
+        const KTX2Level& level = texture.levels[i];
+        const void* data = level.data.data();
+        if (unpack_offset >= 0)
+        {
+            data = (const void*)unpack_offset;
+            unpack_offset += level.data.size();
+        }
+
+        glCompressedTexImage2D(GL_TEXTURE_2D, i, internal_format, level.width, level.height, 0, (GLsizei)level.data.size(), data);
+    }
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (int)texture.levels.size() - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+    return texture_id;
+}
+
+size_t TextureStreamer::DecodedImage::size() const
+{
+    if (!compressed.levels.empty())
+        return compressed.size();
+
+    return image.pixels.size();
+}
+
+bool TextureStreamer::done() const
+{
+    return m_uploaded_count == m_requested_count;
+}
+
+int TextureStreamer::requested_count() const
+{
+    return m_requested_count;
+}
+
+int TextureStreamer::uploaded_count() const
+{
+    return m_uploaded_count;
+}
+
+size_t TextureStreamer::uploaded_bytes() const
+{
+    return m_uploaded_bytes;
+}
+
+int TextureStreamer::compressed_count() const
+{
+    return m_compressed_count;
+}
+
+int TextureStreamer::missing_cache_count() const
+{
+    return m_missing_cache_count;
+}
+
+size_t TextureStreamer::texture_memory() const
+{
+    return m_texture_memory;
+}
+
+float TextureStreamer::load_time() const
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(m_last_upload_time - m_first_request_time).count() / 1000.0f;
+}
@@ -0,0 +1,158 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include "GL/glew.h"
+
+#include "image_io.h"
+#include "tutos/ktx2/ktx2_bake.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Loads textures in the background while the application is already rendering.
+ *
+ * The image files are decoded by a pool of worker threads. If the image has an up to date
+ * KTX2 cache (see bake_textures and ktx2_bake.h), the worker reads the block compressed
+ * levels of the cache instead: no decode, no glGenerateMipmap() and 4 to 8 times less
+ * memory than RGBA8. The decoded images are
+ * uploaded by the OpenGL thread, in upload(), called once per frame: the pixels are copied
+ * into a ring of persistently mapped pixel unpack buffers and the textures are created
+ * from these buffers. At most 'frame_upload_budget' bytes are uploaded each frame so that
+ * the streaming doesn't cause a hitch. Each frame uses its own part of the ring, protected
+ * by a fence: if the GPU hasn't finished reading it, the upload is simply delayed to the
+ * next frame, the OpenGL thread never waits.
+ *
+ * An image larger than the budget is uploaded alone, directly from its decoded pixels.
+ * The same path is used for all the images if persistent buffers aren't supported
+ * (GL_ARB_buffer_storage).
+ *
+ * The texture id is written in the GLuint given to request() once the texture has been
+ * uploaded, the value of that GLuint (a default texture) is used until then.
+ */
+class TextureStreamer
+{
+public:
+    inline static const size_t DEFAULT_FRAME_UPLOAD_BUDGET = 16 * 1024 * 1024;
+    inline static const int RING_FRAMES = 3;
+
+    /**
+     * @param worker_count Number of decode threads. 0 for one thread per core minus the OpenGL thread
+     */
+    TextureStreamer(int worker_count = 0, size_t frame_upload_budget = DEFAULT_FRAME_UPLOAD_BUDGET);
+    ~TextureStreamer();
+
+    /**
+     * Creates the unpack buffers. Needs a current OpenGL context
+     */
+    void init();
+    /**
+     * Deletes the unpack buffers and the fences. The textures stay valid
+     */
+    void release();
+
+    /**
+     * Queues the decode of the image 'filename'.
+     *
+     * @param internal_format Format of the texture, GL_SRGB_ALPHA, GL_RGB, ... if the image
+     * has no KTX2 cache
+     * @param usage Usage the KTX2 cache must have been baked for
+     * @param target Receives the id of the texture once it has been uploaded. Must stay valid
+     * until the texture has been uploaded (done() returns true)
+     */
+    void request(const std::string& filename, GLint internal_format, KTX2Usage usage, GLuint* target);
+
+    /**
+     * Creates the textures of the decoded images, within the byte budget of the frame.
+     * Must be called by the OpenGL thread, once per frame.
+     *
+     * @return The number of textures created
+     */
+    int upload();
+
+    /**
+     * @return True when all the requested textures have been uploaded (or failed to load)
+     */
+    bool done() const;
+
+    int requested_count() const;
+    int uploaded_count() const;
+    size_t uploaded_bytes() const;
+    /**
+     * @return The number of textures loaded from their KTX2 cache
+     */
+    int compressed_count() const;
+    /**
+     * @return The number of images loaded without a KTX2 cache, bake_textures creates the caches
+     */
+    int missing_cache_count() const;
+    /**
+     * @return An estimation of the video memory used by the textures, mipmaps included, in bytes
+     */
+    size_t texture_memory() const;
+    /**
+     * @return The time between the first request and the upload of the last texture, in milliseconds
+     */
+    float load_time() const;
+
+private:
+    struct Request
+    {
+        std::string filename;
+        GLint internal_format;
+        KTX2Usage usage;
+        GLuint* target;
+    };
+
+    struct DecodedImage
+    {
+        Request request;
+        //Either the decoded image or the levels of the KTX2 cache
+        ImageData image;
+        KTX2Texture compressed;
+
+        size_t size() const;
+    };
+
+    void worker_function();
+    GLuint create_texture(const DecodedImage& decoded, const void* pixels);
+    /**
+     * @param unpack_offset Offset of the levels, stored one after the other, in the bound
+     * unpack buffer. -1 to upload the levels from the memory of 'texture'
+     */
+    GLuint create_compressed_texture(const KTX2Texture& texture, ptrdiff_t unpack_offset);
+
+    std::vector<std::thread> m_workers;
+    bool m_stop = false;
+
+    //Requests not decoded yet and images not uploaded yet, protected by m_mutex
+    mutable std::mutex m_mutex;
+    std::condition_variable m_request_condition;
+    std::deque<Request> m_requests;
+    std::deque<DecodedImage> m_decoded_images;
+
+    size_t m_frame_upload_budget;
+    //RING_FRAMES parts of m_frame_upload_budget bytes
+    GLuint m_unpack_buffer = 0;
+    unsigned char* m_unpack_buffer_mapping = nullptr;
+    GLsync m_fences[RING_FRAMES] = { 0 };
+    int m_ring_index = 0;
+
+    int m_requested_count = 0;
+    int m_uploaded_count = 0;
+    size_t m_uploaded_bytes = 0;
+    int m_compressed_count = 0;
+    size_t m_texture_memory = 0;
+    //Written by the workers
+    std::atomic<int> m_missing_cache_count = 0;
+    std::chrono::high_resolution_clock::time_point m_first_request_time;
+    std::chrono::high_resolution_clock::time_point m_last_upload_time;
+};
+
+#endif
@@ -2,14 +2,18 @@
 //! \file tuto7_camera.cpp reprise de tuto7.cpp mais en derivant AppCamera, avec gestion automatique d'une camera.
 
 #include "wavefront.h"
+#include "wavefront_fast.h"
 #include "texture.h"
 
 #include "app_camera.h"
 #include "draw.h"
+#include "mesh_cache.h"
+#include "mesh_optimizer.h"
 #include "image_hdr.h"
 #include "orbiter.h"
 #include "text.h"
 #include "uniforms.h"
+#include "vertex_format.h"
 
 #include "application_settings.h"
 #include "application_timer.h"
@@ -29,8 +33,10 @@ TP2::TP2(const CommandlineArguments& commandline_arguments) : AppCamera(1280, 72
 int TP2::get_window_width() { return window_width(); }
 int TP2::get_window_height() { return window_height(); }
 
-int TP2::mesh_groups_count() { return m_mesh_triangles_group.size(); }
+int TP2::mesh_groups_count() { return m_cull_objects.size(); }
 int TP2::mesh_groups_drawn() { return m_mesh_groups_drawn; }
+int TP2::culling_cpu_time() { return m_culling_cpu_time; }
+int TP2::blocking_readbacks() { return m_blocking_readbacks; }
 
 int TP2::prerender()
 {
@@ -112,15 +118,155 @@ int TP2::postrender()
 {
     m_app_timer.postrender();
 
+    if (m_time_to_first_frame == 0.0f)
+    {
+        auto stop = std::chrono::high_resolution_clock::now();
+        m_time_to_first_frame = std::chrono::duration_cast<std::chrono::microseconds>(stop - m_init_start_time).count() / 1000.0f;
+
+        std::cout << "Time to first frame: " << m_time_to_first_frame << "ms" << std::endl;
+    }
+
     return 0;
 }
 
 void TP2::update_ambient_uniforms()
 {
     glUseProgram(m_texture_shadow_cook_torrance_shader);
+    program_uniform(m_uniforms.use_irradiance_map, m_application_settings.use_irradiance_map && m_environment_ready);
+}
+
+void TP2::update_frame_uniforms(const Transform& vp_matrix, const Transform& vp_matrix_inverse)
+{
+    Transform viewport_matrix = m_camera.viewport();
+
+    m_frame_uniforms.vp_matrix = vp_matrix;
+    m_frame_uniforms.mvpv_matrix = viewport_matrix * vp_matrix;
+    m_frame_uniforms.inverse_matrix = (viewport_matrix * vp_matrix).inverse();
+    m_frame_uniforms.view_matrix = m_camera.view();
+    m_frame_uniforms.lp_matrix = m_lp_light_transform;
+
+    //Corners of the frustum in world space for the frustum culling
+    std::array<vec4, 8> frustum_points_projective_space
+    {
+        vec4(-1, -1, -1, 1),
+                vec4(1, -1, -1, 1),
+                vec4(-1, 1, -1, 1),
+                vec4(1, 1, -1, 1),
+                vec4(-1, -1, 1, 1),
+                vec4(1, -1, 1, 1),
+                vec4(-1, 1, 1, 1),
+                vec4(1, 1, 1, 1)
+    };
+
+    for (int i = 0; i < 8; i++)
+    {
+        vec4 point = vp_matrix_inverse(frustum_points_projective_space[i]);
+
+        if (point.w != 0)
+            m_frame_uniforms.frustum_world_space_vertices[i] = vec4(point.x / point.w, point.y / point.w, point.z / point.w, 1);
+    }
+
+    Point camera_position = m_camera.position();
+    m_frame_uniforms.camera_position = vec3(camera_position.x, camera_position.y, camera_position.z);
+    m_frame_uniforms.exposure = m_application_settings.hdr_exposure;
+    m_frame_uniforms.light_direction = vec3(m_light_direction.x, m_light_direction.y, m_light_direction.z);
+    m_frame_uniforms.shadow_intensity = m_application_settings.shadow_intensity;
+    m_frame_uniforms.light_intensity = vec3(m_light_intensity.x, m_light_intensity.y, m_light_intensity.z);
+    m_frame_uniforms.lod_projection_scale = lod_projection_scale();
+    m_frame_uniforms.lod_threshold = m_application_settings.lod_error_threshold;
+    m_frame_uniforms.nb_mipmaps = m_z_buffer_mipmaps_count;
+    m_frame_uniforms.backface_culling = m_application_settings.backface_culling;
+    m_frame_uniforms.lod_selection = m_application_settings.lod_selection;
+
+    //The whole block in one upload, the buffer stays bound to FRAME_UNIFORMS_BINDING
+    glBindBuffer(GL_UNIFORM_BUFFER, m_frame_uniforms_buffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &m_frame_uniforms);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void TP2::init_program_uniforms()
+{
+    //All the programs read the per-frame uniforms from the same buffer
+    for (GLuint program : { m_texture_shadow_cook_torrance_shader, m_shadow_map_program, m_cubemap_shader,
+                            m_fullscreen_quad_texture_hdr_exposure_shader, m_frustum_culling_shader, m_occlusion_culling_shader,
+                            m_two_phase_frustum_culling_shader, m_two_phase_occlusion_culling_shader })
+        program_uniform_block(program, "FrameUniforms", TP2::FRAME_UNIFORMS_BINDING);
+
+    glGenBuffers(1, &m_frame_uniforms_buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, m_frame_uniforms_buffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, TP2::FRAME_UNIFORMS_BINDING, m_frame_uniforms_buffer);
+
+    m_uniforms.use_irradiance_map = program_uniform_handle(m_texture_shadow_cook_torrance_shader, "u_use_irradiance_map");
+    m_uniforms.has_normal_map = program_uniform_handle(m_texture_shadow_cook_torrance_shader, "u_has_normal_map");
+    m_uniforms.do_normal_mapping = program_uniform_handle(m_texture_shadow_cook_torrance_shader, "u_do_normal_mapping");
+    m_uniforms.override_material = program_uniform_handle(m_texture_shadow_cook_torrance_shader, "u_override_material");
+    m_uniforms.metalness = program_uniform_handle(m_texture_shadow_cook_torrance_shader, "u_metalness");
+    m_uniforms.roughness = program_uniform_handle(m_texture_shadow_cook_torrance_shader, "u_roughness");
+    m_uniforms.use_cubemap = program_uniform_handle(m_cubemap_shader, "u_use_cubemap");
+    m_uniforms.fullscreen_quad_texture = program_uniform_handle(m_fullscreen_quad_texture_shader, "u_texture");
+    m_uniforms.nb_objects_to_cull = program_uniform_handle(m_occlusion_culling_shader, "u_nb_objects_to_cull");
+
+    //The texture units never change, the samplers are only set once
+    glUseProgram(m_texture_shadow_cook_torrance_shader);
+    //The irradiance map is enabled once it has been precomputed, see update_asset_streaming()
+    program_uniform(m_uniforms.use_irradiance_map, m_application_settings.use_irradiance_map && m_environment_ready);
+    program_uniform(m_texture_shadow_cook_torrance_shader, "u_model_matrix", Identity());
+    program_uniform(m_texture_shadow_cook_torrance_shader, "u_mesh_base_color_texture", TP2::TRIANGLE_GROUP_BASE_COLOR_TEXTURE_UNIT);
+    program_uniform(m_texture_shadow_cook_torrance_shader, "u_mesh_specular_texture", TP2::TRIANGLE_GROUP_SPECULAR_TEXTURE_UNIT);
+    program_uniform(m_texture_shadow_cook_torrance_shader, "u_mesh_normal_map", TP2::TRIANGLE_GROUP_NORMAL_MAP_UNIT);
+    program_uniform(m_texture_shadow_cook_torrance_shader, "u_irradiance_map", TP2::DIFFUSE_IRRADIANCE_MAP_UNIT);
+    program_uniform(m_texture_shadow_cook_torrance_shader, "u_shadow_map", TP2::SHADOW_MAP_UNIT);
+
+    glUseProgram(m_cubemap_shader);
+    program_uniform(m_cubemap_shader, "u_cubemap", TP2::SKYBOX_UNIT);
+    program_uniform(m_cubemap_shader, "u_skysphere", TP2::SKYSPHERE_UNIT);
+
+    glUseProgram(m_fullscreen_quad_texture_hdr_exposure_shader);
+    program_uniform(m_fullscreen_quad_texture_hdr_exposure_shader, "u_texture", TP2::FULLSCREEN_QUAD_TEXTURE_UNIT);
+
+    //Z-buffer on the texture unit 0 and its hierarchical mipmaps on the unit 1, see bind_z_buffer_mipmaps()
+    for (GLuint program : { m_occlusion_culling_shader, m_two_phase_occlusion_culling_shader })
+    {
+        glUseProgram(program);
+        program_uniform(program, "u_z_buffer_mipmap0", 0);
+        program_uniform(program, "u_z_buffer_mipmaps1", 1);
+    }
 
-    GLuint use_irradiance_map_location = glGetUniformLocation(m_texture_shadow_cook_torrance_shader, "u_use_irradiance_map");
-    glUniform1i(use_irradiance_map_location, m_application_settings.use_irradiance_map);
+    glUseProgram(m_texture_shadow_cook_torrance_shader);
+}
+
+void TP2::update_asset_streaming()
+{
+    m_texture_streamer.upload();
+
+    if (!m_environment_ready && m_environment_future.valid()
+        && m_environment_future.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+    {
+        EnvironmentData environment = m_environment_future.get();
+
+        m_cubemap = Utils::create_cubemap_texture_from_data(environment.cubemap);
+        m_skysphere = Utils::create_skysphere_texture_hdr(environment.skysphere, TP2::SKYSPHERE_UNIT);
+        m_irradiance_map = Utils::create_skysphere_texture_hdr(environment.irradiance_map, TP2::DIFFUSE_IRRADIANCE_MAP_UNIT);
+
+        m_environment_ready = true;
+        update_ambient_uniforms();
+    }
+
+    if (m_total_load_time == 0.0f && m_environment_ready && m_texture_streamer.done())
+    {
+        auto stop = std::chrono::high_resolution_clock::now();
+        m_total_load_time = std::chrono::duration_cast<std::chrono::microseconds>(stop - m_init_start_time).count() / 1000.0f;
+
+        std::cout << "All assets loaded " << m_total_load_time << "ms after the beginning of init(): " << m_texture_streamer.uploaded_count() << " textures, "
+            << m_texture_streamer.uploaded_bytes() / (1024 * 1024) << "MB streamed in " << m_texture_streamer.load_time() << "ms, "
+            << m_texture_streamer.texture_memory() / (1024 * 1024) << "MB of textures" << std::endl;
+
+        if (m_texture_streamer.missing_cache_count() > 0)
+            std::cout << m_texture_streamer.missing_cache_count() << " textures have no KTX2 cache and were decoded and mipmapped at runtime, "
+                "run 'bake_textures " << m_commandline_arguments.obj_file_path << "' to compress them" << std::endl;
+    }
 }
 
 GLuint TP2::create_opengl_texture(std::string& filepath, int GL_tex_format, float anisotropy)
@@ -185,7 +331,7 @@ void TP2::compute_bounding_boxes_of_groups(std::vector<TriangleGroup>& groups)
     vec3 init_min_bbox = vec3(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
     vec3 init_max_bbox = vec3(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max());
 
-    m_cull_objects.resize(groups.size());
+    m_group_cull_objects.resize(groups.size());
 
 #pragma omp parallel for schedule(dynamic)
     for (int group_index = 0; group_index < groups.size(); group_index++)
@@ -197,9 +343,9 @@ void TP2::compute_bounding_boxes_of_groups(std::vector<TriangleGroup>& groups)
         for (int pos = group.first; pos < group.first + group.n; pos += 3)
         {
             vec3 a, b, c;
-            a = m_mesh.positions()[pos + 0];
-            b = m_mesh.positions()[pos + 1];
-            c = m_mesh.positions()[pos + 2];
+            a = m_mesh.positions()[m_mesh.indices()[pos + 0]];
+            b = m_mesh.positions()[m_mesh.indices()[pos + 1]];
+            c = m_mesh.positions()[m_mesh.indices()[pos + 2]];
 
             cull_object.min = min(cull_object.min, a);
             cull_object.min = min(cull_object.min, b);
@@ -210,11 +356,133 @@ void TP2::compute_bounding_boxes_of_groups(std::vector<TriangleGroup>& groups)
             cull_object.max = max(cull_object.max, c);
         }
 
-        cull_object.vertex_base = group.first;
-        cull_object.vertex_count = group.n;
+        cull_object.first_index = group.first;
+        cull_object.index_count = group.n;
+
+        m_group_cull_objects[group_index] = cull_object;
+    }
+}
+
+void TP2::compute_cull_objects_of_clusters()
+{
+    m_cull_objects.resize(m_mesh_clusters.size());
+    m_frustum_culler.resize(m_mesh_clusters.size());
+
+    for (int cluster_index = 0; cluster_index < int(m_mesh_clusters.size()); cluster_index++)
+    {
+        const MeshCluster& cluster = m_mesh_clusters[cluster_index];
+
+        CullObject cull_object{ cluster.min, (unsigned int)cluster.first, cluster.max, (unsigned int)cluster.n };
 
-        m_cull_objects[group_index] = cull_object;
+        m_cull_objects[cluster_index] = cull_object;
+        m_frustum_culler.set_object(cluster_index, cull_object.min, cull_object.max, cull_object.first_index, cull_object.index_count);
     }
+
+    m_culling_bvh.build(m_cull_objects);
+}
+
+void TP2::add_lod_clusters(LODChain& lod_chain)
+{
+    m_base_triangle_count = m_mesh.triangle_count();
+
+    //Errors of the levels of each group, the full resolution level has no error
+    std::vector<std::array<float, LODBuilder::MAX_LEVELS + 2>> group_errors(m_mesh_triangles_group.size());
+    std::vector<std::array<int, LODBuilder::MAX_LEVELS + 1>> group_triangle_counts(m_mesh_triangles_group.size());
+    for (int group_index = 0; group_index < int(m_mesh_triangles_group.size()); group_index++)
+    {
+        group_errors[group_index].fill(TP2::NO_COARSER_LOD_ERROR);
+        group_errors[group_index][0] = 0.0f;
+        group_triangle_counts[group_index].fill(0);
+        group_triangle_counts[group_index][0] = m_mesh_triangles_group[group_index].n / 3;
+    }
+    for (const MeshLOD& lod : lod_chain.lods)
+    {
+        group_errors[lod.group][lod.level] = lod.error;
+        group_triangle_counts[lod.group][lod.level] = lod.n / 3;
+    }
+
+    //Clustering the levels the same way as the full resolution groups, each level is a group of its own
+    std::vector<MeshCluster> lod_clusters;
+    if (!lod_chain.lods.empty())
+    {
+        //The materials of the triangles must be given for the reordering of the triangles done by the clustering
+        std::vector<unsigned int> lod_materials(lod_chain.indices.size() / 3);
+        std::vector<TriangleGroup> lod_groups(lod_chain.lods.size());
+        for (int lod_index = 0; lod_index < int(lod_chain.lods.size()); lod_index++)
+        {
+            const MeshLOD& lod = lod_chain.lods[lod_index];
+
+            lod_groups[lod_index] = TriangleGroup{ lod_index, lod.first, lod.n };
+            std::fill(lod_materials.begin() + lod.first / 3, lod_materials.begin() + (lod.first + lod.n) / 3, m_mesh_triangles_group[lod.group].index);
+        }
+
+        Mesh lod_mesh(GL_TRIANGLES);
+        lod_mesh.assign(std::move(lod_chain.positions), std::move(lod_chain.texcoords), std::move(lod_chain.normals), {}, std::move(lod_chain.indices), std::move(lod_materials));
+        lod_clusters = ClusterBuilder::build(lod_mesh, lod_groups);
+
+        //The triangles of the levels are drawn from the same buffers as the full resolution mesh
+        std::vector<vec3> positions = m_mesh.positions();
+        std::vector<vec2> texcoords = m_mesh.texcoords();
+        std::vector<vec3> normals = m_mesh.normals();
+        std::vector<vec4> colors = m_mesh.colors();
+        std::vector<unsigned int> indices = m_mesh.indices();
+        std::vector<unsigned int> materials = m_mesh.material_indices();
+
+        int base_vertex_count = positions.size();
+        int base_index_count = indices.size();
+        positions.insert(positions.end(), lod_mesh.positions().begin(), lod_mesh.positions().end());
+        if (!texcoords.empty())
+            texcoords.insert(texcoords.end(), lod_mesh.texcoords().begin(), lod_mesh.texcoords().end());
+        if (!normals.empty())
+            normals.insert(normals.end(), lod_mesh.normals().begin(), lod_mesh.normals().end());
+        if (!colors.empty())
+            colors.resize(positions.size(), vec4(1, 1, 1, 1));
+        for (unsigned int index : lod_mesh.indices())
+            indices.push_back(base_vertex_count + index);
+        materials.insert(materials.end(), lod_mesh.material_indices().begin(), lod_mesh.material_indices().end());
+
+        m_mesh.assign(std::move(positions), std::move(texcoords), std::move(normals), std::move(colors), std::move(indices), std::move(materials));
+
+        for (MeshCluster& cluster : lod_clusters)
+            cluster.first += base_index_count;
+    }
+
+    //Level of detail of all the clusters, full resolution ones first
+    int base_cluster_count = m_mesh_clusters.size();
+    m_cluster_lods.resize(base_cluster_count + lod_clusters.size());
+    for (int cluster_index = 0; cluster_index < int(m_cluster_lods.size()); cluster_index++)
+    {
+        int group = 0;
+        int level = 0;
+        if (cluster_index < base_cluster_count)
+            group = m_mesh_clusters[cluster_index].group;
+        else
+        {
+            //The clusters of the levels belong to the full resolution group for the culling and the metrics
+            MeshCluster& cluster = lod_clusters[cluster_index - base_cluster_count];
+            const MeshLOD& lod = lod_chain.lods[cluster.group];
+
+            group = lod.group;
+            level = lod.level;
+            cluster.group = group;
+        }
+
+        //The same bounding sphere for all the levels of a group so that
+        //the selection of the level is consistent between the clusters of the group
+        const CullObject& group_bounds = m_group_cull_objects[group];
+        Point center = ::center(Point(group_bounds.min), Point(group_bounds.max));
+        float radius = distance(Point(group_bounds.min), Point(group_bounds.max)) * 0.5f;
+
+        ClusterLOD& cluster_lod = m_cluster_lods[cluster_index];
+        cluster_lod.center = center;
+        cluster_lod.radius = radius;
+        cluster_lod.error = group_errors[group][level];
+        cluster_lod.coarser_error = group_errors[group][level + 1];
+        cluster_lod.level = level;
+        cluster_lod.full_resolution_ratio = (float)group_triangle_counts[group][0] / group_triangle_counts[group][level];
+    }
+
+    m_mesh_clusters.insert(m_mesh_clusters.end(), lod_clusters.begin(), lod_clusters.end());
 }
 
 bool TP2::rejection_test_bbox_frustum_culling(const TP2::CullObject& object, const Transform& mvpMatrix)
@@ -331,8 +599,10 @@ bool TP2::rejection_test_bbox_frustum_culling_scene(const CullObject& object, co
     return false;
 }
 
-bool TP2::occlusion_cull_cpu(const Transform& mvpv_matrix, CullObject& object, int depth_buffer_width, int depth_buffer_height, const std::vector<std::vector<float> >& z_buffer_mipmaps, const std::vector<std::pair<int, int>>& mipmaps_widths_heights)
+bool TP2::occlusion_cull_cpu(const Transform& mvpv_matrix, CullObject& object, const HiZPyramid& z_buffer_pyramid)
 {
+    int depth_buffer_width = z_buffer_pyramid.width();
+    int depth_buffer_height = z_buffer_pyramid.height();
     Point screen_space_bbox_min, screen_space_bbox_max;
     float nearest_depth;
 
@@ -369,23 +639,27 @@ bool TP2::occlusion_cull_cpu(const Transform& mvpv_matrix, CullObject& object, i
         mipmap_level = std::log2(std::ceil(largest_extent / 4.0f));
     else //The extent of the bounding rectangle already is small enough
         ;
-    mipmap_level = std::min(mipmap_level, (int)z_buffer_mipmaps.size() - 1);
+    mipmap_level = std::min(mipmap_level, z_buffer_pyramid.level_count() - 1);
     int reduction_factor = std::pow(2, mipmap_level);
     float reduction_factor_inverse = 1.0f / reduction_factor;
 
-    const std::vector<float>& mipmap = z_buffer_mipmaps[mipmap_level];
+    const float* mipmap = z_buffer_pyramid.level(mipmap_level);
+    int mipmap_width = z_buffer_pyramid.width(mipmap_level);
+    int mipmap_height = z_buffer_pyramid.height(mipmap_level);
 
+    //The pixels beyond the last texel of the level are covered by the last texel,
+    //see HiZPyramid, clamping keeps the test conservative
     bool one_pixel_visible = false;
-    int min_y = std::min((int)std::floor(screen_space_bbox_min.y * reduction_factor_inverse), mipmaps_widths_heights[mipmap_level].second - 1);
-    int max_y = std::min((int)std::ceil(screen_space_bbox_max.y * reduction_factor_inverse), mipmaps_widths_heights[mipmap_level].second - 1);
-    int min_x = std::min((int)std::floor(screen_space_bbox_min.x * reduction_factor_inverse), mipmaps_widths_heights[mipmap_level].first - 1);
-    int max_x = std::min((int)std::ceil(screen_space_bbox_max.x * reduction_factor_inverse), mipmaps_widths_heights[mipmap_level].first - 1);
+    int min_y = std::min((int)std::floor(screen_space_bbox_min.y * reduction_factor_inverse), mipmap_height - 1);
+    int max_y = std::min((int)std::ceil(screen_space_bbox_max.y * reduction_factor_inverse), mipmap_height - 1);
+    int min_x = std::min((int)std::floor(screen_space_bbox_min.x * reduction_factor_inverse), mipmap_width - 1);
+    int max_x = std::min((int)std::ceil(screen_space_bbox_max.x * reduction_factor_inverse), mipmap_width - 1);
 
     for (int y = min_y; y <= max_y; y++)
     {
         for (int x = min_x; x <= max_x; x++)
         {
-            float depth_buffer_depth = mipmap[x + y * mipmaps_widths_heights[mipmap_level].first];
+            float depth_buffer_depth = mipmap[x + y * mipmap_width];
 
             if (depth_buffer_depth >= nearest_depth)
             {
@@ -403,32 +677,33 @@ bool TP2::occlusion_cull_cpu(const Transform& mvpv_matrix, CullObject& object, i
     return !one_pixel_visible;
 }
 
-void TP2::occlusion_cull_gpu(const Transform& mvp_matrix, const Transform& view_matrix, const Transform& viewport_matrix, GLuint object_ids_to_cull_buffer, int number_of_objects_to_cull)
+void TP2::bind_z_buffer_mipmaps()
 {
-    std::vector<unsigned int> init(m_mesh_triangles_group.size(), -1);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_culling_passing_ids);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(unsigned int) * m_mesh_triangles_group.size(), init.data(), GL_DYNAMIC_DRAW);
-    //256.0f is the hardcoded number of threads per group of the occlusion culling compute shader
-    int nb_groups = std::ceil(number_of_objects_to_cull / 256.0f);
-    if (nb_groups == 0) //No objects to cull
-        return;
-
-    glUseProgram(m_occlusion_culling_shader);
-    glUniformMatrix4fv(glGetUniformLocation(m_occlusion_culling_shader, "u_mvp_matrix"), 1, GL_TRUE, mvp_matrix.data());
-    glUniformMatrix4fv(glGetUniformLocation(m_occlusion_culling_shader, "u_mvpv_matrix"), 1, GL_TRUE, (viewport_matrix * mvp_matrix).data());
-    glUniformMatrix4fv(glGetUniformLocation(m_occlusion_culling_shader, "u_view_matrix"), 1, GL_TRUE, view_matrix.data());
-    glUniform1i(glGetUniformLocation(m_occlusion_culling_shader, "u_nb_mipmaps"), m_z_buffer_mipmaps_count);
-    glUniform1i(glGetUniformLocation(m_occlusion_culling_shader, "u_nb_objects_to_cull"), number_of_objects_to_cull);
+    //The matrices and the number of mipmaps are in the per-frame uniforms, see update_frame_uniforms()
 
     // Binding the z-buffer depth texture to the texture unit 0
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, m_hdr_depth_buffer_texture);
-    glUniform1i(glGetUniformLocation(m_occlusion_culling_shader, "u_z_buffer_mipmap0"), 0);
 
     // Binding the hierarchical z-buffer texture to the texture unit 1
     glActiveTexture(GL_TEXTURE1);
     glBindTexture(GL_TEXTURE_2D, m_z_buffer_mipmaps_texture);
-    glUniform1i(glGetUniformLocation(m_occlusion_culling_shader, "u_z_buffer_mipmaps1"), 1);
+}
+
+void TP2::occlusion_cull_gpu(GLuint object_ids_to_cull_buffer, int number_of_objects_to_cull)
+{
+    //Filled on the GPU, no upload of a whole buffer from the CPU
+    unsigned int no_object = (unsigned int)-1;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_culling_passing_ids);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &no_object);
+    //256.0f is the hardcoded number of threads per group of the occlusion culling compute shader
+    int nb_groups = std::ceil(number_of_objects_to_cull / 256.0f);
+    if (nb_groups == 0) //No objects to cull
+        return;
+
+    glUseProgram(m_occlusion_culling_shader);
+    bind_z_buffer_mipmaps();
+    program_uniform(m_uniforms.nb_objects_to_cull, number_of_objects_to_cull);
 
     // Input buffer : the ids of the objects that will be tested for occlusion culling against the current z-buffer
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, object_ids_to_cull_buffer);
@@ -451,6 +726,8 @@ void TP2::occlusion_cull_gpu(const Transform& mvp_matrix, const Transform& view_
 
 int TP2::init()
 {
+    m_init_start_time = std::chrono::high_resolution_clock::now();
+
     //Setting ImGUI up
     ImGui::CreateContext();
 
@@ -476,8 +753,18 @@ int TP2::init()
     }
     m_lp_light_transform = TP2::LIGHT_CAMERA_ORTHO_PROJ_BISTRO * m_light_camera.view();
 
-    //Reading the mesh displayed
-    TIME(m_mesh = read_mesh(m_commandline_arguments.obj_file_path.c_str()), "Load OBJ Time: ");
+    //Reading the mesh displayed. The binary cache written next to the OBJ file already
+    //contains the triangles sorted by material so we only parse the OBJ if the cache is missing or out of date.
+    //The mesh is indexed: the vertices shared by the triangles are only stored and transformed once
+    const char* obj_file_path = m_commandline_arguments.obj_file_path.c_str();
+    TIME(
+        if (!read_mesh_cache(obj_file_path, m_mesh, m_mesh_triangles_group))
+        {
+            m_mesh = read_indexed_mesh_fast_parallel(obj_file_path);
+            m_mesh_triangles_group = m_mesh.groups();
+            if (m_mesh.positions().size() > 0)
+                write_mesh_cache(obj_file_path, m_mesh, m_mesh_triangles_group);
+        }, "Load OBJ Time: ");
     if (m_mesh.positions().size() == 0)
     {
         std::cout << "The read mesh has 0 positions. Either the mesh file is incorrect or the mesh file wasn't found (incorrect path)" << std::endl;
@@ -486,6 +773,21 @@ int TP2::init()
         std::exit(-1);
     }
 
+    //Splitting the triangle groups in small clusters that are culled and drawn instead of the
+    //whole groups. This reorders the triangles of the mesh so it must be done before creating the buffers
+    TIME(m_mesh_clusters = ClusterBuilder::build(m_mesh, m_mesh_triangles_group), "Cluster build time: ");
+    std::cout << m_mesh_clusters.size() << " clusters of at most " << ClusterBuilder::MAX_TRIANGLES << " triangles for " << m_mesh_triangles_group.size() << " triangle groups" << std::endl;
+
+    //Simplified levels of the triangle groups, cached next to the OBJ file like the mesh
+    LODChain lod_chain;
+    TIME(
+        if (!LODBuilder::read_cache(obj_file_path, m_mesh.triangle_count(), lod_chain))
+        {
+            lod_chain = LODBuilder::build(m_mesh, m_mesh_triangles_group);
+            LODBuilder::write_cache(obj_file_path, m_mesh.triangle_count(), lod_chain);
+        }, "LOD build time: ");
+    std::cout << lod_chain.lods.size() << " levels of detail, " << lod_chain.indices.size() / 3 << " simplified triangles" << std::endl;
+
 
     // etat openGL par defaut
     glClearColor(0.2f, 0.2f, 0.2f, 1.f);        // couleur par defaut de la fenetre
@@ -495,175 +797,299 @@ int TP2::init()
     glEnable(GL_DEPTH_TEST);                    // activer le ztest
 
 
-    m_fullscreen_quad_texture_shader = read_program("../data/shaders_tp/shader_fullscreen_quad_texture.glsl");
-    program_print_errors(m_fullscreen_quad_texture_shader);
-
-    m_fullscreen_quad_texture_hdr_exposure_shader = read_program("../data/shaders_tp/shader_fullscreen_quad_texture_hdr_exposure.glsl");
-    program_print_errors(m_fullscreen_quad_texture_hdr_exposure_shader);
-
-    m_texture_shadow_cook_torrance_shader = read_program("../data/shaders_tp/shader_texture_shadow_cook_torrance_shader.glsl");
-    program_print_errors(m_texture_shadow_cook_torrance_shader);
-
-    GLint use_irradiance_map_location = glGetUniformLocation(m_texture_shadow_cook_torrance_shader, "u_use_irradiance_map");
-    glUniform1i(use_irradiance_map_location, m_application_settings.use_irradiance_map);
-
-    GLint base_color_texture_uniform_location = glGetUniformLocation(m_texture_shadow_cook_torrance_shader, "u_mesh_base_color_texture");
-    glUniform1i(base_color_texture_uniform_location, TP2::TRIANGLE_GROUP_BASE_COLOR_TEXTURE_UNIT);
+    //All the programs are dispatched before checking any of them so that the driver can compile them
+    //concurrently (GL_KHR_parallel_shader_compile). Programs that were already linked once are loaded
+    //from their binary cache, see read_program_async()
+    auto shaders_start = std::chrono::high_resolution_clock::now();
 
-    GLint specular_texture_uniform_location = glGetUniformLocation(m_texture_shadow_cook_torrance_shader, "u_mesh_specular_texture");
-    glUniform1i(specular_texture_uniform_location, TP2::TRIANGLE_GROUP_SPECULAR_TEXTURE_UNIT);
+    //The mesh shaders decode the compressed vertex attributes
+    const char* vertex_definitions = m_application_settings.packed_vertices ? "#define USE_PACKED_VERTEX\n" : "";
+    //Both phases of the GPU-resident occlusion culling, cf draw_mdi_two_phase_occlusion_culling()
+    std::string two_phase_definitions = "#define TWO_PHASE\n#define MAX_LOD_LEVELS " + std::to_string(LODBuilder::MAX_LEVELS + 1) + "\n";
 
-    GLint normal_map_uniform_location = glGetUniformLocation(m_texture_shadow_cook_torrance_shader, "u_mesh_normal_map");
-    glUniform1i(normal_map_uniform_location, TP2::TRIANGLE_GROUP_NORMAL_MAP_UNIT);
+    m_fullscreen_quad_texture_shader = read_program_async("../data/shaders_tp/shader_fullscreen_quad_texture.glsl");
+    m_fullscreen_quad_texture_hdr_exposure_shader = read_program_async("../data/shaders_tp/shader_fullscreen_quad_texture_hdr_exposure.glsl");
+    m_texture_shadow_cook_torrance_shader = read_program_async("../data/shaders_tp/shader_texture_shadow_cook_torrance_shader.glsl", vertex_definitions);
+    m_shadow_map_program = read_program_async("../data/shaders_tp/shader_shadow_map.glsl", vertex_definitions);
+    m_cubemap_shader = read_program_async("../data/shaders_tp/shader_cubemap.glsl");
+    m_frustum_culling_shader = read_program_async("../data/shaders_tp/TPCG/frustum_culling.glsl");
+    m_occlusion_culling_shader = read_program_async("../data/shaders_tp/TPCG/occlusion_culling.glsl");
+    m_two_phase_frustum_culling_shader = read_program_async("../data/shaders_tp/TPCG/frustum_culling.glsl", two_phase_definitions.c_str());
+    m_two_phase_occlusion_culling_shader = read_program_async("../data/shaders_tp/TPCG/occlusion_culling.glsl", two_phase_definitions.c_str());
 
-    m_shadow_map_program = read_program("../data/shaders_tp/shader_shadow_map.glsl");
+    //Waits for all the programs to be linked
+    program_print_errors(m_fullscreen_quad_texture_shader);
+    program_print_errors(m_fullscreen_quad_texture_hdr_exposure_shader);
+    program_print_errors(m_texture_shadow_cook_torrance_shader);
     program_print_errors(m_shadow_map_program);
-
-    m_cubemap_shader = read_program("../data/shaders_tp/shader_cubemap.glsl");
     program_print_errors(m_cubemap_shader);
+    program_print_errors(m_frustum_culling_shader);
+    program_print_errors(m_occlusion_culling_shader);
+    program_print_errors(m_two_phase_frustum_culling_shader);
+    program_print_errors(m_two_phase_occlusion_culling_shader);
 
-    //The skysphere is on texture unit 1 so we're using 1 for the value of the uniform
-    GLint skysphere_uniform_location = glGetUniformLocation(m_cubemap_shader, "u_skysphere");
-    glUniform1i(skysphere_uniform_location, 1);
+    auto shaders_stop = std::chrono::high_resolution_clock::now();
+    std::cout << "Shader programs ready in " << std::chrono::duration_cast<std::chrono::microseconds>(shaders_stop - shaders_start).count() / 1000.0f << "ms" << std::endl;
 
-    m_frustum_culling_shader = read_program("../data/shaders_tp/TPCG/frustum_culling.glsl");
-    program_print_errors(m_frustum_culling_shader);
+    //read_program_async() doesn't bind the programs, init_program_uniforms() leaves the mesh program bound
+    init_program_uniforms();
 
-    m_occlusion_culling_shader = read_program("../data/shaders_tp/TPCG/occlusion_culling.glsl");
-    program_print_errors(m_occlusion_culling_shader);
 
 
 
 
+    //Generating the default textures that the triangle groups that don't have texture will use
+    //and that all the groups use until their textures have been streamed
+    unsigned char default_texture_data[3] = { 255, 255, 255 };
+    glGenTextures(1, &m_default_texture);
+    glBindTexture(GL_TEXTURE_2D, m_default_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, default_texture_data);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_REPEAT);
+    glGenerateMipmap(GL_TEXTURE_2D);
 
-    //TODO sur un thread
-    auto start = std::chrono::high_resolution_clock::now();
-    m_mesh_triangles_group = m_mesh.groups();
-    m_mesh_base_color_textures.resize(m_mesh.materials().filename_count());
-    m_mesh_specular_textures.resize(m_mesh.materials().filename_count());
-    m_mesh_normal_maps.resize(m_mesh.materials().filename_count());
+    //The textures are decoded by the workers of the streamer while the rest of init() runs
+    //and uploaded at the beginning of the frames, see update_asset_streaming()
+    m_irradiance_map = m_default_texture;
+    m_texture_streamer.init();
+    int filename_count = m_mesh.materials().filename_count();
+    m_mesh_base_color_textures.assign(filename_count, m_default_texture);
+    m_mesh_specular_textures.assign(filename_count, m_default_texture);
+    m_mesh_normal_maps.assign(filename_count, m_default_texture);
+    //One flag per slot: the same file can be the base color of a material and the specular
+    //texture or the normal map of another one, each slot has its own format and texture
+    std::vector<bool> base_color_requested(filename_count, false);
+    std::vector<bool> specular_requested(filename_count, false);
+    std::vector<bool> normal_map_requested(filename_count, false);
     for (Material& mat : m_mesh.materials().materials)
     {
         int diffuse_texture_index = mat.diffuse_texture;
         int specular_texture_index = mat.specular_texture;
         int normal_map_index = mat.normal_map;
 
-        if (diffuse_texture_index != -1)
+        //A texture shared by multiple materials is only loaded once per slot
+        if (diffuse_texture_index != -1 && !base_color_requested[diffuse_texture_index])
         {
-            GLuint texture_id = create_opengl_texture(m_mesh.materials().texture_filenames[diffuse_texture_index], GL_SRGB_ALPHA);
-            m_mesh_base_color_textures[diffuse_texture_index] = texture_id;
+            m_texture_streamer.request(m_mesh.materials().texture_filenames[diffuse_texture_index], GL_SRGB_ALPHA, KTX2_USAGE_COLOR_SRGB, &m_mesh_base_color_textures[diffuse_texture_index]);
+            base_color_requested[diffuse_texture_index] = true;
         }
-
-        if (specular_texture_index != -1)
+        if (specular_texture_index != -1 && !specular_requested[specular_texture_index])
         {
-            GLuint texture_id = create_opengl_texture(m_mesh.materials().texture_filenames[specular_texture_index], GL_RGB);
-            m_mesh_specular_textures[specular_texture_index] = texture_id;
+            m_texture_streamer.request(m_mesh.materials().texture_filenames[specular_texture_index], GL_RGB, KTX2_USAGE_COLOR_LINEAR, &m_mesh_specular_textures[specular_texture_index]);
+            specular_requested[specular_texture_index] = true;
         }
-
-        if (normal_map_index != -1)
+        if (normal_map_index != -1 && !normal_map_requested[normal_map_index])
         {
-            GLuint texture_id = create_opengl_texture(m_mesh.materials().texture_filenames[normal_map_index], GL_RGB);
-            m_mesh_normal_maps[normal_map_index] = texture_id;
+            m_texture_streamer.request(m_mesh.materials().texture_filenames[normal_map_index], GL_RGB, KTX2_USAGE_NORMAL_MAP, &m_mesh_normal_maps[normal_map_index]);
+            normal_map_requested[normal_map_index] = true;
         }
     }
-    auto stop = std::chrono::high_resolution_clock::now();
-    std::cout << "Texture loading time: " << std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count() << "ms" << std::endl;
-    
+    std::cout << m_texture_streamer.requested_count() << " textures streamed in the background" << std::endl;
+
+    //Reading the faces of the skybox and the skysphere and precomputing the irradiance map
+    //in the background as well, the environment is black until then
+    std::string skysphere_file_path = m_application_settings.irradiance_map_file_path;
+    unsigned int irradiance_samples = m_application_settings.irradiance_map_precomputation_samples;
+    unsigned int irradiance_downscale_factor = m_application_settings.irradiance_map_precomputation_downscale_factor;
+    bool irradiance_use_spherical_harmonics = m_application_settings.irradiance_map_use_spherical_harmonics;
+    m_environment_future = std::async(std::launch::async, [=]()
+    {
+        EnvironmentData environment;
+
+        std::thread load_thread_cubemap = std::thread([&] {environment.cubemap = Utils::read_cubemap_data("../data/skybox", ".jpg"); });
+        std::thread load_thread_skypshere = std::thread([&] {environment.skysphere = Utils::read_skysphere_image(skysphere_file_path.c_str()); });
+        environment.irradiance_map = Utils::precompute_and_load_associated_irradiance(skysphere_file_path.c_str(), irradiance_samples, irradiance_downscale_factor, irradiance_use_spherical_harmonics);
+
+        load_thread_cubemap.join();
+        load_thread_skypshere.join();
+
+        return environment;
+    });
+
     // Bounding boxes of the groups that will be used for the culling
     compute_bounding_boxes_of_groups(m_mesh_triangles_group);
-
-    //Generating the default textures that the triangle groups that don't have texture will use
-    unsigned char default_texture_data[3] = { 255, 255, 255 };
-    glGenTextures(1, &m_default_texture);
-    glBindTexture(GL_TEXTURE_2D, m_default_texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, default_texture_data);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_REPEAT);
-    glGenerateMipmap(GL_TEXTURE_2D);
+    //Appends the triangles of the levels of detail to the mesh, before the creation of the vertex buffers
+    add_lod_clusters(lod_chain);
+
+    //Reordering the triangles of each cluster for the post-transform vertex cache (the clusters are the draws
+    //so they don't move in the index buffer) and then the vertices in the order of the index buffer
+    std::vector<TriangleGroup> cluster_ranges(m_mesh_clusters.size());
+    for (int cluster_index = 0; cluster_index < int(m_mesh_clusters.size()); cluster_index++)
+        cluster_ranges[cluster_index] = TriangleGroup{ cluster_index, m_mesh_clusters[cluster_index].first, m_mesh_clusters[cluster_index].n };
+    VertexCacheStats vertex_cache_before = vertex_cache_stats(m_mesh, cluster_ranges);
+    TIME(optimize_vertex_cache(m_mesh, cluster_ranges); optimize_vertex_fetch(m_mesh), "Vertex cache optimization time: ");
+    VertexCacheStats vertex_cache_after = vertex_cache_stats(m_mesh, cluster_ranges);
+    std::cout << "Vertex cache (FIFO " << VERTEX_CACHE_SIZE << "): ACMR " << vertex_cache_before.acmr << " -> " << vertex_cache_after.acmr
+        << ", ATVR " << vertex_cache_before.atvr << " -> " << vertex_cache_after.atvr << std::endl;
+    compute_cull_objects_of_clusters();
+    m_occluder_groups = OcclusionRasterizer::select_occluders(m_mesh.positions(), m_mesh.indices(), m_mesh_triangles_group, m_application_settings.occluder_triangle_budget);
 
     //Creating the VAO for the mesh that will be displayed
     glGenVertexArrays(1, &m_mesh_vao);
     //Selecting the VAO that we're going to configure
     glBindVertexArray(m_mesh_vao);
 
-    //Creation du position buffer
+    //Creation du vertex buffer
     GLuint mesh_buffer;
     glGenBuffers(1, &mesh_buffer);
-    //On selectionne le position buffer
+    //On selectionne le vertex buffer
     glBindBuffer(GL_ARRAY_BUFFER, mesh_buffer);
-    size_t total_size = m_mesh.normal_buffer_size() + m_mesh.positions().size() * sizeof(vec3) + m_mesh.texcoord_buffer_size();
-    //On definit la taille du buffer selectionne (le position buffer)
-    glBufferData(GL_ARRAY_BUFFER, total_size, nullptr, GL_STATIC_DRAW);
-
-    //Envoie des positions
-    glBufferSubData(GL_ARRAY_BUFFER, 0, m_mesh.positions().size() * sizeof(vec3), m_mesh.positions().data());
-    size_t position_size = m_mesh.positions().size() * sizeof(vec3);
 
-    //Envoie des normales
-    glBufferSubData(GL_ARRAY_BUFFER, position_size, m_mesh.normal_buffer_size(), m_mesh.normal_buffer());
-    size_t normal_size = m_mesh.normal_buffer_size();
+    //Index buffer, stays bound to the VAO
+    GLuint mesh_index_buffer;
+    glGenBuffers(1, &mesh_index_buffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh_index_buffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_mesh.index_buffer_size(), m_mesh.index_buffer(), GL_STATIC_DRAW);
 
-    //Envoie des texcoords
-    glBufferSubData(GL_ARRAY_BUFFER, position_size + normal_size, m_mesh.texcoord_buffer_size(), m_mesh.texcoord_buffer());
-
-
-    glUseProgram(m_texture_shadow_cook_torrance_shader);
     //Setting the id of the attributes (set using layout in the shader)
     GLint position_attribute = glGetAttribLocation(m_texture_shadow_cook_torrance_shader, "position");
     GLint normal_attribute = glGetAttribLocation(m_texture_shadow_cook_torrance_shader, "normal");
     GLint texcoord_attribute = glGetAttribLocation(m_texture_shadow_cook_torrance_shader, "texcoords");
 
-    glVertexAttribPointer(position_attribute, /* size */ 3, /* type */ GL_FLOAT, GL_FALSE, /* stride */ 0, /* offset */ 0);
-    glEnableVertexAttribArray(position_attribute);
-    glVertexAttribPointer(normal_attribute, /* size */ 3, /* type */ GL_FLOAT, GL_FALSE, /* stride */ 0, /* offset */ (GLvoid*)position_size);
-    glEnableVertexAttribArray(normal_attribute);
-    glVertexAttribPointer(texcoord_attribute, /* size */ 2, /* type */ GL_FLOAT, GL_FALSE, /* stride */ 0, /* offset */ (GLvoid*)(position_size + normal_size));
-    glEnableVertexAttribArray(texcoord_attribute);
-
-    //Creating an empty VAO that will be used for the cubemap
-    glGenVertexArrays(1, &m_cubemap_vao);
-
-    //Reading the faces of the skybox and creating the OpenGL Cubemap
-    std::vector<ImageData> cubemap_data;
-    Image skysphere_image, irradiance_map_image;
+    size_t total_size = 0;
+    size_t float_size = m_mesh.normal_buffer_size() + m_mesh.positions().size() * sizeof(vec3) + m_mesh.texcoord_buffer_size();
+    if (m_application_settings.packed_vertices)
+    {
+        //Interleaved compressed attributes, dequantized by the shaders with the
+        //bounding boxes of the positions and of the texcoords of the whole mesh
+        PackedVertexLayout layout = packed_vertex_layout(/* texcoord */ true, /* normal */ true, /* color */ false);
+        VertexQuantization quantization = compute_vertex_quantization(m_mesh);
+        std::vector<unsigned char> vertices = pack_vertices(m_mesh, quantization, layout);
+
+        total_size = vertices.size();
+        glBufferData(GL_ARRAY_BUFFER, total_size, vertices.data(), GL_STATIC_DRAW);
+
+        glVertexAttribPointer(position_attribute, /* size */ 3, /* type */ GL_UNSIGNED_SHORT, GL_TRUE, /* stride */ layout.stride, /* offset */ (GLvoid*)size_t(layout.position));
+        glEnableVertexAttribArray(position_attribute);
+        glVertexAttribPointer(normal_attribute, /* size */ 2, /* type */ GL_BYTE, GL_TRUE, /* stride */ layout.stride, /* offset */ (GLvoid*)size_t(layout.normal));
+        glEnableVertexAttribArray(normal_attribute);
+        glVertexAttribPointer(texcoord_attribute, /* size */ 2, /* type */ GL_UNSIGNED_SHORT, GL_TRUE, /* stride */ layout.stride, /* offset */ (GLvoid*)size_t(layout.texcoord));
+        glEnableVertexAttribArray(texcoord_attribute);
+
+        for (GLuint program : { m_texture_shadow_cook_torrance_shader, m_shadow_map_program })
+        {
+            glUseProgram(program);
+            program_uniform(program, "u_position_offset", quantization.position_offset);
+            program_uniform(program, "u_position_scale", quantization.position_scale);
+            //The shadow map program doesn't use the texcoords
+            if (program == m_texture_shadow_cook_torrance_shader)
+            {
+                program_uniform(program, "u_texcoord_offset", quantization.texcoord_offset);
+                program_uniform(program, "u_texcoord_scale", quantization.texcoord_scale);
+            }
+        }
+        glUseProgram(m_texture_shadow_cook_torrance_shader);
 
-    std::thread load_thread_cubemap = std::thread([&] {cubemap_data = Utils::read_cubemap_data("../data/skybox", ".jpg"); });
-    std::thread load_thread_skypshere = std::thread([&] {skysphere_image = Utils::read_skysphere_image(m_application_settings.irradiance_map_file_path.c_str()); });
-    irradiance_map_image = Utils::precompute_and_load_associated_irradiance(m_application_settings.irradiance_map_file_path.c_str(), m_application_settings.irradiance_map_precomputation_samples, m_application_settings.irradiance_map_precomputation_downscale_factor);
+        VertexFormatError error = vertex_format_error(m_mesh);
+        std::cout << "Packed vertices: " << layout.stride << " bytes per vertex instead of " << float_size / m_mesh.positions().size()
+            << ", max error: position " << error.position_max << ", normal " << error.normal_max << " degrees, texcoord " << error.texcoord_max << std::endl;
+    }
+    else
+    {
+        total_size = float_size;
+        //On definit la taille du buffer selectionne (le vertex buffer)
+        glBufferData(GL_ARRAY_BUFFER, total_size, nullptr, GL_STATIC_DRAW);
+
+        //Envoie des positions
+        glBufferSubData(GL_ARRAY_BUFFER, 0, m_mesh.positions().size() * sizeof(vec3), m_mesh.positions().data());
+        size_t position_size = m_mesh.positions().size() * sizeof(vec3);
+
+        //Envoie des normales
+        glBufferSubData(GL_ARRAY_BUFFER, position_size, m_mesh.normal_buffer_size(), m_mesh.normal_buffer());
+        size_t normal_size = m_mesh.normal_buffer_size();
+
+        //Envoie des texcoords
+        glBufferSubData(GL_ARRAY_BUFFER, position_size + normal_size, m_mesh.texcoord_buffer_size(), m_mesh.texcoord_buffer());
+
+        glVertexAttribPointer(position_attribute, /* size */ 3, /* type */ GL_FLOAT, GL_FALSE, /* stride */ 0, /* offset */ 0);
+        glEnableVertexAttribArray(position_attribute);
+        glVertexAttribPointer(normal_attribute, /* size */ 3, /* type */ GL_FLOAT, GL_FALSE, /* stride */ 0, /* offset */ (GLvoid*)position_size);
+        glEnableVertexAttribArray(normal_attribute);
+        glVertexAttribPointer(texcoord_attribute, /* size */ 2, /* type */ GL_FLOAT, GL_FALSE, /* stride */ 0, /* offset */ (GLvoid*)(position_size + normal_size));
+        glEnableVertexAttribArray(texcoord_attribute);
+    }
 
-    load_thread_cubemap.join();
-    load_thread_skypshere.join();
+    m_mesh_vertex_buffer_size = total_size;
+    m_mesh_index_buffer_size = m_mesh.index_buffer_size();
+    //One vertex per corner of each triangle without the indices
+    m_mesh_non_indexed_buffer_size = float_size / m_mesh.positions().size() * m_mesh.index_count();
+    std::cout << "Mesh buffers: " << m_mesh.positions().size() << " vertices, " << m_mesh.index_count() << " indices, "
+        << (m_mesh_vertex_buffer_size + m_mesh_index_buffer_size) / (1024 * 1024) << "MB ("
+        << m_mesh_non_indexed_buffer_size / (1024 * 1024) << "MB without indices and compression)" << std::endl;
 
-    m_cubemap = Utils::create_cubemap_texture_from_data(cubemap_data);
-    m_skysphere = Utils::create_skysphere_texture_hdr(skysphere_image, TP2::SKYSPHERE_UNIT);
-    m_irradiance_map = Utils::create_skysphere_texture_hdr(irradiance_map_image, TP2::DIFFUSE_IRRADIANCE_MAP_UNIT);
+    //Creating an empty VAO that will be used for the cubemap
+    glGenVertexArrays(1, &m_cubemap_vao);
 
     // ---------- Preparing for multi-draw indirect: ---------- //
     glUseProgram(m_frustum_culling_shader);
 
     glGenBuffers(1, &m_mdi_draw_params_buffer);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_mdi_draw_params_buffer);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(TP2::MultiDrawIndirectParam) * m_mesh_triangles_group.size(), nullptr, GL_DYNAMIC_DRAW);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(TP2::MultiDrawIndirectParam) * m_cull_objects.size(), nullptr, GL_DYNAMIC_DRAW);
 
     glGenBuffers(1, &m_culling_objects_id_to_draw);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_culling_objects_id_to_draw);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(unsigned int)* m_mesh_triangles_group.size(), nullptr, GL_DYNAMIC_DRAW);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(unsigned int)* m_cull_objects.size(), nullptr, GL_DYNAMIC_DRAW);
 
     glGenBuffers(1, &m_culling_passing_ids);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_culling_passing_ids);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(unsigned int)* m_mesh_triangles_group.size(), nullptr, GL_DYNAMIC_DRAW);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(unsigned int)* m_cull_objects.size(), nullptr, GL_DYNAMIC_DRAW);
 
     glGenBuffers(1, &m_culling_input_object_buffer);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_culling_input_object_buffer);
     glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(TP2::CullObject) * m_cull_objects.size(), nullptr, GL_STATIC_DRAW);
     glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(TP2::CullObject) * m_cull_objects.size(), m_cull_objects.data());
 
+    std::vector<TP2::ClusterCone> cluster_cones(m_mesh_clusters.size());
+    for (int i = 0; i < int(m_mesh_clusters.size()); i++)
+        cluster_cones[i] = TP2::ClusterCone{ m_mesh_clusters[i].cone_apex, m_mesh_clusters[i].cone_cutoff, m_mesh_clusters[i].cone_axis, 0.0f };
+
+    glGenBuffers(1, &m_culling_cluster_cones_buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_culling_cluster_cones_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(TP2::ClusterCone) * cluster_cones.size(), cluster_cones.data(), GL_STATIC_DRAW);
+
+    glGenBuffers(1, &m_culling_cluster_lods_buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_culling_cluster_lods_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(TP2::ClusterLOD) * m_cluster_lods.size(), m_cluster_lods.data(), GL_STATIC_DRAW);
+
     glGenBuffers(1, &m_culling_nb_objects_passed_buffer);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_culling_nb_objects_passed_buffer);
     glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(unsigned int), nullptr, GL_DYNAMIC_DRAW);
 
+    //Buffers of the GPU-resident occlusion culling
+    glGenBuffers(1, &m_mdi_phase2_draw_params_buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_mdi_phase2_draw_params_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(TP2::MultiDrawIndirectParam) * m_cull_objects.size(), nullptr, GL_DYNAMIC_DRAW);
+
+    //No object visible before the first frame: everything is tested by the second phase
+    unsigned int no_bit = 0;
+    glGenBuffers(1, &m_visibility_bits_buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_visibility_bits_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(unsigned int) * ((m_cull_objects.size() + 31) / 32), nullptr, GL_DYNAMIC_DRAW);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &no_bit);
+
+    glGenBuffers(1, &m_occlusion_culling_counters_buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_occlusion_culling_counters_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(OcclusionCullingCounters), nullptr, GL_DYNAMIC_DRAW);
+
+    //Copied over the counters at the beginning of each frame: 0 objects, dispatch of 0x1x1 groups
+    OcclusionCullingCounters counters_reset = {};
+    counters_reset.dispatch[1] = 1;
+    counters_reset.dispatch[2] = 1;
+    glGenBuffers(1, &m_occlusion_culling_counters_reset_buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_occlusion_culling_counters_reset_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(OcclusionCullingCounters), &counters_reset, GL_STATIC_DRAW);
+
+    glGenBuffers(CULLING_READBACK_FRAMES, m_culling_counters_readback_buffers);
+    for (int i = 0; i < CULLING_READBACK_FRAMES; i++)
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_culling_counters_readback_buffers[i]);
+        glBufferData(GL_COPY_WRITE_BUFFER, sizeof(OcclusionCullingCounters), nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
     //Cleaning (repositionning the buffers that have been selected to their default value)
     glBindVertexArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -679,6 +1105,9 @@ int TP2::init()
 
     if (create_shadow_map() == -1)
         return -1;
+    //The light matrix of the shadow map is in the per-frame uniforms
+    Transform vp_matrix = m_camera.projection() * m_camera.view();
+    update_frame_uniforms(vp_matrix, vp_matrix.inverse());
     draw_shadow_map();
 
     if (create_hdr_frame() == -1)
@@ -691,6 +1120,9 @@ int TP2::init()
 
 int TP2::quit()
 {
+    m_texture_streamer.release();
+    glDeleteBuffers(1, &m_frame_uniforms_buffer);
+
     return 0;//Error code 0 = no error
 }
 
@@ -802,12 +1234,12 @@ void TP2::draw_shadow_map()
     glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
     glCullFace(GL_FRONT);
 
+    //The light matrix is in the per-frame uniforms
     glUseProgram(m_shadow_map_program);
-    GLint mlp_matrix_uniform_location = glGetUniformLocation(m_shadow_map_program, "mlp_matrix");
-    glUniformMatrix4fv(mlp_matrix_uniform_location, 1, GL_TRUE, m_lp_light_transform.data());
 
+    //Only the full resolution triangles, the levels of detail are after them in the buffers
     glBindVertexArray(m_mesh_vao);
-    glDrawArrays(GL_TRIANGLES, 0, m_mesh.triangle_count() * 3);
+    glDrawElements(GL_TRIANGLES, m_base_triangle_count * 3, GL_UNSIGNED_INT, 0);
 
     //Cleaning
     glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
@@ -826,8 +1258,9 @@ std::vector<TP2::MultiDrawIndirectParam> TP2::generate_draw_params_from_object_i
         TP2::MultiDrawIndirectParam draw_param;
         draw_param.instance_base = 0;
         draw_param.instance_count = 1;
-        draw_param.vertex_base = m_cull_objects[object_id].vertex_base;
-        draw_param.vertex_count = m_cull_objects[object_id].vertex_count;
+        draw_param.base_vertex = 0;
+        draw_param.first_index = m_cull_objects[object_id].first_index;
+        draw_param.index_count = m_cull_objects[object_id].index_count;
 
         draw_params.push_back(draw_param);
     }
@@ -839,12 +1272,11 @@ void TP2::draw_by_groups_cpu_frustum_culling(const Transform& vp_matrix, const T
 {
     m_mesh_groups_drawn = 0;
 
-    GLint has_normal_map_uniform_location = glGetUniformLocation(m_texture_shadow_cook_torrance_shader, "u_has_normal_map");
     for (TriangleGroup& group : m_mesh_triangles_group)
     {
-        if (!rejection_test_bbox_frustum_culling(m_cull_objects[group.index], vp_matrix))
+        if (!rejection_test_bbox_frustum_culling(m_group_cull_objects[group.index], vp_matrix))
         {
-            if (!rejection_test_bbox_frustum_culling_scene(m_cull_objects[group.index], mvp_matrix_inverse))
+            if (!rejection_test_bbox_frustum_culling_scene(m_group_cull_objects[group.index], mvp_matrix_inverse))
             {
                 int diffuse_texture_index = m_mesh.materials()(group.index).diffuse_texture;
                 int specular_texture_index = m_mesh.materials()(group.index).specular_texture;
@@ -869,18 +1301,19 @@ void TP2::draw_by_groups_cpu_frustum_culling(const Transform& vp_matrix, const T
                     glBindTexture(GL_TEXTURE_2D, group_specular_texture_id);
                 }
 
-                if (normal_map_index != -1)
+                //No normal mapping with the default texture, while the normal map is streamed
+                if (normal_map_index != -1 && m_mesh_normal_maps[normal_map_index] != m_default_texture)
                 {
                     GLuint group_normal_map_id = m_mesh_normal_maps[normal_map_index];
                     glActiveTexture(GL_TEXTURE0 + TP2::TRIANGLE_GROUP_NORMAL_MAP_UNIT);
                     glBindTexture(GL_TEXTURE_2D, group_normal_map_id);
 
-                    glUniform1i(has_normal_map_uniform_location, 1);
+                    program_uniform(m_uniforms.has_normal_map, 1);
                 }
                 else
-                    glUniform1i(has_normal_map_uniform_location, 0);
+                    program_uniform(m_uniforms.has_normal_map, 0);
 
-                glDrawArrays(GL_TRIANGLES, group.first, group.n);
+                glDrawElements(GL_TRIANGLES, group.n, GL_UNSIGNED_INT, (GLvoid*)(group.first * sizeof(unsigned int)));
 
                 m_mesh_groups_drawn++;
             }
@@ -898,168 +1331,148 @@ void TP2::draw_multi_draw_indirect_from_ids(const std::vector<int>& object_ids)
     glBufferSubData(GL_PARAMETER_BUFFER_ARB, 0, sizeof(unsigned int), &nb_params);
     glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_mdi_draw_params_buffer);
     glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(TP2::MultiDrawIndirectParam) * draw_params.size(), draw_params.data());
-    glMultiDrawArraysIndirectCountARB(GL_TRIANGLES, 0, 0, m_cull_objects.size(), 0);
+    glMultiDrawElementsIndirectCountARB(GL_TRIANGLES, GL_UNSIGNED_INT, 0, 0, m_cull_objects.size(), 0);
 }
 
 void TP2::cpu_mdi_selective_frustum_culling(const std::vector<int>& objects_id, const Transform& mvp_matrix, const Transform& mvp_matrix_inverse)
 {
-    std::vector<TP2::MultiDrawIndirectParam> params;
-
-    std::array<Vector, 8> frustum_world_space_vertices;
-    std::array<vec4, 8> frustum_points_projective_space
-    {
-        vec4(-1, -1, -1, 1),
-                vec4(1, -1, -1, 1),
-                vec4(-1, 1, -1, 1),
-                vec4(1, 1, -1, 1),
-                vec4(-1, -1, 1, 1),
-                vec4(1, -1, 1, 1),
-                vec4(-1, 1, 1, 1),
-                vec4(1, 1, 1, 1)
-    };
-
-    for (int i = 0; i < 8; i++)
-    {
-        frustum_points_projective_space[i] = mvp_matrix_inverse(frustum_points_projective_space[i]);
-
-        if (frustum_points_projective_space[i].w != 0)
-            frustum_world_space_vertices[i] = Vector(frustum_points_projective_space[i]) / frustum_points_projective_space[i].w;
-    }
+    int visible_count = m_frustum_culler.cull(mvp_matrix, objects_id.data(), objects_id.size());
 
-    m_objects_drawn_last_frame.clear();
-    m_mesh_groups_drawn = 0;
-    for (int object_id : objects_id)
-    {
-        CullObject cull_object = m_cull_objects[object_id];
-
-        vec4 bbox_points_projective[8];
-        bbox_points_projective[0] = mvp_matrix(vec4(cull_object.min, 1));
-        bbox_points_projective[1] = mvp_matrix(vec4(cull_object.max.x, cull_object.min.y, cull_object.min.z, 1));
-        bbox_points_projective[2] = mvp_matrix(vec4(cull_object.min.x, cull_object.max.y, cull_object.min.z, 1));
-        bbox_points_projective[3] = mvp_matrix(vec4(cull_object.max.x, cull_object.max.y, cull_object.min.z, 1));
-        bbox_points_projective[4] = mvp_matrix(vec4(cull_object.min.x, cull_object.min.y, cull_object.max.z, 1));
-        bbox_points_projective[5] = mvp_matrix(vec4(cull_object.max.x, cull_object.min.y, cull_object.max.z, 1));
-        bbox_points_projective[6] = mvp_matrix(vec4(cull_object.min.x, cull_object.max.y, cull_object.max.z, 1));
-        bbox_points_projective[7] = mvp_matrix(vec4(cull_object.max, 1));
-
-        bool next_object = false;
-        for (int coord_index = 0; coord_index < 6; coord_index++)
-        {
-            bool all_points_outside = true;
-
-            for (int i = 0; i < 8; i++)
-            {
-                vec4 bbox_point = bbox_points_projective[i];
-
-                int test_negative_plane = coord_index & 1;
+    upload_cpu_frustum_culling_results(m_frustum_culler.visible_ids().data(), m_frustum_culler.draw_commands().data(), visible_count);
+}
 
-                if (test_negative_plane == 1)
-                    all_points_outside = all_points_outside && (bbox_point(coord_index / 2) < -bbox_point.w);
-                else
-                    all_points_outside = all_points_outside && (bbox_point(coord_index / 2) > bbox_point.w);
+void TP2::cpu_mdi_frustum_culling(const Transform& mvp_matrix, const Transform& mvp_matrix_inverse)
+{
+    //No list of ids, all the objects are tested
+    int visible_count = m_frustum_culler.cull(mvp_matrix);
 
-                if (!all_points_outside)
-                    break;
-            }
+    upload_cpu_frustum_culling_results(m_frustum_culler.visible_ids().data(), m_frustum_culler.draw_commands().data(), visible_count);
+}
 
-            //If all the points are on the same side
-            if (all_points_outside)
-            {
-                next_object = true;
+void TP2::cpu_mdi_bvh_frustum_culling(const Transform& mvp_matrix, const Transform& mvp_matrix_inverse)
+{
+    int visible_count = m_culling_bvh.cull(mvp_matrix, m_bvh_visible_ids);
+    m_culling_bvh_stats = m_culling_bvh.stats();
 
-                break;
-            }
-        }
+    std::vector<TP2::MultiDrawIndirectParam> draw_params = generate_draw_params_from_object_ids(m_bvh_visible_ids);
+    upload_cpu_frustum_culling_results(m_bvh_visible_ids.data(), draw_params.data(), visible_count);
+}
 
-        if (next_object)
-            continue;
+void TP2::upload_cpu_frustum_culling_results(const int* visible_ids, const TP2::MultiDrawIndirectParam* draw_params, int visible_count)
+{
+    {
+        //The levels of detail and the normal cones are only tested on the clusters inside the frustum
+        Point camera_position = m_camera.position();
+        float projection_scale = lod_projection_scale();
 
-        for (int coord_index = 0; coord_index < 6; coord_index++)
+        m_filtered_cluster_ids.clear();
+        m_filtered_draw_params.clear();
+        for (int i = 0; i < visible_count; i++)
         {
-            bool all_points_outside = true;
-            for (int i = 0; i < 8; i++)
-            {
-                vec3 frustum_point = frustum_world_space_vertices[i];
-
-                int test_negative = coord_index & 1;
+            if (is_cluster_rejected(visible_ids[i], camera_position, projection_scale))
+                continue;
 
-                if (test_negative == 1)
-                    all_points_outside = all_points_outside && (frustum_point(coord_index / 2) < cull_object.min(coord_index / 2));
-                else
-                    all_points_outside = all_points_outside && (frustum_point(coord_index / 2) > cull_object.max(coord_index / 2));
-
-                //If all the points are not on the same side
-                if (!all_points_outside)
-                    break;
-            }
-
-            if (all_points_outside)
-                break;
+            m_filtered_cluster_ids.push_back(visible_ids[i]);
+            m_filtered_draw_params.push_back(draw_params[i]);
         }
 
-        m_mesh_groups_drawn++;
-
-        //The object has not been culled, we're going to push the params
-        //for the object to be drawn by the future MDI call
-        TP2::MultiDrawIndirectParam object_draw_params;
-        object_draw_params.instance_base = 0;
-        object_draw_params.instance_count = 1;
-        object_draw_params.vertex_base = m_cull_objects[object_id].vertex_base;
-        object_draw_params.vertex_count = m_cull_objects[object_id].vertex_count;
-
-        params.push_back(object_draw_params);
-        m_objects_drawn_last_frame.push_back(object_id);
+        visible_ids = m_filtered_cluster_ids.data();
+        draw_params = m_filtered_draw_params.data();
+        visible_count = m_filtered_cluster_ids.size();
     }
 
+    m_mesh_groups_drawn = visible_count;
+    m_objects_drawn_last_frame.assign(visible_ids, visible_ids + visible_count);
+
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_mdi_draw_params_buffer);
-    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(TP2::MultiDrawIndirectParam) * m_cull_objects.size(), params.data());
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(TP2::MultiDrawIndirectParam) * visible_count, draw_params);
 
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_culling_objects_id_to_draw);
-    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(unsigned int) * m_objects_drawn_last_frame.size(), m_objects_drawn_last_frame.data());
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(unsigned int) * visible_count, visible_ids);
 
     glBindBuffer(GL_PARAMETER_BUFFER_ARB, m_culling_nb_objects_passed_buffer);
     glBufferSubData(GL_PARAMETER_BUFFER_ARB, 0, sizeof(unsigned int), &m_mesh_groups_drawn);
 }
 
-void TP2::cpu_mdi_frustum_culling(const Transform& mvp_matrix, const Transform& mvp_matrix_inverse)
+int TP2::mdi_frustum_culling(const Transform& mvp_matrix, const Transform& mvp_matrix_inverse)
 {
-    std::vector<int> objects_id(m_cull_objects.size());
-    for (int i = 0; i < m_cull_objects.size(); i++)
-        objects_id[i] = i;
+    //The CPU versions upload their results in the same buffers as the compute shader
+    //so the passes that follow don't depend on where the frustum culling was done
+    if (m_application_settings.gpu_frustum_culling == 1)
+        return gpu_mdi_frustum_culling();
+    else if (m_application_settings.gpu_frustum_culling == 2)
+        cpu_mdi_bvh_frustum_culling(mvp_matrix, mvp_matrix_inverse);
+    else
+        cpu_mdi_frustum_culling(mvp_matrix, mvp_matrix_inverse);
 
-    cpu_mdi_selective_frustum_culling(objects_id, mvp_matrix, mvp_matrix_inverse);
+    return m_mesh_groups_drawn;
 }
 
-int TP2::gpu_mdi_frustum_culling(const Transform& mvp_matrix, const Transform& mvp_matrix_inverse)
+float TP2::lod_projection_scale()
 {
-    glUseProgram(m_frustum_culling_shader);
+    Transform projection = m_camera.projection();
 
-    GLint mvp_matrix_uniform_location = glGetUniformLocation(m_frustum_culling_shader, "u_mvp_matrix");
-    glUniformMatrix4fv(mvp_matrix_uniform_location, 1, GL_TRUE, mvp_matrix.data());
+    return projection.m[1][1] * window_height() * 0.5f;
+}
 
-    std::array<Vector, 8> frustum_points_world_space;
-    std::array<vec4, 8> frustum_points_projective_space
+bool TP2::is_cluster_rejected(int object_id, const Point& camera_position, float projection_scale)
+{
+    const ClusterLOD& lod = m_cluster_lods[object_id];
+    if (m_application_settings.lod_selection)
     {
-        vec4(-1, -1, -1, 1),
-                vec4(1, -1, -1, 1),
-                vec4(-1, 1, -1, 1),
-                vec4(1, 1, -1, 1),
-                vec4(-1, -1, 1, 1),
-                vec4(1, -1, 1, 1),
-                vec4(-1, 1, 1, 1),
-                vec4(1, 1, 1, 1)
-    };
+        //The coarsest level whose error projects to less than the threshold: the error of the
+        //level must be small enough and the error of the next level too big
+        float distance = std::max(::distance(Point(lod.center), camera_position) - lod.radius, 1.0e-4f);
+        float threshold = m_application_settings.lod_error_threshold * distance;
+        if (lod.error * projection_scale > threshold || lod.coarser_error * projection_scale <= threshold)
+            return true;
+    }
+    else if (lod.level != 0)
+        return true;
 
-    for (int i = 0; i < 8; i++)
+    return m_application_settings.backface_culling && ClusterBuilder::is_backfacing(m_mesh_clusters[object_id], camera_position);
+}
+
+void TP2::reject_clusters(std::vector<int>& object_ids)
+{
+    Point camera_position = m_camera.position();
+    float projection_scale = lod_projection_scale();
+
+    object_ids.erase(std::remove_if(object_ids.begin(), object_ids.end(), [this, &camera_position, projection_scale](int object_id)
     {
-        frustum_points_projective_space[i] = mvp_matrix_inverse(frustum_points_projective_space[i]);
+        return is_cluster_rejected(object_id, camera_position, projection_scale);
+    }), object_ids.end());
+}
+
+void TP2::update_triangle_metrics()
+{
+    std::vector<unsigned char> group_drawn(m_mesh_triangles_group.size(), 0);
+
+    m_triangles_drawn = 0;
+    m_triangles_drawn_full_resolution = 0;
+    std::fill(std::begin(m_triangles_drawn_per_lod), std::end(m_triangles_drawn_per_lod), 0);
+    for (int object_id : m_objects_drawn_last_frame)
+    {
+        const MeshCluster& cluster = m_mesh_clusters[object_id];
+        const ClusterLOD& lod = m_cluster_lods[object_id];
 
-        if (frustum_points_projective_space[i].w != 0)
-            frustum_points_world_space[i] = Vector(frustum_points_projective_space[i]) / frustum_points_projective_space[i].w;
+        m_triangles_drawn += cluster.n / 3;
+        m_triangles_drawn_per_lod[lod.level] += cluster.n / 3;
+        m_triangles_drawn_full_resolution += (int)(cluster.n / 3 * lod.full_resolution_ratio);
+        group_drawn[cluster.group] = 1;
     }
 
-    GLint frustum_world_space_vertices_uniform_location = glGetUniformLocation(m_frustum_culling_shader, "frustum_world_space_vertices");
-    glUniform3fv(frustum_world_space_vertices_uniform_location, 8, (float*)frustum_points_world_space.data());
+    //What would have been drawn if whole groups were culled
+    m_triangles_drawn_whole_groups = 0;
+    for (int group_index = 0; group_index < int(m_mesh_triangles_group.size()); group_index++)
+        if (group_drawn[group_index])
+            m_triangles_drawn_whole_groups += m_mesh_triangles_group[group_index].n / 3;
+}
+
+int TP2::gpu_mdi_frustum_culling()
+{
+    //The matrices, the frustum and the LOD parameters are in the per-frame uniforms, see update_frame_uniforms()
+    glUseProgram(m_frustum_culling_shader);
 
     // Out buffer : a list of commands that directly be fed into an multiDrawIndirect() call
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_mdi_draw_params_buffer);
@@ -1067,35 +1480,35 @@ int TP2::gpu_mdi_frustum_culling(const Transform& mvp_matrix, const Transform& m
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_culling_objects_id_to_draw);
     // Input buffer that contains all the objects of the scene
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, m_culling_input_object_buffer);
+    // Input buffer that contains the normal cones of the objects
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, m_culling_cluster_cones_buffer);
+    // Input buffer that contains the levels of detail of the objects
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, m_culling_cluster_lods_buffer);
 
     // Out buffer : how many objects passed the culling test
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, m_culling_nb_objects_passed_buffer);
     unsigned int zero = 0;
     glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(unsigned int), &zero);
 
-    int nb_groups = m_mesh_triangles_group.size() / 256 + (m_mesh_triangles_group.size() % 256 > 0);
+    int nb_groups = m_cull_objects.size() / 256 + (m_cull_objects.size() % 256 > 0);
     glDispatchCompute(nb_groups, 1, 1);
     glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
 
     // Getting the number of groups drawn for displaying with ImGui
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_culling_nb_objects_passed_buffer);
-    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(unsigned int), &m_mesh_groups_drawn);
+    read_gpu_buffer(m_culling_nb_objects_passed_buffer, sizeof(unsigned int), &m_mesh_groups_drawn);
 
     return m_mesh_groups_drawn;
 }
 
 void TP2::draw_mdi_frustum_culling(const Transform& mvp_matrix, const Transform& mvp_matrix_inverse)
 {
-    if (m_application_settings.gpu_frustum_culling)
-        gpu_mdi_frustum_culling(mvp_matrix, mvp_matrix_inverse);
-    else
-        cpu_mdi_frustum_culling(mvp_matrix, mvp_matrix_inverse);
+    mdi_frustum_culling(mvp_matrix, mvp_matrix_inverse);
 
     glUseProgram(m_texture_shadow_cook_torrance_shader);
 
     glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_mdi_draw_params_buffer);
     glBindBuffer(GL_PARAMETER_BUFFER_ARB, m_culling_nb_objects_passed_buffer);
-    glMultiDrawArraysIndirectCountARB(GL_TRIANGLES, 0, 0, m_cull_objects.size(), 0);
+    glMultiDrawElementsIndirectCountARB(GL_TRIANGLES, GL_UNSIGNED_INT, 0, 0, m_cull_objects.size(), 0);
 
     glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
@@ -1109,13 +1522,12 @@ void TP2::draw_mdi_occlusion_culling(const Transform& mvp_matrix, const Transfor
     {
         //Drawing every object
         //This function fills the m_mesh_groups_drawn variable
-        gpu_mdi_frustum_culling(mvp_matrix, mvp_matrix_inverse);
+        mdi_frustum_culling(mvp_matrix, mvp_matrix_inverse);
 
         // The m_mesh_groups_drawn variable is filled by the frustum culling
         // pass
         objects_to_draw.resize(m_mesh_groups_drawn);
-        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_culling_objects_id_to_draw);
-        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(unsigned int) * m_mesh_groups_drawn, objects_to_draw.data());
+        read_gpu_buffer(m_culling_objects_id_to_draw, sizeof(unsigned int) * m_mesh_groups_drawn, objects_to_draw.data());
 
         m_objects_drawn_last_frame.resize(m_mesh_groups_drawn);
         std::copy(objects_to_draw.begin(), objects_to_draw.end(), m_objects_drawn_last_frame.begin());
@@ -1132,7 +1544,7 @@ void TP2::draw_mdi_occlusion_culling(const Transform& mvp_matrix, const Transfor
     else
     {
         //First, we want to draw the objects that were visible last frame to fill the z-buffer
-        int nb_accepted_objects = gpu_mdi_frustum_culling(mvp_matrix, mvp_matrix_inverse);
+        int nb_accepted_objects = mdi_frustum_culling(mvp_matrix, mvp_matrix_inverse);
         std::vector<int> non_frustum_culled_ids_this_frame(nb_accepted_objects);
 
         // We're getting the ids of the objects that passed the frustum culling back on the CPU
@@ -1140,8 +1552,7 @@ void TP2::draw_mdi_occlusion_culling(const Transform& mvp_matrix, const Transfor
         // m_objects_draw_last_frame vector) and that still are visible this frame (in the
         // m_occlusion_culling_objects_id_to_draw buffer we just filled with the frustum culling
         // pass)
-        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_culling_objects_id_to_draw);
-        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(int) * nb_accepted_objects, non_frustum_culled_ids_this_frame.data());
+        read_gpu_buffer(m_culling_objects_id_to_draw, sizeof(int) * nb_accepted_objects, non_frustum_culled_ids_this_frame.data());
 
         //Now that we have all the objects of the scene that are visible according
         //to the frustum culling, we can draw the ones that were visible last frame
@@ -1153,11 +1564,15 @@ void TP2::draw_mdi_occlusion_culling(const Transform& mvp_matrix, const Transfor
 
         //We we will have to find the objects that were drawn last frame
         //and that passed the frustum culling this frame because those are
-        //the objects that we're going to draw to fill the z-buffer
+        //the objects that we're going to draw to fill the z-buffer.
+        //The objects drawn last frame are marked with the frame number: no search
+        m_object_drawn_frame.resize(m_cull_objects.size(), -1);
+        for (int object_id : m_objects_drawn_last_frame)
+            m_object_drawn_frame[object_id] = m_frame_number;
+
         for (int object_id_this_frame : non_frustum_culled_ids_this_frame)
         {
-            //TODO optimize find because find in a vector is slow : we can use a set for m_objects_drawn_last_frame
-            if (std::find(m_objects_drawn_last_frame.begin(), m_objects_drawn_last_frame.end(), object_id_this_frame) != m_objects_drawn_last_frame.end())
+            if (m_object_drawn_frame[object_id_this_frame] == m_frame_number)
                 //We found an object that was visible last frame and that still is this frame
                 //We're going to use that object to fill the z buffer
                 objects_to_fill_zbuffer.push_back(object_id_this_frame);
@@ -1169,19 +1584,143 @@ void TP2::draw_mdi_occlusion_culling(const Transform& mvp_matrix, const Transfor
         draw_multi_draw_indirect_from_ids(objects_to_fill_zbuffer);
 
         Utils::compute_mipmaps_gpu(m_hdr_depth_buffer_texture, window_width(), window_height(), m_z_buffer_mipmaps_texture);
-        occlusion_cull_gpu(mvp_matrix, m_camera.view(), m_camera.viewport(), m_culling_objects_id_to_draw, nb_accepted_objects);
+        occlusion_cull_gpu(m_culling_objects_id_to_draw, nb_accepted_objects);
 
         // Getting the number of objects drawn
-        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_culling_nb_objects_passed_buffer);
-        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(unsigned int), &m_mesh_groups_drawn);
+        read_gpu_buffer(m_culling_nb_objects_passed_buffer, sizeof(unsigned int), &m_mesh_groups_drawn);
 
         // Now that the occlusion culling on the GPU has filled the buffer with
         // the ids of the object that are going to be drawn, we can use this buffer
         // to fill the objects_drawn_last_frame buffer
         m_objects_drawn_last_frame.resize(m_mesh_groups_drawn);
-        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_culling_passing_ids);
-        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, m_mesh_groups_drawn * sizeof(unsigned int), m_objects_drawn_last_frame.data());
+        read_gpu_buffer(m_culling_passing_ids, m_mesh_groups_drawn * sizeof(unsigned int), m_objects_drawn_last_frame.data());
+    }
+}
+
+void TP2::read_gpu_buffer(GLuint buffer, size_t size, void* data)
+{
+    //The CPU waits for the GPU to finish all the commands submitted so far
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, size, data);
+
+    m_frame_blocking_readbacks++;
+}
+
+void TP2::draw_mdi_two_phase_occlusion_culling(const Transform& mvp_matrix, const Transform& mvp_matrix_inverse)
+{
+    //Resetting the counters and the dispatch parameters of the second phase on the GPU
+    glBindBuffer(GL_COPY_READ_BUFFER, m_occlusion_culling_counters_reset_buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_occlusion_culling_counters_buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(OcclusionCullingCounters));
+
+    //First phase: frustum culling and selection of the levels of detail of all the objects.
+    //The objects that were visible last frame are drawn to fill the z-buffer, all the objects
+    //in the frustum are written in m_culling_objects_id_to_draw for the second phase
+    glUseProgram(m_two_phase_frustum_culling_shader);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_mdi_draw_params_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_culling_objects_id_to_draw);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, m_culling_input_object_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, m_occlusion_culling_counters_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, m_culling_cluster_cones_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, m_culling_cluster_lods_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, m_visibility_bits_buffer);
+
+    int nb_groups = m_cull_objects.size() / 256 + (m_cull_objects.size() % 256 > 0);
+    glDispatchCompute(nb_groups, 1, 1);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+    glUseProgram(m_texture_shadow_cook_torrance_shader);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_mdi_draw_params_buffer);
+    glBindBuffer(GL_PARAMETER_BUFFER_ARB, m_occlusion_culling_counters_buffer);
+    glMultiDrawElementsIndirectCountARB(GL_TRIANGLES, GL_UNSIGNED_INT, 0, offsetof(OcclusionCullingCounters, phase1_draw_count), m_cull_objects.size(), 0);
+
+    //Second phase: the objects in the frustum are tested against the hierarchical z-buffer of
+    //the first phase. Their visibility bits are updated for the next frame and the objects
+    //that were not drawn by the first phase and that are visible are drawn now
+    Utils::compute_mipmaps_gpu(m_hdr_depth_buffer_texture, window_width(), window_height(), m_z_buffer_mipmaps_texture);
+
+    glUseProgram(m_two_phase_occlusion_culling_shader);
+    bind_z_buffer_mipmaps();
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_culling_objects_id_to_draw);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_culling_input_object_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, m_mdi_phase2_draw_params_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, m_occlusion_culling_counters_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, m_visibility_bits_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, m_culling_cluster_lods_buffer);
+
+    //As many groups of threads as the first phase found objects in the frustum
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, m_occlusion_culling_counters_buffer);
+    glDispatchComputeIndirect(offsetof(OcclusionCullingCounters, dispatch));
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+    glUseProgram(m_texture_shadow_cook_torrance_shader);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_mdi_phase2_draw_params_buffer);
+    glMultiDrawElementsIndirectCountARB(GL_TRIANGLES, GL_UNSIGNED_INT, 0, offsetof(OcclusionCullingCounters, phase2_draw_count), m_cull_objects.size(), 0);
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    read_back_culling_counters();
+}
+
+void TP2::read_back_culling_counters()
+{
+    int slot = m_frame_number % CULLING_READBACK_FRAMES;
+    GLsync& fence = m_culling_counters_fences[slot];
+    if (fence != 0)
+    {
+        //The copy of CULLING_READBACK_FRAMES frames ago is usually done: its counters are
+        //read without waiting for the GPU. If it is not, the counters are not updated this frame
+        if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+            return;
+
+        glDeleteSync(fence);
+        fence = 0;
+
+        OcclusionCullingCounters counters;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_culling_counters_readback_buffers[slot]);
+        glGetBufferSubData(GL_COPY_WRITE_BUFFER, 0, sizeof(OcclusionCullingCounters), &counters);
+
+        m_mesh_groups_drawn = counters.phase1_draw_count + counters.phase2_draw_count;
+        m_triangles_drawn = counters.triangles_drawn;
+        m_triangles_drawn_full_resolution = counters.triangles_drawn_full_resolution;
+        for (int level = 0; level <= LODBuilder::MAX_LEVELS; level++)
+            m_triangles_drawn_per_lod[level] = counters.triangles_drawn_per_lod[level];
+        //The clusters drawn are not read back, the triangles of their groups are not counted
+        m_triangles_drawn_whole_groups = 0;
     }
+
+    glBindBuffer(GL_COPY_READ_BUFFER, m_occlusion_culling_counters_buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_culling_counters_readback_buffers[slot]);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(OcclusionCullingCounters));
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void TP2::draw_mdi_software_occlusion_culling(const Transform& mvp_matrix, const Transform& mvp_matrix_inverse)
+{
+    //Rasterizing the occluders on the CPU, no need to wait for the z-buffer of the GPU
+    m_occlusion_rasterizer.clear();
+    m_occlusion_rasterizer.rasterize(m_mesh.positions(), m_mesh.indices(), m_mesh_triangles_group, m_occluder_groups, mvp_matrix);
+
+    //Hierarchical test: the nodes of the culling BVH that are hidden by the occluders
+    //are rejected with all their objects
+    std::vector<int> objects_to_draw;
+    m_culling_bvh.cull(mvp_matrix, [this, &mvp_matrix](const Point& bbox_min, const Point& bbox_max)
+    {
+        return m_occlusion_rasterizer.test_box(bbox_min, bbox_max, mvp_matrix);
+    }, objects_to_draw);
+    m_culling_bvh_stats = m_culling_bvh.stats();
+    reject_clusters(objects_to_draw);
+
+    m_mesh_groups_drawn = objects_to_draw.size();
+    m_objects_drawn_last_frame = objects_to_draw;
+
+    glUseProgram(m_texture_shadow_cook_torrance_shader);
+    if (objects_to_draw.size() > 0)
+        draw_multi_draw_indirect_from_ids(objects_to_draw);
 }
 
 void TP2::draw_skysphere()
@@ -1189,37 +1728,20 @@ void TP2::draw_skysphere()
     //Selecting the empty VAO for the cubemap shader
     glBindVertexArray(m_cubemap_vao);
     glUseProgram(m_cubemap_shader);
-    GLint camera_uniform_location = glGetUniformLocation(m_cubemap_shader, "u_camera_position");
-    GLint use_cubemap_uniform_location = glGetUniformLocation(m_cubemap_shader, "u_use_cubemap");
-    GLint inverse_matrix_uniform_location = glGetUniformLocation(m_cubemap_shader, "u_inverse_matrix");
-
-    glUniform3f(camera_uniform_location, m_camera.position().x, m_camera.position().y, m_camera.position().z);
-    glUniformMatrix4fv(inverse_matrix_uniform_location, 1, GL_TRUE, (m_camera.viewport() * m_camera.projection() * m_camera.view() * Identity()).inverse().data());
-    glUniform1i(use_cubemap_uniform_location, m_application_settings.cubemap_or_skysphere);
+    //The camera position and the inverse matrix are in the per-frame uniforms
+    program_uniform(m_uniforms.use_cubemap, m_application_settings.cubemap_or_skysphere);
 
     if (m_application_settings.cubemap_or_skysphere)
     {
-        //Cubemap
-
-        GLint cubemap_uniform_location = glGetUniformLocation(m_cubemap_shader, "u_cubemap");
-
+        //Cubemap, the sampler is set once in init_program_uniforms()
         glActiveTexture(GL_TEXTURE0 + TP2::SKYBOX_UNIT);
         glBindTexture(GL_TEXTURE_CUBE_MAP, m_cubemap);
-
-        //The cubemap is on texture unit 0 so we're using 0 for the value of the uniform
-        glUniform1i(cubemap_uniform_location, 0);
     }
     else
     {
-        //Skysphere
-
-        GLint skysphere_uniform_location = glGetUniformLocation(m_cubemap_shader, "u_skysphere");
-
+        //Skysphere, the sampler is set once in init_program_uniforms()
         glActiveTexture(GL_TEXTURE0 + TP2::SKYSPHERE_UNIT);
         glBindTexture(GL_TEXTURE_2D, m_skysphere);
-
-        //The skysphere is on texture unit 1 so we're using 1 for the value of the uniform
-        glUniform1i(skysphere_uniform_location, 1);
     }
 
     glDrawArrays(GL_TRIANGLES, 0, 3);
@@ -1271,10 +1793,9 @@ void TP2::draw_fullscreen_quad_texture(GLuint texture_to_draw)
 
     glUseProgram(m_fullscreen_quad_texture_shader);
 
-    GLint texture_sampler_location = glGetUniformLocation(m_fullscreen_quad_texture_shader, "u_texture");
     glActiveTexture(GL_TEXTURE0 + TP2::FULLSCREEN_QUAD_TEXTURE_UNIT);
     glBindTexture(GL_TEXTURE_2D, texture_to_draw);
-    glUniform1i(texture_sampler_location, TP2::FULLSCREEN_QUAD_TEXTURE_UNIT);
+    program_uniform(m_uniforms.fullscreen_quad_texture, TP2::FULLSCREEN_QUAD_TEXTURE_UNIT);
 
     glDrawArrays(GL_TRIANGLES, 0, 6);
 }
@@ -1284,15 +1805,11 @@ void TP2::draw_fullscreen_quad_texture_hdr_exposure(GLuint texture_to_draw)
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+    //The exposure is in the per-frame uniforms, the sampler is set once in init_program_uniforms()
     glUseProgram(m_fullscreen_quad_texture_hdr_exposure_shader);
 
-    GLint u_exposure_uniform_location = glGetUniformLocation(m_fullscreen_quad_texture_hdr_exposure_shader, "u_exposure");
-    glUniform1f(u_exposure_uniform_location, m_application_settings.hdr_exposure);
-
-    GLint texture_sampler_location = glGetUniformLocation(m_fullscreen_quad_texture_shader, "u_texture");
     glActiveTexture(GL_TEXTURE0 + TP2::FULLSCREEN_QUAD_TEXTURE_UNIT);
     glBindTexture(GL_TEXTURE_2D, texture_to_draw);
-    glUniform1i(texture_sampler_location, TP2::FULLSCREEN_QUAD_TEXTURE_UNIT);
 
     glDrawArrays(GL_TRIANGLES, 0, 6);
 }
@@ -1307,10 +1824,53 @@ void TP2::draw_general_settings()
             vsync_on();
     }
 
+    ImGui::Separator();
+    ImGui::Text("Asset streaming");
+    ImGui::Text("Textures: %d / %d, %.1fMB", m_texture_streamer.uploaded_count(), m_texture_streamer.requested_count(), m_texture_streamer.uploaded_bytes() / (1024.0f * 1024.0f));
+    ImGui::Text("Textures memory: %.1fMB, %d from KTX2 caches", m_texture_streamer.texture_memory() / (1024.0f * 1024.0f), m_texture_streamer.compressed_count());
+    if (m_total_load_time > 0.0f)
+        ImGui::Text("Time to first frame: %.0fms, all assets loaded in %.0fms", m_time_to_first_frame, m_total_load_time);
+    else
+        ImGui::Text("Time to first frame: %.0fms, loading%s", m_time_to_first_frame, m_environment_ready ? "" : " (environment not ready)");
+
     ImGui::Separator();
     ImGui::Text("Frustum Culling");
     ImGui::RadioButton("CPU Frustum Culling", &m_application_settings.gpu_frustum_culling, 0); ImGui::SameLine();
-    ImGui::RadioButton("GPU Frustum Culling", &m_application_settings.gpu_frustum_culling, 1);
+    ImGui::RadioButton("GPU Frustum Culling", &m_application_settings.gpu_frustum_culling, 1); ImGui::SameLine();
+    ImGui::RadioButton("CPU BVH Frustum Culling", &m_application_settings.gpu_frustum_culling, 2);
+    if (m_application_settings.gpu_frustum_culling == 2 || m_application_settings.software_occlusion_culling)
+    {
+        ImGui::Text("Culling BVH: %d nodes, %d objects", m_culling_bvh.node_count(), m_culling_bvh.object_count());
+        ImGui::Text("Nodes visited: %d, subtrees accepted: %d", m_culling_bvh_stats.nodes_visited, m_culling_bvh_stats.subtrees_accepted);
+        ImGui::Text("Objects tested: %d, accepted: %d", m_culling_bvh_stats.objects_tested, m_culling_bvh_stats.objects_accepted);
+    }
+
+    ImGui::Separator();
+    ImGui::Text("Clusters");
+    ImGui::Checkbox("Back Face Culling", &m_application_settings.backface_culling);
+    ImGui::Text("%d clusters of at most %d triangles, %d triangle groups", (int)m_mesh_clusters.size(), ClusterBuilder::MAX_TRIANGLES, (int)m_mesh_triangles_group.size());
+    ImGui::Text("Triangles drawn: %d / %d", m_triangles_drawn, m_base_triangle_count);
+    ImGui::Text("Mesh buffers: %.1fMB vertices + %.1fMB indices (%.1fMB without indices and compression)", m_mesh_vertex_buffer_size / (1024.0f * 1024.0f),
+                m_mesh_index_buffer_size / (1024.0f * 1024.0f), m_mesh_non_indexed_buffer_size / (1024.0f * 1024.0f));
+    ImGui::Text("Triangles of the groups of these clusters: %d (%.1f%% less triangles with the clusters)", m_triangles_drawn_whole_groups,
+                m_triangles_drawn_whole_groups > 0 ? 100.0f * (1.0f - (float)m_triangles_drawn_full_resolution / m_triangles_drawn_whole_groups) : 0.0f);
+
+    ImGui::Separator();
+    ImGui::Text("Levels of Detail");
+    ImGui::Checkbox("LOD Selection", &m_application_settings.lod_selection);
+    ImGui::SliderFloat("LOD Error Threshold (pixels)", &m_application_settings.lod_error_threshold, 0.1f, 16.0f, "%.1f");
+    for (int level = 0; level <= LODBuilder::MAX_LEVELS; level++)
+        ImGui::Text("Level %d: %d triangles drawn", level, m_triangles_drawn_per_lod[level]);
+    ImGui::Text("Full resolution equivalent: %d triangles (%.1f%% less triangles with the levels of detail)", m_triangles_drawn_full_resolution,
+                m_triangles_drawn_full_resolution > 0 ? 100.0f * (1.0f - (float)m_triangles_drawn / m_triangles_drawn_full_resolution) : 0.0f);
+
+    ImGui::Separator();
+    ImGui::Text("Occlusion Culling");
+    ImGui::Checkbox("GPU-Resident Two-Phase Occlusion Culling", &m_application_settings.gpu_resident_occlusion_culling);
+    ImGui::Text("Culling and draws: %.2fms CPU, %d blocking GPU readbacks", m_culling_cpu_time / 1000.0f, m_blocking_readbacks);
+    ImGui::Checkbox("Software Occlusion Culling", &m_application_settings.software_occlusion_culling);
+    if (ImGui::SliderInt("Occluders Triangle Budget", &m_application_settings.occluder_triangle_budget, 1000, 1000000))
+        m_occluder_groups = OcclusionRasterizer::select_occluders(m_mesh.positions(), m_mesh.indices(), m_mesh_triangles_group, m_application_settings.occluder_triangle_budget);
 }
 
 void TP2::update_recomputed_irradiance_map()
@@ -1348,6 +1908,7 @@ void TP2::draw_lighting_window()
     if (ImGui::Checkbox("Use Irradiance Map", &m_application_settings.use_irradiance_map))
         update_ambient_uniforms();
     ImGui::PushItemWidth(128);
+    ImGui::Checkbox("Irradiance Map Spherical Harmonics", &m_application_settings.irradiance_map_use_spherical_harmonics);
     ImGui::DragInt("Irradiance Map Precomputation Samples", &m_application_settings.irradiance_map_precomputation_samples, 1.0f, 1, 2048);
     ImGui::DragInt("Irradiance Map Downscale Factor", &m_application_settings.irradiance_map_precomputation_downscale_factor, 1.0f, 1, 8);
     if (ImGui::Button("Recompute"))
@@ -1361,7 +1922,8 @@ void TP2::draw_lighting_window()
             std::thread recompute_thread([&] {
                 m_recomputed_irradiance_map_data = Utils::precompute_and_load_associated_irradiance(m_application_settings.irradiance_map_file_path.c_str(),
                                                                                                     m_application_settings.irradiance_map_precomputation_samples,
-                                                                                                    m_application_settings.irradiance_map_precomputation_downscale_factor);
+                                                                                                    m_application_settings.irradiance_map_precomputation_downscale_factor,
+                                                                                                    m_application_settings.irradiance_map_use_spherical_harmonics);
 
                 m_application_state.irradiance_map_freshly_recomputed = true;
                 m_application_state.currently_recomputing_irradiance = false;
@@ -1412,6 +1974,14 @@ void TP2::draw_imgui()
 // dessiner une nouvelle image
 int TP2::render()
 {
+    update_asset_streaming();
+
+    Transform model_matrix;// = RotationX(90);
+    Transform mvp_matrix = m_camera.projection() * m_camera.view() * model_matrix;
+    Transform mvp_matrix_inverse = mvp_matrix.inverse();
+    //All the uniforms of the frame that are shared by the programs, in one upload
+    update_frame_uniforms(mvp_matrix, mvp_matrix_inverse);
+
     if (m_application_settings.draw_shadow_map)
     {
         draw_shadow_map();
@@ -1419,10 +1989,9 @@ int TP2::render()
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         glUseProgram(m_fullscreen_quad_texture_shader);
-        GLint texture_sampler_location = glGetUniformLocation(m_fullscreen_quad_texture_shader, "u_texture");
         glActiveTexture(GL_TEXTURE0 + TP2::SHADOW_MAP_UNIT);
         glBindTexture(GL_TEXTURE_2D, m_shadow_map);
-        glUniform1i(texture_sampler_location, TP2::SHADOW_MAP_UNIT);
+        program_uniform(m_uniforms.fullscreen_quad_texture, TP2::SHADOW_MAP_UNIT);
 
         glBindVertexArray(m_cubemap_vao);
         glDrawArrays(GL_TRIANGLES, 0, 6);
@@ -1440,60 +2009,49 @@ int TP2::render()
     //On selectionne notre shader
     glUseProgram(m_texture_shadow_cook_torrance_shader);
 
-    //On update l'uniform mvpMatrix de notre shader
-    Transform model_matrix;// = RotationX(90);
-    Transform mvp_matrix = m_camera.projection() * m_camera.view() * model_matrix;
-    Transform mvp_matrix_inverse = mvp_matrix.inverse();
-    GLint model_matrix_uniform_location = glGetUniformLocation(m_texture_shadow_cook_torrance_shader, "u_model_matrix");
-    glUniformMatrix4fv(model_matrix_uniform_location, 1, GL_TRUE, model_matrix.data());
-
-    GLint mvp_matrix_uniform_location = glGetUniformLocation(m_texture_shadow_cook_torrance_shader, "u_vp_matrix");
-    glUniformMatrix4fv(mvp_matrix_uniform_location, 1, GL_TRUE, mvp_matrix.data());
-
-    GLint mlp_matrix_uniform_location = glGetUniformLocation(m_texture_shadow_cook_torrance_shader, "u_lp_matrix");
-    glUniformMatrix4fv(mlp_matrix_uniform_location, 1, GL_TRUE, m_lp_light_transform.data());
-
-    //Setting the camera position
-    GLint camera_position_uniform_location = glGetUniformLocation(m_texture_shadow_cook_torrance_shader, "u_camera_position");
-    glUniform3f(camera_position_uniform_location, m_camera.position().x, m_camera.position().y, m_camera.position().z);
+    //The matrices, the camera and the light are in the per-frame uniforms, see update_frame_uniforms()
+    program_uniform(m_uniforms.override_material, m_application_settings.override_material);
+    program_uniform(m_uniforms.metalness, m_application_settings.mesh_metalness);
+    program_uniform(m_uniforms.roughness, m_application_settings.mesh_roughness);
+    program_uniform(m_uniforms.do_normal_mapping, m_application_settings.do_normal_mapping);
 
-    GLint light_direction_uniform_location = glGetUniformLocation(m_texture_shadow_cook_torrance_shader, "u_light_direction");
-    glUniform3f(light_direction_uniform_location, m_light_direction.x, m_light_direction.y, m_light_direction.z);
-
-    GLint light_intensity_uniform_location = glGetUniformLocation(m_texture_shadow_cook_torrance_shader, "u_light_intensity");
-    glUniform3f(light_intensity_uniform_location, m_light_intensity.x, m_light_intensity.y, m_light_intensity.z);
-
-    GLint override_material_uniform_location = glGetUniformLocation(m_texture_shadow_cook_torrance_shader, "u_override_material");
-    glUniform1i(override_material_uniform_location, m_application_settings.override_material);
-
-    GLint metalness_uniform_location = glGetUniformLocation(m_texture_shadow_cook_torrance_shader, "u_metalness");
-    glUniform1f(metalness_uniform_location, m_application_settings.mesh_metalness);
-
-    GLint roughness_uniform_location = glGetUniformLocation(m_texture_shadow_cook_torrance_shader, "u_roughness");
-    glUniform1f(roughness_uniform_location, m_application_settings.mesh_roughness);
-
-    GLint do_normal_mapping_uniform_location = glGetUniformLocation(m_texture_shadow_cook_torrance_shader, "u_do_normal_mapping");
-    glUniform1f(do_normal_mapping_uniform_location, m_application_settings.do_normal_mapping);
-
-    //Setting up the irradiance map
-    GLint irradiance_map_uniform_location = glGetUniformLocation(m_texture_shadow_cook_torrance_shader, "u_irradiance_map");
-    //The irradiance map is in texture unit 2
+    //The samplers are set once in init_program_uniforms(), only the textures are bound
     glActiveTexture(GL_TEXTURE0 + TP2::DIFFUSE_IRRADIANCE_MAP_UNIT);
     glBindTexture(GL_TEXTURE_2D, m_irradiance_map);
-    glUniform1i(irradiance_map_uniform_location, TP2::DIFFUSE_IRRADIANCE_MAP_UNIT);
 
-    GLint shadow_map_uniform_location = glGetUniformLocation(m_texture_shadow_cook_torrance_shader, "u_shadow_map");
     glActiveTexture(GL_TEXTURE0 + TP2::SHADOW_MAP_UNIT);
     glBindTexture(GL_TEXTURE_2D, m_shadow_map);
-    glUniform1i(shadow_map_uniform_location, TP2::SHADOW_MAP_UNIT);
-
-    GLint shadow_intensity_uniform_location = glGetUniformLocation(m_texture_shadow_cook_torrance_shader, "u_shadow_intensity");
-    glUniform1f(shadow_intensity_uniform_location, m_application_settings.shadow_intensity);
 
     //Selecting the VAO of the mesh
     glBindVertexArray(m_mesh_vao);
 
-    draw_mdi_occlusion_culling(mvp_matrix, mvp_matrix_inverse);
+    //The clusters rejected with their normal cone are only the ones
+    //that OpenGL would not draw with the back face culling
+    if (m_application_settings.backface_culling)
+        glEnable(GL_CULL_FACE);
+
+    //CPU time of the culling and of the draws, including the time spent waiting for the readbacks
+    m_frame_blocking_readbacks = 0;
+    auto culling_start = std::chrono::high_resolution_clock::now();
+
+    //The GPU-resident occlusion culling needs the frustum culling compute shader for its first phase
+    bool gpu_resident_culling = m_application_settings.gpu_resident_occlusion_culling && m_application_settings.gpu_frustum_culling == 1
+        && !m_application_settings.software_occlusion_culling;
+    if (gpu_resident_culling)
+        draw_mdi_two_phase_occlusion_culling(mvp_matrix, mvp_matrix_inverse);
+    else if (m_application_settings.software_occlusion_culling)
+        draw_mdi_software_occlusion_culling(mvp_matrix, mvp_matrix_inverse);
+    else
+        draw_mdi_occlusion_culling(mvp_matrix, mvp_matrix_inverse);
+    glDisable(GL_CULL_FACE);
+
+    auto culling_stop = std::chrono::high_resolution_clock::now();
+    m_culling_cpu_time = std::chrono::duration_cast<std::chrono::microseconds>(culling_stop - culling_start).count();
+    m_blocking_readbacks = m_frame_blocking_readbacks;
+
+    //The metrics of the GPU-resident culling are read back with a few frames of delay
+    if (!gpu_resident_culling)
+        update_triangle_metrics();
     draw_skysphere();
     draw_fullscreen_quad_texture_hdr_exposure(m_hdr_shader_output_texture);
 
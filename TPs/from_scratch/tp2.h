@@ -5,11 +5,21 @@
 #include "application_settings.h"
 #include "application_state.h"
 #include "application_timer.h"
+#include "culling_bvh.h"
+#include "frustum_culler.h"
+#include "hiz_pyramid.h"
 #include "image_io.h"
 #include "imgui.h"
+#include "mesh_clusters.h"
+#include "mesh_lods.h"
 #include "imgui_impl_sdl_gl3.h"
 #include "mesh.h"
+#include "occlusion_rasterizer.h"
+#include "texture_streamer.h"
+#include "uniforms.h"
 
+#include <chrono>
+#include <future>
 #include <string>
 
 struct BoundingBox
@@ -32,19 +42,103 @@ public:
     struct alignas(16) CullObject
     {
         vec3 min;
-        unsigned int vertex_base;
+        //Range of the index buffer of the mesh drawn for the object
+        unsigned int first_index;
         vec3 max;
-        unsigned int vertex_count;
+        unsigned int index_count;
     };
 
-    struct alignas(4) MultiDrawIndirectParam
+    //Normal cone of a cluster as read by the frustum culling compute shader
+    struct alignas(16) ClusterCone
     {
-        unsigned int vertex_count;
-        unsigned int instance_count;
-        unsigned int vertex_base;
-        unsigned int instance_base;
+        vec3 apex;
+        float cutoff;
+        vec3 axis;
+        float padding;
     };
 
+    //Level of detail of a cluster as read by the frustum culling compute shader. The cluster is drawn
+    //when the projected 'error' is below the threshold and the projected 'coarser_error' (error of the
+    //next level of the group) is above: exactly one level of each group is drawn
+    struct alignas(16) ClusterLOD
+    {
+        //Bounding sphere of the whole group, the same for all its levels
+        vec3 center;
+        float radius;
+        float error;
+        float coarser_error;
+        int level;
+        //Number of full resolution triangles per triangle of the level
+        float full_resolution_ratio;
+    };
+
+    //coarser_error of the coarsest level of a group
+    inline static const float NO_COARSER_LOD_ERROR = 1.0e30f;
+
+    //Same layout as the commands of glMultiDrawElementsIndirect, also written by the FrustumCuller
+    using MultiDrawIndirectParam = DrawElementsIndirectCommand;
+
+    //Counters of the GPU-resident two-phase occlusion culling, same layout as the 'parameters'
+    //buffers of frustum_culling.glsl and occlusion_culling.glsl compiled with TWO_PHASE
+    struct OcclusionCullingCounters
+    {
+        //Draw counts of the glMultiDrawElementsIndirectCount of the 2 phases
+        unsigned int phase1_draw_count;
+        unsigned int phase2_draw_count;
+        //Objects in the frustum tested by the second phase and the glDispatchComputeIndirect parameters of this test
+        unsigned int candidate_count;
+        unsigned int dispatch[3];
+        unsigned int triangles_drawn;
+        unsigned int triangles_drawn_full_resolution;
+        unsigned int triangles_drawn_per_lod[LODBuilder::MAX_LEVELS + 1];
+    };
+
+    /**
+     * Per-frame uniforms shared by all the programs, uploaded once per frame in
+     * m_frame_uniforms_buffer. std140 layout of the FrameUniforms block of the shaders,
+     * the matrices are declared row_major
+     */
+    struct FrameUniforms
+    {
+        Transform vp_matrix;
+        Transform mvpv_matrix;
+        Transform inverse_matrix;
+        Transform view_matrix;
+        Transform lp_matrix;
+        vec4 frustum_world_space_vertices[8];
+
+        vec3 camera_position;
+        float exposure;
+        vec3 light_direction;
+        float shadow_intensity;
+        vec3 light_intensity;
+        float lod_projection_scale;
+        float lod_threshold;
+        int nb_mipmaps;
+        int backface_culling;
+        int lod_selection;
+    };
+    static_assert(sizeof(FrameUniforms) == 512, "FrameUniforms doesn't match the std140 layout of the shaders");
+
+    /**
+     * Uniforms of the programs that still change during the frame, looked up once after the programs are linked
+     */
+    struct UniformHandles
+    {
+        UniformHandle use_irradiance_map;
+        UniformHandle has_normal_map;
+        UniformHandle do_normal_mapping;
+        UniformHandle override_material;
+        UniformHandle metalness;
+        UniformHandle roughness;
+        UniformHandle use_cubemap;
+        UniformHandle fullscreen_quad_texture;
+        UniformHandle nb_objects_to_cull;
+    };
+
+    //Frames of delay of the readback of the counters of the GPU-resident occlusion culling
+    inline static const int CULLING_READBACK_FRAMES = 3;
+
     TP2();
 
 	int get_window_width();
@@ -52,28 +146,75 @@ public:
 
     int mesh_groups_count();
     int mesh_groups_drawn();
+    //CPU time of the culling and of the draws of the last frame in microseconds
+    int culling_cpu_time();
+    //Number of readbacks of the last frame that waited for the GPU
+    int blocking_readbacks();
 
 	int prerender() override;
 	int postrender() override;
 
 	void update_ambient_uniforms();
+    /**
+     * Fills and uploads the per-frame uniforms of all the programs, a single upload per frame
+     */
+    void update_frame_uniforms(const Transform& vp_matrix, const Transform& vp_matrix_inverse);
+    /**
+     * Looks up the uniforms that change during the frame and sets the ones that never change
+     * (texture units, dequantization of the vertices...) once
+     */
+    void init_program_uniforms();
+
+    /**
+     * Images of the environment, decoded and precomputed in the background by init()
+     */
+    struct EnvironmentData
+    {
+        std::vector<ImageData> cubemap;
+        Image skysphere;
+        Image irradiance_map;
+    };
+
+    /**
+     * Uploads the textures streamed since the last frame and the environment once it is ready.
+     * Called at the beginning of each frame
+     */
+    void update_asset_streaming();
 
     GLuint create_opengl_texture(std::string& filepath, int GL_tex_format, float anisotropy = 0.0f);
     void load_mesh_textures_thread_function(const Materials& materials);
 
 	void compute_bounding_boxes_of_groups(std::vector<TriangleGroup>& groups);
+    /**
+     * Fills the cull objects (and the CPU culling structures) with the clusters of the mesh
+     */
+    void compute_cull_objects_of_clusters();
+    /**
+     * Clusters the levels of detail of the groups, appends their triangles
+     * to the mesh and their clusters to m_mesh_clusters
+     */
+    void add_lod_clusters(LODChain& lod_chain);
     bool rejection_test_bbox_frustum_culling(const CullObject& object, const Transform& mvpMatrix);
     bool rejection_test_bbox_frustum_culling_scene(const CullObject& object, const Transform& inverse_mvp_matrix);
 
     /**
+     * Hi-Z occlusion test on the CPU. TP2 doesn't call it: the CPU occlusion culling
+     * of TP2 is done by OcclusionRasterizer and the Hi-Z test runs in the occlusion culling
+     * compute shaders. Only the benchmarks use this test: bench_occlusion reproduces it and
+     * bench_hiz checks the HiZPyramid it reads.
+     *
      * @param object Object to try to cull
-     * @param z_buffer_mipmaps The mipmaps of the z-buffer that will be
-     * used for the hierarchical occlusion test
+     * @param z_buffer_pyramid The hierarchical z-buffer used for the occlusion test,
+     * its level 0 is the z-buffer
      * @return True if the object has been culled and is not visible.
      * False if it is visible
      */
-    bool occlusion_cull_cpu(const Transform &mvpv_matrix, CullObject& object, int depth_buffer_width, int depth_buffer_height, const std::vector<std::vector<float>>& z_buffer_mipmaps, const std::vector<std::pair<int, int>>& mipmaps_widths_heights);
-    void occlusion_cull_gpu(const Transform& mvp_matrix, const Transform& view_matrix, const Transform& viewport_matrix, GLuint object_ids_to_cull_buffer, int number_of_objects_to_cull);
+    bool occlusion_cull_cpu(const Transform &mvpv_matrix, CullObject& object, const HiZPyramid& z_buffer_pyramid);
+    void occlusion_cull_gpu(GLuint object_ids_to_cull_buffer, int number_of_objects_to_cull);
+    /**
+     * Binds the z-buffer and its hierarchical mipmaps for the occlusion culling compute shaders
+     */
+    void bind_z_buffer_mipmaps();
 
 	// creation des objets de l'application
 	int init();
@@ -100,9 +241,50 @@ public:
     void draw_multi_draw_indirect_from_ids(const std::vector<int>& object_ids);
     void draw_mdi_frustum_culling(const Transform& mvp_matrix, const Transform& mvp_matrix_inverse);
     void draw_mdi_occlusion_culling(const Transform &mvp_matrix, const Transform &mvp_matrix_inverse);
-    int gpu_mdi_frustum_culling(const Transform& mvp_matrix, const Transform& mvp_matrix_inverse);
+    void draw_mdi_software_occlusion_culling(const Transform &mvp_matrix, const Transform &mvp_matrix_inverse);
+    /**
+     * Two-phase occlusion culling without any CPU/GPU synchronization: the first phase draws
+     * the objects in the frustum that were visible last frame, the second phase tests all the
+     * objects in the frustum against the hierarchical z-buffer of the first phase, updates their
+     * visibility bits and draws the newly visible ones
+     */
+    void draw_mdi_two_phase_occlusion_culling(const Transform& mvp_matrix, const Transform& mvp_matrix_inverse);
+    /**
+     * Copies the counters of the two-phase occlusion culling for a later readback
+     * and reads the copy of CULLING_READBACK_FRAMES frames ago if the GPU is done with it
+     */
+    void read_back_culling_counters();
+    /**
+     * Blocking readback of the beginning of a buffer, counted in the blocking readbacks of the frame
+     */
+    void read_gpu_buffer(GLuint buffer, size_t size, void* data);
+    int gpu_mdi_frustum_culling();
     void cpu_mdi_frustum_culling(const Transform& mvp_matrix, const Transform& mvp_matrix_inverse);
     void cpu_mdi_selective_frustum_culling(const std::vector<int>& objects_id, const Transform& mvp_matrix, const Transform& mvp_matrix_inverse);
+    void cpu_mdi_bvh_frustum_culling(const Transform& mvp_matrix, const Transform& mvp_matrix_inverse);
+    void upload_cpu_frustum_culling_results(const int* visible_ids, const TP2::MultiDrawIndirectParam* draw_params, int visible_count);
+    /**
+     * Frustum culling on the GPU, on the CPU or on the CPU with the culling BVH depending on the settings
+     * @return The number of objects that passed the test
+     */
+    int mdi_frustum_culling(const Transform& mvp_matrix, const Transform& mvp_matrix_inverse);
+    /**
+     * @return True if the cluster is not drawn this frame: it is not the level of detail
+     * of its group that is selected or it is back facing
+     */
+    bool is_cluster_rejected(int object_id, const Point& camera_position, float lod_projection_scale);
+    /**
+     * Removes the clusters rejected by is_cluster_rejected() from the list of objects
+     */
+    void reject_clusters(std::vector<int>& object_ids);
+    /**
+     * Pixels per unit of length at a distance of 1 from the camera
+     */
+    float lod_projection_scale();
+    /**
+     * Counts the triangles of the objects drawn during the last frame
+     */
+    void update_triangle_metrics();
 
 	void draw_general_settings();
     void draw_lighting_window();
@@ -123,6 +305,9 @@ public:
     inline static const int TRIANGLE_GROUP_NORMAL_MAP_UNIT = 5;
     inline static const int SHADOW_MAP_UNIT = 6;
 
+    //Uniform buffer binding point of the FrameUniforms block of all the programs
+    inline static const int FRAME_UNIFORMS_BINDING = 0;
+
     inline static const Transform LIGHT_CAMERA_ORTHO_PROJ_BISTRO = Ortho(-60, 90, -80, 110, 50, 190);
     inline static const int SHADOW_MAP_RESOLUTION = 16384;
 
@@ -145,27 +330,70 @@ protected:
     std::vector<GLuint> m_mesh_specular_textures;
     std::vector<GLuint> m_mesh_normal_maps;
     GLuint m_default_texture;
+    //The textures of the materials are decoded and uploaded while the application is running,
+    //the groups use m_default_texture until then
+    TextureStreamer m_texture_streamer;
+    std::future<EnvironmentData> m_environment_future;
+    bool m_environment_ready = false;
+    //Time to first frame and time until all the assets are loaded, from the beginning of init()
+    std::chrono::high_resolution_clock::time_point m_init_start_time;
+    float m_time_to_first_frame = 0.0f;
+    float m_total_load_time = 0.0f;
 	GLuint m_cubemap_vao;
     GLuint m_mesh_vao;
+    //Size of the vertex and index buffers of the mesh and size of the vertex buffer of the same triangles without indices
+    size_t m_mesh_vertex_buffer_size = 0;
+    size_t m_mesh_index_buffer_size = 0;
+    size_t m_mesh_non_indexed_buffer_size = 0;
     GLuint m_texture_shadow_cook_torrance_shader;
 	GLuint m_cubemap_shader;
-	GLuint m_cubemap;
-	GLuint m_skysphere;
-	GLuint m_irradiance_map;
+	GLuint m_cubemap = 0;
+	GLuint m_skysphere = 0;
+	GLuint m_irradiance_map = 0;
     GLuint m_hdr_shader_output_texture;
     GLuint m_hdr_depth_buffer_texture;
     GLuint m_hdr_framebuffer;
     GLuint m_fullscreen_quad_texture_shader;
     GLuint m_fullscreen_quad_texture_hdr_exposure_shader;
 	GLuint m_shadow_map_program;
+    FrameUniforms m_frame_uniforms;
+    GLuint m_frame_uniforms_buffer = 0;
+    UniformHandles m_uniforms;
 	GLuint m_shadow_map_framebuffer;
     GLuint m_shadow_map = 0;
 
     //Variables used for the culling (frustum and occlusion)
     GLuint m_z_buffer_mipmaps_texture;
-    int m_z_buffer_mipmaps_count;
+    int m_z_buffer_mipmaps_count = 0;
     std::vector<int> m_objects_drawn_last_frame;
+    //Frame number of the last frame each object was drawn, replaces the search in m_objects_drawn_last_frame
+    std::vector<int> m_object_drawn_frame;
+    //The objects culled and drawn are the clusters of the mesh, see m_mesh_clusters
     std::vector<CullObject> m_cull_objects;
+    //Bounding boxes of the triangle groups
+    std::vector<CullObject> m_group_cull_objects;
+    std::vector<MeshCluster> m_mesh_clusters;
+    std::vector<ClusterLOD> m_cluster_lods;
+    //The triangles of the levels of detail are after the triangles of the full resolution mesh
+    int m_base_triangle_count = 0;
+    //Results of the CPU frustum culling that passed the LOD and back facing tests of the clusters
+    std::vector<int> m_filtered_cluster_ids;
+    std::vector<TP2::MultiDrawIndirectParam> m_filtered_draw_params;
+    GLuint m_culling_cluster_cones_buffer;
+    GLuint m_culling_cluster_lods_buffer;
+    //Triangles of the clusters drawn last frame and triangles of the groups
+    //that these clusters belong to
+    int m_triangles_drawn = 0;
+    int m_triangles_drawn_whole_groups = 0;
+    int m_triangles_drawn_per_lod[LODBuilder::MAX_LEVELS + 1] = { 0 };
+    //Triangles that would have been drawn without the levels of detail
+    int m_triangles_drawn_full_resolution = 0;
+    //Same bounding boxes as m_cull_objects but in the SoA layout of the SIMD CPU frustum culling
+    FrustumCuller m_frustum_culler;
+    //Hierarchy over m_cull_objects for the hierarchical frustum / occlusion culling
+    CullingBVH m_culling_bvh;
+    CullingBVH::CullingStats m_culling_bvh_stats;
+    std::vector<int> m_bvh_visible_ids;
     GLuint m_occlusion_culling_shader;
     GLuint m_frustum_culling_shader;
     GLuint m_mdi_draw_params_buffer;
@@ -174,6 +402,26 @@ protected:
     GLuint m_culling_input_object_buffer;
     GLuint m_culling_nb_objects_passed_buffer;
 
+    //GPU-resident two-phase occlusion culling
+    GLuint m_two_phase_frustum_culling_shader;
+    GLuint m_two_phase_occlusion_culling_shader;
+    GLuint m_mdi_phase2_draw_params_buffer;
+    //One bit per object, set when the object was visible last frame
+    GLuint m_visibility_bits_buffer;
+    GLuint m_occlusion_culling_counters_buffer;
+    GLuint m_occlusion_culling_counters_reset_buffer;
+    GLuint m_culling_counters_readback_buffers[CULLING_READBACK_FRAMES];
+    GLsync m_culling_counters_fences[CULLING_READBACK_FRAMES] = { 0 };
+    //Frame-time breakdown of the culling
+    int m_culling_cpu_time = 0;
+    int m_blocking_readbacks = 0;
+    int m_frame_blocking_readbacks = 0;
+
+    //CPU rasterizer of the occluders used instead of the z-buffer of the GPU
+    //for the occlusion culling when software_occlusion_culling is enabled
+    OcclusionRasterizer m_occlusion_rasterizer;
+    std::vector<int> m_occluder_groups;
+
 
 
 
@@ -25,10 +25,14 @@ uint32_t Utils::xorshift32(struct Utils::xorshift32_state* state)
 	return state->a = x;
 }
 
-void Utils::precompute_irradiance_map_from_skysphere_and_write(const char* skysphere_path, unsigned int samples, unsigned int downscale_factor, const char* output_irradiance_map_path)
+void Utils::precompute_irradiance_map_from_skysphere_and_write(const char* skysphere_path, unsigned int samples, unsigned int downscale_factor, const char* output_irradiance_map_path, bool use_spherical_harmonics)
 {
     auto start = std::chrono::high_resolution_clock::now();
-    Image irradiance_map = Utils::precompute_irradiance_map_from_skysphere(skysphere_path, samples, downscale_factor);
+    Image irradiance_map;
+    if (use_spherical_harmonics)
+        irradiance_map = Utils::precompute_irradiance_map_from_skysphere_sh(skysphere_path, downscale_factor);
+    else
+        irradiance_map = Utils::precompute_irradiance_map_from_skysphere(skysphere_path, samples, downscale_factor);
     auto stop = std::chrono::high_resolution_clock::now();
 
     std::cout << "Writing the precomputed irradiance map to disk..." << std::endl;
@@ -63,15 +67,17 @@ void Utils::precompute_irradiance_map_from_skysphere_and_write_gpu(const char* s
     std::cout << std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count() << "ms --- " << (irradiance_map.width() * irradiance_map.height() * samples) / (float)(std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count()) << "samples/ms" << std::endl;
 }
 
-Image Utils::precompute_and_load_associated_irradiance(const char* skysphere_file_path, unsigned int samples, unsigned int downscale_factor)
+Image Utils::precompute_and_load_associated_irradiance(const char* skysphere_file_path, unsigned int samples, unsigned int downscale_factor, bool use_spherical_harmonics)
 {
     std::string skysphere_file_string = std::string(skysphere_file_path);
     //Only the name of the jpg (or png, bmp, ...) file without the path in front of it
     std::string skysphere_image_file_name = skysphere_file_string.substr(skysphere_file_string.rfind('/') + 1);
 
-    //Creating the complete (path + image file name) file name of the irradiance map
+    //Creating the complete (path + image file name) file name of the irradiance map.
+    //The spherical harmonics irradiance map doesn't depend on the number of samples
     std::filesystem::create_directory(TP2::IRRADIANCE_MAPS_CACHE_FOLDER);
-    std::string irradiance_map_name = skysphere_file_string.substr(0, skysphere_file_string.rfind('/') - 11) + "/irradiance_maps_cache/" + skysphere_image_file_name + "_Irradiance_" + std::to_string(samples) + "x_Down" + std::to_string(downscale_factor) + "x.hdr";
+    std::string method_name = use_spherical_harmonics ? std::string("SH") : "QMC_" + std::to_string(samples) + "x";
+    std::string irradiance_map_name = skysphere_file_string.substr(0, skysphere_file_string.rfind('/') - 11) + "/irradiance_maps_cache/" + skysphere_image_file_name + "_Irradiance_" + method_name + "_Down" + std::to_string(downscale_factor) + "x.hdr";
 
     //Checking whether the irradiance map already exists or not
     std::ifstream input_irradiance(irradiance_map_name);
@@ -86,7 +92,7 @@ Image Utils::precompute_and_load_associated_irradiance(const char* skysphere_fil
     {
         //No irradiance map was found, precomputing it
 
-        precompute_irradiance_map_from_skysphere_and_write(skysphere_file_path, samples, downscale_factor, irradiance_map_name.c_str());
+        precompute_irradiance_map_from_skysphere_and_write(skysphere_file_path, samples, downscale_factor, irradiance_map_name.c_str(), use_spherical_harmonics);
         return read_skysphere_image(irradiance_map_name.c_str());
     }
 }
@@ -163,7 +169,54 @@ void branchlessONB(const Vector& n, Vector& b1, Vector& b2)
 }
 
 
-Image Utils::precompute_irradiance_map_from_skysphere(const char* skysphere_path, unsigned int samples, unsigned int downscale_factor)
+/*
+ * atan2 approximation (max error ~1e-5 rad) with no branches so that
+ * the sampling loops below can be vectorized by the compiler
+ */
+static inline float fast_atan2(float y, float x)
+{
+    float abs_x = std::abs(x);
+    float abs_y = std::abs(y);
+    float a = std::min(abs_x, abs_y) / std::max(std::max(abs_x, abs_y), 1.0e-30f);
+    float s = a * a;
+    float r = ((-0.0464964749f * s + 0.15931422f) * s - 0.327622764f) * s * a + a;
+
+    r = (abs_y > abs_x) ? 1.57079637f - r : r;
+    r = (x < 0) ? 3.14159274f - r : r;
+    r = (y < 0) ? -r : r;
+
+    return r;
+}
+
+/*
+ * Returns the direction of the texel (x, y) of an equirectangular map of size width*height.
+ * This is the inverse of the uv mapping used to sample the skysphere
+ */
+static Vector skysphere_texel_direction(float x, float y, int width, int height)
+{
+    float theta = M_PI * (1.0f - y / height);
+    float phi = 2.0f * M_PI * (0.5f - x / width);
+
+    return Vector(std::cos(phi) * std::sin(theta), std::sin(phi) * std::sin(theta), std::cos(theta));
+}
+
+/*
+ * Evaluates the 9 real spherical harmonics basis functions of the first 3 bands (l = 0, 1, 2) in the direction d
+ */
+static void sh9_basis(const Vector& d, float sh[9])
+{
+    sh[0] = 0.282095f;
+    sh[1] = 0.488603f * d.y;
+    sh[2] = 0.488603f * d.z;
+    sh[3] = 0.488603f * d.x;
+    sh[4] = 1.092548f * d.x * d.y;
+    sh[5] = 1.092548f * d.y * d.z;
+    sh[6] = 0.315392f * (3.0f * d.z * d.z - 1.0f);
+    sh[7] = 1.092548f * d.x * d.z;
+    sh[8] = 0.546274f * (d.x * d.x - d.y * d.y);
+}
+
+Image Utils::read_downscaled_skysphere(const char* skysphere_path, unsigned int downscale_factor)
 {
     Image skysphere_image = read_image_hdr(skysphere_path);
 
@@ -176,82 +229,199 @@ Image Utils::precompute_irradiance_map_from_skysphere(const char* skysphere_path
 	}
 	std::cout << "Skysphere loaded" << std::endl;
 
-	Image irradiance_map(skysphere_image.width(), skysphere_image.height());
+    return skysphere_image;
+}
 
-	std::cout << "Precomputing the irradiance map..." << std::endl;
+void Utils::project_skysphere_sh9(const Image& skysphere_image, Color sh_coefficients[9])
+{
+    int width = skysphere_image.width();
+    int height = skysphere_image.height();
 
-	//Generating one random number generator for each thread
-	std::vector<Utils::xorshift32_state> states;
-	for (int i = 0; i < omp_get_max_threads(); i++)
-	{
-		Utils::xorshift32_state state;
-		state.a = rand();
+    //Each line of the skysphere is projected in parallel, the partial sums are added
+    //afterwards in the same order to get a deterministic result
+    std::vector<double> line_sums(height * 9 * 3, 0.0);
 
-		states.push_back(state);
-	}
+#pragma omp parallel for
+    for (int y = 0; y < height; y++)
+    {
+        float theta = M_PI * (1.0f - (y + 0.5f) / height);
+        //Solid angle of a texel of this line
+        double solid_angle = (2.0 * M_PI / width) * (M_PI / height) * std::sin(theta);
+
+        double sums[9 * 3] = { 0.0 };
+        for (int x = 0; x < width; x++)
+        {
+            float sh[9];
+            sh9_basis(skysphere_texel_direction(x + 0.5f, y + 0.5f, width, height), sh);
+
+            Color radiance = skysphere_image(x, y);
+            for (int i = 0; i < 9; i++)
+            {
+                sums[i * 3 + 0] += radiance.r * sh[i];
+                sums[i * 3 + 1] += radiance.g * sh[i];
+                sums[i * 3 + 2] += radiance.b * sh[i];
+            }
+        }
+
+        for (int i = 0; i < 9 * 3; i++)
+            line_sums[y * 9 * 3 + i] = sums[i] * solid_angle;
+    }
+
+    double sums[9 * 3] = { 0.0 };
+    for (int y = 0; y < height; y++)
+        for (int i = 0; i < 9 * 3; i++)
+            sums[i] += line_sums[y * 9 * 3 + i];
+
+    for (int i = 0; i < 9; i++)
+        sh_coefficients[i] = Color(sums[i * 3 + 0], sums[i * 3 + 1], sums[i * 3 + 2]);
+}
+
+Image Utils::precompute_irradiance_map_from_skysphere_sh(const char* skysphere_path, unsigned int downscale_factor)
+{
+    Image skysphere_image = read_image_hdr(skysphere_path);
+	std::cout << "Skysphere loaded" << std::endl;
+
+	std::cout << "Precomputing the irradiance map (spherical harmonics)..." << std::endl;
+
+    //The projection uses the full resolution skysphere, only the output
+    //irradiance map is downscaled
+    Color sh_coefficients[9];
+    project_skysphere_sh9(skysphere_image, sh_coefficients);
+
+    //Convolution with the clamped cosine lobe: A0 = pi, A1 = 2pi/3, A2 = pi/4
+    //(Ramamoorthi & Hanrahan 2001). The higher odd bands of the cosine lobe are 0 and the
+    //even ones are negligible so 3 bands are enough. Everything is divided by pi to get the same
+    //average radiance over the cosine weighted hemisphere as the Monte Carlo estimator
+    const float band_factors[9] = { 1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+    for (int i = 0; i < 9; i++)
+        sh_coefficients[i] = sh_coefficients[i] * band_factors[i];
+
+    int width = skysphere_image.width() / std::max(1u, downscale_factor);
+    int height = skysphere_image.height() / std::max(1u, downscale_factor);
+	Image irradiance_map(width, height);
+
+#pragma omp parallel for
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            float sh[9];
+            sh9_basis(normalize(skysphere_texel_direction(x, y, width, height)), sh);
+
+            Color irradiance = Color(0.0f, 0.0f, 0.0f);
+            for (int i = 0; i < 9; i++)
+                irradiance = irradiance + sh_coefficients[i] * sh[i];
+
+            //3 bands of SH can ring slightly below 0 with very bright and small light sources
+            irradiance_map(x, y) = Color(std::max(0.0f, irradiance.r), std::max(0.0f, irradiance.g), std::max(0.0f, irradiance.b));
+        }
+    }
+
+	return irradiance_map;
+}
+
+Image Utils::precompute_irradiance_map_from_skysphere(const char* skysphere_path, unsigned int samples, unsigned int downscale_factor)
+{
+    Image skysphere_image = read_downscaled_skysphere(skysphere_path, downscale_factor);
+
+    int width = skysphere_image.width();
+    int height = skysphere_image.height();
+	Image irradiance_map(width, height);
+
+	std::cout << "Precomputing the irradiance map (Monte Carlo)..." << std::endl;
+
+    //Cosine weighted directions of a Hammersley point set, in the local frame of the normal.
+    //They are computed only once and stored by axis so that the loop over the samples of each texel
+    //can be vectorized. Each texel rotates the point set around its normal by a different angle so that
+    //all the texels don't use exactly the same directions
+    std::vector<float> local_x(samples), local_y(samples), local_z(samples);
+    for (unsigned int i = 0; i < samples; i++)
+    {
+        float u1 = (i + 0.5f) / samples;
+
+        uint32_t bits = i;
+        bits = (bits << 16) | (bits >> 16);
+        bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+        bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+        bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+        bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+        float u2 = bits * 2.3283064365386963e-10f;
+
+        float phi = 2.0f * M_PI * u1;
+        float r = std::sqrt(u2);
+        local_x[i] = r * std::cos(phi);
+        local_y[i] = r * std::sin(phi);
+        local_z[i] = std::sqrt(std::max(0.0f, 1.0f - u2));
+    }
+
+    const float* lx = local_x.data();
+    const float* ly = local_y.data();
+    const float* lz = local_z.data();
+    const Color* pixels = &skysphere_image(0, 0);
 
 	//Each thread is going to increment this variable after one line of the irradiance map has been computed
 	//Because all thread increment this variable, it is atomic
 	//This variable is then used to print a completion purcentage on stdout
 	std::atomic<int> completed_lines(0);
 
-#pragma omp parallel for
-		for (int y = 0; y < irradiance_map.height(); y++)
-		{
-            float theta = M_PI * (1.0f - (float)y / irradiance_map.height());
-			for (int x = 0; x < irradiance_map.width(); x++)
-			{
-                float phi = 2.0f * M_PI * (0.5f - (float)x / irradiance_map.width());
-
-				//The main direction we're going to randomly sample the skysphere around
-                Vector normal = normalize(Vector(std::cos(phi) * std::sin(theta),
-										  std::sin(phi) * std::sin(theta),
-										  std::cos(theta)));
-				
-				//Calculating the vectors of the basis we're going to use to rotate the randomly generated vector
-				//around our main direction
-				Vector tangent, bitangent;
-
-				branchlessONB(normal, tangent, bitangent);
-				Transform onb(tangent, bitangent, normal, Vector(0, 0, 0));
-
-				Color sum = Color(0, 0, 0);
-				for (unsigned int i = 0; i < samples; i++)
-				{
-                    float rand1 = Utils::xorshift32(&states[omp_get_thread_num()]) / (float)std::numeric_limits<unsigned int>::max();
-                    float rand2 = Utils::xorshift32(&states[omp_get_thread_num()]) / (float)std::numeric_limits<unsigned int>::max();
-
-                    float phi_rand = 2.0f * M_PI * rand1;
-                    float theta_rand = std::asin(std::sqrt(rand2));
-
-                    Vector random_direction_in_canonical_hemisphere = normalize(Vector(std::cos(phi_rand) * std::sin(theta_rand),
-                                                                                       std::sin(phi_rand) * std::sin(theta_rand),
-                                                                                       std::cos(theta_rand)));
-						
-                    Vector random_direction_in_hemisphere_around_normal = onb(random_direction_in_canonical_hemisphere);
-					Vector random_direction_rotated = random_direction_in_hemisphere_around_normal;
-
-                    vec2 uv = vec2(0.5 - std::atan2(random_direction_rotated.y, random_direction_rotated.x) / (2.0 * M_PI),
-                                   1.0 - std::acos(random_direction_rotated.z) / M_PI);
-
-					Color sample_color = skysphere_image(uv.x * skysphere_image.width(), uv.y * skysphere_image.height());
-					sum = sum + sample_color;
-				}
-
-				irradiance_map(x, y) = sum / (float)samples;
-			}
-
-			completed_lines++;
-
-			if (omp_get_thread_num() == 0)
-			{
-				if (completed_lines % 20)
-                {
-                    printf("[%d*%d, %dx] - %.3f%% completed", skysphere_image.width(), skysphere_image.height(), samples, completed_lines / (float)skysphere_image.height() * 100);
-                    std::cout << std::endl;
-                }
-			}
-		}
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            //The main direction we're going to sample the skysphere around
+            Vector normal = normalize(skysphere_texel_direction(x, y, width, height));
+
+            //Calculating the vectors of the basis we're going to use to rotate the sampled directions
+            //around our main direction
+            Vector tangent, bitangent;
+            branchlessONB(normal, tangent, bitangent);
+
+            //Per texel rotation of the point set (Cranley-Patterson rotation of the angle)
+            uint32_t hash = (uint32_t(x) * 73856093u) ^ (uint32_t(y) * 19349663u);
+            hash = (hash ^ (hash >> 16)) * 0x45d9f3bu;
+            hash = hash ^ (hash >> 16);
+            float rotation = 2.0f * M_PI * (hash * 2.3283064365386963e-10f);
+            float cos_rotation = std::cos(rotation);
+            float sin_rotation = std::sin(rotation);
+            Vector t = tangent * cos_rotation + bitangent * sin_rotation;
+            Vector b = bitangent * cos_rotation - tangent * sin_rotation;
+
+            float sum_r = 0.0f, sum_g = 0.0f, sum_b = 0.0f;
+#pragma omp simd reduction(+:sum_r, sum_g, sum_b)
+            for (unsigned int i = 0; i < samples; i++)
+            {
+                float dx = t.x * lx[i] + b.x * ly[i] + normal.x * lz[i];
+                float dy = t.y * lx[i] + b.y * ly[i] + normal.y * lz[i];
+                float dz = t.z * lx[i] + b.z * ly[i] + normal.z * lz[i];
+
+                //acos(z) == atan2(sqrt(1 - z^2), z)
+                float u = 0.5f - fast_atan2(dy, dx) * (float)(0.5 / M_PI);
+                float v = 1.0f - fast_atan2(std::sqrt(std::max(0.0f, 1.0f - dz * dz)), dz) * (float)(1.0 / M_PI);
+
+                int px = std::min(std::max(int(u * width), 0), width - 1);
+                int py = std::min(std::max(int(v * height), 0), height - 1);
+
+                const Color& sample_color = pixels[py * width + px];
+                sum_r += sample_color.r;
+                sum_g += sample_color.g;
+                sum_b += sample_color.b;
+            }
+
+            irradiance_map(x, y) = Color(sum_r, sum_g, sum_b) / (float)samples;
+        }
+
+        completed_lines++;
+
+        if (omp_get_thread_num() == 0)
+        {
+            if (completed_lines % 20)
+            {
+                printf("[%d*%d, %dx] - %.3f%% completed", width, height, samples, completed_lines / (float)height * 100);
+                std::cout << std::endl;
+            }
+        }
+    }
 
 	return irradiance_map;
 }
@@ -447,35 +617,6 @@ void Utils::downscale_image(const Image& input_image, Image& downscaled_output,
     }
 }
 
-std::vector<std::vector<float>> Utils::compute_mipmaps(const std::vector<float>& input_image, int width, int height, std::vector<std::pair<int, int>>& mipmaps_widths_heights)
-{
-    std::vector<std::vector<float>> mipmaps;
-    mipmaps.push_back(input_image);
-    mipmaps_widths_heights.push_back(std::make_pair(width, height));
-
-    int level = 0;
-    while (width > 4 && height > 4)//Stop at a 4*4 mipmap
-    {
-        int new_width = std::max(1, width / 2);
-        int new_height = std::max(1, height / 2);
-
-        mipmaps.push_back(std::vector<float>(new_width * new_height));
-        mipmaps_widths_heights.push_back(std::make_pair(new_width, new_height));
-
-        const std::vector<float>& previous_level = mipmaps[level];
-        std::vector<float>& mipmap = mipmaps[level + 1];
-        for (int y = 0; y < new_height; y++)
-            for (int x = 0; x < new_width; x++)
-                mipmap[y * new_width + x] = std::max(previous_level[x * 2 + y * 2 * width], std::max(previous_level[x * 2 + 1 + y * 2 * width], std::max(previous_level[x * 2 + (y * 2 + 1) * width], previous_level[x * 2 + 1 + (y * 2 + 1) * width])));
-
-        width = new_width;
-        height = new_height;
-        level++;
-    }
-
-    return mipmaps; 
-}
-
 void Utils::compute_mipmaps_gpu(GLuint input_image, int width, int height, GLuint z_buffer_mipmap_texture)
 {
     static GLuint compute_mipmap_shader_sampler = read_program("../data/shaders_tp/TPCG/compute_mipmap_sampler.glsl");
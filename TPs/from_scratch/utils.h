@@ -18,15 +18,29 @@ public:
 
 	static uint32_t xorshift32(struct xorshift32_state* state);
 
-	static void precompute_irradiance_map_from_skysphere_and_write(const char* skysphere_path, unsigned int samples, unsigned int downscale_factor, const char* output_irradiance_map_path);
+	static void precompute_irradiance_map_from_skysphere_and_write(const char* skysphere_path, unsigned int samples, unsigned int downscale_factor, const char* output_irradiance_map_path, bool use_spherical_harmonics = true);
 	static void precompute_irradiance_map_from_skysphere_and_write_gpu(const char* skysphere_path, unsigned int samples, unsigned int downscale_factor, const char* output_irradiance_map_path);
+
+	/**
+	 * Reference Monte Carlo integration: cosine weighted Hammersley directions,
+	 * the loop over the samples of a texel is vectorized
+	 */
 	static Image precompute_irradiance_map_from_skysphere(const char* skysphere_path, unsigned int samples, unsigned int downscale_factor = 1);
 
+	/**
+	 * Projects the skysphere on the first 3 bands of spherical harmonics (9 coefficients)
+	 * and evaluates the irradiance of each texel in closed form. Much faster than the
+	 * Monte Carlo integration and doesn't depend on a number of samples
+	 */
+	static Image precompute_irradiance_map_from_skysphere_sh(const char* skysphere_path, unsigned int downscale_factor = 1);
+	static void project_skysphere_sh9(const Image& skysphere_image, Color sh_coefficients[9]);
+	static Image read_downscaled_skysphere(const char* skysphere_path, unsigned int downscale_factor);
+
 	/**
 	 * @return Returns the ID of the texture containing the irradiance map
 	 */
 	static GLuint precompute_irradiance_map_from_skysphere_gpu(const char* skysphere_path, unsigned int samples, float mipmap_level = 0.0f);
-    static Image precompute_and_load_associated_irradiance(const char* skysphere_file_path, unsigned int samples = 20, unsigned int downscale_factor = 1);
+    static Image precompute_and_load_associated_irradiance(const char* skysphere_file_path, unsigned int samples = 20, unsigned int downscale_factor = 1, bool use_spherical_harmonics = true);
     static Image precompute_and_load_associated_irradiance_gpu(const char* skysphere_file_path, unsigned int samples, unsigned int downscale_factor);
 
     static std::vector<ImageData> read_cubemap_data(const char* folder_name, const char* face_extension);
@@ -44,7 +58,6 @@ public:
     static GLuint create_skysphere_texture_hdr(Image& skysphere_image, int texture_unit);
 	static GLuint create_skysphere_texture_from_path(const char* filename, int texture_unit);
 
-	static std::vector<std::vector<float>> compute_mipmaps(const std::vector<float>& input_image, int width, int height, std::vector<std::pair<int, int>>& mipmaps_widths_heights);
 	/**
 	 * Computes the mipmaps of a given image and stores the results in the mipmap levels of the 
 	 * @z_buffer_mipmap_texture texture
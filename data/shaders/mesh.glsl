@@ -13,7 +13,11 @@ uniform mat4 mvpMatrix;
 #endif
 
 #ifdef USE_NORMAL
-    layout(location= 2) in vec3 normal;
+    #ifdef USE_PACKED_VERTEX
+        layout(location= 2) in vec2 normal;
+    #else
+        layout(location= 2) in vec3 normal;
+    #endif
     uniform mat4 normalMatrix;
     out vec3 vertex_normal;
 #endif
@@ -28,21 +32,52 @@ uniform mat4 mvpMatrix;
     out vec4 vertex_color;
 #endif
 
+#ifdef USE_PACKED_VERTEX
+    // cf Mesh::vertex_format() et vertex_format.h
+    uniform vec3 position_offset;
+    uniform vec3 position_scale;
+    uniform vec2 texcoord_offset;
+    uniform vec2 texcoord_scale;
+    
+    // projection octaedrique
+    vec3 decode_octahedral( const vec2 code )
+    {
+        vec3 n= vec3(code, 1 - abs(code.x) - abs(code.y));
+        float t= max(-n.z, 0);
+        n.x+= (n.x >= 0) ? -t : t;
+        n.y+= (n.y >= 0) ? -t : t;
+        return normalize(n);
+    }
+#endif
+
 
 void main( )
 {
-    gl_Position= mvpMatrix * vec4(position, 1);
+#ifdef USE_PACKED_VERTEX
+    vec3 p= position_offset + position_scale * position;
+#else
+    vec3 p= position;
+#endif
+    gl_Position= mvpMatrix * vec4(p, 1);
     
 #ifdef USE_TEXCOORD
-    vertex_texcoord= texcoord;
+    #ifdef USE_PACKED_VERTEX
+        vertex_texcoord= texcoord_offset + texcoord_scale * texcoord;
+    #else
+        vertex_texcoord= texcoord;
+    #endif
 #endif
 
 #ifdef USE_NORMAL
-    vertex_normal= mat3(normalMatrix) * normal;
+    #ifdef USE_PACKED_VERTEX
+        vertex_normal= mat3(normalMatrix) * decode_octahedral(normal);
+    #else
+        vertex_normal= mat3(normalMatrix) * normal;
+    #endif
 #endif
 
 #if defined USE_LIGHT || !defined USE_NORMAL
-    vertex_position= vec3(mvMatrix * vec4(position, 1));
+    vertex_position= vec3(mvMatrix * vec4(p, 1));
 #endif
 
 #ifdef USE_COLOR
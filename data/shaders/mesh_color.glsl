@@ -11,9 +11,19 @@ layout(location= 0) in vec3 position;
 
 uniform mat4 mvpMatrix;
 
+#ifdef USE_PACKED_VERTEX
+    // cf Mesh::vertex_format() et vertex_format.h
+    uniform vec3 position_offset;
+    uniform vec3 position_scale;
+#endif
+
 void main( )
 {
+#ifdef USE_PACKED_VERTEX
+    gl_Position= mvpMatrix * vec4(position_offset + position_scale * position, 1);
+#else
     gl_Position= mvpMatrix * vec4(position, 1);
+#endif
 #ifdef USE_COLOR
     vertex_color= color;
 #endif
@@ -19,6 +19,24 @@ void main()
     float fourth_texel_depth = imageLoad(input_mipmap, thread_id * 2 + ivec2(1, 1)).r;
     float computed_mipmap_depth = max(max(max(first_texel_depth, second_texel_depth), third_texel_depth), fourth_texel_depth);
 
+    //Odd input size: the last column / row also covers the last input column / row
+    //so that the mipmap stays conservative, same as HiZPyramid on the CPU
+    ivec2 input_mipmap_size = imageSize(input_mipmap);
+    bool extra_column = (input_mipmap_size.x & 1) != 0 && thread_id.x == output_mipmap_size.x - 1;
+    bool extra_row = (input_mipmap_size.y & 1) != 0 && thread_id.y == output_mipmap_size.y - 1;
+    if (extra_column)
+    {
+        computed_mipmap_depth = max(computed_mipmap_depth, imageLoad(input_mipmap, thread_id * 2 + ivec2(2, 0)).r);
+        computed_mipmap_depth = max(computed_mipmap_depth, imageLoad(input_mipmap, thread_id * 2 + ivec2(2, 1)).r);
+    }
+    if (extra_row)
+    {
+        computed_mipmap_depth = max(computed_mipmap_depth, imageLoad(input_mipmap, thread_id * 2 + ivec2(0, 2)).r);
+        computed_mipmap_depth = max(computed_mipmap_depth, imageLoad(input_mipmap, thread_id * 2 + ivec2(1, 2)).r);
+    }
+    if (extra_column && extra_row)
+        computed_mipmap_depth = max(computed_mipmap_depth, imageLoad(input_mipmap, thread_id * 2 + ivec2(2, 2)).r);
+
     imageStore(output_mipmap, thread_id, vec4(vec3(computed_mipmap_depth), 1.0f));
 }
 
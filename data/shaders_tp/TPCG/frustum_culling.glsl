@@ -1,20 +1,70 @@
 #version 430
 
+//Per-frame uniforms shared by all the programs of TP2, uploaded once per frame
+//in a uniform buffer. Must match the layout of TP2::FrameUniforms
+layout(std140, row_major) uniform FrameUniforms
+{
+    mat4 u_vp_matrix;
+    //Viewport * projection * view, screen space bounding boxes of the occlusion culling
+    mat4 u_mvpv_matrix;
+    //Inverse of the viewport * projection * view matrix, skysphere
+    mat4 u_inverse_matrix;
+    mat4 u_view_matrix;
+    //Projection * view of the light, shadow map
+    mat4 u_lp_matrix;
+    //Corners of the view frustum, w is unused
+    vec4 frustum_world_space_vertices[8];
+
+    vec3 u_camera_position;
+    float u_exposure;
+    vec3 u_light_direction;
+    float u_shadow_intensity;
+    vec3 u_light_intensity;
+    //Pixels per unit of length at a distance of 1 from the camera
+    float u_lod_projection_scale;
+    //Maximum error of the level drawn, in pixels
+    float u_lod_threshold;
+    //How many mipmap levels we have in the hierarchical z buffer
+    int u_nb_mipmaps;
+    bool u_backface_culling;
+    bool u_lod_selection;
+};
+
 #ifdef COMPUTE_SHADER
 
 struct CullObject
 {
     vec3 min;
-    uint vertex_base;
+    uint first_index;
     vec3 max;
-    uint vertex_count;
+    uint index_count;
+};
+
+struct ClusterCone
+{
+    vec3 apex;
+    float cutoff;
+    vec3 axis;
+    float padding;
 };
 
+struct ClusterLOD
+{
+    vec3 center;
+    float radius;
+    float error;
+    float coarser_error;
+    int level;
+    float full_resolution_ratio;
+};
+
+//Same layout as the commands of glMultiDrawElementsIndirect
 struct MultiDrawIndirectParam
 {
-    uint vertex_count;
+    uint index_count;
     uint instance_count;
-    uint vertex_base;
+    uint first_index;
+    uint base_vertex;
     uint instance_base;
 };
 
@@ -33,35 +83,79 @@ layout(std430, binding = 2) buffer inputData
     CullObject input_cull_objects[];
 };
 
+#ifdef TWO_PHASE
+//Same layout as TP2::OcclusionCullingCounters
 layout(std430, binding = 3) buffer parameters
 {
     uint nb_groups_drawn;
+    uint nb_groups_drawn_phase2;
+    //Objects in the frustum tested by the second phase and parameters of its glDispatchComputeIndirect
+    uint nb_candidates;
+    uint dispatch_x;
+    uint dispatch_y;
+    uint dispatch_z;
+    uint triangles_drawn;
+    uint triangles_drawn_full_resolution;
+    uint triangles_drawn_per_lod[MAX_LOD_LEVELS];
+};
+
+//One bit per object, set when the object was visible last frame
+layout(std430, binding = 6) buffer visibilityBits
+{
+    uint visibility_bits[];
+};
+#else
+layout(std430, binding = 3) buffer parameters
+{
+    uint nb_groups_drawn;
+};
+#endif
+
+layout(std430, binding = 4) buffer inputCones
+{
+    ClusterCone input_cluster_cones[];
 };
 
-uniform vec3 frustum_world_space_vertices[8];
-uniform mat4 u_mvp_matrix;
+layout(std430, binding = 5) buffer inputLODs
+{
+    ClusterLOD input_cluster_lods[];
+};
 
 layout(local_size_x = 256) in;
 void main()
 {
     const uint thread_id = gl_GlobalInvocationID.x;
+#ifndef TWO_PHASE
     if (thread_id == 0)
         nb_groups_drawn = 0;
+#endif
 
     if (thread_id >= input_cull_objects.length())
         return;
 
+    //Only one level of detail of each group is drawn: the coarsest whose error is below the threshold
+    ClusterLOD lod = input_cluster_lods[thread_id];
+    if (u_lod_selection)
+    {
+        float distance = max(length(lod.center - u_camera_position) - lod.radius, 1.0e-4f);
+        float threshold = u_lod_threshold * distance;
+        if (lod.error * u_lod_projection_scale > threshold || lod.coarser_error * u_lod_projection_scale <= threshold)
+            return;
+    }
+    else if (lod.level != 0)
+        return;
+
     CullObject cull_object = input_cull_objects[thread_id];
 
     vec4 bbox_points_projective[8];
-    bbox_points_projective[0] = u_mvp_matrix * vec4(cull_object.min.xyz, 1);
-    bbox_points_projective[1] = u_mvp_matrix * vec4(cull_object.max.x, cull_object.min.y, cull_object.min.z, 1);
-    bbox_points_projective[2] = u_mvp_matrix * vec4(cull_object.min.x, cull_object.max.y, cull_object.min.z, 1);
-    bbox_points_projective[3] = u_mvp_matrix * vec4(cull_object.max.x, cull_object.max.y, cull_object.min.z, 1);
-    bbox_points_projective[4] = u_mvp_matrix * vec4(cull_object.min.x, cull_object.min.y, cull_object.max.z, 1);
-    bbox_points_projective[5] = u_mvp_matrix * vec4(cull_object.max.x, cull_object.min.y, cull_object.max.z, 1);
-    bbox_points_projective[6] = u_mvp_matrix * vec4(cull_object.min.x, cull_object.max.y, cull_object.max.z, 1);
-    bbox_points_projective[7] = u_mvp_matrix * vec4(cull_object.max.xyz, 1);
+    bbox_points_projective[0] = u_vp_matrix * vec4(cull_object.min.xyz, 1);
+    bbox_points_projective[1] = u_vp_matrix * vec4(cull_object.max.x, cull_object.min.y, cull_object.min.z, 1);
+    bbox_points_projective[2] = u_vp_matrix * vec4(cull_object.min.x, cull_object.max.y, cull_object.min.z, 1);
+    bbox_points_projective[3] = u_vp_matrix * vec4(cull_object.max.x, cull_object.max.y, cull_object.min.z, 1);
+    bbox_points_projective[4] = u_vp_matrix * vec4(cull_object.min.x, cull_object.min.y, cull_object.max.z, 1);
+    bbox_points_projective[5] = u_vp_matrix * vec4(cull_object.max.x, cull_object.min.y, cull_object.max.z, 1);
+    bbox_points_projective[6] = u_vp_matrix * vec4(cull_object.min.x, cull_object.max.y, cull_object.max.z, 1);
+    bbox_points_projective[7] = u_vp_matrix * vec4(cull_object.max.xyz, 1);
 
     for (int coord_index = 0; coord_index < 6; coord_index++)
     {
@@ -92,7 +186,7 @@ void main()
         bool all_points_outside = true;
         for (int i = 0; i < 8; i++)
         {
-            vec3 frustum_point = frustum_world_space_vertices[i];
+            vec3 frustum_point = frustum_world_space_vertices[i].xyz;
 
             int test_negative = coord_index & 1;
 
@@ -110,14 +204,44 @@ void main()
             return;
     }
 
+    //All the triangles of the cluster are facing away from the camera
+    if (u_backface_culling)
+    {
+        ClusterCone cone = input_cluster_cones[thread_id];
+
+        vec3 to_apex = cone.apex - u_camera_position;
+        if (dot(to_apex, cone.axis) > cone.cutoff * length(to_apex))
+            return;
+    }
+
+#ifdef TWO_PHASE
+    //Every object in the frustum is tested by the second phase against the z-buffer
+    //of the objects drawn by this phase
+    uint candidate = atomicAdd(nb_candidates, 1);
+    output_objects_drawn_id[candidate] = thread_id;
+    atomicMax(dispatch_x, candidate / 256 + 1);
+
+    //Only the objects that were visible last frame are drawn by the first phase
+    if ((visibility_bits[thread_id >> 5] & (1u << (thread_id & 31u))) == 0)
+        return;
+#endif
+
     uint index = atomicAdd(nb_groups_drawn, 1);
 
-    output_draw_params[index].vertex_count = input_cull_objects[thread_id].vertex_count;
-    output_draw_params[index].vertex_base = input_cull_objects[thread_id].vertex_base;
+    output_draw_params[index].index_count = input_cull_objects[thread_id].index_count;
+    output_draw_params[index].first_index = input_cull_objects[thread_id].first_index;
+    output_draw_params[index].base_vertex = 0;
     output_draw_params[index].instance_count = 1;
     output_draw_params[index].instance_base = 0;
 
+#ifdef TWO_PHASE
+    uint triangles = cull_object.index_count / 3;
+    atomicAdd(triangles_drawn, triangles);
+    atomicAdd(triangles_drawn_per_lod[lod.level], triangles);
+    atomicAdd(triangles_drawn_full_resolution, uint(float(triangles) * lod.full_resolution_ratio));
+#else
     output_objects_drawn_id[index] = thread_id;
+#endif
 }
 
 #endif
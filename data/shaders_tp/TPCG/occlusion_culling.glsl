@@ -1,20 +1,52 @@
 #version 430
 
+//Per-frame uniforms shared by all the programs of TP2, uploaded once per frame
+//in a uniform buffer. Must match the layout of TP2::FrameUniforms
+layout(std140, row_major) uniform FrameUniforms
+{
+    mat4 u_vp_matrix;
+    //Viewport * projection * view, screen space bounding boxes of the occlusion culling
+    mat4 u_mvpv_matrix;
+    //Inverse of the viewport * projection * view matrix, skysphere
+    mat4 u_inverse_matrix;
+    mat4 u_view_matrix;
+    //Projection * view of the light, shadow map
+    mat4 u_lp_matrix;
+    //Corners of the view frustum, w is unused
+    vec4 frustum_world_space_vertices[8];
+
+    vec3 u_camera_position;
+    float u_exposure;
+    vec3 u_light_direction;
+    float u_shadow_intensity;
+    vec3 u_light_intensity;
+    //Pixels per unit of length at a distance of 1 from the camera
+    float u_lod_projection_scale;
+    //Maximum error of the level drawn, in pixels
+    float u_lod_threshold;
+    //How many mipmap levels we have in the hierarchical z buffer
+    int u_nb_mipmaps;
+    bool u_backface_culling;
+    bool u_lod_selection;
+};
+
 #ifdef COMPUTE_SHADER
 
 struct CullObject
 {
     vec3 min;
-    uint vertex_base;
+    uint first_index;
     vec3 max;
-    uint vertex_count;
+    uint index_count;
 };
 
+//Same layout as the commands of glMultiDrawElementsIndirect
 struct MultiDrawIndirectParam
 {
-    uint vertex_count;
+    uint index_count;
     uint instance_count;
-    uint vertex_base;
+    uint first_index;
+    uint base_vertex;
     uint instance_base;
 };
 
@@ -38,10 +70,48 @@ layout(std430, binding = 3) buffer outputDrawCommandsBuffer
     MultiDrawIndirectParam output_draw_commands[];
 };
 
+#ifdef TWO_PHASE
+struct ClusterLOD
+{
+    vec3 center;
+    float radius;
+    float error;
+    float coarser_error;
+    int level;
+    float full_resolution_ratio;
+};
+
+//Same layout as TP2::OcclusionCullingCounters
+layout(std430, binding = 4) buffer nbObjectsDrawnBuffer
+{
+    uint nb_phase1_objects;
+    uint nb_passing_objects;
+    //Objects to cull written by the first phase and parameters of the glDispatchComputeIndirect of this pass
+    uint nb_objects_to_cull;
+    uint dispatch_x;
+    uint dispatch_y;
+    uint dispatch_z;
+    uint triangles_drawn;
+    uint triangles_drawn_full_resolution;
+    uint triangles_drawn_per_lod[MAX_LOD_LEVELS];
+};
+
+//One bit per object, set when the object was visible last frame. Updated with the result of the test
+layout(std430, binding = 5) buffer visibilityBits
+{
+    uint visibility_bits[];
+};
+
+layout(std430, binding = 6) buffer inputLODs
+{
+    ClusterLOD input_cluster_lods[];
+};
+#else
 layout(std430, binding = 4) buffer nbObjectsDrawnBuffer
 {
     uint nb_passing_objects;
 };
+#endif
 
 // We have 2 samplers for the hierarchical z-buffer because the mipmap level 0
 // is a depth texture, not a color texture as the levels 1, 2,3 , ... are so we
@@ -52,13 +122,6 @@ uniform sampler2D u_z_buffer_mipmap0;
 // All the other mipmaps (1, 2, 3, ......) of the hierarchical z-buffer
 uniform sampler2D u_z_buffer_mipmaps1;
 
-// How many mipmap levels we have in the hierarchical z buffer
-uniform int u_nb_mipmaps;
-
-uniform mat4 u_mvp_matrix;
-uniform mat4 u_mvpv_matrix;
-uniform mat4 u_view_matrix;
-
 uniform int u_nb_objects_to_cull;
 
 int get_visibility_of_object_from_camera(CullObject object)
@@ -122,16 +185,8 @@ void get_object_screen_space_bounding_box(CullObject object, out vec3 out_bbox_m
     }
 }
 
-layout(local_size_x = 256) in;
-void main()
+bool is_object_visible(CullObject object)
 {
-    uint thread_id = gl_GlobalInvocationID.x;
-    if (thread_id >= u_nb_objects_to_cull)
-        return;
-
-    uint object_id = input_cull_object_ids[thread_id];
-    CullObject object = input_cull_objects[object_id];
-
     vec3 screen_space_bbox_min, screen_space_bbox_max;
     ivec2 z_buffer_mipmap_0_dims = textureSize(u_z_buffer_mipmap0, 0);
     int visibility = get_visibility_of_object_from_camera(object);
@@ -150,7 +205,7 @@ void main()
         screen_space_bbox_max = min(screen_space_bbox_max, vec3(z_buffer_mipmap_0_dims.x - 1, z_buffer_mipmap_0_dims.y - 1, 1000000.0f));
     }
     else //Not visible
-        return;
+        return false;
 
     //We're going to consider that all the pixels of the object are at the same depth,
     //this depth because the closest one to the camera
@@ -205,16 +260,60 @@ void main()
             break;
     }
 
-    if (one_pixel_visible)
-    {
-        uint index = atomicAdd(nb_passing_objects, 1);
+    return one_pixel_visible;
+}
 
-        passing_object_ids[index] = object_id;
-        output_draw_commands[index].vertex_count = object.vertex_count;
-        output_draw_commands[index].vertex_base = object.vertex_base;
-        output_draw_commands[index].instance_count = 1;
-        output_draw_commands[index].instance_base = 0;
+layout(local_size_x = 256) in;
+void main()
+{
+    uint thread_id = gl_GlobalInvocationID.x;
+#ifdef TWO_PHASE
+    if (thread_id >= nb_objects_to_cull)
+        return;
+#else
+    if (thread_id >= u_nb_objects_to_cull)
+        return;
+#endif
+
+    uint object_id = input_cull_object_ids[thread_id];
+    CullObject object = input_cull_objects[object_id];
+
+    bool visible = is_object_visible(object);
+#ifdef TWO_PHASE
+    //The visibility of the object is kept for the first phase of the next frame
+    uint mask = 1u << (object_id & 31u);
+    if (!visible)
+    {
+        atomicAnd(visibility_bits[object_id >> 5], ~mask);
+        return;
     }
+
+    //Only the objects that were not already drawn by the first phase are drawn by the second
+    uint previous_bits = atomicOr(visibility_bits[object_id >> 5], mask);
+    if ((previous_bits & mask) != 0)
+        return;
+#else
+    if (!visible)
+        return;
+#endif
+
+    uint index = atomicAdd(nb_passing_objects, 1);
+
+    output_draw_commands[index].index_count = object.index_count;
+    output_draw_commands[index].first_index = object.first_index;
+    output_draw_commands[index].base_vertex = 0;
+    output_draw_commands[index].instance_count = 1;
+    output_draw_commands[index].instance_base = 0;
+
+#ifdef TWO_PHASE
+    ClusterLOD lod = input_cluster_lods[object_id];
+    uint triangles = object.index_count / 3;
+    atomicAdd(triangles_drawn, triangles);
+    atomicAdd(triangles_drawn_per_lod[lod.level], triangles);
+    atomicAdd(triangles_drawn_full_resolution, uint(float(triangles) * lod.full_resolution_ratio));
+#else
+    passing_object_ids[index] = object_id;
+#endif
 }
 
 #endif
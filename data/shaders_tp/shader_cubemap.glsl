@@ -1,5 +1,35 @@
 #version 330
 
+//Per-frame uniforms shared by all the programs of TP2, uploaded once per frame
+//in a uniform buffer. Must match the layout of TP2::FrameUniforms
+layout(std140, row_major) uniform FrameUniforms
+{
+    mat4 u_vp_matrix;
+    //Viewport * projection * view, screen space bounding boxes of the occlusion culling
+    mat4 u_mvpv_matrix;
+    //Inverse of the viewport * projection * view matrix, skysphere
+    mat4 u_inverse_matrix;
+    mat4 u_view_matrix;
+    //Projection * view of the light, shadow map
+    mat4 u_lp_matrix;
+    //Corners of the view frustum, w is unused
+    vec4 frustum_world_space_vertices[8];
+
+    vec3 u_camera_position;
+    float u_exposure;
+    vec3 u_light_direction;
+    float u_shadow_intensity;
+    vec3 u_light_intensity;
+    //Pixels per unit of length at a distance of 1 from the camera
+    float u_lod_projection_scale;
+    //Maximum error of the level drawn, in pixels
+    float u_lod_threshold;
+    //How many mipmap levels we have in the hierarchical z buffer
+    int u_nb_mipmaps;
+    bool u_backface_culling;
+    bool u_lod_selection;
+};
+
 #ifdef VERTEX_SHADER
 
 void main()
@@ -22,9 +52,6 @@ void main()
 
 #ifdef FRAGMENT_SHADER
 
-uniform mat4 u_inverse_matrix;
-uniform vec3 u_camera_position;
-
 uniform int u_use_cubemap;
 uniform samplerCube u_cubemap;
 
@@ -1,13 +1,51 @@
 #version 330
 
+//Per-frame uniforms shared by all the programs of TP2, uploaded once per frame
+//in a uniform buffer. Must match the layout of TP2::FrameUniforms
+layout(std140, row_major) uniform FrameUniforms
+{
+    mat4 u_vp_matrix;
+    //Viewport * projection * view, screen space bounding boxes of the occlusion culling
+    mat4 u_mvpv_matrix;
+    //Inverse of the viewport * projection * view matrix, skysphere
+    mat4 u_inverse_matrix;
+    mat4 u_view_matrix;
+    //Projection * view of the light, shadow map
+    mat4 u_lp_matrix;
+    //Corners of the view frustum, w is unused
+    vec4 frustum_world_space_vertices[8];
+
+    vec3 u_camera_position;
+    float u_exposure;
+    vec3 u_light_direction;
+    float u_shadow_intensity;
+    vec3 u_light_intensity;
+    //Pixels per unit of length at a distance of 1 from the camera
+    float u_lod_projection_scale;
+    //Maximum error of the level drawn, in pixels
+    float u_lod_threshold;
+    //How many mipmap levels we have in the hierarchical z buffer
+    int u_nb_mipmaps;
+    bool u_backface_culling;
+    bool u_lod_selection;
+};
+
 #ifdef VERTEX_SHADER
 
 layout(location = 0) in vec3 position;
 
-uniform mat4 mlp_matrix;
+#ifdef USE_PACKED_VERTEX
+//Dequantization of the compressed positions, cf vertex_format.h
+uniform vec3 u_position_offset;
+uniform vec3 u_position_scale;
+#endif
 
 void main()
 {
-    gl_Position = mlp_matrix * vec4(position, 1);
+#ifdef USE_PACKED_VERTEX
+    gl_Position = u_lp_matrix * vec4(u_position_offset + u_position_scale * position, 1);
+#else
+    gl_Position = u_lp_matrix * vec4(position, 1);
+#endif
 }
 #endif
@@ -1,14 +1,64 @@
 #version 330
 
+//Per-frame uniforms shared by all the programs of TP2, uploaded once per frame
+//in a uniform buffer. Must match the layout of TP2::FrameUniforms
+layout(std140, row_major) uniform FrameUniforms
+{
+    mat4 u_vp_matrix;
+    //Viewport * projection * view, screen space bounding boxes of the occlusion culling
+    mat4 u_mvpv_matrix;
+    //Inverse of the viewport * projection * view matrix, skysphere
+    mat4 u_inverse_matrix;
+    mat4 u_view_matrix;
+    //Projection * view of the light, shadow map
+    mat4 u_lp_matrix;
+    //Corners of the view frustum, w is unused
+    vec4 frustum_world_space_vertices[8];
+
+    vec3 u_camera_position;
+    float u_exposure;
+    vec3 u_light_direction;
+    float u_shadow_intensity;
+    vec3 u_light_intensity;
+    //Pixels per unit of length at a distance of 1 from the camera
+    float u_lod_projection_scale;
+    //Maximum error of the level drawn, in pixels
+    float u_lod_threshold;
+    //How many mipmap levels we have in the hierarchical z buffer
+    int u_nb_mipmaps;
+    bool u_backface_culling;
+    bool u_lod_selection;
+};
+
 #ifdef VERTEX_SHADER
 
 layout(location = 0) in vec3 position;
+#ifdef USE_PACKED_VERTEX
+layout(location = 1) in vec2 normal;
+#else
 layout(location = 1) in vec3 normal;
+#endif
 layout(location = 2) in vec2 texcoords;
 
+#ifdef USE_PACKED_VERTEX
+//Dequantization of the compressed attributes, cf vertex_format.h
+uniform vec3 u_position_offset;
+uniform vec3 u_position_scale;
+uniform vec2 u_texcoord_offset;
+uniform vec2 u_texcoord_scale;
+
+vec3 decode_octahedral(vec2 code)
+{
+    vec3 n = vec3(code, 1.0f - abs(code.x) - abs(code.y));
+    float t = max(-n.z, 0.0f);
+    n.x += (n.x >= 0.0f) ? -t : t;
+    n.y += (n.y >= 0.0f) ? -t : t;
+
+    return normalize(n);
+}
+#endif
+
 uniform mat4 u_model_matrix;
-uniform mat4 u_vp_matrix;
-uniform mat4 u_lp_matrix;
 
 out mat4 vs_model_matrix;
 out vec4 vs_position_light_space;
@@ -18,14 +68,24 @@ out vec2 vs_texcoords;
 
 void main()
 {
-    gl_Position = u_vp_matrix * u_model_matrix * vec4(position, 1.0f);
+#ifdef USE_PACKED_VERTEX
+    vec3 vertex_position = u_position_offset + u_position_scale * position;
+    vec3 vertex_normal = decode_octahedral(normal);
+    vec2 vertex_texcoords = u_texcoord_offset + u_texcoord_scale * texcoords;
+#else
+    vec3 vertex_position = position;
+    vec3 vertex_normal = normal;
+    vec2 vertex_texcoords = texcoords;
+#endif
+
+    gl_Position = u_vp_matrix * u_model_matrix * vec4(vertex_position, 1.0f);
 
-    vs_normal = vec3(u_model_matrix * vec4(normal, 0.0f));
-    vs_normal = normalize(vec3(transpose(inverse(u_model_matrix)) * vec4(normal, 0.0f)));
-    vs_position = vec3(u_model_matrix * vec4(position, 1.0f));
-    vs_texcoords = texcoords;
+    vs_normal = vec3(u_model_matrix * vec4(vertex_normal, 0.0f));
+    vs_normal = normalize(vec3(transpose(inverse(u_model_matrix)) * vec4(vertex_normal, 0.0f)));
+    vs_position = vec3(u_model_matrix * vec4(vertex_position, 1.0f));
+    vs_texcoords = vertex_texcoords;
 
-    vs_position_light_space = u_lp_matrix * u_model_matrix * vec4(position, 1);
+    vs_position_light_space = u_lp_matrix * u_model_matrix * vec4(vertex_position, 1);
 
     vs_model_matrix = u_model_matrix;
 }
@@ -35,10 +95,6 @@ void main()
 
 const float M_PI = 3.1415926535897932384626433832795f;
 
-uniform vec3 u_camera_position;
-uniform vec3 u_light_direction;
-uniform vec3 u_light_intensity;
-
 uniform bool u_use_irradiance_map;
 uniform bool u_has_normal_map;
 uniform bool u_do_normal_mapping;
@@ -48,7 +104,6 @@ uniform sampler2D u_mesh_base_color_texture;
 uniform sampler2D u_mesh_specular_texture;
 uniform sampler2D u_mesh_normal_map;
 uniform sampler2D u_shadow_map;
-uniform float u_shadow_intensity;
 
 uniform bool u_override_material;
 uniform float u_metalness;
@@ -158,7 +213,10 @@ vec3 normal_mapping(vec2 normal_map_uv)
                     normalize(bitangent),
                     normalize(vs_normal));
 
-    vec3 texture_normal = texture2D(u_mesh_normal_map, normal_map_uv).rgb * 2.0f - 1.0f;
+    //Only x and y are read: the baked normal maps are BC5 (two channels), z is reconstructed
+    vec3 texture_normal;
+    texture_normal.xy = texture2D(u_mesh_normal_map, normal_map_uv).rg * 2.0f - 1.0f;
+    texture_normal.z = sqrt(max(0.0f, 1.0f - dot(texture_normal.xy, texture_normal.xy)));
     return normalize(ONB * texture_normal);
 }
 
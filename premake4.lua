@@ -290,7 +290,70 @@ project("bench_setup")
 	targetdir "bin"
 	files ( gkit_files )
 	files { gkit_dir .. "/tutos/bench/bench_setup.cpp" }
+
+project("bench_weld")
+	language "C++"
+	kind "ConsoleApp"
+	targetdir "bin"
+	files ( gkit_files )
+	files { gkit_dir .. "/tutos/bench/bench_weld.cpp" }
+
+project("bench_tlas")
+	language "C++"
+	kind "ConsoleApp"
+	targetdir "bin"
+	files ( gkit_files )
+	files { gkit_dir .. "/tutos/bench/bench_tlas.cpp" }
+
+project("bench_occlusion")
+	language "C++"
+	kind "ConsoleApp"
+	targetdir "bin"
+	files ( gkit_files )
+	files { gkit_dir .. "/tutos/bench/bench_occlusion.cpp", gkit_dir .. "/TPs/from_scratch/occlusion_rasterizer.cpp" }
+
+project("bench_hiz")
+	language "C++"
+	kind "ConsoleApp"
+	targetdir "bin"
+	files ( gkit_files )
+	files { gkit_dir .. "/tutos/bench/bench_hiz.cpp", gkit_dir .. "/TPs/from_scratch/hiz_pyramid.cpp" }
+
+project("bench_frustum")
+	language "C++"
+	kind "ConsoleApp"
+	targetdir "bin"
+	files ( gkit_files )
+	files { gkit_dir .. "/tutos/bench/bench_frustum.cpp", gkit_dir .. "/TPs/from_scratch/frustum_culler.cpp", gkit_dir .. "/TPs/from_scratch/culling_bvh.cpp" }
         
+project("bench_clusters")
+	language "C++"
+	kind "ConsoleApp"
+	targetdir "bin"
+	files ( gkit_files )
+	files { gkit_dir .. "/tutos/bench/bench_clusters.cpp", gkit_dir .. "/TPs/from_scratch/frustum_culler.cpp", gkit_dir .. "/TPs/from_scratch/mesh_clusters.cpp" }
+
+project("bench_vcache")
+	language "C++"
+	kind "ConsoleApp"
+	targetdir "bin"
+	files ( gkit_files )
+	files { gkit_dir .. "/tutos/bench/bench_vcache.cpp" }
+
+project("bench_lods")
+	language "C++"
+	kind "ConsoleApp"
+	targetdir "bin"
+	files ( gkit_files )
+	files { gkit_dir .. "/tutos/bench/bench_lods.cpp", gkit_dir .. "/TPs/from_scratch/frustum_culler.cpp", gkit_dir .. "/TPs/from_scratch/mesh_lods.cpp", gkit_dir .. "/TPs/from_scratch/mesh_simplifier.cpp" }
+
+project("bench_vertex_format")
+	language "C++"
+	kind "ConsoleApp"
+	targetdir "bin"
+	files ( gkit_files )
+	files { gkit_dir .. "/tutos/bench/bench_vertex_format.cpp" }
+
 project("gltf")
 	language "C++"
 	kind "ConsoleApp"
@@ -304,6 +367,24 @@ project("simple_gltf")
 	targetdir "bin"
 	files ( gkit_files )
 	files { gkit_dir .. "/tutos/gltf/simple.cpp" }
+
+ktx2_bake_files = { gkit_dir .. "/tutos/ktx2/ktx2_bake.cpp", gkit_dir .. "/tutos/ktx2/bc_encoder.cpp", gkit_dir .. "/tutos/ktx2/zstd/zstd.c" }
+
+project("bake_textures")
+	language "C++"
+	kind "ConsoleApp"
+	targetdir "bin"
+	files ( gkit_files )
+	files ( ktx2_bake_files )
+	files { gkit_dir .. "/tutos/ktx2/bake_textures.cpp" }
+
+project("bench_ktx2")
+	language "C++"
+	kind "ConsoleApp"
+	targetdir "bin"
+	files ( gkit_files )
+	files ( ktx2_bake_files )
+	files { gkit_dir .. "/tutos/bench/bench_ktx2.cpp", gkit_dir .. "/tutos/ktx2/ktx2.cpp", gkit_dir .. "/tutos/ktx2/transcoder/basisu_transcoder.cpp" }
 	
 project("tp1")
 	language "C++"
@@ -318,6 +399,7 @@ project("from_scratch")
 	targetdir "bin"
 	files ( gkit_files )
 	files ( imgui_files )
-	files { gkit_dir .. "/TPs/from_scratch/*.cpp" }
+	files ( ktx2_bake_files )
+	files { gkit_dir .. "/TPs/from_scratch/*.cpp", gkit_dir .. "/tutos/ktx2/ktx2_texture.cpp" }
 
 os.execute("cp extern/visual/bin/*.dll bin/")
@@ -109,7 +109,7 @@ void draw( Mesh& m, DrawParam& param )
 }
 
 
-GLuint DrawParam::create_program( const GLenum primitives, const bool use_texcoord, const bool use_normal, const bool use_color, const bool use_light, const bool use_alpha_test )
+GLuint DrawParam::create_program( const GLenum primitives, const bool use_texcoord, const bool use_normal, const bool use_color, const bool use_light, const bool use_alpha_test, const bool use_packed_vertex )
 {
     std::string definitions;
 
@@ -123,6 +123,8 @@ GLuint DrawParam::create_program( const GLenum primitives, const bool use_texcoo
         definitions.append("#define USE_LIGHT\n");
     if(use_texcoord && use_alpha_test)
         definitions.append("#define USE_ALPHATEST\n");
+    if(use_packed_vertex)
+        definitions.append("#define USE_PACKED_VERTEX\n");
 
     //~ printf("--\n%s", definitions.c_str());
     const char *filename= smart_path("data/shaders/mesh.glsl");
@@ -183,7 +185,7 @@ void DrawParam::draw( Mesh& mesh )
         return;
     }
     
-    program= create_program(mesh.primitives(), use_texcoord, use_normal, use_color, m_use_light, m_use_alpha_test);
+    program= create_program(mesh.primitives(), use_texcoord, use_normal, use_color, m_use_light, m_use_alpha_test, mesh.vertex_format() == VERTEX_FORMAT_PACKED);
     
     glUseProgram(program);
     if(!use_color)
@@ -246,7 +248,7 @@ void DrawParam::draw( const TriangleGroup& group, Mesh& mesh )
     bool use_color= mesh.has_color();
     
     // etape 1 : construit le program en fonction des attributs du mesh et des options choisies
-    GLuint program= create_program(mesh.primitives(), use_texcoord, use_normal, use_color, m_use_light, m_use_alpha_test);
+    GLuint program= create_program(mesh.primitives(), use_texcoord, use_normal, use_color, m_use_light, m_use_alpha_test, mesh.vertex_format() == VERTEX_FORMAT_PACKED);
     
     glUseProgram(program);
     if(group.index != -1 && group.index < mesh.materials().count())
@@ -6,6 +6,15 @@
     #include <sys/stat.h>
 #endif
 
+#ifdef WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+#endif
+
 #include <string>
 #include <algorithm>
 
@@ -115,3 +124,85 @@ std::string relative_filename( const std::string& filename, const std::string& p
     
     return filename.substr(i);
 }
+
+
+//! projette un fichier en memoire.
+MappedFile map_file( const std::string& filename )
+{
+    MappedFile file;
+    
+#ifndef WIN32
+    int fd= open(filename.c_str(), O_RDONLY);
+    if(fd < 0)
+        return file;
+    
+    struct stat info;
+    if(fstat(fd, &info) < 0 || info.st_size == 0)
+    {
+        close(fd);
+        return file;
+    }
+    
+    void *data= mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);  // la projection reste valide apres la fermeture du fichier
+    if(data == MAP_FAILED)
+        return file;
+    
+    // le fichier sera lu sequentiellement...
+    madvise(data, info.st_size, MADV_SEQUENTIAL);
+    
+    file.data= (const char *) data;
+    file.size= size_t(info.st_size);
+    
+#else
+    HANDLE handle= CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if(handle == INVALID_HANDLE_VALUE)
+        return file;
+    
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(handle, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(handle);
+        return file;
+    }
+    
+    HANDLE mapping= CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(mapping == nullptr)
+    {
+        CloseHandle(handle);
+        return file;
+    }
+    
+    const void *data= MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if(data == nullptr)
+    {
+        CloseHandle(mapping);
+        CloseHandle(handle);
+        return file;
+    }
+    
+    file.data= (const char *) data;
+    file.size= size_t(size.QuadPart);
+    file.handle= handle;
+    file.mapping= mapping;
+#endif
+
+    return file;
+}
+
+//! detruit la projection d'un fichier.
+void unmap_file( MappedFile& file )
+{
+    if(file.data == nullptr)
+        return;
+    
+#ifndef WIN32
+    munmap((void *) file.data, file.size);
+#else
+    UnmapViewOfFile(file.data);
+    CloseHandle((HANDLE) file.mapping);
+    CloseHandle((HANDLE) file.handle);
+#endif
+    
+    file= MappedFile();
+}
@@ -27,4 +27,22 @@ std::string normalize_filename( const std::string& filename );
 */
 std::string relative_filename( const std::string& filename, const std::string& path );
 
+
+//! fichier projete en memoire, en lecture seule. cf map_file() et unmap_file().
+struct MappedFile
+{
+    const char *data;   //!< contenu du fichier, n'est pas termine par un 0.
+    size_t size;        //!< taille du fichier en octets.
+    void *handle;       //!< details internes, fichier et projection (windows).
+    void *mapping;
+    
+    MappedFile( ) : data(nullptr), size(0), handle(nullptr), mapping(nullptr) {}
+};
+
+//! projette un fichier en memoire. renvoie un MappedFile vide en cas d'erreur (ou si le fichier est vide).
+MappedFile map_file( const std::string& filename );
+
+//! detruit la projection d'un fichier.
+void unmap_file( MappedFile& file );
+
 #endif
@@ -0,0 +1,213 @@
+
+#include <cstdio>
+#include <cstdint>
+#include <cfloat>
+#include <chrono>
+#include <algorithm>
+
+#include "image_tiles.h"
+
+
+TileRenderer::TileRenderer( const int width, const int height, const int tile_size, const int threads ) :
+    m_tiles(), m_tile_times(), m_accumulation(width * height), m_width(width), m_height(height), m_samples(0),
+    m_queues(std::max(1, (threads > 0) ? threads : int(std::thread::hardware_concurrency()))), m_workers(),
+    m_lock(), m_start(), m_done(), m_job(nullptr), m_generation(0), m_running(0), m_stop(false), m_time(0)
+{
+    // decoupe l'image, les tuiles sont numerotees ligne par ligne
+    int size= std::max(1, tile_size);
+    for(int y= 0; y < height; y+= size)
+    for(int x= 0; x < width; x+= size)
+        m_tiles.push_back( { x, y, std::min(x + size, width), std::min(y + size, height) } );
+
+    m_tile_times.resize(m_tiles.size(), 0);
+    clear();
+
+    // le thread appelant est le thread 0, cf run()
+    for(int i= 1; i < int(m_queues.size()); i++)
+        m_workers.emplace_back(&TileRenderer::worker, this, i);
+}
+
+TileRenderer::~TileRenderer( )
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_stop= true;
+    }
+    m_start.notify_all();
+
+    for(auto& thread : m_workers)
+        thread.join();
+}
+
+void TileRenderer::clear( )
+{
+    std::fill(m_accumulation.begin(), m_accumulation.end(), Color(0, 0, 0, 0));
+    m_samples= 0;
+}
+
+
+void TileRenderer::run( const std::function<void (const Tile&, const int)>& f )
+{
+    auto start= std::chrono::high_resolution_clock::now();
+
+    // repartit les tuiles en bandes contigues, les threads inactifs voleront le travail des autres
+    const int n= threads();
+    const int count= int(m_tiles.size());
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        for(int i= 0; i < n; i++)
+        {
+            TileQueue& queue= m_queues[i];
+            std::lock_guard<std::mutex> queue_lock(queue.lock);
+            queue.begin= int(int64_t(count) * i / n);
+            queue.end= int(int64_t(count) * (i +1) / n);
+            queue.tiles= 0;
+            queue.steals= 0;
+        }
+
+        m_job= &f;
+        m_running= n -1;
+        m_generation++;
+    }
+    m_start.notify_all();
+
+    // le thread appelant participe aussi
+    work(0);
+
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_done.wait(lock, [&]{ return m_running == 0; });
+        m_job= nullptr;
+    }
+
+    auto stop= std::chrono::high_resolution_clock::now();
+    m_time= float(std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count()) / 1000;
+}
+
+void TileRenderer::worker( const int id )
+{
+    int generation= 0;
+    for(;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_start.wait(lock, [&]{ return m_stop || m_generation != generation; });
+            if(m_stop)
+                return;
+            generation= m_generation;
+        }
+
+        work(id);
+
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_running--;
+            if(m_running == 0)
+                m_done.notify_one();
+        }
+    }
+}
+
+void TileRenderer::work( const int id )
+{
+    // les tuiles ne sont distribuees qu'au debut de run(), un thread peut s'arreter des que toutes les files sont vides.
+    int tile;
+    while(pop(id, tile) || steal(id, tile))
+    {
+        auto start= std::chrono::high_resolution_clock::now();
+
+        (*m_job)(m_tiles[tile], id);
+
+        auto stop= std::chrono::high_resolution_clock::now();
+        m_tile_times[tile]= float(std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count()) / 1000;
+        m_queues[id].tiles++;
+    }
+}
+
+bool TileRenderer::pop( const int id, int& tile )
+{
+    TileQueue& queue= m_queues[id];
+    std::lock_guard<std::mutex> lock(queue.lock);
+    if(queue.begin == queue.end)
+        return false;
+
+    // le thread traite ses tuiles dans l'ordre, les voleurs prennent les dernieres
+    tile= queue.begin++;
+    return true;
+}
+
+bool TileRenderer::steal( const int id, int& tile )
+{
+    const int n= threads();
+    for(int i= 1; i < n; i++)
+    {
+        TileQueue& victim= m_queues[(id + i) % n];
+
+        int begin, end;
+        {
+            std::lock_guard<std::mutex> lock(victim.lock);
+            int remaining= victim.end - victim.begin;
+            if(remaining == 0)
+                continue;
+
+            // vole la moitie des tuiles restantes, a la fin de la file
+            end= victim.end;
+            begin= end - (remaining +1) / 2;
+            victim.end= begin;
+        }
+
+        // traite la premiere tuile volee, les autres passent dans la file du thread, qui est vide
+        TileQueue& queue= m_queues[id];
+        {
+            std::lock_guard<std::mutex> lock(queue.lock);
+            queue.begin= begin +1;
+            queue.end= end;
+            queue.steals++;
+        }
+
+        tile= begin;
+        return true;
+    }
+
+    return false;
+}
+
+
+void TileRenderer::print_stats( ) const
+{
+    float tmin= FLT_MAX;
+    float tmax= 0;
+    float total= 0;
+    for(float t : m_tile_times)
+    {
+        tmin= std::min(tmin, t);
+        tmax= std::max(tmax, t);
+        total+= t;
+    }
+    if(m_tile_times.empty())
+        tmin= 0;
+
+    printf("tiles: %d tiles, %d threads, %d samples, %.2fms\n", int(m_tiles.size()), threads(), m_samples, m_time);
+    printf("  tile min %.3fms, avg %.3fms, max %.3fms\n", tmin, m_tile_times.empty() ? 0.f : total / float(m_tile_times.size()), tmax);
+    for(int i= 0; i < threads(); i++)
+        printf("  thread %d: %d tiles, %d steals\n", i, m_queues[i].tiles, m_queues[i].steals);
+}
+
+Image TileRenderer::tile_image( ) const
+{
+    float tmax= 0;
+    for(float t : m_tile_times)
+        tmax= std::max(tmax, t);
+
+    Image image(m_width, m_height);
+    for(int i= 0; i < int(m_tiles.size()); i++)
+    {
+        const Tile& tile= m_tiles[i];
+        float v= (tmax > 0) ? m_tile_times[i] / tmax : 0;
+        for(int y= tile.y0; y < tile.y1; y++)
+        for(int x= tile.x0; x < tile.x1; x++)
+            image(x, y)= Color(v, v, v);
+    }
+
+    return image;
+}
@@ -0,0 +1,169 @@
+
+#ifndef _IMAGE_TILES_H
+#define _IMAGE_TILES_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+#include "color.h"
+#include "image.h"
+
+
+//! \addtogroup image
+///@{
+
+//! \file
+//! calcul parallele d'une image par tuiles, repartition dynamique des tuiles entre les threads (vol de travail) et accumulation progressive des echantillons.
+
+//! tuile de l'image, pixels [x0 .. x1[ x [y0 .. y1[.
+struct Tile
+{
+    int x0, y0;
+    int x1, y1;
+};
+
+/*! calcule une image par tuiles de 16x16 ou 32x32 pixels.
+
+    les tuiles sont reparties en bandes contigues entre les threads, chaque thread traite ses tuiles dans l'ordre puis vole la moitie des tuiles
+    restantes d'un autre thread lorsqu'il a fini les siennes : le cout des pixels peut etre tres different d'une region a l'autre de l'image,
+    une repartition statique par lignes (`#pragma omp parallel for`) laisse des threads inactifs a la fin de l'image.
+    les threads sont crees une seule fois, par le constructeur, et sont reutilises par chaque passe.
+
+    accumulation progressive : chaque appel de render() ajoute un echantillon par pixel et l'image contient la moyenne des echantillons.
+\code
+Image image(1024, 768);
+TileRenderer renderer(image.width(), image.height());
+
+for(int i= 0; i < 16; i++)
+    renderer.render(image,
+        [&]( const int x, const int y, const int sample )
+        {
+            Ray ray= primary(x, y, sample);
+            ...
+            return color;
+        });
+
+renderer.print_stats();
+\endcode
+
+    for_each_pixel() ne fait que repartir les pixels entre les threads, sans accumulation, cf tuto_is.cpp :
+\code
+renderer.for_each_pixel(
+    [&]( const int x, const int y )
+    {
+        ...
+        image(x, y)= color;
+    });
+\endcode
+*/
+class TileRenderer
+{
+public:
+    //! constructeur, dimensions de l'image, taille des tuiles et nombre de threads. threads= 0, utilise tous les coeurs.
+    TileRenderer( const int width, const int height, const int tile_size= 32, const int threads= 0 );
+    ~TileRenderer( );
+
+    TileRenderer( const TileRenderer& ) = delete;
+    TileRenderer& operator= ( const TileRenderer& ) = delete;
+
+    //! execute f(tile, thread) pour chaque tuile de l'image.
+    void run( const std::function<void (const Tile&, const int)>& f );
+
+    //! execute f(x, y) pour chaque pixel de l'image.
+    template < typename F >
+    void for_each_pixel( F f )
+    {
+        run([&]( const Tile& tile, const int )
+        {
+            for(int y= tile.y0; y < tile.y1; y++)
+            for(int x= tile.x0; x < tile.x1; x++)
+                f(x, y);
+        });
+    }
+
+    /*! ajoute un echantillon par pixel, kernel(x, y, sample) renvoie sa couleur. sample est l'indice de l'echantillon, pour initialiser un generateur
+        aleatoire, par exemple. image contient la moyenne des echantillons calcules depuis le dernier clear().
+    */
+    template < typename F >
+    void render( Image& image, F kernel )
+    {
+        const int sample= m_samples;
+        run([&]( const Tile& tile, const int )
+        {
+            for(int y= tile.y0; y < tile.y1; y++)
+            for(int x= tile.x0; x < tile.x1; x++)
+            {
+                Color& sum= m_accumulation[y * m_width + x];
+                sum= sum + Color(kernel(x, y, sample));
+                image(x, y)= sum / float(sample +1);
+            }
+        });
+        m_samples++;
+    }
+
+    //! ajoute samples echantillons par pixel, 1 passe par echantillon.
+    template < typename F >
+    void render( Image& image, F kernel, const int samples )
+    {
+        for(int i= 0; i < samples; i++)
+            render(image, kernel);
+    }
+
+    //! recommence l'accumulation, a utiliser lorsque la camera ou la scene change.
+    void clear( );
+
+    //! renvoie le nombre d'echantillons accumules par pixel.
+    int samples( ) const { return m_samples; }
+    //! renvoie le nombre de threads.
+    int threads( ) const { return int(m_queues.size()); }
+    //! renvoie les tuiles.
+    const std::vector<Tile>& tiles( ) const { return m_tiles; }
+    //! renvoie le temps de calcul de chaque tuile, en ms, pour la derniere passe.
+    const std::vector<float>& tile_times( ) const { return m_tile_times; }
+
+    //! affiche le temps de la derniere passe, le temps min / moyen / max des tuiles et le nombre de vols par thread.
+    void print_stats( ) const;
+
+    //! renvoie une image du temps de calcul des tuiles de la derniere passe, normalise par le temps max. cf write_image().
+    Image tile_image( ) const;
+
+protected:
+    //! tuiles a traiter par un thread : [begin .. end[ dans m_tiles.
+    struct alignas(64) TileQueue
+    {
+        std::mutex lock;
+        int begin;
+        int end;
+        int tiles;
+        int steals;
+    };
+
+    void worker( const int id );
+    void work( const int id );
+    bool pop( const int id, int& tile );
+    bool steal( const int id, int& tile );
+
+    std::vector<Tile> m_tiles;
+    std::vector<float> m_tile_times;
+    std::vector<Color> m_accumulation;
+    int m_width;
+    int m_height;
+    int m_samples;
+
+    std::vector<TileQueue> m_queues;
+    std::vector<std::thread> m_workers;
+    std::mutex m_lock;
+    std::condition_variable m_start;
+    std::condition_variable m_done;
+    const std::function<void (const Tile&, const int)> *m_job;
+    int m_generation;
+    int m_running;
+    bool m_stop;
+    float m_time;
+};
+
+///@}
+#endif
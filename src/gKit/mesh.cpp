@@ -1,11 +1,13 @@
 
 #include <cstdio>
 #include <cassert>
+#include <cstring>
 #include <string>
 #include <algorithm>
 
 #include "vec.h"
 #include "mesh.h"
+#include "vertex_format.h"
 
 #include "program.h"
 #include "uniforms.h"
@@ -35,6 +37,14 @@ Mesh& Mesh::default_color( const Color& color )
     return *this;
 }
 
+Mesh& Mesh::vertex_format( const VertexFormat format )
+{
+    if(format != m_vertex_format)
+        m_update_buffers= true;
+    m_vertex_format= format;
+    return *this;
+}
+
 Mesh& Mesh::color( const vec4& color )
 {
     if(m_colors.size() <= m_positions.size())
@@ -146,6 +156,23 @@ void Mesh::clear( )
     m_triangle_materials.clear();
 }
 
+void Mesh::assign( std::vector<vec3>&& positions, std::vector<vec2>&& texcoords, std::vector<vec3>&& normals, std::vector<vec4>&& colors, 
+    std::vector<unsigned int>&& indices, std::vector<unsigned int>&& material_indices )
+{
+    assert(texcoords.empty() || texcoords.size() == positions.size());
+    assert(normals.empty() || normals.size() == positions.size());
+    assert(colors.empty() || colors.size() == positions.size());
+    
+    m_update_buffers= true;
+    
+    m_positions= std::move(positions);
+    m_texcoords= std::move(texcoords);
+    m_normals= std::move(normals);
+    m_colors= std::move(colors);
+    m_indices= std::move(indices);
+    m_triangle_materials= std::move(material_indices);
+}
+
 //
 Mesh& Mesh::triangle( const unsigned int a, const unsigned int b, const unsigned int c )
 {
@@ -265,6 +292,27 @@ std::vector<TriangleGroup> Mesh::groups( )
     return groups(m_triangle_materials);
 }
 
+// re-organise les triangles : le triangle i est deplace en position dest[i]. 
+// scratch : tampon temporaire partage par tous les tableaux, alloue une seule fois a la taille du plus gros tableau.
+// les triangles sont copies en parallele.
+template < int stride, typename T >
+static void permute_triangles( std::vector<T>& data, const std::vector<unsigned int>& dest, std::vector<unsigned char>& scratch )
+{
+    assert(data.size() == stride * dest.size());
+    assert(scratch.size() >= data.size() * sizeof(T));
+    
+    const size_t triangle_size= stride * sizeof(T);
+    const unsigned char *src= (const unsigned char *) data.data();
+    unsigned char *tmp= scratch.data();
+    
+    const int n= int(dest.size());
+#pragma omp parallel for
+    for(int i= 0; i < n; i++)
+        memcpy(tmp + triangle_size * dest[i], src + triangle_size * i, triangle_size);
+    
+    memcpy(data.data(), tmp, data.size() * sizeof(T));
+}
+
 std::vector<TriangleGroup> Mesh::groups( const std::vector<unsigned int>& triangle_properties )
 {
     if(m_primitives != GL_TRIANGLES)
@@ -279,114 +327,84 @@ std::vector<TriangleGroup> Mesh::groups( const std::vector<unsigned int>& triang
             return { {0, 0, int(m_positions.size())} };
     }
     
-    // trie les triangles
-    std::vector<int> remap(triangle_count());
-    for(unsigned i= 0; i < remap.size(); i++)
-        remap[i]= i;
-
-    struct triangle_sort
+    if(triangle_properties.empty())
+        return {};
+    
+    // tri par denombrement des triangles, les proprietes sont en general des petits entiers, les indices des matieres...
+    // sinon, numerote les proprietes distinctes
+    const int n= int(triangle_properties.size());
+    unsigned int max_property= *std::max_element(triangle_properties.begin(), triangle_properties.end());
+    
+    std::vector<unsigned int> keys;
+    if(max_property > unsigned(n))
     {
-        const std::vector<unsigned int>& properties;
-        
-        triangle_sort( const std::vector<unsigned int>& _properties ) : properties(_properties) {}
-        
-        bool operator() ( const int& a, const int& b ) const
-        {
-            return properties[a] < properties[b];
-        }
+        keys= triangle_properties;
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    }
+    
+    auto key= [&]( const int i ) -> unsigned int
+    {
+        if(keys.empty())
+            return triangle_properties[i];
+        return unsigned(std::lower_bound(keys.begin(), keys.end(), triangle_properties[i]) - keys.begin());
     };
     
-    std::stable_sort(remap.begin(), remap.end(), triangle_sort(triangle_properties));
+    std::vector<unsigned int> dest(n);
+    for(int i= 0; i < n; i++)
+        dest[i]= key(i);
+    
+    std::vector<unsigned int> offsets(keys.empty() ? max_property +1 : keys.size(), 0);
+    for(int i= 0; i < n; i++)
+        offsets[dest[i]]++;
     
-    // re-organise les triangles, et construit les groupes
+    // construit les groupes, dans l'ordre croissant des proprietes
     std::vector<TriangleGroup> groups;
-    if(m_indices.size())
+    unsigned int first= 0;
+    for(unsigned int k= 0; k < offsets.size(); k++)
     {
-        int first= 0;
-        int property_id= triangle_properties[remap[0]];
+        unsigned int count= offsets[k];
+        if(count)
+            groups.push_back( {int(keys.empty() ? k : keys[k]), int(3*first), int(3*count)} );
         
-        // re-organise l'index buffer...
-        std::vector<unsigned int> indices;
-        std::vector<unsigned int> material_indices;
-        for(unsigned i= 0; i < remap.size(); i++)
-        {
-            int id= triangle_properties[remap[i]];
-            if(id != property_id)
-            {
-                groups.push_back( {property_id, first, int(3*i) - first} );
-                first= 3*i;
-                property_id= id;
-            }
-            
-            indices.push_back(m_indices[3*remap[i]]);
-            indices.push_back(m_indices[3*remap[i]+1]);
-            indices.push_back(m_indices[3*remap[i]+2]);
-            
-            material_indices.push_back(m_triangle_materials[remap[i]]);
-        }
-        
-        // dernier groupe
-        groups.push_back( {property_id, first, int(3 * remap.size()) - first} );
-        
-        std::swap(m_indices, indices);
-        std::swap(m_triangle_materials, material_indices);
+        offsets[k]= first;
+        first+= count;
     }
+    
+    // position de chaque triangle apres le tri, conserve l'ordre des triangles d'un groupe
+    for(int i= 0; i < n; i++)
+        dest[i]= offsets[dest[i]]++;
+    
+    // re-organise les triangles, un tableau apres l'autre, avec le meme tampon temporaire : 
+    // la memoire supplementaire est limitee a la taille du plus gros tableau.
+    // les matieres ne sont re-organisees que si elles sont definies pour chaque triangle, cf groups( cluster ids ), par exemple.
+    const bool materials= (m_triangle_materials.size() == dest.size());
+    const bool indices= (m_indices.size() > 0);
+    const bool texcoords= !indices && has_texcoord();
+    const bool normals= !indices && has_normal();
+    const bool colors= !indices && has_color();
+    
+    size_t scratch_size= indices ? m_indices.size() * sizeof(unsigned int) : m_positions.size() * sizeof(vec3);
+    if(materials) scratch_size= std::max(scratch_size, m_triangle_materials.size() * sizeof(unsigned int));
+    if(texcoords) scratch_size= std::max(scratch_size, m_texcoords.size() * sizeof(vec2));
+    if(normals) scratch_size= std::max(scratch_size, m_normals.size() * sizeof(vec3));
+    if(colors) scratch_size= std::max(scratch_size, m_colors.size() * sizeof(vec4));
+    std::vector<unsigned char> scratch(scratch_size);
+    
+    if(materials)
+        permute_triangles<1>(m_triangle_materials, dest, scratch);
+    if(indices)
+        permute_triangles<3>(m_indices, dest, scratch);
     else
-    {
-        int first= 0;
-        int property_id= triangle_properties[remap[0]];
-        
-        // re-organise les attributs !!
-        std::vector<vec3> positions;
-        std::vector<vec2> texcoords;
-        std::vector<vec3> normals;
-        std::vector<vec4> colors;
-        std::vector<unsigned int> material_indices;
-        for(unsigned i= 0; i < remap.size(); i++)
-        {
-            int id= triangle_properties[remap[i]];
-            if(id != property_id)
-            {
-                groups.push_back( {property_id, first, int(3*i) - first} );
-                first= 3*i;
-                property_id= id;
-            }
-            
-            positions.push_back(m_positions[3*remap[i]]);
-            positions.push_back(m_positions[3*remap[i]+1]);
-            positions.push_back(m_positions[3*remap[i]+2]);
-            if(has_texcoord())
-            {
-                texcoords.push_back(m_texcoords[3*remap[i]]);
-                texcoords.push_back(m_texcoords[3*remap[i]+1]);
-                texcoords.push_back(m_texcoords[3*remap[i]+2]);
-            }
-            if(has_normal())
-            {
-                normals.push_back(m_normals[3*remap[i]]);
-                normals.push_back(m_normals[3*remap[i]+1]);
-                normals.push_back(m_normals[3*remap[i]+2]);
-            }
-            if(has_color())
-            {
-                colors.push_back(m_colors[3*remap[i]]);
-                colors.push_back(m_colors[3*remap[i]+1]);
-                colors.push_back(m_colors[3*remap[i]+2]);
-            }
-            
-            material_indices.push_back(m_triangle_materials[remap[i]]);
-        }
-        
-        // dernier groupe
-        groups.push_back( {property_id, first, int(3 * remap.size()) - first} );
-        
-        std::swap(m_positions, positions);
-        std::swap(m_texcoords, texcoords);
-        std::swap(m_normals, normals);
-        std::swap(m_colors, colors);
-        std::swap(m_triangle_materials, material_indices);
-    }
+        permute_triangles<3>(m_positions, dest, scratch);
+    if(texcoords)
+        permute_triangles<3>(m_texcoords, dest, scratch);
+    if(normals)
+        permute_triangles<3>(m_normals, dest, scratch);
+    if(colors)
+        permute_triangles<3>(m_colors, dest, scratch);
     
+    m_update_buffers= true;
     return groups;
 }
 
@@ -561,15 +579,7 @@ GLuint Mesh::create_buffers( const bool use_texcoord, const bool use_normal, con
     glBindVertexArray(m_vao);
     
     // determine la taille du buffer pour stocker tous les attributs et les indices
-    m_vertex_buffer_size= vertex_buffer_size();
-    if(use_texcoord && has_texcoord())
-        m_vertex_buffer_size+= texcoord_buffer_size();
-    if(use_normal && has_normal())
-        m_vertex_buffer_size+= normal_buffer_size();
-    if(use_color && has_color())
-        m_vertex_buffer_size+= color_buffer_size();
-    if(use_material_index && has_material_index())
-        m_vertex_buffer_size+= m_positions.size() * sizeof(unsigned char);
+    m_vertex_buffer_size= attribute_buffer_size(use_texcoord, use_normal, use_color, use_material_index);
     
     // alloue le buffer
     glGenBuffers(1, &m_buffer);
@@ -591,6 +601,30 @@ GLuint Mesh::create_buffers( const bool use_texcoord, const bool use_normal, con
     return m_vao;
 }
 
+size_t Mesh::attribute_buffer_size( const bool use_texcoord, const bool use_normal, const bool use_color, const bool use_material_index ) const
+{
+    size_t size= 0;
+    if(m_vertex_format == VERTEX_FORMAT_PACKED)
+    {
+        PackedVertexLayout layout= packed_vertex_layout(use_texcoord && has_texcoord(), use_normal && has_normal(), use_color && has_color());
+        size= m_positions.size() * layout.stride;
+    }
+    else
+    {
+        size= vertex_buffer_size();
+        if(use_texcoord && has_texcoord())
+            size+= texcoord_buffer_size();
+        if(use_normal && has_normal())
+            size+= normal_buffer_size();
+        if(use_color && has_color())
+            size+= color_buffer_size();
+    }
+    
+    if(use_material_index && has_material_index())
+        size+= m_positions.size() * sizeof(unsigned char);
+    return size;
+}
+
 int Mesh::update_buffers( const bool use_texcoord, const bool use_normal, const bool use_color, const bool use_material_index )
 {
     assert(m_vao > 0);
@@ -605,62 +639,85 @@ int Mesh::update_buffers( const bool use_texcoord, const bool use_normal, const
     glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
     
     // determine la taille du buffer pour stocker tous les attributs et les indices
-    size_t size= vertex_buffer_size();
-    if(use_texcoord && has_texcoord())
-        size+= texcoord_buffer_size();
-    if(use_normal && has_normal())
-        size+= normal_buffer_size();
-    if(use_color && has_color())
-        size+= color_buffer_size();
-    if(use_material_index && has_material_index())
-        size+= m_positions.size() * sizeof(unsigned char);
-    
+    size_t size= attribute_buffer_size(use_texcoord, use_normal, use_color, use_material_index);
     if(size != m_vertex_buffer_size)
     {
         m_vertex_buffer_size= size;
         glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STATIC_DRAW);
     }
     
-    // transferer les attributs et configurer le format de sommet (vao)
     size_t offset= 0;
-    size= vertex_buffer_size();
-    //~ glBufferSubData(GL_ARRAY_BUFFER, offset, size, vertex_buffer());        // copie les donnees dans le vertex buffer
-    update.copy(GL_ARRAY_BUFFER, offset, size, vertex_buffer());                // copie les donnees dans le vertex buffer
-    
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (const void *) offset);
-    glEnableVertexAttribArray(0);
-    
-    if(use_texcoord && has_texcoord())
+    if(m_vertex_format == VERTEX_FORMAT_PACKED)
     {
-        offset= offset + size;
-        size= texcoord_buffer_size();
-        //~ glBufferSubData(GL_ARRAY_BUFFER, offset, size, texcoord_buffer());  // copie les donnees dans le vertex buffer
-        update.copy(GL_ARRAY_BUFFER, offset, size, texcoord_buffer());          // copie les donnees dans le vertex buffer
+        // compresse et entrelace les attributs, cf vertex_format.h
+        PackedVertexLayout layout= packed_vertex_layout(use_texcoord && has_texcoord(), use_normal && has_normal(), use_color && has_color());
+        m_vertex_quantization= compute_vertex_quantization(*this);
+        std::vector<unsigned char> vertices= pack_vertices(*this, m_vertex_quantization, layout);
         
-        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (const void *) offset);
-        glEnableVertexAttribArray(1);
+        size= vertices.size();
+        update.copy(GL_ARRAY_BUFFER, offset, size, vertices.data());           // copie les donnees dans le vertex buffer
+        
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, layout.stride, (const void *) size_t(layout.position));
+        glEnableVertexAttribArray(0);
+        
+        if(layout.texcoord >= 0)
+        {
+            glVertexAttribPointer(1, 2, GL_UNSIGNED_SHORT, GL_TRUE, layout.stride, (const void *) size_t(layout.texcoord));
+            glEnableVertexAttribArray(1);
+        }
+        if(layout.normal >= 0)
+        {
+            glVertexAttribPointer(2, 2, GL_BYTE, GL_TRUE, layout.stride, (const void *) size_t(layout.normal));
+            glEnableVertexAttribArray(2);
+        }
+        if(layout.color >= 0)
+        {
+            glVertexAttribPointer(3, 4, GL_UNSIGNED_BYTE, GL_TRUE, layout.stride, (const void *) size_t(layout.color));
+            glEnableVertexAttribArray(3);
+        }
     }
-    
-    if(use_normal && has_normal())
+    else
     {
-        offset= offset + size;
-        size= normal_buffer_size();
-        //~ glBufferSubData(GL_ARRAY_BUFFER, offset, size, normal_buffer());    // copie les donnees dans le vertex buffer
-        update.copy(GL_ARRAY_BUFFER, offset, size, normal_buffer());            // copie les donnees dans le vertex buffer
+        // transferer les attributs et configurer le format de sommet (vao)
+        size= vertex_buffer_size();
+        //~ glBufferSubData(GL_ARRAY_BUFFER, offset, size, vertex_buffer());        // copie les donnees dans le vertex buffer
+        update.copy(GL_ARRAY_BUFFER, offset, size, vertex_buffer());                // copie les donnees dans le vertex buffer
+    
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (const void *) offset);
+        glEnableVertexAttribArray(0);
+    
+        if(use_texcoord && has_texcoord())
+        {
+            offset= offset + size;
+            size= texcoord_buffer_size();
+            //~ glBufferSubData(GL_ARRAY_BUFFER, offset, size, texcoord_buffer());  // copie les donnees dans le vertex buffer
+            update.copy(GL_ARRAY_BUFFER, offset, size, texcoord_buffer());          // copie les donnees dans le vertex buffer
         
-        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, (const void *) offset);
-        glEnableVertexAttribArray(2);
-    }
+            glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (const void *) offset);
+            glEnableVertexAttribArray(1);
+        }
     
-    if(use_color && has_color())
-    {
-        offset= offset + size;
-        size= color_buffer_size();
-        //~ glBufferSubData(GL_ARRAY_BUFFER, offset, size, color_buffer());     // copie les donnees dans le vertex buffer
-        update.copy(GL_ARRAY_BUFFER, offset, size, color_buffer());             // copie les donnees dans le vertex buffer
+        if(use_normal && has_normal())
+        {
+            offset= offset + size;
+            size= normal_buffer_size();
+            //~ glBufferSubData(GL_ARRAY_BUFFER, offset, size, normal_buffer());    // copie les donnees dans le vertex buffer
+            update.copy(GL_ARRAY_BUFFER, offset, size, normal_buffer());            // copie les donnees dans le vertex buffer
+        
+            glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, (const void *) offset);
+            glEnableVertexAttribArray(2);
+        }
+    
+        if(use_color && has_color())
+        {
+            offset= offset + size;
+            size= color_buffer_size();
+            //~ glBufferSubData(GL_ARRAY_BUFFER, offset, size, color_buffer());     // copie les donnees dans le vertex buffer
+            update.copy(GL_ARRAY_BUFFER, offset, size, color_buffer());             // copie les donnees dans le vertex buffer
         
-        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 0, (const void *) offset);
-        glEnableVertexAttribArray(3);
+            glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 0, (const void *) offset);
+            glEnableVertexAttribArray(3);
+        }
     }
     
     if(use_material_index && has_material_index())
@@ -803,7 +860,12 @@ void Mesh::draw( const int first, const int n, const GLuint program, const bool
             {
                 if(!use_normal || !has_normal())
                     printf("[oops] normal attribute '%s' in %s: no data... undefined draw !!\n", name, label);
-                if(glsl_size != 1 || glsl_type != GL_FLOAT_VEC3)
+                if(m_vertex_format == VERTEX_FORMAT_PACKED)
+                {
+                    if(glsl_size != 1 || glsl_type != GL_FLOAT_VEC2)
+                        printf("[oops] packed normal attribute '%s' is not declared as a vec2 in %s... undefined draw !!\n", name, label);
+                }
+                else if(glsl_size != 1 || glsl_type != GL_FLOAT_VEC3)
                     printf("[oops] attribute '%s' is not declared as a vec3 in %s... undefined draw !!\n", name, label);
             }
             else if(location == 3)  // attribut color necessaire
@@ -824,6 +886,20 @@ void Mesh::draw( const int first, const int n, const GLuint program, const bool
     }
     #endif
     
+    if(m_vertex_format == VERTEX_FORMAT_PACKED)
+    {
+        // parametres de dequantification, si le shader les utilise...
+        // les locations viennent de l'inventaire des uniforms fait apres le link, pas du driver, cf program_uniform_handle( ).
+        UniformHandle uniform= program_uniform_handle(program, "position_offset", false);
+        if(uniform.valid()) program_uniform(uniform, m_vertex_quantization.position_offset);
+        uniform= program_uniform_handle(program, "position_scale", false);
+        if(uniform.valid()) program_uniform(uniform, m_vertex_quantization.position_scale);
+        uniform= program_uniform_handle(program, "texcoord_offset", false);
+        if(uniform.valid()) program_uniform(uniform, m_vertex_quantization.texcoord_offset);
+        uniform= program_uniform_handle(program, "texcoord_scale", false);
+        if(uniform.valid()) program_uniform(uniform, m_vertex_quantization.texcoord_scale);
+    }
+    
     if(m_indices.size() > 0)
         glDrawElements(m_primitives, n, GL_UNSIGNED_INT, (void *) (first * sizeof(unsigned)));
     else
@@ -107,6 +107,23 @@ struct TriangleGroup
 };
 
 
+//! format des sommets dans les buffers openGL construits par Mesh::create_buffers(), cf Mesh::vertex_format().
+enum VertexFormat
+{
+    VERTEX_FORMAT_FLOAT= 0,     //!< un bloc par attribut, en float : position vec3, texcoord vec2, normale vec3, couleur vec4. jusqu'a 48 octets par sommet.
+    VERTEX_FORMAT_PACKED        //!< attributs compresses et entrelaces, jusqu'a 16 octets par sommet, cf vertex_format.h.
+};
+
+//! dequantification des positions et des texcoords au format VERTEX_FORMAT_PACKED : attribut= offset + scale * q, avec q dans [0 1], cf Mesh::vertex_quantization().
+struct VertexQuantization
+{
+    vec3 position_offset;
+    vec3 position_scale;
+    vec2 texcoord_offset;
+    vec2 texcoord_scale;
+};
+
+
 //! representation d'un objet / maillage.
 class Mesh
 {
@@ -115,11 +132,11 @@ public:
     //@{
     //! constructeur par defaut.
     Mesh( ) : m_positions(), m_texcoords(), m_normals(), m_colors(), m_indices(), 
-        m_color(White()), m_primitives(GL_POINTS), m_vao(0), m_buffer(0), m_index_buffer(0), m_vertex_buffer_size(0), m_index_buffer_size(0), m_update_buffers(false) {}
+        m_color(White()), m_primitives(GL_POINTS), m_vao(0), m_buffer(0), m_index_buffer(0), m_vertex_buffer_size(0), m_index_buffer_size(0), m_vertex_format(VERTEX_FORMAT_FLOAT), m_vertex_quantization(), m_update_buffers(false) {}
     
     //! constructeur.
     Mesh( const GLenum primitives ) : m_positions(), m_texcoords(), m_normals(), m_colors(), m_indices(), 
-        m_color(White()), m_primitives(primitives), m_vao(0), m_buffer(0), m_index_buffer(0), m_vertex_buffer_size(0), m_index_buffer_size(0), m_update_buffers(false) {}
+        m_color(White()), m_primitives(primitives), m_vao(0), m_buffer(0), m_index_buffer(0), m_vertex_buffer_size(0), m_index_buffer_size(0), m_vertex_format(VERTEX_FORMAT_FLOAT), m_vertex_quantization(), m_update_buffers(false) {}
     
     //! construit les objets openGL.
     int create( const GLenum primitives );
@@ -157,6 +174,12 @@ public:
     
     //! vide la description.
     void clear( );
+    
+    /*! remplace tous les attributs des sommets, les indices et les matieres des triangles. les tableaux sont deplaces dans l'objet, sans copie.
+    utilitaire pour les chargeurs de fichiers qui construisent directement les tableaux. texcoords, normals, colors, indices et material_indices peuvent etre vides.
+    */
+    void assign( std::vector<vec3>&& positions, std::vector<vec2>&& texcoords, std::vector<vec3>&& normals, std::vector<vec4>&& colors, 
+        std::vector<unsigned int>&& indices, std::vector<unsigned int>&& material_indices );
     //@}
 
     //! \name description de triangles indexes.
@@ -346,6 +369,19 @@ public:
     //@}
     
     
+    //! \name format des sommets dans les buffers openGL.
+    //@{
+    /*! selectionne le format des sommets utilise par create_buffers() et draw(), VERTEX_FORMAT_FLOAT par defaut.
+        avec VERTEX_FORMAT_PACKED, les shaders declarent la normale comme un vec2 et dequantifient les attributs, cf vertex_format.h et USE_PACKED_VERTEX dans data/shaders/mesh.glsl.
+        draw() affecte les uniforms position_offset, position_scale, texcoord_offset et texcoord_scale du shader.
+     */
+    Mesh& vertex_format( const VertexFormat format );
+    //! renvoie le format des sommets.
+    VertexFormat vertex_format( ) const { return m_vertex_format; }
+    //! renvoie les parametres de dequantification des positions et des texcoords au format VERTEX_FORMAT_PACKED, calcules par create_buffers().
+    const VertexQuantization& vertex_quantization( ) const { return m_vertex_quantization; }
+    //@}
+    
     //! construit les buffers et le vertex array object necessaires pour dessiner l'objet avec openGL. utilitaire. detruit par release( ).
     GLuint create_buffers( const bool use_texcoord, const bool use_normal, const bool use_color, const bool use_material_index );
     //! dessine l'objet avec un shader program. 
@@ -356,6 +392,8 @@ public:
 private:
     //! modifie les buffers openGL, si necessaire.
     int update_buffers( const bool use_texcoord, const bool use_normal, const bool use_color, const bool use_material_index );
+    //! renvoie la taille du vertex buffer, en octets, selon le format des sommets.
+    size_t attribute_buffer_size( const bool use_texcoord, const bool use_normal, const bool use_color, const bool use_material_index ) const;
     
     //
     std::vector<vec3> m_positions;
@@ -377,6 +415,9 @@ private:
     size_t m_vertex_buffer_size;
     size_t m_index_buffer_size;
     
+    VertexFormat m_vertex_format;
+    VertexQuantization m_vertex_quantization;
+    
     bool m_update_buffers;
 };
 
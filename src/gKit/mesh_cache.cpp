@@ -0,0 +1,284 @@
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <chrono>
+#include <type_traits>
+
+#include "files.h"
+#include "mesh_cache.h"
+
+
+// format du fichier : entete, puis chaque tableau aligne sur 16 octets.
+// positions, texcoords, normals, colors, indices, matieres des triangles, groupes, matieres, noms des matieres, noms des textures.
+static const char gkmesh_magic[8]= { 'g', 'k', 'm', 'e', 's', 'h', 0, 0 };
+// version 2 : les maillages de TP2 sont indexes, les caches de la version 1 ne le sont pas.
+static const uint32_t gkmesh_version= 2;
+
+struct gkmesh_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t primitives;
+    uint64_t source_timestamp;      // timestamp() du fichier source
+    uint64_t file_size;             // detecte les fichiers tronques
+
+    uint64_t positions;
+    uint64_t texcoords;
+    uint64_t normals;
+    uint64_t colors;
+    uint64_t indices;
+    uint64_t material_indices;
+    uint64_t groups;
+    uint64_t materials;
+    uint64_t textures;
+    int32_t default_material_id;
+    uint32_t pad;
+};
+
+static_assert(sizeof(gkmesh_header) % 16 == 0, "gkmesh header alignment");
+static_assert(std::is_trivially_copyable<Material>::value, "Material is written as is");
+static_assert(std::is_trivially_copyable<TriangleGroup>::value, "TriangleGroup is written as is");
+
+
+std::string mesh_cache_filename( const std::string& filename )
+{
+    size_t dot= filename.rfind('.');
+    size_t slash= filename.find_last_of("/\\");
+    if(dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return filename + ".gkmesh";
+
+    return filename.substr(0, dot) + ".gkmesh";
+}
+
+
+// ecrit un tableau, complete par des 0 pour aligner le suivant sur 16 octets.
+static bool write_block( FILE *out, const void *data, const size_t size )
+{
+    static const char zeros[16]= { };
+
+    if(size && fwrite(data, 1, size, out) != size)
+        return false;
+
+    size_t pad= (16 - size % 16) % 16;
+    return fwrite(zeros, 1, pad, out) == pad;
+}
+
+template < typename T >
+static bool write_array( FILE *out, const std::vector<T>& v )
+{
+    return write_block(out, v.data(), v.size() * sizeof(T));
+}
+
+static bool write_strings( FILE *out, const std::vector<std::string>& strings )
+{
+    std::vector<char> data;
+    for(const std::string& string : strings)
+    {
+        uint32_t length= uint32_t(string.size());
+        data.insert(data.end(), (const char *) &length, (const char *) &length + sizeof(length));
+        data.insert(data.end(), string.begin(), string.end());
+    }
+
+    return write_array(out, data);
+}
+
+
+bool write_mesh_cache( const char *filename, const Mesh& mesh, const std::vector<TriangleGroup>& groups )
+{
+    size_t source_timestamp= timestamp(filename);
+    if(source_timestamp == 0)
+        return false;
+
+    std::string cache= mesh_cache_filename(filename);
+    FILE *out= fopen(cache.c_str(), "wb");
+    if(out == nullptr)
+    {
+        printf("[error] writing mesh cache '%s'...\n", cache.c_str());
+        return false;
+    }
+
+    const Materials& materials= mesh.materials();
+
+    gkmesh_header header= { };
+    memcpy(header.magic, gkmesh_magic, sizeof(header.magic));
+    header.version= gkmesh_version;
+    header.primitives= mesh.primitives();
+    header.source_timestamp= source_timestamp;
+    header.positions= mesh.positions().size();
+    header.texcoords= mesh.texcoords().size();
+    header.normals= mesh.normals().size();
+    header.colors= mesh.colors().size();
+    header.indices= mesh.indices().size();
+    header.material_indices= mesh.material_indices().size();
+    header.groups= groups.size();
+    header.materials= materials.materials.size();
+    header.textures= materials.texture_filenames.size();
+    header.default_material_id= materials.default_material_id;
+
+    // la taille du fichier est connue apres l'ecriture, l'entete est re-ecrit a la fin
+    bool code= write_block(out, &header, sizeof(header))
+        && write_array(out, mesh.positions())
+        && write_array(out, mesh.texcoords())
+        && write_array(out, mesh.normals())
+        && write_array(out, mesh.colors())
+        && write_array(out, mesh.indices())
+        && write_array(out, mesh.material_indices())
+        && write_array(out, groups)
+        && write_array(out, materials.materials)
+        && write_strings(out, materials.names)
+        && write_strings(out, materials.texture_filenames);
+
+    if(code)
+    {
+        header.file_size= uint64_t(ftell(out));
+        code= (fseek(out, 0, SEEK_SET) == 0) && write_block(out, &header, sizeof(header));
+    }
+
+    fclose(out);
+    if(!code)
+    {
+        printf("[error] writing mesh cache '%s'...\n", cache.c_str());
+        remove(cache.c_str());
+        return false;
+    }
+
+    printf("writing mesh cache '%s'...\n", cache.c_str());
+    return true;
+}
+
+
+// lecture sequentielle du fichier projete en memoire, verifie que les tableaux ne depassent pas la fin du fichier.
+struct gkmesh_reader
+{
+    const char *data;
+    size_t size;
+    size_t offset;
+
+    const char *block( const size_t length )
+    {
+        if(length > size - offset)
+            return nullptr;
+
+        const char *p= data + offset;
+        offset+= (length + 15) & ~size_t(15);
+        if(offset > size)
+            offset= size;
+        return p;
+    }
+
+    template < typename T >
+    bool array( const uint64_t n, std::vector<T>& v )
+    {
+        if(n > size / sizeof(T))
+            return false;
+
+        const T *p= (const T *) block(n * sizeof(T));
+        if(p == nullptr)
+            return false;
+
+        v.assign(p, p + n);
+        return true;
+    }
+
+    bool strings( const uint64_t n, std::vector<std::string>& strings )
+    {
+        strings.clear();
+        strings.reserve(n);
+
+        size_t start= offset;
+        for(uint64_t i= 0; i < n; i++)
+        {
+            uint32_t length;
+            if(sizeof(length) > size - offset)
+                return false;
+            memcpy(&length, data + offset, sizeof(length));
+            offset+= sizeof(length);
+
+            if(length > size - offset)
+                return false;
+            strings.emplace_back(data + offset, length);
+            offset+= length;
+        }
+
+        // aligne le tableau suivant
+        offset= start + ((offset - start + 15) & ~size_t(15));
+        if(offset > size)
+            offset= size;
+        return true;
+    }
+};
+
+
+bool read_mesh_cache( const char *filename, Mesh& mesh, std::vector<TriangleGroup>& groups )
+{
+    std::string cache= mesh_cache_filename(filename);
+    if(!exists(cache))
+        return false;
+
+    auto start= std::chrono::high_resolution_clock::now();
+
+    MappedFile file= map_file(cache);
+    if(file.data == nullptr || file.size < sizeof(gkmesh_header))
+    {
+        unmap_file(file);
+        return false;
+    }
+
+    gkmesh_header header;
+    memcpy(&header, file.data, sizeof(header));
+    if(memcmp(header.magic, gkmesh_magic, sizeof(header.magic)) != 0 || header.version != gkmesh_version || header.file_size != file.size)
+    {
+        printf("[error] invalid mesh cache '%s'...\n", cache.c_str());
+        unmap_file(file);
+        return false;
+    }
+
+    // le fichier source a ete modifie, le cache n'est plus valide
+    if(header.source_timestamp != timestamp(filename))
+    {
+        printf("mesh cache '%s' is out of date...\n", cache.c_str());
+        unmap_file(file);
+        return false;
+    }
+
+    gkmesh_reader in= { file.data, file.size, sizeof(gkmesh_header) };
+
+    std::vector<vec3> positions;
+    std::vector<vec2> texcoords;
+    std::vector<vec3> normals;
+    std::vector<vec4> colors;
+    std::vector<unsigned int> indices;
+    std::vector<unsigned int> material_indices;
+    std::vector<TriangleGroup> triangle_groups;
+    Materials materials;
+    bool code= in.array(header.positions, positions)
+        && in.array(header.texcoords, texcoords)
+        && in.array(header.normals, normals)
+        && in.array(header.colors, colors)
+        && in.array(header.indices, indices)
+        && in.array(header.material_indices, material_indices)
+        && in.array(header.groups, triangle_groups)
+        && in.array(header.materials, materials.materials)
+        && in.strings(header.materials, materials.names)
+        && in.strings(header.textures, materials.texture_filenames);
+
+    unmap_file(file);
+
+    if(!code)
+    {
+        printf("[error] invalid mesh cache '%s'...\n", cache.c_str());
+        return false;
+    }
+    materials.default_material_id= header.default_material_id;
+
+    mesh= Mesh(GLenum(header.primitives));
+    mesh.assign(std::move(positions), std::move(texcoords), std::move(normals), std::move(colors), std::move(indices), std::move(material_indices));
+    mesh.materials()= std::move(materials);
+    groups= std::move(triangle_groups);
+
+    auto stop= std::chrono::high_resolution_clock::now();
+    printf("loading mesh cache '%s': %d positions, %d groups, %dms\n", cache.c_str(),
+        int(mesh.positions().size()), int(groups.size()), int(std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count()));
+    return true;
+}
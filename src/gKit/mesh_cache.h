@@ -0,0 +1,41 @@
+
+#ifndef _MESH_CACHE_H
+#define _MESH_CACHE_H
+
+#include <string>
+#include <vector>
+
+#include "mesh.h"
+
+
+//! \addtogroup objet3D
+///@{
+
+/*! \file
+cache binaire d'un objet, fichier .gkmesh : evite de relire et de trier les triangles d'un objet a chaque execution.
+
+le cache contient les attributs des sommets, les indices, les matieres des triangles, la description des matieres et les groupes de triangles, cf Mesh::groups().
+il est ecrit a cote du fichier source et il est invalide des que le fichier source est modifie, cf timestamp().
+\code
+Mesh mesh;
+std::vector<TriangleGroup> groups;
+if(!read_mesh_cache("data/bistro.obj", mesh, groups))
+{
+    mesh= read_mesh("data/bistro.obj");
+    groups= mesh.groups();
+    write_mesh_cache("data/bistro.obj", mesh, groups);
+}
+\endcode
+*/
+
+//! renvoie le nom du cache d'un objet. mesh_cache_filename("data/bistro.obj") == "data/bistro.gkmesh"
+std::string mesh_cache_filename( const std::string& filename );
+
+//! charge le cache de l'objet filename, s'il existe et s'il est a jour. renvoie false sinon, mesh et groups ne sont pas modifies.
+bool read_mesh_cache( const char *filename, Mesh& mesh, std::vector<TriangleGroup>& groups );
+
+//! ecrit le cache de l'objet filename. groups est renvoye par mesh.groups(). renvoie false en cas d'erreur.
+bool write_mesh_cache( const char *filename, const Mesh& mesh, const std::vector<TriangleGroup>& groups );
+
+///@}
+#endif
@@ -0,0 +1,345 @@
+
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+
+#include "mesh_optimizer.h"
+
+
+namespace {
+
+// sequence de triangles construite par tipsify, commence quand le cache est "vide" : les sequences peuvent etre reordonnees sans perdre de sommets dans le cache.
+struct Sequence
+{
+    int begin;
+    int end;
+    float occlusion;        // les sequences qui cachent les autres sont dessinees en premier
+};
+
+// tipsify sur les triangles d'un groupe, indices locaux des sommets : 0 .. vertex_count-1.
+// renvoie l'ordre des triangles et les sequences.
+void tipsify( const std::vector<unsigned int>& indices, const int vertex_count, const int cache_size,
+    std::vector<int>& order, std::vector<Sequence>& sequences )
+{
+    const int triangle_count= int(indices.size()) / 3;
+
+    // triangles adjacents a chaque sommet
+    std::vector<int> offsets(vertex_count +1, 0);
+    for(unsigned int v : indices)
+        offsets[v +1]++;
+    for(int v= 0; v < vertex_count; v++)
+        offsets[v +1]+= offsets[v];
+
+    std::vector<int> adjacency(indices.size());
+    {
+        std::vector<int> fill(offsets.begin(), offsets.end() -1);
+        for(int i= 0; i < int(indices.size()); i++)
+            adjacency[fill[indices[i]]++]= i / 3;
+    }
+
+    // nombre de triangles pas encore emis autour de chaque sommet
+    std::vector<int> live(vertex_count);
+    for(int v= 0; v < vertex_count; v++)
+        live[v]= offsets[v +1] - offsets[v];
+
+    // date d'entree de chaque sommet dans le cache, il est dans le cache si time - cache_time[v] <= cache_size
+    std::vector<int> cache_time(vertex_count, 0);
+    int time= cache_size +1;
+
+    std::vector<unsigned char> emitted(triangle_count, 0);
+    std::vector<int> dead_end;
+    std::vector<int> candidates;
+
+    order.clear();
+    order.reserve(triangle_count);
+    sequences.clear();
+
+    int cursor= 0;
+    int fanning= 0;
+    sequences.push_back( {0, 0, 0} );
+    while(fanning >= 0)
+    {
+        // emet les triangles autour du sommet
+        candidates.clear();
+        for(int k= offsets[fanning]; k < offsets[fanning +1]; k++)
+        {
+            int t= adjacency[k];
+            if(emitted[t])
+                continue;
+
+            for(int i= 0; i < 3; i++)
+            {
+                int v= indices[3*t +i];
+                dead_end.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+
+                if(time - cache_time[v] > cache_size)
+                {
+                    cache_time[v]= time;
+                    time++;
+                }
+            }
+
+            emitted[t]= 1;
+            order.push_back(t);
+        }
+
+        // sommet suivant : le voisin qui restera dans le cache pendant que ses triangles sont emis, et qui est le plus ancien dans le cache
+        int next= -1;
+        int best= -1;
+        for(int v : candidates)
+        {
+            if(live[v] <= 0)
+                continue;
+
+            int priority= 0;
+            if(time - cache_time[v] + 2 * live[v] <= cache_size)
+                priority= time - cache_time[v];
+
+            if(priority > best)
+            {
+                best= priority;
+                next= v;
+            }
+        }
+
+        if(next < 0)
+        {
+            // impasse, reprend un sommet utilise recemment, ou le prochain sommet qui a encore des triangles
+            while(!dead_end.empty() && next < 0)
+            {
+                int v= dead_end.back();
+                dead_end.pop_back();
+                if(live[v] > 0)
+                    next= v;
+            }
+
+            while(next < 0 && cursor < vertex_count)
+            {
+                if(live[cursor] > 0)
+                    next= cursor;
+                cursor++;
+            }
+
+            // nouvelle sequence si le sommet n'est plus dans le cache
+            if(next >= 0 && time - cache_time[next] > cache_size)
+            {
+                sequences.back().end= int(order.size());
+                sequences.push_back( {int(order.size()), 0, 0} );
+            }
+        }
+
+        fanning= next;
+    }
+
+    sequences.back().end= int(order.size());
+    assert(int(order.size()) == triangle_count);
+}
+
+}
+
+
+void optimize_vertex_cache( Mesh& mesh, const std::vector<TriangleGroup>& groups, const int cache_size, const bool optimize_overdraw )
+{
+    if(mesh.indices().empty() || mesh.primitives() != GL_TRIANGLES)
+        return;
+
+    std::vector<unsigned int> indices= mesh.indices();
+    std::vector<unsigned int> materials= mesh.material_indices();
+    const bool has_materials= (int(materials.size()) == mesh.triangle_count());
+    const std::vector<vec3>& positions= mesh.positions();
+
+#pragma omp parallel for schedule(dynamic, 1)
+    for(int g= 0; g < int(groups.size()); g++)
+    {
+        const TriangleGroup& group= groups[g];
+        if(group.n < 6)
+            continue;
+
+        // numerotation locale des sommets du groupe
+        std::vector<unsigned int> vertices(indices.begin() + group.first, indices.begin() + group.first + group.n);
+        std::sort(vertices.begin(), vertices.end());
+        vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+
+        std::vector<unsigned int> local(group.n);
+        for(int i= 0; i < group.n; i++)
+            local[i]= unsigned(std::lower_bound(vertices.begin(), vertices.end(), indices[group.first + i]) - vertices.begin());
+
+        std::vector<int> order;
+        std::vector<Sequence> sequences;
+        tipsify(local, int(vertices.size()), cache_size, order, sequences);
+
+        if(optimize_overdraw && sequences.size() > 1)
+        {
+            // potentiel d'occlusion de chaque sequence : les sequences loin du centre du groupe, orientees vers l'exterieur, cachent les autres
+            // cf section 4 de l'article, le centre et la normale de chaque sequence sont ponderes par l'aire des triangles
+            auto triangle= [&]( const int t, Vector& normal, Point& center )
+            {
+                Point a= Point(positions[indices[group.first + 3*t]]);
+                Point b= Point(positions[indices[group.first + 3*t +1]]);
+                Point c= Point(positions[indices[group.first + 3*t +2]]);
+                normal= cross(b - a, c - a);
+                center= Point((Vector(a) + Vector(b) + Vector(c)) / 3);
+            };
+
+            Vector group_center;
+            float group_area= 0;
+            for(int t= 0; t < group.n / 3; t++)
+            {
+                Vector normal;
+                Point center;
+                triangle(t, normal, center);
+                float area= length(normal);
+                group_center= group_center + area * Vector(center);
+                group_area+= area;
+            }
+            if(group_area > 0)
+                group_center= group_center / group_area;
+
+            for(Sequence& sequence : sequences)
+            {
+                Vector sequence_normal;
+                Vector sequence_center;
+                float sequence_area= 0;
+                for(int i= sequence.begin; i < sequence.end; i++)
+                {
+                    Vector normal;
+                    Point center;
+                    triangle(order[i], normal, center);
+                    float area= length(normal);
+                    sequence_normal= sequence_normal + normal;
+                    sequence_center= sequence_center + area * Vector(center);
+                    sequence_area+= area;
+                }
+
+                float normal_length= length(sequence_normal);
+                if(sequence_area > 0 && normal_length > 0)
+                    sequence.occlusion= dot(sequence_center / sequence_area - group_center, sequence_normal / normal_length);
+            }
+
+            std::stable_sort(sequences.begin(), sequences.end(), []( const Sequence& a, const Sequence& b ) { return a.occlusion > b.occlusion; });
+
+            std::vector<int> sorted;
+            sorted.reserve(order.size());
+            for(const Sequence& sequence : sequences)
+                sorted.insert(sorted.end(), order.begin() + sequence.begin, order.begin() + sequence.end);
+            std::swap(order, sorted);
+        }
+
+        // re-ecrit les triangles du groupe dans le nouvel ordre, les groupes sont disjoints
+        std::vector<unsigned int> group_materials;
+        if(has_materials)
+            group_materials.assign(materials.begin() + group.first / 3, materials.begin() + (group.first + group.n) / 3);
+
+        for(int i= 0; i < int(order.size()); i++)
+        {
+            int t= order[i];
+            for(int k= 0; k < 3; k++)
+                indices[group.first + 3*i +k]= vertices[local[3*t +k]];
+            if(has_materials)
+                materials[group.first / 3 + i]= group_materials[t];
+        }
+    }
+
+    mesh.assign(std::vector<vec3>(mesh.positions()), std::vector<vec2>(mesh.texcoords()), std::vector<vec3>(mesh.normals()), std::vector<vec4>(mesh.colors()),
+        std::move(indices), std::move(materials));
+}
+
+void optimize_vertex_fetch( Mesh& mesh )
+{
+    if(mesh.indices().empty())
+        return;
+
+    const int vertex_count= int(mesh.positions().size());
+    std::vector<int> remap(vertex_count, -1);
+    std::vector<unsigned int> indices= mesh.indices();
+
+    // numerote les sommets dans l'ordre de leur premiere utilisation
+    std::vector<int> vertices;
+    vertices.reserve(vertex_count);
+    for(unsigned int& index : indices)
+    {
+        if(remap[index] < 0)
+        {
+            remap[index]= int(vertices.size());
+            vertices.push_back(index);
+        }
+
+        index= remap[index];
+    }
+
+    auto reorder= [&]( const auto& data )
+    {
+        std::remove_const_t<std::remove_reference_t<decltype(data)>> tmp;
+        if(data.empty())
+            return tmp;
+
+        tmp.resize(vertices.size());
+        for(int i= 0; i < int(vertices.size()); i++)
+            tmp[i]= data[vertices[i]];
+        return tmp;
+    };
+
+    mesh.assign(reorder(mesh.positions()), reorder(mesh.texcoords()), reorder(mesh.normals()), reorder(mesh.colors()),
+        std::move(indices), std::vector<unsigned int>(mesh.material_indices()));
+}
+
+VertexCacheStats vertex_cache_stats( const Mesh& mesh, const std::vector<TriangleGroup>& groups, const int cache_size, const bool lru )
+{
+    VertexCacheStats stats= { 0, 0, 0, 0, 0 };
+
+    const std::vector<unsigned int>& indices= mesh.indices();
+    const bool indexed= !indices.empty();
+    const int vertex_count= int(mesh.positions().size());
+
+    std::vector<int> cache(cache_size);
+    std::vector<int> group_mark(vertex_count, -1);
+    for(int g= 0; g < int(groups.size()); g++)
+    {
+        const TriangleGroup& group= groups[g];
+
+        // chaque draw commence avec un cache vide
+        std::fill(cache.begin(), cache.end(), -1);
+        int fifo= 0;
+
+        for(int i= group.first; i < group.first + group.n; i++)
+        {
+            int v= indexed ? int(indices[i]) : i;
+            if(group_mark[v] != g)
+            {
+                group_mark[v]= g;
+                stats.vertices++;
+            }
+
+            int slot= int(std::find(cache.begin(), cache.end(), v) - cache.begin());
+            if(slot < cache_size)
+            {
+                // lru : le sommet devient le plus recent
+                if(lru)
+                    std::rotate(cache.begin(), cache.begin() + slot, cache.begin() + slot +1);
+                continue;
+            }
+
+            stats.transformed++;
+            if(lru)
+            {
+                std::rotate(cache.begin(), cache.end() -1, cache.end());
+                cache[0]= v;
+            }
+            else
+            {
+                cache[fifo]= v;
+                fifo= (fifo +1) % cache_size;
+            }
+        }
+
+        stats.triangles+= group.n / 3;
+    }
+
+    if(stats.triangles > 0)
+        stats.acmr= float(stats.transformed) / float(stats.triangles);
+    if(stats.vertices > 0)
+        stats.atvr= float(stats.transformed) / float(stats.vertices);
+    return stats;
+}
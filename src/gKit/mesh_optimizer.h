@@ -0,0 +1,63 @@
+#ifndef _MESH_OPTIMIZER_H
+#define _MESH_OPTIMIZER_H
+
+#include <vector>
+
+#include "mesh.h"
+
+
+//! \addtogroup objet3D
+///@{
+
+/*! \file
+optimisation de l'ordre des triangles et des sommets d'un objet indexe, pour le cache des sommets transformes et pour le cache des attributs des sommets.
+
+les triangles sont reordonnes dans chaque groupe (cf Mesh::groups()), ils restent dans leur groupe et les groupes ne bougent pas dans l'index buffer.
+\code
+Mesh mesh= read_indexed_mesh("data/bistro.obj");
+std::vector<TriangleGroup> groups= mesh.groups();
+
+VertexCacheStats before= vertex_cache_stats(mesh, groups);
+optimize_vertex_cache(mesh, groups);
+optimize_vertex_fetch(mesh);
+VertexCacheStats after= vertex_cache_stats(mesh, groups);
+printf("acmr %.3f -> %.3f\n", before.acmr, after.acmr);
+\endcode
+*/
+
+//! taille du cache de sommets transformes utilisee par defaut, pour l'optimisation et pour la simulation.
+const int VERTEX_CACHE_SIZE= 16;
+
+/*! reordonne les triangles de chaque groupe pour reutiliser les sommets transformes par le gpu, cf "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw", Sander, Nehab, Barczak, 2007 (Tipsify).
+
+    les triangles autour d'un sommet sont emis ensemble, puis l'algorithme continue avec un sommet voisin encore dans le cache.
+    si optimize_overdraw est vrai, les sequences de triangles construites par Tipsify sont ensuite triees par groupe pour dessiner d'abord celles
+    qui sont sur l'exterieur de l'objet et qui cachent les autres, sans (trop) degrader l'utilisation du cache.
+
+    les groupes sont traites en parallele. l'objet doit etre indexe.
+*/
+void optimize_vertex_cache( Mesh& mesh, const std::vector<TriangleGroup>& groups, const int cache_size= VERTEX_CACHE_SIZE, const bool optimize_overdraw= true );
+
+/*! reordonne les sommets dans l'ordre de leur premiere utilisation par l'index buffer, les attributs des sommets sont lus (presque) sequentiellement.
+    les sommets qui ne sont pas utilises par les triangles sont supprimes. l'objet doit etre indexe.
+*/
+void optimize_vertex_fetch( Mesh& mesh );
+
+//! resultat de la simulation du cache de sommets transformes, cf vertex_cache_stats().
+struct VertexCacheStats
+{
+    int triangles;          //!< nombre de triangles.
+    int vertices;           //!< nombre de sommets differents utilises par les triangles de chaque groupe.
+    int transformed;        //!< nombre de sommets transformes, ie qui n'etaient pas dans le cache.
+    float acmr;             //!< average cache miss ratio : sommets transformes par triangle, entre 0.5 (ideal, grand maillage regulier) et 3.
+    float atvr;             //!< average transformed vertex ratio : sommets transformes par sommet, entre 1 (ideal) et 6.
+};
+
+/*! simule le cache de sommets transformes du gpu pour dessiner les groupes de triangles, un draw par groupe. le cache est vide au debut de chaque groupe.
+    \param cache_size nombre de sommets du cache.
+    \param lru cache lru si vrai, sinon fifo (les sommets presents dans le cache ne changent pas de position quand ils sont reutilises, comme sur la plupart des gpu).
+*/
+VertexCacheStats vertex_cache_stats( const Mesh& mesh, const std::vector<TriangleGroup>& groups, const int cache_size= VERTEX_CACHE_SIZE, const bool lru= false );
+
+///@}
+#endif
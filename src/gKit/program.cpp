@@ -1,13 +1,19 @@
 
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <chrono>
 #include <fstream>
 #include <sstream>
 #include <string>
 #include <vector>
+#include <unordered_map>
 #include <algorithm>
 
 #include <climits>
 
 #include "program.h"
+#include "uniforms.h"
 
 
 // charge un fichier texte.
@@ -127,6 +133,8 @@ GLenum shader_types[] =
 #endif
 };
 
+// compile un shader et l'attache au program. ne verifie pas les erreurs, cf finish_program( ) : 
+// la compilation peut se terminer en parallele, l'etat du shader n'est pas demande avant la fin du link.
 static
 GLuint compile_shader( const GLuint program, const GLenum shader_type, const std::string& source )
 {
@@ -139,17 +147,242 @@ GLuint compile_shader( const GLuint program, const GLenum shader_type, const std
     const char *sources= source.c_str();
     glShaderSource(shader, 1, &sources, NULL);
     glCompileShader(shader);
+    return shader;
+}
 
-    GLint status;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
-    return (status == GL_TRUE) ? shader : 0;
+
+// compilation en parallele par le driver, si GL_KHR_parallel_shader_compile est disponible.
+static
+bool parallel_compile( )
+{
+    static int available= -1;
+    if(available < 0)
+    {
+        available= 0;
+    #ifndef NO_GLEW
+        if(GLEW_KHR_parallel_shader_compile)
+        {
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);  // autant de threads que le driver le souhaite
+            available= 1;
+        }
+        else if(GLEW_ARB_parallel_shader_compile)
+        {
+            glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+            available= 1;
+        }
+    #endif
+    }
+    
+    return available == 1;
 }
 
 
-int reload_program( const GLuint program, const char *filename, const char *definitions )
+// cache binaire des programs, fichier .gkprogram : glGetProgramBinary( ) apres le premier link, glProgramBinary( ) aux executions suivantes.
+// un fichier par source et par definitions, ecrit a cote du source, cf program_cache_filename( ).
+// le cache est invalide si le source complet (avec les definitions) ou le driver changent.
+static const char gkprogram_magic[8]= { 'g', 'k', 'p', 'r', 'o', 'g', 0, 0 };
+static const uint32_t gkprogram_version= 1;
+
+struct gkprogram_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t binary_format;
+    uint64_t key;               // hash des sources, des definitions et du driver, cf program_key( )
+    uint64_t binary_size;
+};
+
+// fnv-1a 64 bits
+static
+uint64_t hash( uint64_t h, const char *data, const size_t size )
+{
+    for(size_t i= 0; i < size; i++)
+    {
+        h^= uint8_t(data[i]);
+        h*= 1099511628211ull;
+    }
+    return h;
+}
+
+static
+uint64_t hash( const uint64_t h, const std::string& string )
+{
+    // inclut le 0 final pour separer les chaines
+    return hash(h, string.c_str(), string.size() +1);
+}
+
+static
+uint64_t program_key( const std::vector<std::string>& sources, const std::string& definitions )
+{
+    uint64_t h= 14695981039346656037ull;
+    
+    // le binaire depend du driver et de la carte graphique
+    const GLenum strings[]= { GL_VENDOR, GL_RENDERER, GL_VERSION };
+    for(GLenum name : strings)
+    {
+        const char *string= (const char *) glGetString(name);
+        h= hash(h, std::string(string ? string : ""));
+    }
+    
+    h= hash(h, definitions);
+    for(const std::string& source : sources)
+        h= hash(h, source);
+    return h;
+}
+
+// renvoie le nom du cache d'un program. "data/shaders/mesh.glsl" + definitions == "data/shaders/mesh.<hash des definitions>.gkprogram"
+static
+std::string program_cache_filename( const std::string& filename, const std::string& definitions )
+{
+    char suffix[32];
+    sprintf(suffix, ".%08x.gkprogram", unsigned(hash(14695981039346656037ull, definitions) & 0xffffffffu));
+    
+    size_t dot= filename.rfind('.');
+    size_t slash= filename.find_last_of("/\\");
+    if(dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return filename + suffix;
+    
+    return filename.substr(0, dot) + suffix;
+}
+
+// charge le binaire d'un program, s'il existe et s'il correspond aux sources et au driver.
+static
+bool read_program_cache( const GLuint program, const std::string& cache, const uint64_t key )
+{
+#ifdef GL_VERSION_4_1
+#ifndef NO_GLEW
+    if(!GLEW_ARB_get_program_binary)
+        return false;
+#endif
+    
+    FILE *in= fopen(cache.c_str(), "rb");
+    if(in == nullptr)
+        return false;
+    
+    gkprogram_header header;
+    std::vector<char> binary;
+    bool code= fread(&header, sizeof(header), 1, in) == 1
+        && memcmp(header.magic, gkprogram_magic, sizeof(header.magic)) == 0
+        && header.version == gkprogram_version
+        && header.key == key
+        && header.binary_size > 0 && header.binary_size < (1u << 30);
+    if(code)
+    {
+        binary.resize(header.binary_size);
+        code= fread(binary.data(), 1, binary.size(), in) == binary.size();
+    }
+    fclose(in);
+    
+    if(!code)
+        return false;
+    
+    glProgramBinary(program, header.binary_format, binary.data(), GLsizei(binary.size()));
+    
+    // le driver peut refuser un binaire, apres une mise a jour par exemple
+    GLint status= GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    return status == GL_TRUE;
+#else
+    return false;
+#endif
+}
+
+static
+bool write_program_cache( const GLuint program, const std::string& cache, const uint64_t key )
+{
+#ifdef GL_VERSION_4_1
+#ifndef NO_GLEW
+    if(!GLEW_ARB_get_program_binary)
+        return false;
+#endif
+    
+    GLint size= 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+    if(size <= 0)
+        return false;
+    
+    std::vector<char> binary(size);
+    GLenum format= 0;
+    glGetProgramBinary(program, size, nullptr, &format, binary.data());
+    
+    gkprogram_header header= { };
+    memcpy(header.magic, gkprogram_magic, sizeof(header.magic));
+    header.version= gkprogram_version;
+    header.binary_format= format;
+    header.key= key;
+    header.binary_size= binary.size();
+    
+    FILE *out= fopen(cache.c_str(), "wb");
+    if(out == nullptr)
+        return false;
+    
+    bool code= fwrite(&header, sizeof(header), 1, out) == 1
+        && fwrite(binary.data(), 1, binary.size(), out) == binary.size();
+    fclose(out);
+    
+    if(!code)
+        remove(cache.c_str());
+    return code;
+#else
+    return false;
+#endif
+}
+
+
+// programs en cours de compilation, termines par finish_program( ).
+struct PendingProgram
+{
+    std::string filename;
+    std::string cache;
+    uint64_t key;
+    std::chrono::high_resolution_clock::time_point start;
+};
+
+static std::unordered_map<GLuint, PendingProgram> pending_programs;
+
+static
+float elapsed_ms( const std::chrono::high_resolution_clock::time_point& start )
+{
+    auto stop= std::chrono::high_resolution_clock::now();
+    return float(std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count()) / 1000;
+}
+
+// attend la fin de la compilation et du link d'un program, ecrit le cache et affiche le temps de compilation.
+static
+int finish_program( const GLuint program )
+{
+    auto found= pending_programs.find(program);
+    if(found == pending_programs.end())
+        return 0;
+    
+    PendingProgram pending= found->second;
+    pending_programs.erase(found);
+    
+    // bloque jusqu'a la fin du link
+    GLint status;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    program_reflect_uniforms(program);
+    if(status == GL_FALSE)
+    {
+        printf("[error] linking program %u '%s'...\n", program, pending.filename.c_str());
+        return -1;
+    }
+    
+    write_program_cache(program, pending.cache, pending.key);
+    printf("program '%s' compiled in %.1fms\n", pending.filename.c_str(), elapsed_ms(pending.start));
+    return 0;
+}
+
+// charge les sources, ou le binaire du cache, compile et linke le program. 
+// wait == false : n'attend pas la fin du link, cf read_program_async( ).
+static
+int load_program( const GLuint program, const char *filename, const char *definitions, const bool wait )
 {
     if(program == 0)
         return -1;
+    
+    auto start= std::chrono::high_resolution_clock::now();
+    pending_programs.erase(program);
 
     // supprime les shaders attaches au program
     int shaders_max= 0;
@@ -171,40 +404,70 @@ int reload_program( const GLuint program, const char *filename, const char *defi
 
     // prepare les sources
     std::string common_source= read(filename);
+    std::vector<GLenum> types;
+    std::vector<std::string> sources;
     for(int i = 0; i < shader_keys_max; i++)
     {
         if(common_source.find(shader_keys[i]) != std::string::npos)
         {
-            // cree et compile les shaders detectes dans le source
-            std::string source= prepare_source(common_source, std::string(definitions).append("#define ").append(shader_keys[i]).append("\n"));
-            GLuint shader= compile_shader(program, shader_types[i], source);
-            //~ printf("  %s...\n", shader_string(shader_types[i]));
-            if(shader == 0)
-                printf("[error] compiling %s...\n%s\n", shader_string(shader_types[i]), definitions);
+            types.push_back(shader_types[i]);
+            sources.push_back(prepare_source(common_source, std::string(definitions).append("#define ").append(shader_keys[i]).append("\n")));
         }
     }
     
-    // linke les shaders
+    // utilise le binaire du cache, s'il correspond aux sources et au driver
+    uint64_t key= program_key(sources, definitions);
+    std::string cache= program_cache_filename(filename, definitions);
+    if(read_program_cache(program, cache, key))
+    {
+        program_reflect_uniforms(program);
+        printf("program '%s' loaded from binary cache in %.1fms\n", filename, elapsed_ms(start));
+        if(wait)
+            // pour etre coherent avec les autres fonctions de creation, active l'objet gl qui vient d'etre cree.
+            glUseProgram(program);
+        return 0;
+    }
+    
+    // cree et compile les shaders detectes dans le source
+    parallel_compile();
+    for(unsigned i= 0; i < types.size(); i++)
+        compile_shader(program, types[i], sources[i]);
+    
+    // linke les shaders, conserve le binaire pour le cache
+#ifdef GL_VERSION_4_1
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+#endif
     glLinkProgram(program);
-
+    
+    pending_programs[program]= PendingProgram{ filename, cache, key, start };
+    if(!wait)
+        return 0;
+    
     // verifie les erreurs
-    GLint status;
-    glGetProgramiv(program, GL_LINK_STATUS, &status);
-    if(status == GL_FALSE)
-    {
-        printf("[error] linking program %u '%s'...\n", program, filename);
+    if(finish_program(program) < 0)
         return -1;
-    }
-
+    
     // pour etre coherent avec les autres fonctions de creation, active l'objet gl qui vient d'etre cree.
     glUseProgram(program);
     return 0;
 }
 
+int reload_program( const GLuint program, const char *filename, const char *definitions )
+{
+    return load_program(program, filename, definitions, true);
+}
+
 GLuint read_program( const char *filename, const char *definitions )
 {
     GLuint program= glCreateProgram();
-    reload_program(program, filename, definitions);
+    load_program(program, filename, definitions, true);
+    return program;
+}
+
+GLuint read_program_async( const char *filename, const char *definitions )
+{
+    GLuint program= glCreateProgram();
+    load_program(program, filename, definitions, false);
     return program;
 }
 
@@ -212,6 +475,9 @@ int release_program( const GLuint program )
 {
     if(program == 0)
         return -1;
+    
+    pending_programs.erase(program);
+    program_release_uniforms(program);
 
     // recupere les shaders
     int shaders_max= 0;
@@ -238,6 +504,8 @@ bool program_ready( const GLuint program )
     if(program == 0)
         return false;
     
+    finish_program(program);
+    
     GLint status= GL_FALSE;
     glGetProgramiv(program, GL_LINK_STATUS, &status);
     
@@ -261,6 +529,8 @@ bool program_errors( const GLuint program )
     if(program == 0)
         return true;
     
+    finish_program(program);
+    
     GLint status;
     glGetProgramiv(program, GL_LINK_STATUS, &status);
     
@@ -372,6 +642,8 @@ int program_format_errors( const GLuint program, std::string& errors )
         errors.append("[error] no program...\n");
         return -1;
     }
+    
+    finish_program(program);
 
     GLint status;
     glGetProgramiv(program, GL_LINK_STATUS, &status);
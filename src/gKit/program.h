@@ -20,6 +20,16 @@
 //! \param definitions chaine de caracteres pouvant comporter plusieurs lignes "#define what value\n".
 GLuint read_program( const char *filename, const char *definitions= "" );
 
+/*! cree un shader program sans attendre la fin de la compilation. a detruire avec release_program( ).\n
+    le program n'est pas selectionne : creer tous les programs avant de verifier leurs erreurs (cf program_print_errors( )), 
+    pour que le driver les compile en parallele (GL_KHR_parallel_shader_compile).
+
+    read_program( ) et read_program_async( ) conservent le binaire du program dans un cache, a cote du source, fichier .gkprogram. 
+    le cache est reutilise tant que le source, les definitions et le driver ne changent pas, cf glProgramBinary( ).
+    le temps de compilation, ou de chargement du cache, de chaque program est affiche.
+ */
+GLuint read_program_async( const char *filename, const char *definitions= "" );
+
 //! detruit les shaders et le program.
 int release_program( const GLuint program );
 
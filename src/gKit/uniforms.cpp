@@ -1,13 +1,135 @@
 
 #include <cstdio>
+#include <cstdint>
+#include <cstring>
 #include <cassert>
 
+#include <algorithm>
 #include <set>
+#include <unordered_map>
 
 #include "program.h"
 #include "uniforms.h"
 
 
+// inventaire des uniforms d'un program : hash du nom -> location, taille du tableau.
+struct UniformInfo
+{
+    GLint location;
+    GLint array_size;
+};
+
+typedef std::unordered_map<uint64_t, UniformInfo> ProgramUniforms;
+static std::unordered_map<GLuint, ProgramUniforms> programs_uniforms;
+
+// fnv-1a 64 bits
+static
+uint64_t uniform_hash( const char *name, const size_t length )
+{
+    uint64_t h= 14695981039346656037ull;
+    for(size_t i= 0; i < length; i++)
+    {
+        h^= uint8_t(name[i]);
+        h*= 1099511628211ull;
+    }
+    return h;
+}
+
+static
+uint64_t uniform_hash( const char *name )
+{
+    return uniform_hash(name, strlen(name));
+}
+
+void program_reflect_uniforms( const GLuint program )
+{
+    if(program == 0)
+        return;
+    
+    ProgramUniforms& uniforms= programs_uniforms[program];
+    uniforms.clear();
+    
+    GLint status= GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if(status == GL_FALSE)
+        return;
+    
+    GLint count= 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+    GLint length= 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &length);
+    
+    std::vector<char> name(std::max(length, 1));
+    for(int i= 0; i < count; i++)
+    {
+        GLint size= 0;
+        GLenum type= 0;
+        GLsizei name_length= 0;
+        glGetActiveUniform(program, i, GLsizei(name.size()), &name_length, &size, &type, name.data());
+        
+        // les uniforms des blocs n'ont pas de location, cf program_uniform_block( )
+        GLint location= glGetUniformLocation(program, name.data());
+        if(location < 0)
+            continue;
+        
+        UniformInfo info= { location, size };
+        uniforms[uniform_hash(name.data(), name_length)]= info;
+        
+        // un tableau est nomme "array[0]", il est aussi utilise avec "array"
+        if(name_length > 3 && strcmp(name.data() + name_length - 3, "[0]") == 0)
+            uniforms[uniform_hash(name.data(), name_length - 3)]= info;
+    }
+}
+
+void program_release_uniforms( const GLuint program )
+{
+    programs_uniforms.erase(program);
+}
+
+// recherche un uniform dans l'inventaire du program. les elements de tableaux "array[3]" ne sont pas inventories, demande au driver.
+static
+UniformInfo find_uniform( const GLuint program, const char *uniform )
+{
+    auto found= programs_uniforms.find(program);
+    if(found == programs_uniforms.end())
+    {
+        // program cree sans read_program( ), inventorie ses uniforms maintenant
+        program_reflect_uniforms(program);
+        found= programs_uniforms.find(program);
+    }
+    
+    const ProgramUniforms& uniforms= found->second;
+    auto info= uniforms.find(uniform_hash(uniform));
+    if(info != uniforms.end())
+        return info->second;
+    
+    if(strchr(uniform, '[') != nullptr)
+        return UniformInfo{ glGetUniformLocation(program, uniform), 0 };
+    
+    return UniformInfo{ -1, 0 };
+}
+
+static
+void uniform_not_found( const GLuint program, const char *uniform )
+{
+    char error[4096]= { 0 };
+#ifdef GL_VERSION_4_3
+    {
+        char label[1024];
+        glGetObjectLabel(GL_PROGRAM, program, sizeof(label), nullptr, label);
+        
+        sprintf(error, "uniform( %s %u, '%s' ): not found.", label, program, uniform); 
+    }
+#else
+    sprintf(error, "uniform( program %u, '%s'): not found.", program, uniform); 
+#endif
+    
+    static std::set<std::string> log;
+    if(log.insert(error).second == true) 
+        // pas la peine d'afficher le message 60 fois par seconde...
+        printf("%s\n", error); 
+}
+
 static 
 int location( const GLuint program, const char *uniform, const int array_size= 0 )
 {
@@ -16,25 +138,11 @@ int location( const GLuint program, const char *uniform, const int array_size= 0
     
     // recuperer l'identifiant de l'uniform dans le program
     char error[4096]= { 0 };
-    GLint location= glGetUniformLocation(program, uniform);
+    UniformInfo info= find_uniform(program, uniform);
+    GLint location= info.location;
     if(location < 0)
     {
-    #ifdef GL_VERSION_4_3
-        {
-            char label[1024];
-            glGetObjectLabel(GL_PROGRAM, program, sizeof(label), nullptr, label);
-            
-            sprintf(error, "uniform( %s %u, '%s' ): not found.", label, program, uniform); 
-        }
-    #else
-        sprintf(error, "uniform( program %u, '%s'): not found.", program, uniform); 
-    #endif
-        
-        static std::set<std::string> log;
-        if(log.insert(error).second == true) 
-            // pas la peine d'afficher le message 60 fois par seconde...
-            printf("%s\n", error); 
-        
+        uniform_not_found(program, uniform);
         return -1; 
     }
     
@@ -61,25 +169,16 @@ int location( const GLuint program, const char *uniform, const int array_size= 0
         glUseProgram(program);
     }
     
-    if(location >= 0 && array_size > 0)
+    // verifier que le tableau d'uniform fait la bonne taille...
+    if(array_size > 0 && info.array_size > 0 && info.array_size != array_size)
     {
     #ifdef GL_VERSION_4_3
-        // verifier que le tableau d'uniform fait la bonne taille...
-        GLuint index= glGetProgramResourceIndex(program, GL_UNIFORM, uniform);
-        if(index != GL_INVALID_INDEX)
-        {
-            GLenum props[]= { GL_ARRAY_SIZE };
-            GLint value= 0;
-            glGetProgramResourceiv(program, GL_UNIFORM,  index, 1, props, 1, nullptr, &value);
-            if(value != array_size)
-            {
-                char label[1024];
-                glGetObjectLabel(GL_PROGRAM, program, sizeof(label), nullptr, label);
-    
-                printf("uniform( %s %u, '%s' array [%d] ): invalid array size [%d]...\n", label, location, uniform, value, array_size);
-            }
-        }
+        char label[1024];
+        glGetObjectLabel(GL_PROGRAM, program, sizeof(label), nullptr, label);
+    #else
+        const char *label= "program";
     #endif
+        printf("uniform( %s %u, '%s' array [%d] ): invalid array size [%d]...\n", label, location, uniform, info.array_size, array_size);
     }
 #endif
     
@@ -213,3 +312,82 @@ void program_use_texture( const GLuint program, const char *uniform, const int u
     // transmet l'indice de l'unite de texture au shader
     glUniform1i(id, unit);
 }
+
+
+UniformHandle program_uniform_handle( const GLuint program, const char *uniform, const bool required )
+{
+    if(program == 0)
+        return UniformHandle();
+    
+    GLint location= find_uniform(program, uniform).location;
+    if(location < 0 && required)
+        uniform_not_found(program, uniform);
+    
+    return UniformHandle(program, location);
+}
+
+void program_uniform( const UniformHandle& uniform, const unsigned v )
+{
+    glUniform1ui( uniform.location, v );
+}
+
+void program_uniform( const UniformHandle& uniform, const int v )
+{
+    glUniform1i( uniform.location, v );
+}
+
+void program_uniform( const UniformHandle& uniform, const float v )
+{
+    glUniform1f( uniform.location, v );
+}
+
+void program_uniform( const UniformHandle& uniform, const vec2& v )
+{
+    glUniform2fv( uniform.location, 1, &v.x );
+}
+
+void program_uniform( const UniformHandle& uniform, const vec3& v )
+{
+    glUniform3fv( uniform.location, 1, &v.x );
+}
+
+void program_uniform( const UniformHandle& uniform, const Point& a )
+{
+    glUniform3fv( uniform.location, 1, &a.x );
+}
+
+void program_uniform( const UniformHandle& uniform, const Vector& v )
+{
+    glUniform3fv( uniform.location, 1, &v.x );
+}
+
+void program_uniform( const UniformHandle& uniform, const vec4& v )
+{
+    glUniform4fv( uniform.location, 1, &v.x );
+}
+
+void program_uniform( const UniformHandle& uniform, const Color& c )
+{
+    glUniform4fv( uniform.location, 1, &c.r );
+}
+
+void program_uniform( const UniformHandle& uniform, const Transform& v )
+{
+    glUniformMatrix4fv( uniform.location, 1, GL_TRUE, v.data() );
+}
+
+bool program_uniform_block( const GLuint program, const char *block, const GLuint binding )
+{
+    if(program == 0)
+        return false;
+    
+    GLuint index= glGetUniformBlockIndex(program, block);
+    if(index == GL_INVALID_INDEX)
+    {
+        printf("uniform block( program %u, '%s' ): not found.\n", program, block);
+        return false;
+    }
+    
+    glUniformBlockBinding(program, index, binding);
+    return true;
+}
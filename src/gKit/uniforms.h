@@ -63,5 +63,68 @@ void program_uniform( const GLuint program, const char *uniform, const std::vect
 //! configure le pipeline et le shader program pour utiliser une texture, et des parametres de filtrage, eventuellement.
 void program_use_texture( const GLuint program, const char *uniform, const int unit, const GLuint texture, const GLuint sampler= 0 );
 
+
+/*! identifiant d'un uniform d'un shader program, a recuperer une seule fois, apres la creation du program, cf program_uniform_handle( ).
+    les affectations avec un identifiant ne recherchent plus l'uniform, ni dans le program, ni dans le driver.
+\code
+GLuint program= read_program("shader.glsl");
+UniformHandle color= program_uniform_handle(program, "color");
+
+// a chaque affichage
+glUseProgram(program);
+program_uniform(color, Red());
+\endcode
+*/
+struct UniformHandle
+{
+    UniformHandle( ) : program(0), location(-1) {}
+    UniformHandle( const GLuint _program, const GLint _location ) : program(_program), location(_location) {}
+    
+    GLuint program;
+    GLint location;
+    
+    //! renvoie vrai si l'uniform existe dans le program.
+    bool valid( ) const { return location >= 0; }
+};
+
+/*! renvoie l'identifiant d'un uniform. 
+    les uniforms sont inventories une seule fois, apres le link du program, cf program_reflect_uniforms( ) : pas d'appel au driver, 
+    sauf pour un element de tableau "array[3]".
+    si required est faux, un uniform absent n'affiche pas de message, cf UniformHandle::valid( ).
+ */
+UniformHandle program_uniform_handle( const GLuint program, const char *uniform, const bool required= true );
+
+//! affecte une valeur a un uniform, le program doit etre selectionne, cf glUseProgram( ). uint.
+void program_uniform( const UniformHandle& uniform, const unsigned v );
+//! affecte une valeur a un uniform. int.
+void program_uniform( const UniformHandle& uniform, const int v );
+//! affecte une valeur a un uniform. float.
+void program_uniform( const UniformHandle& uniform, const float v );
+//! affecte une valeur a un uniform. vec2.
+void program_uniform( const UniformHandle& uniform, const vec2& v );
+//! affecte une valeur a un uniform. vec3.
+void program_uniform( const UniformHandle& uniform, const vec3& v );
+//! affecte une valeur a un uniform. Point.
+void program_uniform( const UniformHandle& uniform, const Point& v );
+//! affecte une valeur a un uniform. Vector.
+void program_uniform( const UniformHandle& uniform, const Vector& v );
+//! affecte une valeur a un uniform. vec4.
+void program_uniform( const UniformHandle& uniform, const vec4& v );
+//! affecte une valeur a un uniform. Color.
+void program_uniform( const UniformHandle& uniform, const Color& c );
+//! affecte une valeur a un uniform. Transform.
+void program_uniform( const UniformHandle& uniform, const Transform& v );
+
+/*! associe un bloc d'uniforms du program a un point d'attache, cf glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer).
+    pour partager le meme buffer entre plusieurs programs, sans utiliser layout(binding= ) (glsl 420).
+    renvoie false si le bloc n'existe pas dans le program.
+ */
+bool program_uniform_block( const GLuint program, const char *block, const GLuint binding );
+
+//! inventorie les uniforms actifs d'un program, apres un link reussi. utilise par read_program( ) et reload_program( ), cf program_uniform_handle( ).
+void program_reflect_uniforms( const GLuint program );
+//! oublie les uniforms d'un program. utilise par release_program( ).
+void program_release_uniforms( const GLuint program );
+
 ///@}
 #endif
@@ -0,0 +1,287 @@
+
+#include <cassert>
+#include <cmath>
+#include <cfloat>
+#include <cstring>
+#include <algorithm>
+
+#include "vertex_format.h"
+
+
+namespace {
+
+uint16_t quantize_unorm16( const float x )
+{
+    return uint16_t(std::lround(std::min(std::max(x, 0.f), 1.f) * 65535));
+}
+
+uint8_t quantize_unorm8( const float x )
+{
+    return uint8_t(std::lround(std::min(std::max(x, 0.f), 1.f) * 255));
+}
+
+// inverse de l'echelle de quantification, 0 si l'attribut est constant
+float inverse_scale( const float scale )
+{
+    return scale > 0 ? 1 / scale : 0;
+}
+
+}
+
+
+PackedVertexLayout packed_vertex_layout( const bool use_texcoord, const bool use_normal, const bool use_color )
+{
+    PackedVertexLayout layout= { 0, -1, -1, -1, -1 };
+
+    // position 3x16 bits + normale 2x8 bits : les attributs suivants restent alignes sur 4 octets
+    layout.position= 0;
+    if(use_normal)
+        layout.normal= 6;
+    layout.stride= 8;
+
+    if(use_texcoord)
+    {
+        layout.texcoord= layout.stride;
+        layout.stride+= 4;
+    }
+    if(use_color)
+    {
+        layout.color= layout.stride;
+        layout.stride+= 4;
+    }
+
+    return layout;
+}
+
+VertexQuantization compute_vertex_quantization( const Mesh& mesh )
+{
+    VertexQuantization quantization;
+
+    const std::vector<vec3>& positions= mesh.positions();
+    if(!positions.empty())
+    {
+        Point pmin= Point(positions[0]);
+        Point pmax= Point(positions[0]);
+        for(const vec3& p : positions)
+        {
+            pmin= min(pmin, Point(p));
+            pmax= max(pmax, Point(p));
+        }
+
+        quantization.position_offset= vec3(pmin);
+        quantization.position_scale= vec3(pmax - pmin);
+    }
+
+    const std::vector<vec2>& texcoords= mesh.texcoords();
+    if(!texcoords.empty())
+    {
+        vec2 tmin= texcoords[0];
+        vec2 tmax= texcoords[0];
+        for(const vec2& t : texcoords)
+        {
+            tmin= vec2(std::min(tmin.x, t.x), std::min(tmin.y, t.y));
+            tmax= vec2(std::max(tmax.x, t.x), std::max(tmax.y, t.y));
+        }
+
+        quantization.texcoord_offset= tmin;
+        quantization.texcoord_scale= vec2(tmax.x - tmin.x, tmax.y - tmin.y);
+    }
+
+    return quantization;
+}
+
+void encode_octahedral( const Vector& n, int8_t code[2] )
+{
+    code[0]= 0;
+    code[1]= 0;
+
+    float s= std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if(s == 0)
+        return;
+
+    // projection sur l'octaedre, puis depliage de la moitie z < 0
+    float u= n.x / s;
+    float v= n.y / s;
+    if(n.z < 0)
+    {
+        float x= u;
+        u= (1 - std::abs(v)) * (x >= 0 ? 1 : -1);
+        v= (1 - std::abs(x)) * (v >= 0 ? 1 : -1);
+    }
+
+    // choisit l'arrondi qui minimise l'erreur angulaire, parmi les 4 voisins
+    Vector direction= n / length(n);
+    float fu= std::floor(u * 127);
+    float fv= std::floor(v * 127);
+    float best= -2;
+    for(int i= 0; i < 2; i++)
+    for(int j= 0; j < 2; j++)
+    {
+        int8_t candidate[2]= {
+            int8_t(std::min(std::max(fu + i, -127.f), 127.f)),
+            int8_t(std::min(std::max(fv + j, -127.f), 127.f)) };
+
+        float d= dot(decode_octahedral(candidate), direction);
+        if(d > best)
+        {
+            best= d;
+            code[0]= candidate[0];
+            code[1]= candidate[1];
+        }
+    }
+}
+
+Vector decode_octahedral( const int8_t code[2] )
+{
+    // meme conversion que openGL pour les entiers signes normalises
+    float x= std::max(code[0] / 127.f, -1.f);
+    float y= std::max(code[1] / 127.f, -1.f);
+    float z= 1 - std::abs(x) - std::abs(y);
+    float t= std::max(-z, 0.f);
+    x+= (x >= 0) ? -t : t;
+    y+= (y >= 0) ? -t : t;
+
+    return normalize(Vector(x, y, z));
+}
+
+std::vector<unsigned char> pack_vertices( const Mesh& mesh, const VertexQuantization& quantization, const PackedVertexLayout& layout )
+{
+    const int n= mesh.vertex_count();
+    std::vector<unsigned char> data(std::size_t(n) * layout.stride, 0);
+
+    const std::vector<vec3>& positions= mesh.positions();
+    const std::vector<vec3>& normals= mesh.normals();
+    const std::vector<vec2>& texcoords= mesh.texcoords();
+    const std::vector<vec4>& colors= mesh.colors();
+    assert(layout.normal < 0 || mesh.has_normal());
+    assert(layout.texcoord < 0 || mesh.has_texcoord());
+    assert(layout.color < 0 || mesh.has_color());
+
+    vec3 pscale= vec3(inverse_scale(quantization.position_scale.x), inverse_scale(quantization.position_scale.y), inverse_scale(quantization.position_scale.z));
+    vec2 tscale= vec2(inverse_scale(quantization.texcoord_scale.x), inverse_scale(quantization.texcoord_scale.y));
+
+#pragma omp parallel for schedule(static)
+    for(int i= 0; i < n; i++)
+    {
+        unsigned char *vertex= data.data() + std::size_t(i) * layout.stride;
+
+        const vec3& p= positions[i];
+        uint16_t position[3]= {
+            quantize_unorm16((p.x - quantization.position_offset.x) * pscale.x),
+            quantize_unorm16((p.y - quantization.position_offset.y) * pscale.y),
+            quantize_unorm16((p.z - quantization.position_offset.z) * pscale.z) };
+        memcpy(vertex + layout.position, position, sizeof(position));
+
+        if(layout.normal >= 0)
+        {
+            int8_t normal[2];
+            encode_octahedral(Vector(normals[i]), normal);
+            memcpy(vertex + layout.normal, normal, sizeof(normal));
+        }
+
+        if(layout.texcoord >= 0)
+        {
+            const vec2& t= texcoords[i];
+            uint16_t texcoord[2]= {
+                quantize_unorm16((t.x - quantization.texcoord_offset.x) * tscale.x),
+                quantize_unorm16((t.y - quantization.texcoord_offset.y) * tscale.y) };
+            memcpy(vertex + layout.texcoord, texcoord, sizeof(texcoord));
+        }
+
+        if(layout.color >= 0)
+        {
+            const vec4& c= colors[i];
+            uint8_t color[4]= { quantize_unorm8(c.x), quantize_unorm8(c.y), quantize_unorm8(c.z), quantize_unorm8(c.w) };
+            memcpy(vertex + layout.color, color, sizeof(color));
+        }
+    }
+
+    return data;
+}
+
+VertexFormatError vertex_format_error( const Mesh& mesh )
+{
+    VertexFormatError error= { 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+
+    const int n= mesh.vertex_count();
+    if(n == 0)
+        return error;
+
+    const bool use_normal= mesh.has_normal();
+    const bool use_texcoord= mesh.has_texcoord();
+    const bool use_color= mesh.has_color();
+
+    VertexQuantization quantization= compute_vertex_quantization(mesh);
+    PackedVertexLayout layout= packed_vertex_layout(use_texcoord, use_normal, use_color);
+    std::vector<unsigned char> data= pack_vertices(mesh, quantization, layout);
+
+    error.float_size= std::size_t(n) * (sizeof(vec3) + (use_texcoord ? sizeof(vec2) : 0) + (use_normal ? sizeof(vec3) : 0) + (use_color ? sizeof(vec4) : 0));
+    error.packed_size= data.size();
+
+    const std::vector<vec3>& positions= mesh.positions();
+    const std::vector<vec3>& normals= mesh.normals();
+    const std::vector<vec2>& texcoords= mesh.texcoords();
+    const std::vector<vec4>& colors= mesh.colors();
+
+    float position_max= 0, normal_max= 0, texcoord_max= 0, color_max= 0;
+    double position_sum= 0, normal_sum= 0, texcoord_sum= 0;
+
+    // decompresse comme les shaders : les entiers normalises sont convertis en float, puis dequantifies
+#pragma omp parallel for schedule(static) reduction(max: position_max, normal_max, texcoord_max, color_max) reduction(+: position_sum, normal_sum, texcoord_sum)
+    for(int i= 0; i < n; i++)
+    {
+        const unsigned char *vertex= data.data() + std::size_t(i) * layout.stride;
+
+        uint16_t position[3];
+        memcpy(position, vertex + layout.position, sizeof(position));
+        Point p= Point(
+            quantization.position_offset.x + quantization.position_scale.x * (position[0] / 65535.f),
+            quantization.position_offset.y + quantization.position_scale.y * (position[1] / 65535.f),
+            quantization.position_offset.z + quantization.position_scale.z * (position[2] / 65535.f));
+        float d= distance(p, Point(positions[i]));
+        position_max= std::max(position_max, d);
+        position_sum+= d;
+
+        if(use_normal)
+        {
+            int8_t code[2];
+            memcpy(code, vertex + layout.normal, sizeof(code));
+            Vector normal= Vector(normals[i]);
+            float l= length(normal);
+            float angle= 0;
+            if(l > 0)
+                angle= degrees(std::acos(std::min(std::max(dot(decode_octahedral(code), normal / l), -1.f), 1.f)));
+            normal_max= std::max(normal_max, angle);
+            normal_sum+= angle;
+        }
+
+        if(use_texcoord)
+        {
+            uint16_t texcoord[2];
+            memcpy(texcoord, vertex + layout.texcoord, sizeof(texcoord));
+            float u= quantization.texcoord_offset.x + quantization.texcoord_scale.x * (texcoord[0] / 65535.f);
+            float v= quantization.texcoord_offset.y + quantization.texcoord_scale.y * (texcoord[1] / 65535.f);
+            float d= std::sqrt((u - texcoords[i].x) * (u - texcoords[i].x) + (v - texcoords[i].y) * (v - texcoords[i].y));
+            texcoord_max= std::max(texcoord_max, d);
+            texcoord_sum+= d;
+        }
+
+        if(use_color)
+        {
+            uint8_t color[4];
+            memcpy(color, vertex + layout.color, sizeof(color));
+            const float c[4]= { colors[i].x, colors[i].y, colors[i].z, colors[i].w };
+            for(int k= 0; k < 4; k++)
+                color_max= std::max(color_max, std::abs(color[k] / 255.f - std::min(std::max(c[k], 0.f), 1.f)));
+        }
+    }
+
+    error.position_max= position_max;
+    error.position_mean= float(position_sum / n);
+    error.normal_max= normal_max;
+    error.normal_mean= float(normal_sum / n);
+    error.texcoord_max= texcoord_max;
+    error.texcoord_mean= float(texcoord_sum / n);
+    error.color_max= color_max;
+    return error;
+}
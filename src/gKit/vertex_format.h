@@ -0,0 +1,77 @@
+#ifndef _VERTEX_FORMAT_H
+#define _VERTEX_FORMAT_H
+
+#include <cstdint>
+#include <vector>
+
+#include "vec.h"
+#include "mesh.h"
+
+
+//! \addtogroup objet3D
+///@{
+
+/*! \file
+compression des attributs des sommets d'un objet, cf Mesh::vertex_format() et VERTEX_FORMAT_PACKED.
+
+les attributs sont entrelaces, un sommet occupe 8, 12 ou 16 octets au lieu de 48 :
+    - position : 3 x GL_UNSIGNED_SHORT normalises dans l'englobant de l'objet, cf VertexQuantization,
+    - normale : 2 x GL_BYTE normalises, projection octaedrique de la direction, cf encode_octahedral(),
+    - texcoord : 2 x GL_UNSIGNED_SHORT normalises dans l'englobant des texcoords,
+    - couleur : 4 x GL_UNSIGNED_BYTE normalises, les couleurs sont limitees a [0 1].
+
+les shaders dequantifient la position et les texcoords avec les uniforms position_offset, position_scale, texcoord_offset, texcoord_scale
+et decodent la normale, cf data/shaders/mesh.glsl et USE_PACKED_VERTEX. les englobants sont ceux de l'objet complet : un seul draw peut dessiner tous les groupes de triangles.
+les shaders de debug de DrawParam (normals.glsl, texcoords.glsl) n'utilisent que le format float.
+\code
+Mesh mesh= read_indexed_mesh("data/bistro.obj");
+mesh.vertex_format(VERTEX_FORMAT_PACKED);
+
+VertexFormatError error= vertex_format_error(mesh);
+printf("%.1f octets par sommet, erreur position %f, normale %.2f degres\n", float(error.packed_size) / mesh.vertex_count(), error.position_max, error.normal_max);
+\endcode
+*/
+
+//! position des attributs dans un sommet au format VERTEX_FORMAT_PACKED, en octets. -1 si l'attribut n'est pas present.
+struct PackedVertexLayout
+{
+    int stride;
+    int position;
+    int normal;
+    int texcoord;
+    int color;
+};
+
+//! renvoie la position des attributs dans un sommet au format VERTEX_FORMAT_PACKED. la position est toujours presente.
+PackedVertexLayout packed_vertex_layout( const bool use_texcoord, const bool use_normal, const bool use_color );
+
+//! calcule les parametres de quantification des positions et des texcoords de l'objet : les englobants des attributs.
+VertexQuantization compute_vertex_quantization( const Mesh& mesh );
+
+//! compresse les attributs des sommets de l'objet, renvoie layout.stride * vertex_count() octets.
+std::vector<unsigned char> pack_vertices( const Mesh& mesh, const VertexQuantization& quantization, const PackedVertexLayout& layout );
+
+//! projection octaedrique d'une direction sur 2 x 8 bits, cf "A Survey of Efficient Representations for Independent Unit Vectors", Cigolle et al, 2014.
+void encode_octahedral( const Vector& n, int8_t code[2] );
+//! decode une direction, comme un shader, cf data/shaders/mesh.glsl.
+Vector decode_octahedral( const int8_t code[2] );
+
+//! erreurs de compression des attributs, cf vertex_format_error().
+struct VertexFormatError
+{
+    float position_max;         //!< distance max entre la position et la position compressee, dans le repere de l'objet.
+    float position_mean;        //!< distance moyenne.
+    float normal_max;           //!< angle max entre la normale et la normale compressee, en degres.
+    float normal_mean;          //!< angle moyen, en degres.
+    float texcoord_max;         //!< distance max entre les texcoords et les texcoords compressees.
+    float texcoord_mean;        //!< distance moyenne.
+    float color_max;            //!< erreur max sur une composante des couleurs (limitees a [0 1]).
+    std::size_t float_size;     //!< taille des attributs au format VERTEX_FORMAT_FLOAT, en octets.
+    std::size_t packed_size;    //!< taille des attributs au format VERTEX_FORMAT_PACKED, en octets.
+};
+
+//! compresse puis decompresse les attributs de l'objet, comme les shaders, et mesure les erreurs. les sommets sont traites en parallele.
+VertexFormatError vertex_format_error( const Mesh& mesh );
+
+///@}
+#endif
@@ -0,0 +1,114 @@
+
+#include <thread>
+#include <algorithm>
+
+#include "vertex_map.h"
+
+
+//! execute f(i) pour chaque partie, 1 thread par partie.
+template < typename F >
+static void for_each_shard( const int n, F f )
+{
+    std::vector<std::thread> threads;
+    for(int i= 1; i < n; i++)
+        threads.emplace_back(f, i);
+
+    f(0);
+    for(auto& thread : threads)
+        thread.join();
+}
+
+int weld_vertices( const std::vector<VertexKey>& vertices, std::vector<unsigned int>& indices, std::vector<int>& unique, const int threads )
+{
+    const int count= int(vertices.size());
+
+    int n= (threads > 0) ? threads : int(std::thread::hardware_concurrency());
+    n= std::max(1, std::min({ n, count / (64*1024) +1, 256 }));
+
+    // etape 1 : hachage des sommets, et affectation a une partie. les sommets identiques sont dans la meme partie.
+    std::vector<uint32_t> hashes(count);
+    std::vector<unsigned char> shards(count);
+    for_each_shard(n,
+        [&]( const int s )
+        {
+            int begin= int(int64_t(count) * s / n);
+            int end= int(int64_t(count) * (s +1) / n);
+            for(int i= begin; i < end; i++)
+            {
+                hashes[i]= vertex_hash(vertices[i]);
+                shards[i]= (uint64_t(hashes[i]) * uint64_t(n)) >> 32;     // bits de poids fort, les bits de poids faible sont utilises par la table
+            }
+        });
+
+    // etape 2 : chaque partie soude ses sommets, dans l'ordre. first[i] indique la premiere apparition du sommet i.
+    std::vector<int> first(count);
+    for_each_shard(n,
+        [&]( const int s )
+        {
+            VertexMap remap(count / n);
+            std::vector<int> occurrence;
+            occurrence.reserve(count / n);
+
+            for(int i= 0; i < count; i++)
+            {
+                if(shards[i] != s)
+                    continue;
+
+                auto found= remap.insert(vertices[i], hashes[i]);
+                if(found.second)
+                    occurrence.push_back(i);
+
+                first[i]= occurrence[found.first];
+            }
+        });
+
+    // etape 3 : numerote les sommets uniques dans l'ordre de leur premiere apparition, somme prefixe par blocs
+    std::vector<int> offsets(n +1, 0);
+    for_each_shard(n,
+        [&]( const int s )
+        {
+            int begin= int(int64_t(count) * s / n);
+            int end= int(int64_t(count) * (s +1) / n);
+            int k= 0;
+            for(int i= begin; i < end; i++)
+                if(first[i] == i)
+                    k++;
+            offsets[s +1]= k;
+        });
+
+    for(int s= 0; s < n; s++)
+        offsets[s +1]+= offsets[s];
+
+    // rank[i] : indice du sommet unique, uniquement pour les premieres apparitions
+    std::vector<int> rank(count);
+    unique.resize(offsets[n]);
+    for_each_shard(n,
+        [&]( const int s )
+        {
+            int begin= int(int64_t(count) * s / n);
+            int end= int(int64_t(count) * (s +1) / n);
+            int k= offsets[s];
+            for(int i= begin; i < end; i++)
+            {
+                if(first[i] == i)
+                {
+                    rank[i]= k;
+                    unique[k]= i;
+                    k++;
+                }
+            }
+        });
+
+    // etape 4 : construit l'index buffer
+    indices.resize(count);
+    for_each_shard(n,
+        [&]( const int s )
+        {
+            int begin= int(int64_t(count) * s / n);
+            int end= int(int64_t(count) * (s +1) / n);
+            for(int i= begin; i < end; i++)
+                indices[i]= rank[first[i]];
+        });
+
+    return offsets[n];
+}
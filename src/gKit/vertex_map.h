@@ -0,0 +1,154 @@
+
+#ifndef _VERTEX_MAP_H
+#define _VERTEX_MAP_H
+
+#include <cstdint>
+#include <vector>
+#include <utility>
+
+
+//! \addtogroup objet3D
+///@{
+
+//! \file
+//! soudure des sommets : construction d'un index buffer a partir des indices des attributs des sommets, cf read_indexed_mesh().
+
+//! representation de l'indexation complete d'un sommet.
+struct VertexKey
+{
+    int material;
+    int position;
+    int texcoord;
+    int normal;
+
+    VertexKey( ) : material(-1), position(-1), texcoord(-1), normal(-1) {}
+    VertexKey( const int m, const int p, const int t, const int n ) : material(m), position(p), texcoord(t), normal(n) {}
+
+    bool operator== ( const VertexKey& b ) const
+    {
+        return material == b.material && position == b.position && texcoord == b.texcoord && normal == b.normal;
+    }
+};
+
+//! hachage d'un sommet.
+inline uint32_t vertex_hash( const VertexKey& key )
+{
+    // melange les 4 indices, cf finalisation de murmur3 / splitmix64
+    uint64_t h= (uint64_t(uint32_t(key.position)) << 32 | uint32_t(key.texcoord)) * 0x9E3779B97F4A7C15ull;
+    h^= (uint64_t(uint32_t(key.normal)) << 32 | uint32_t(key.material)) + 0xBF58476D1CE4E5B9ull + (h << 6) + (h >> 2);
+    h^= h >> 31;
+    h*= 0x94D049BB133111EBull;
+    h^= h >> 29;
+    return uint32_t(h);
+}
+
+
+/*! table de hachage, adressage ouvert, sondage lineaire : sommet -> indice. remplace std::map<vertex, int> pour construire un index buffer.
+    les sommets sont numerotes dans l'ordre d'insertion, comme avec `remap.insert( std::make_pair(vertex, int(remap.size())) )`.
+
+    les sommets sont stockes dans un seul tableau, et la table ne contient que leurs indices : pas d'allocation par sommet.
+\code
+VertexMap remap;
+auto found= remap.insert( VertexKey(material, p, t, n) );
+if(found.second)
+    // nouveau sommet, copier ses attributs...
+mesh.index(found.first);
+\endcode
+*/
+class VertexMap
+{
+public:
+    //! constructeur, nombre de sommets prevus, optionnel.
+    VertexMap( const size_t count= 0 ) : m_keys(), m_slots() { reserve(count); }
+
+    //! prevoit la place pour count sommets.
+    void reserve( const size_t count )
+    {
+        m_keys.reserve(count);
+
+        size_t size= 64;
+        while(size < 2 * count)
+            size= size * 2;
+        if(size > m_slots.size())
+            rehash(size);
+    }
+
+    //! recherche / insere un sommet. renvoie l'indice du sommet et true s'il vient d'etre insere.
+    std::pair<int, bool> insert( const VertexKey& key ) { return insert(key, vertex_hash(key)); }
+
+    //! recherche / insere un sommet, dont le hachage est deja calcule, cf vertex_hash().
+    std::pair<int, bool> insert( const VertexKey& key, const uint32_t hash )
+    {
+        // facteur de remplissage < 1/2
+        if(2 * (m_keys.size() +1) > m_slots.size())
+            rehash(2 * m_slots.size());
+
+        size_t mask= m_slots.size() -1;
+        for(size_t i= hash & mask; ; i= (i +1) & mask)
+        {
+            Slot& slot= m_slots[i];
+            if(slot.id < 0)
+            {
+                // pas trouve, insere le sommet
+                slot.id= int(m_keys.size());
+                slot.hash= hash;
+                m_keys.push_back(key);
+                return std::make_pair(slot.id, true);
+            }
+
+            if(slot.hash == hash && m_keys[slot.id] == key)
+                return std::make_pair(slot.id, false);
+        }
+    }
+
+    //! renvoie le nombre de sommets.
+    size_t size( ) const { return m_keys.size(); }
+    //! renvoie le ieme sommet, dans l'ordre d'insertion.
+    const VertexKey& operator[] ( const int id ) const { return m_keys[id]; }
+
+protected:
+    struct Slot
+    {
+        int id;             // indice du sommet dans m_keys, ou -1
+        uint32_t hash;
+    };
+
+    void rehash( const size_t size )
+    {
+        std::vector<Slot> slots(size, Slot{ -1, 0 });
+
+        size_t mask= size -1;
+        for(const Slot& slot : m_slots)
+        {
+            if(slot.id < 0)
+                continue;
+
+            size_t i= slot.hash & mask;
+            while(slots[i].id >= 0)
+                i= (i +1) & mask;
+            slots[i]= slot;
+        }
+
+        std::swap(m_slots, slots);
+    }
+
+    std::vector<VertexKey> m_keys;      // sommets, dans l'ordre d'insertion
+    std::vector<Slot> m_slots;          // table, taille puissance de 2
+};
+
+
+/*! soudure parallele des sommets. construit le meme index buffer que l'insertion sequentielle des sommets dans un VertexMap :
+    les sommets uniques sont numerotes dans l'ordre de leur premiere apparition.
+
+    les sommets sont repartis entre les threads en fonction de leur hachage, chaque thread soude les sommets de sa partie avec son propre VertexMap.
+
+    \param vertices les sommets, 3 par triangle.
+    \param indices l'index buffer, 1 indice par sommet.
+    \param unique position dans vertices de la premiere apparition de chaque sommet unique, permet de copier les attributs des sommets.
+    \param threads nombre de threads, 0 : utilise tous les coeurs disponibles.
+    \return le nombre de sommets uniques.
+*/
+int weld_vertices( const std::vector<VertexKey>& vertices, std::vector<unsigned int>& indices, std::vector<int>& unique, const int threads= 0 );
+
+///@}
+#endif
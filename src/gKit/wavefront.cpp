@@ -4,10 +4,10 @@
 #include <ctype.h>
 #include <climits>
 
-#include <map>
 #include <algorithm>
 
 #include "files.h"
+#include "vertex_map.h"
 #include "wavefront.h"
 
 Mesh read_mesh( const char *filename )
@@ -170,29 +170,6 @@ Mesh read_mesh( const char *filename )
 }
 
 
-//! representation de l'indexation complete d'un sommet
-struct vertex
-{
-    int material;
-    int position;
-    int texcoord;
-    int normal;
-    
-    vertex( ) : material(-1), position(-1), texcoord(-1), normal(-1) {}
-    vertex( const int m, const int p, const int t, const int n ) : material(m), position(p), texcoord(t), normal(n) {}
-    
-    // comparaison lexicographique de 2 sommets / des indices de leurs attributs
-    bool operator< ( const vertex& b ) const
-    {
-        if(material != b.material) return material < b.material;
-        if(position != b.position) return position < b.position;
-        if(texcoord != b.texcoord) return texcoord < b.texcoord;
-        if(normal != b.normal) return normal < b.normal;
-        return false;
-    }
-};
-
-
 Mesh read_indexed_mesh( const char *filename )
 {
     FILE *in= fopen(filename, "rb");
@@ -215,7 +192,7 @@ Mesh read_indexed_mesh( const char *filename )
     std::vector<int> idt;
     std::vector<int> idn;
     
-    std::map<vertex, int> remap;
+    VertexMap remap;
     
     char tmp[1024];
     char line_buffer[1024];
@@ -311,7 +288,7 @@ Mesh read_indexed_mesh( const char *filename )
                     if(p < 0) break; // error
                     
                     // recherche / insere le sommet 
-                    auto found= remap.insert( std::make_pair(vertex(material_id, p, t, n), int(remap.size())) );
+                    auto found= remap.insert( VertexKey(material_id, p, t, n) );
                     if(found.second)
                     {
                         // pas trouve, copie les nouveaux attributs
@@ -321,7 +298,7 @@ Mesh read_indexed_mesh( const char *filename )
                     }
                     
                     // construit l'index buffer
-                    data.index(found.first->second);
+                    data.index(found.first);
                 }
             }
         }
@@ -1,12 +1,16 @@
 
 #include <cstdio>
+#include <cstring>
 #include <ctype.h>
 #include <climits>
 
-#include <map>
+#include <string>
+#include <thread>
+#include <chrono>
 #include <algorithm>
 
 #include "files.h"
+#include "vertex_map.h"
 #include "wavefront.h"
 #include "wavefront_fast.h"
 
@@ -303,29 +307,6 @@ Mesh read_mesh_fast( const char *filename )
 }
 
 
-//! representation de l'indexation complete d'un sommet
-struct vertex
-{
-    int material;
-    int position;
-    int texcoord;
-    int normal;
-    
-    vertex( ) : material(-1), position(-1), texcoord(-1), normal(-1) {}
-    vertex( const int m, const int p, const int t, const int n ) : material(m), position(p), texcoord(t), normal(n) {}
-    
-    // comparaison lexicographique de 2 sommets / des indices de leurs attributs
-    bool operator< ( const vertex& b ) const
-    {
-        if(material != b.material) return material < b.material;
-        if(position != b.position) return position < b.position;
-        if(texcoord != b.texcoord) return texcoord < b.texcoord;
-        if(normal != b.normal) return normal < b.normal;
-        return false;
-    }
-};
-
-
 Mesh read_indexed_mesh_fast( const char *filename )
 {
     FILE *in= fopen(filename, "rb");
@@ -348,7 +329,7 @@ Mesh read_indexed_mesh_fast( const char *filename )
     std::vector<int> idt;
     std::vector<int> idn;
     
-    std::map<vertex, int> remap;
+    VertexMap remap;
     
     char tmp[1024*64];
     char line_buffer[1024*64];
@@ -453,7 +434,7 @@ Mesh read_indexed_mesh_fast( const char *filename )
                     if(p < 0) break; // error
                     
                     // recherche / insere le sommet 
-                    auto found= remap.insert( std::make_pair(vertex(material_id, p, t, n), int(remap.size())) );
+                    auto found= remap.insert( VertexKey(material_id, p, t, n) );
                     if(found.second)
                     {
                         // pas trouve, copie les nouveaux attributs
@@ -463,7 +444,7 @@ Mesh read_indexed_mesh_fast( const char *filename )
                     }
                     
                     // construit l'index buffer
-                    data.index(found.first->second);
+                    data.index(found.first);
                 }
             }
         }
@@ -495,3 +476,500 @@ Mesh read_indexed_mesh_fast( const char *filename )
     
     return data;
 }
+
+
+// chargement parallele. le fichier est projete en memoire, decoupe en blocs de lignes completes, et chaque bloc est analyse par un thread.
+// les faces peuvent utiliser des indices negatifs, relatifs a la fin des tableaux d'attributs, ils ne sont resolus qu'une fois que 
+// tous les blocs sont analyses et que le nombre d'attributs de chaque bloc est connu.
+
+//! sommet d'une face / indices de ses attributs.
+struct obj_corner
+{
+    int p, t, n;                //!< indices des attributs, a partir de 0, ou -1 si l'attribut n'est pas defini.
+    unsigned char relative;     //!< bits 0, 1, 2 : p, t, n sont relatifs au debut du bloc, cf indices negatifs.
+};
+
+//! resultat de l'analyse d'un bloc de lignes.
+struct obj_chunk
+{
+    std::vector<vec3> positions;
+    std::vector<vec2> texcoords;
+    std::vector<vec3> normals;
+    
+    std::vector<obj_corner> corners;    //!< sommets des faces.
+    std::vector<int> faces;             //!< indice du premier sommet de chaque face dans corners.
+    
+    std::vector<std::pair<int, std::string>> usemtl;    //!< changements de matiere : indice de la face suivante, nom de la matiere.
+    std::vector<std::pair<int, int>> materials;         //!< changements de matiere : indice de la face suivante, indice de la matiere.
+    std::vector<std::string> mtllib;
+    
+    int material= -1;           //!< matiere utilisee au debut du bloc.
+    int triangles= 0;           //!< nombre de triangles apres triangulation des faces.
+    bool has_texcoords= false;
+    bool has_normals= false;
+};
+
+//! resultat de l'analyse de tous les blocs.
+struct obj_file
+{
+    std::vector<obj_chunk> chunks;
+    std::vector<vec3> positions;        //!< attributs de tous les blocs.
+    std::vector<vec2> texcoords;
+    std::vector<vec3> normals;
+    std::vector<int> first_triangle;    //!< indice du premier triangle de chaque bloc.
+    
+    int triangles= 0;
+    bool has_texcoords= false;
+    bool has_normals= false;
+};
+
+//! execute f(i) pour chaque bloc, 1 thread par bloc.
+template < typename F >
+static void for_each_chunk( const int n, F f )
+{
+    std::vector<std::thread> threads;
+    for(int i= 1; i < n; i++)
+        threads.emplace_back(f, i);
+    
+    f(0);
+    for(auto& thread : threads)
+        thread.join();
+}
+
+static float elapsed_ms( const std::chrono::high_resolution_clock::time_point& start, const std::chrono::high_resolution_clock::time_point& stop )
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count() / 1000.0f;
+}
+
+// indice d'un attribut, a partir de 0, ou relatif au debut du bloc pour les indices negatifs.
+static int obj_index( const int id, const size_t count, unsigned char& relative, const unsigned char bit )
+{
+    if(id > 0)
+        return id -1;
+    if(id == 0)
+        return -1;      // pas d'attribut
+    
+    relative|= bit;
+    return int(count) + id;
+}
+
+// renvoie la fin de la ligne, sans le retour a la ligne. equivalent de sscanf(line, "%[^\r\n]"), mais sscanf() parcourt tout le fichier projete en memoire...
+static std::string parse_name( const char *line )
+{
+    line= skip_whitespace(line);
+    
+    const char *end= line;
+    while(*end && *end != '\r' && *end != '\n')
+        end++;
+    
+    return std::string(line, end);
+}
+
+// analyse les lignes completes d'un bloc [begin, end).
+static void parse_chunk( const char *begin, const char *end, obj_chunk& chunk )
+{
+    std::string last_line;
+    for(const char *next= begin; next < end; )
+    {
+        const char *line= next;
+        const char *eol= (const char *) memchr(next, '\n', end - next);
+        if(eol == nullptr)
+        {
+            // derniere ligne du fichier, sans retour a la ligne. copie la ligne pour la terminer par un 0...
+            last_line.assign(next, end);
+            line= last_line.c_str();
+            eol= end;
+        }
+        next= eol +1;
+        
+        // saute les espaces en debut de ligne
+        line= skip_whitespace(line);
+        if(line[0] == 'v')
+        {
+            float x, y, z;
+            if(is_whitespace(line[1]))  // position x y z
+            {
+                line+= 2;
+                line= parse_float(line, &x);
+                line= parse_float(line, &y);
+                line= parse_float(line, &z);
+                
+                chunk.positions.push_back( vec3(x, y, z) );
+            }
+            else if(line[1] == 'n')     // normal x y z
+            {
+                line+= 3;
+                line= parse_float(line, &x);
+                line= parse_float(line, &y);
+                line= parse_float(line, &z);
+                
+                chunk.normals.push_back( vec3(x, y, z) );
+            }
+            else if(line[1] == 't')     // texcoord x y
+            {
+                line+= 3;
+                line= parse_float(line, &x);
+                line= parse_float(line, &y);
+                
+                chunk.texcoords.push_back( vec2(x, y) );
+            }
+        }
+        
+        else if(line[0] == 'f' && is_whitespace(line[1]))       // face a b c ..., les sommets sont numerotes a partir de 1 ou de la fin du tableau (< 0)
+        {
+            int first= int(chunk.corners.size());
+            
+            line+= 2;
+            for(;;)
+            {
+                line= skip_whitespace(line);
+                if(!is_digit(*line) && *line != '-')
+                    break;      // fin de la ligne
+                
+                int idp= 0, idt= 0, idn= 0;     // 0: invalid index
+                line= parse_int(line, &idp);
+                if(*line == '/')
+                {
+                    line++;
+                    if(*line != '/')
+                        line= parse_int(line, &idt);
+                    
+                    if(*line == '/')
+                    {
+                        line++;
+                        line= parse_int(line, &idn);
+                    }
+                }
+                
+                obj_corner corner;
+                corner.relative= 0;
+                corner.p= obj_index(idp, chunk.positions.size(), corner.relative, 1);
+                corner.t= obj_index(idt, chunk.texcoords.size(), corner.relative, 2);
+                corner.n= obj_index(idn, chunk.normals.size(), corner.relative, 4);
+                
+                chunk.has_texcoords= chunk.has_texcoords || (idt != 0);
+                chunk.has_normals= chunk.has_normals || (idn != 0);
+                chunk.corners.push_back(corner);
+            }
+            
+            int n= int(chunk.corners.size()) - first;
+            if(n < 3)
+            {
+                // pas de triangle...
+                chunk.corners.resize(first);
+                continue;
+            }
+            
+            chunk.faces.push_back(first);
+            chunk.triangles+= n - 2;
+        }
+        
+        else if(line[0] == 'm')
+        {
+            if(strncmp(line, "mtllib", 6) == 0 && is_whitespace(line[6]))
+                chunk.mtllib.push_back( parse_name(line + 6) );
+        }
+        
+        else if(line[0] == 'u')
+        {
+            if(strncmp(line, "usemtl", 6) == 0 && is_whitespace(line[6]))
+                chunk.usemtl.push_back( std::make_pair(int(chunk.faces.size()), parse_name(line + 6)) );
+        }
+    }
+}
+
+// analyse un fichier en parallele, resoud les indices des sommets et les matieres.
+static bool read_obj_parallel( const char *filename, const int threads, Mesh& data, obj_file& obj, float times[3] )
+{
+    auto start= std::chrono::high_resolution_clock::now();
+    
+    MappedFile file= map_file(filename);
+    if(file.data == nullptr)
+        return false;
+    
+    auto mapped= std::chrono::high_resolution_clock::now();
+    
+    // decoupe le fichier en blocs de lignes completes, au moins 64Ko par bloc
+    int n= (threads > 0) ? threads : int(std::thread::hardware_concurrency());
+    n= std::max(1, std::min(n, int(file.size / (64*1024))));
+    
+    std::vector<const char *> bounds(n +1);
+    bounds[0]= file.data;
+    bounds[n]= file.data + file.size;
+    for(int i= 1; i < n; i++)
+    {
+        const char *split= std::max(bounds[i-1], file.data + file.size / n * i);
+        const char *eol= (const char *) memchr(split, '\n', bounds[n] - split);
+        bounds[i]= eol ? eol +1 : bounds[n];
+    }
+    
+    obj.chunks.resize(n);
+    for_each_chunk(n, [&]( const int i ) { parse_chunk(bounds[i], bounds[i+1], obj.chunks[i]); });
+    
+    auto parsed= std::chrono::high_resolution_clock::now();
+    unmap_file(file);
+    
+    // concatene les attributs des blocs
+    std::vector<int> first_position(n), first_texcoord(n), first_normal(n);
+    obj.first_triangle.resize(n);
+    
+    size_t positions= 0, texcoords= 0, normals= 0;
+    obj.triangles= 0;
+    for(int i= 0; i < n; i++)
+    {
+        const obj_chunk& chunk= obj.chunks[i];
+        first_position[i]= int(positions);
+        first_texcoord[i]= int(texcoords);
+        first_normal[i]= int(normals);
+        obj.first_triangle[i]= obj.triangles;
+        
+        positions+= chunk.positions.size();
+        texcoords+= chunk.texcoords.size();
+        normals+= chunk.normals.size();
+        obj.triangles+= chunk.triangles;
+        obj.has_texcoords= obj.has_texcoords || chunk.has_texcoords;
+        obj.has_normals= obj.has_normals || chunk.has_normals;
+    }
+    
+    obj.positions.resize(positions);
+    obj.texcoords.resize(texcoords);
+    obj.normals.resize(normals);
+    for_each_chunk(n, 
+        [&]( const int i )
+        {
+            obj_chunk& chunk= obj.chunks[i];
+            std::copy(chunk.positions.begin(), chunk.positions.end(), obj.positions.begin() + first_position[i]);
+            std::copy(chunk.texcoords.begin(), chunk.texcoords.end(), obj.texcoords.begin() + first_texcoord[i]);
+            std::copy(chunk.normals.begin(), chunk.normals.end(), obj.normals.begin() + first_normal[i]);
+            chunk.positions= std::vector<vec3>();
+            chunk.texcoords= std::vector<vec2>();
+            chunk.normals= std::vector<vec3>();
+            
+            // resoud les indices relatifs
+            for(obj_corner& corner : chunk.corners)
+            {
+                if(corner.relative & 1) corner.p+= first_position[i];
+                if(corner.relative & 2) corner.t+= first_texcoord[i];
+                if(corner.relative & 4) corner.n+= first_normal[i];
+            }
+        });
+    
+    // charge les matieres et resoud les noms des matieres, dans l'ordre du fichier
+    int material_id= -1;
+    for(int i= 0; i < n; i++)
+    {
+        obj_chunk& chunk= obj.chunks[i];
+        for(const std::string& library : chunk.mtllib)
+        {
+            std::string materials_filename;
+            if(library[0] != '/' && library[1] != ':')   // windows c:\ pour les chemins complets...
+                materials_filename= normalize_filename(pathname(filename) + library);
+            else
+                materials_filename= library;
+            
+            // charge les matieres et les enregistre dans le mesh
+            data.materials(read_materials(materials_filename.c_str()));
+        }
+        
+        // verifie qu'une matiere est definie pour les faces, sinon affecte une matiere par defaut
+        int first_event= chunk.usemtl.empty() ? int(chunk.faces.size()) : chunk.usemtl[0].first;
+        if(material_id == -1 && first_event > 0)
+            material_id= data.materials().default_material_index();
+        chunk.material= material_id;
+        
+        for(unsigned k= 0; k < chunk.usemtl.size(); k++)
+        {
+            int next_event= (k +1 < chunk.usemtl.size()) ? chunk.usemtl[k+1].first : int(chunk.faces.size());
+            material_id= data.materials().find(chunk.usemtl[k].second.c_str());
+            if(material_id == -1 && next_event > chunk.usemtl[k].first)
+                material_id= data.materials().default_material_index();
+            
+            chunk.materials.push_back( std::make_pair(chunk.usemtl[k].first, material_id) );
+        }
+    }
+    
+    auto merged= std::chrono::high_resolution_clock::now();
+    times[0]= elapsed_ms(start, mapped);
+    times[1]= elapsed_ms(mapped, parsed);
+    times[2]= elapsed_ms(parsed, merged);
+    return true;
+}
+
+// parcourt les triangles d'un bloc, f(triangle, a, b, c, material) avec triangle, l'indice du triangle dans le bloc, a, b, c ses sommets.
+template < typename F >
+static void for_each_triangle( const obj_chunk& chunk, F f )
+{
+    int triangle= 0;
+    int material= chunk.material;
+    unsigned event= 0;
+    for(unsigned face= 0; face < chunk.faces.size(); face++)
+    {
+        while(event < chunk.materials.size() && chunk.materials[event].first <= int(face))
+            material= chunk.materials[event++].second;
+        
+        // triangule la face (supposee convexe)
+        int first= chunk.faces[face];
+        int last= (face +1 < chunk.faces.size()) ? chunk.faces[face +1] : int(chunk.corners.size());
+        for(int v= first +2; v < last; v++)
+            f(triangle++, chunk.corners[first], chunk.corners[v -1], chunk.corners[v], material);
+    }
+}
+
+
+Mesh read_mesh_fast_parallel( const char *filename, const int threads )
+{
+    auto start= std::chrono::high_resolution_clock::now();
+    printf("loading mesh '%s'...\n", filename);
+    
+    Mesh data(GL_TRIANGLES);
+    obj_file obj;
+    float times[3];
+    if(!read_obj_parallel(filename, threads, data, obj, times))
+    {
+        printf("[error] loading mesh '%s'...\n", filename);
+        return Mesh::error();
+    }
+    
+    auto merged= std::chrono::high_resolution_clock::now();
+    
+    // construit les triangles non indexes, chaque bloc ecrit ses triangles directement a leur place
+    std::vector<vec3> positions(3 * size_t(obj.triangles));
+    std::vector<vec2> texcoords(obj.has_texcoords ? 3 * size_t(obj.triangles) : 0);
+    std::vector<vec3> normals(obj.has_normals ? 3 * size_t(obj.triangles) : 0);
+    std::vector<unsigned int> materials(obj.triangles);
+    
+    std::vector<int> errors(obj.chunks.size(), 0);
+    for_each_chunk(int(obj.chunks.size()), 
+        [&]( const int i )
+        {
+            size_t first= obj.first_triangle[i];
+            for_each_triangle(obj.chunks[i], 
+                [&]( const int triangle, const obj_corner& a, const obj_corner& b, const obj_corner& c, const int material )
+                {
+                    size_t id= first + triangle;
+                    const obj_corner *corners[3]= { &a, &b, &c };
+                    for(int k= 0; k < 3; k++)
+                    {
+                        const obj_corner& corner= *corners[k];
+                        if(corner.p >= 0 && corner.p < int(obj.positions.size()))
+                            positions[3*id +k]= obj.positions[corner.p];
+                        else
+                            errors[i]++;
+                        
+                        if(obj.has_texcoords && corner.t >= 0 && corner.t < int(obj.texcoords.size()))
+                            texcoords[3*id +k]= obj.texcoords[corner.t];
+                        if(obj.has_normals && corner.n >= 0 && corner.n < int(obj.normals.size()))
+                            normals[3*id +k]= obj.normals[corner.n];
+                    }
+                    
+                    materials[id]= material;
+                });
+        });
+    
+    data.assign(std::move(positions), std::move(texcoords), std::move(normals), {}, {}, std::move(materials));
+    
+    auto stop= std::chrono::high_resolution_clock::now();
+    
+    int error_count= 0;
+    for(int e : errors)
+        error_count+= e;
+    if(error_count)
+        printf("[error] loading mesh '%s': %d invalid vertices...\n", filename, error_count);
+    
+    printf("mesh '%s': %d positions %s %s\n", filename, int(data.positions().size()), data.has_texcoord() ? "texcoord" : "", data.has_normal() ? "normal" : "");
+    printf("  %d threads: map %.1fms, parse %.1fms, merge %.1fms, build %.1fms, total %.1fms\n", 
+        int(obj.chunks.size()), times[0], times[1], times[2], elapsed_ms(merged, stop), elapsed_ms(start, stop));
+    
+    return data;
+}
+
+
+Mesh read_indexed_mesh_fast_parallel( const char *filename, const int threads )
+{
+    auto start= std::chrono::high_resolution_clock::now();
+    printf("loading indexed mesh '%s'...\n", filename);
+    
+    Mesh data(GL_TRIANGLES);
+    obj_file obj;
+    float times[3];
+    if(!read_obj_parallel(filename, threads, data, obj, times))
+    {
+        printf("[error] loading indexed mesh '%s'...\n", filename);
+        return Mesh::error();
+    }
+    
+    auto merged= std::chrono::high_resolution_clock::now();
+    
+    // etape 1 : construit les sommets, 3 par triangle, dans l'ordre du fichier
+    std::vector<VertexKey> vertices(3 * size_t(obj.triangles));
+    std::vector<unsigned int> materials(obj.triangles);
+    
+    std::vector<int> errors(obj.chunks.size(), 0);
+    for_each_chunk(int(obj.chunks.size()), 
+        [&]( const int i )
+        {
+            size_t first= obj.first_triangle[i];
+            for_each_triangle(obj.chunks[i], 
+                [&]( const int triangle, const obj_corner& a, const obj_corner& b, const obj_corner& c, const int material )
+                {
+                    size_t id= first + triangle;
+                    const obj_corner *corners[3]= { &a, &b, &c };
+                    for(int k= 0; k < 3; k++)
+                    {
+                        const obj_corner& corner= *corners[k];
+                        int p= corner.p;
+                        int t= (corner.t >= 0 && corner.t < int(obj.texcoords.size())) ? corner.t : -1;
+                        int n= (corner.n >= 0 && corner.n < int(obj.normals.size())) ? corner.n : -1;
+                        if(p < 0 || p >= int(obj.positions.size()))
+                        {
+                            errors[i]++;
+                            p= 0;
+                        }
+                        
+                        vertices[3*id +k]= VertexKey(material, p, t, n);
+                    }
+                    
+                    materials[id]= material;
+                });
+        });
+    
+    // etape 2 : soude les sommets, meme numerotation que l'insertion sequentielle dans un VertexMap
+    std::vector<unsigned int> indices;
+    std::vector<int> unique;
+    int count= weld_vertices(vertices, indices, unique, int(obj.chunks.size()));
+    
+    // etape 3 : copie les attributs des sommets uniques
+    std::vector<vec3> positions(count);
+    std::vector<vec2> texcoords(obj.has_texcoords ? count : 0);
+    std::vector<vec3> normals(obj.has_normals ? count : 0);
+    for_each_chunk(int(obj.chunks.size()), 
+        [&]( const int i )
+        {
+            int begin= int(int64_t(count) * i / int(obj.chunks.size()));
+            int end= int(int64_t(count) * (i +1) / int(obj.chunks.size()));
+            for(int k= begin; k < end; k++)
+            {
+                const VertexKey& vertex= vertices[unique[k]];
+                if(!obj.positions.empty()) positions[k]= obj.positions[vertex.position];
+                if(obj.has_texcoords && vertex.texcoord != -1) texcoords[k]= obj.texcoords[vertex.texcoord];
+                if(obj.has_normals && vertex.normal != -1) normals[k]= obj.normals[vertex.normal];
+            }
+        });
+    
+    data.assign(std::move(positions), std::move(texcoords), std::move(normals), {}, std::move(indices), std::move(materials));
+    
+    auto stop= std::chrono::high_resolution_clock::now();
+    
+    int error_count= 0;
+    for(int e : errors)
+        error_count+= e;
+    if(error_count)
+        printf("[error] loading indexed mesh '%s': %d invalid vertices...\n", filename, error_count);
+    
+    printf("  %d indices, %d positions %d texcoords %d normals\n", 
+        int(data.indices().size()), int(data.positions().size()), int(data.texcoords().size()), int(data.normals().size()));
+    printf("  %d threads: map %.1fms, parse %.1fms, merge %.1fms, index %.1fms, total %.1fms\n", 
+        int(obj.chunks.size()), times[0], times[1], times[2], elapsed_ms(merged, stop), elapsed_ms(start, stop));
+    
+    return data;
+}
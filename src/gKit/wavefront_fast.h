@@ -17,5 +17,14 @@ Mesh read_mesh_fast( const char *filename );
 //! charge un fichier wavefront .obj et renvoie un mesh compose de triangles indexes. utiliser glDrawElements pour l'afficher. a detruire avec Mesh::release( ).
 Mesh read_indexed_mesh_fast( const char *filename );
 
+/*! charge un fichier wavefront .obj en parallele et renvoie un mesh compose de triangles non indexes, meme resultat que read_mesh_fast(). 
+    le fichier est projete en memoire et decoupe en blocs de lignes, chaque bloc est analyse par un thread, puis les resultats sont assembles dans le mesh.
+    threads= 0 : utilise tous les coeurs disponibles. affiche le temps de chaque etape du chargement.
+*/
+Mesh read_mesh_fast_parallel( const char *filename, const int threads= 0 );
+
+//! charge un fichier wavefront .obj en parallele et renvoie un mesh compose de triangles indexes, meme resultat que read_indexed_mesh_fast(). cf read_mesh_fast_parallel().
+Mesh read_indexed_mesh_fast_parallel( const char *filename, const int threads= 0 );
+
 ///@}
 #endif
@@ -13,6 +13,7 @@
 #include "draw.h"
 
 #include "image.h"
+#include "image_tiles.h"
 #include "image_io.h"
 #include "image_hdr.h"
 
@@ -295,35 +296,35 @@ struct IS : public App
                     point= hit.p;
                     normal= hit.n;
                     
-                    // frame
-                #pragma omp parallel for schedule(dynamic, 16)
-                    for(int y= 0; y < m_hitp.height(); y++)
-                    for(int x= 0; x < m_hitp.width(); x++)
-                    {
-                        // clear
-                        m_hitp(x, y)= Black();
-                        m_hitn(x, y)= Black();
-                        m_hitv(x, y)= Black();
+                    // frame, par tuiles de 16x16 pixels, cf TileRenderer
+                    TileRenderer renderer(m_hitp.width(), m_hitp.height(), 16);
+                    renderer.for_each_pixel(
+                        [&]( const int x, const int y )
+                        {
+                            // clear
+                            m_hitp(x, y)= Black();
+                            m_hitn(x, y)= Black();
+                            m_hitv(x, y)= Black();
                         
-                        Point o= d0 + x*dx0 + y*dy0;
-                        Point e= d1 + x*dx1 + y*dy1;
+                            Point o= d0 + x*dx0 + y*dy0;
+                            Point e= d1 + x*dx1 + y*dy1;
                         
-                        Ray ray(o, e);
-                        Hit hit;
-                        if(intersect(ray, hit))
-                        {
-                            m_hitp(x, y)= Color(hit.p.x, hit.p.y, hit.p.z);
-                            m_hitn(x, y)= Color(hit.n.x, hit.n.y, hit.n.z);
+                            Ray ray(o, e);
+                            Hit hit;
+                            if(intersect(ray, hit))
+                            {
+                                m_hitp(x, y)= Color(hit.p.x, hit.p.y, hit.p.z);
+                                m_hitn(x, y)= Color(hit.n.x, hit.n.y, hit.n.z);
                             
-                            Ray shadow(hit.p + hit.n * 0.001f, point + normal * 0.001f);
-                            Hit shadow_hit;
-                            int v= 1;
-                            if(intersect(shadow, shadow_hit))
-                                v= 0;
+                                Ray shadow(hit.p + hit.n * 0.001f, point + normal * 0.001f);
+                                Hit shadow_hit;
+                                int v= 1;
+                                if(intersect(shadow, shadow_hit))
+                                    v= 0;
                             
-                            m_hitv(x, y)= Color(v, v, v);
-                        }
-                    }
+                                m_hitv(x, y)= Color(v, v, v);
+                            }
+                        });
                     
                     // transferre les donnees
                     glActiveTexture(GL_TEXTURE0);
@@ -0,0 +1,183 @@
+
+//! \file bench_clusters.cpp decoupe les groupes de triangles d'un objet en clusters (cf TPs/from_scratch/mesh_clusters.h) et compare le nombre de triangles dessines apres le frustum culling des groupes et des clusters, et apres le test des cones de normales.
+// utilisation : bench_clusters [scene.obj] [views], par defaut data/occlusion_culling_demo.obj, 64 points de vue.
+// ne necessite pas de contexte openGL.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cfloat>
+#include <random>
+#include <chrono>
+#include <vector>
+
+#include "vec.h"
+#include "mat.h"
+#include "mesh.h"
+#include "wavefront_fast.h"
+#include "mesh_cache.h"
+
+#include "TPs/from_scratch/frustum_culler.h"
+#include "TPs/from_scratch/mesh_clusters.h"
+
+
+static float elapsed_ms( const std::chrono::high_resolution_clock::time_point& start )
+{
+    auto stop= std::chrono::high_resolution_clock::now();
+    return float(std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count()) / 1000;
+}
+
+//! renvoie true si le triangle est vu de face depuis la camera.
+static bool front_facing( const TriangleData& triangle, const Point& camera )
+{
+    Vector normal= cross(Point(triangle.b) - Point(triangle.a), Point(triangle.c) - Point(triangle.a));
+    return dot(normal, camera - Point(triangle.a)) > 0;
+}
+
+int main( int argc, char **argv )
+{
+    const char *filename= "data/occlusion_culling_demo.obj";
+    int views= 64;
+    if(argc > 1) filename= argv[1];
+    if(argc > 2) views= atoi(argv[2]);
+
+    Mesh mesh;
+    std::vector<TriangleGroup> groups;
+    if(!read_mesh_cache(filename, mesh, groups))
+    {
+        mesh= read_mesh_fast_parallel(filename);
+        groups= mesh.groups();
+    }
+    if(mesh.positions().size() == 0)
+        return 1;
+
+    auto start= std::chrono::high_resolution_clock::now();
+    std::vector<MeshCluster> clusters= ClusterBuilder::build(mesh, groups);
+    float build_time= elapsed_ms(start);
+
+    int triangles= mesh.triangle_count();
+    int cones= 0;
+    for(const MeshCluster& cluster : clusters)
+        if(cluster.cone_cutoff < 1)
+            cones++;
+
+    printf("%s: %d triangles, %d groups, %d clusters (%.1f triangles per cluster, %d with a normal cone), build %.1fms\n", filename,
+        triangles, int(groups.size()), int(clusters.size()), float(triangles) / float(clusters.size()), cones, build_time);
+
+    // verifie que les clusters couvrent les triangles de leur groupe et que les triangles sont dans leur englobant
+    int errors= 0;
+    std::vector<int> group_triangles(groups.size(), 0);
+    for(const MeshCluster& cluster : clusters)
+    {
+        const TriangleGroup& group= groups[cluster.group];
+        if(cluster.first < group.first || cluster.first + cluster.n > group.first + group.n || cluster.n > 3 * ClusterBuilder::MAX_TRIANGLES)
+            errors++;
+        group_triangles[cluster.group]+= cluster.n;
+
+        for(int t= cluster.first / 3; t < (cluster.first + cluster.n) / 3; t++)
+        {
+            TriangleData triangle= mesh.triangle(t);
+            for(const vec3& p : { triangle.a, triangle.b, triangle.c })
+                if(p.x < cluster.min.x || p.y < cluster.min.y || p.z < cluster.min.z
+                || p.x > cluster.max.x || p.y > cluster.max.y || p.z > cluster.max.z)
+                    errors++;
+        }
+    }
+    for(unsigned g= 0; g < groups.size(); g++)
+        if(group_triangles[g] != groups[g].n)
+            errors++;
+
+    FrustumCuller group_culler;
+    group_culler.resize(groups.size());
+    Point scene_min(FLT_MAX, FLT_MAX, FLT_MAX);
+    Point scene_max(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    {
+        std::vector<vec3> gmin(groups.size(), vec3(FLT_MAX, FLT_MAX, FLT_MAX));
+        std::vector<vec3> gmax(groups.size(), vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX));
+        for(const MeshCluster& cluster : clusters)
+        {
+            gmin[cluster.group]= min(gmin[cluster.group], cluster.min);
+            gmax[cluster.group]= max(gmax[cluster.group], cluster.max);
+        }
+
+        for(unsigned g= 0; g < groups.size(); g++)
+        {
+            group_culler.set_object(g, gmin[g], gmax[g], groups[g].first, groups[g].n);
+            scene_min= min(scene_min, Point(gmin[g]));
+            scene_max= max(scene_max, Point(gmax[g]));
+        }
+    }
+
+    FrustumCuller cluster_culler;
+    cluster_culler.resize(clusters.size());
+    for(unsigned c= 0; c < clusters.size(); c++)
+        cluster_culler.set_object(c, clusters[c].min, clusters[c].max, clusters[c].first, clusters[c].n);
+
+    // points de vue aleatoires a l'interieur de la scene
+    Vector extent= scene_max - scene_min;
+    float diagonal= length(extent);
+    std::default_random_engine rng(1);
+    std::uniform_real_distribution<float> u(0.1f, 0.9f);
+    Transform projection= Perspective(45, 16.f / 9.f, diagonal / 1000, diagonal * 2);
+
+    long long group_triangles_drawn= 0;
+    long long cluster_triangles_drawn= 0;
+    long long cone_triangles_drawn= 0;
+    long long front_triangles= 0;
+    int backfacing_errors= 0;
+    float group_time= 0;
+    float cluster_time= 0;
+    float cone_time= 0;
+    for(int v= 0; v < views; v++)
+    {
+        Point from= scene_min + Vector(u(rng) * extent.x, u(rng) * extent.y, u(rng) * extent.z);
+        Point to= scene_min + Vector(u(rng) * extent.x, u(rng) * extent.y, u(rng) * extent.z);
+        Transform mvp= projection * Lookat(from, to, Vector(0, 1, 0));
+
+        start= std::chrono::high_resolution_clock::now();
+        int n= group_culler.cull(mvp);
+        group_time+= elapsed_ms(start);
+        for(int i= 0; i < n; i++)
+            group_triangles_drawn+= group_culler.draw_commands()[i].index_count / 3;
+
+        start= std::chrono::high_resolution_clock::now();
+        n= cluster_culler.cull(mvp);
+        cluster_time+= elapsed_ms(start);
+
+        start= std::chrono::high_resolution_clock::now();
+        std::vector<int> front_clusters;
+        for(int i= 0; i < n; i++)
+            if(!ClusterBuilder::is_backfacing(clusters[cluster_culler.visible_ids()[i]], from))
+                front_clusters.push_back(cluster_culler.visible_ids()[i]);
+        cone_time+= elapsed_ms(start);
+
+        std::vector<unsigned char> front(clusters.size(), 0);
+        for(int id : front_clusters)
+        {
+            front[id]= 1;
+            cone_triangles_drawn+= clusters[id].n / 3;
+        }
+
+        // les clusters rejetes par leur cone ne doivent contenir que des triangles vus de dos
+        for(int i= 0; i < n; i++)
+        {
+            int id= cluster_culler.visible_ids()[i];
+            cluster_triangles_drawn+= clusters[id].n / 3;
+
+            for(int t= clusters[id].first / 3; t < (clusters[id].first + clusters[id].n) / 3; t++)
+            {
+                bool visible= front_facing(mesh.triangle(t), from);
+                front_triangles+= visible;
+                if(visible && !front[id])
+                    backfacing_errors++;
+            }
+        }
+    }
+
+    printf("%d errors, %d front facing triangles in back facing clusters\n", errors, backfacing_errors);
+    printf("  triangles drawn per view, frustum culling of the groups    %10.0f (%5.1f%%), %.3fms\n", double(group_triangles_drawn) / views, 100.0 * double(group_triangles_drawn) / views / triangles, group_time / views);
+    printf("  triangles drawn per view, frustum culling of the clusters  %10.0f (%5.1f%%), %.3fms\n", double(cluster_triangles_drawn) / views, 100.0 * double(cluster_triangles_drawn) / views / triangles, cluster_time / views);
+    printf("  triangles drawn per view, + normal cones                   %10.0f (%5.1f%%), %.3fms\n", double(cone_triangles_drawn) / views, 100.0 * double(cone_triangles_drawn) / views / triangles, cone_time / views);
+    printf("  front facing triangles in the frustum                      %10.0f (%5.1f%%)\n", double(front_triangles) / views, 100.0 * double(front_triangles) / views / triangles);
+
+    return 0;
+}
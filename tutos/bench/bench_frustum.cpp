@@ -0,0 +1,198 @@
+
+//! \file bench_frustum.cpp mesure le frustum culling cpu de TP2 : test scalaire des 8 sommets des englobants transformes, FrustumCuller et CullingBVH, cf TPs/from_scratch/frustum_culler.h et culling_bvh.h.
+// utilisation : bench_frustum [frames], par defaut 100 images. mesure 10k, 100k et 1M objets.
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <chrono>
+#include <vector>
+
+#include "vec.h"
+#include "mat.h"
+
+#include "TPs/from_scratch/culling_bvh.h"
+#include "TPs/from_scratch/frustum_culler.h"
+
+
+static float elapsed_ms( const std::chrono::high_resolution_clock::time_point& start )
+{
+    auto stop= std::chrono::high_resolution_clock::now();
+    return float(std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count()) / 1000;
+}
+
+//! test de l'ancienne version de TP2::cpu_mdi_selective_frustum_culling(), renvoie true si l'englobant est visible.
+static bool visible( const Point& pmin, const Point& pmax, const Transform& mvp )
+{
+    vec4 points[8];
+    for(unsigned i= 0; i < 8; i++)
+        points[i]= mvp(vec4(i & 1 ? pmax.x : pmin.x, i & 2 ? pmax.y : pmin.y, i & 4 ? pmax.z : pmin.z, 1));
+
+    for(int plane= 0; plane < 6; plane++)
+    {
+        bool outside= true;
+        for(int i= 0; i < 8 && outside; i++)
+        {
+            float c= (plane / 2 == 0) ? points[i].x : (plane / 2 == 1) ? points[i].y : points[i].z;
+            if(plane & 1)
+                outside= c < -points[i].w;
+            else
+                outside= c > points[i].w;
+        }
+
+        if(outside)
+            return false;
+    }
+
+    return true;
+}
+
+//! meme test en double, pour verifier le resultat : pres du plan far, z et w sont presque egaux et le test en float n'est pas exact.
+static bool visible_exact( const Point& pmin, const Point& pmax, const Transform& mvp )
+{
+    for(int plane= 0; plane < 6; plane++)
+    {
+        bool outside= true;
+        for(unsigned i= 0; i < 8 && outside; i++)
+        {
+            double p[4]= { i & 1 ? pmax.x : pmin.x, i & 2 ? pmax.y : pmin.y, i & 4 ? pmax.z : pmin.z, 1 };
+            double c= 0;
+            double w= 0;
+            for(int k= 0; k < 4; k++)
+            {
+                c+= double(mvp.m[plane / 2][k]) * p[k];
+                w+= double(mvp.m[3][k]) * p[k];
+            }
+
+            outside= (plane & 1) ? c < -w : c > w;
+        }
+
+        if(outside)
+            return false;
+    }
+
+    return true;
+}
+
+int main( int argc, char **argv )
+{
+    int frames= 100;
+    if(argc > 1) frames= atoi(argv[1]);
+
+    for(int count : { 10000, 100000, 1000000 })
+    {
+        // objets repartis dans un cube, la camera tourne au centre
+        float extent= 100;
+        std::default_random_engine rng(count);
+        std::uniform_real_distribution<float> u(-extent, extent);
+        std::uniform_real_distribution<float> s(0.1f, 2);
+
+        std::vector<Point> pmin(count);
+        std::vector<Point> pmax(count);
+        FrustumCuller culler;
+        culler.resize(count);
+        for(int i= 0; i < count; i++)
+        {
+            Point p(u(rng), u(rng), u(rng));
+            Vector size(s(rng), s(rng), s(rng));
+            pmin[i]= p - size;
+            pmax[i]= p + size;
+            culler.set_object(i, vec3(pmin[i]), vec3(pmax[i]), i * 3, 3);
+        }
+
+        auto start= std::chrono::high_resolution_clock::now();
+        CullingBVH bvh;
+        bvh.build(std::vector<vec3>(pmin.begin(), pmin.end()), std::vector<vec3>(pmax.begin(), pmax.end()));
+        float bvh_build_time= elapsed_ms(start);
+
+        // la moitie des objets, pour le test d'une liste d'objets
+        std::vector<int> ids;
+        for(int i= 0; i < count; i+= 2)
+            ids.push_back(i);
+
+        Transform projection= Perspective(60, 16.f / 9.f, 0.1f, extent);
+
+        float reference_time= 0;
+        float culler_time= 0;
+        float culler_ids_time= 0;
+        float bvh_time= 0;
+        int bvh_nodes_visited= 0;
+        int bvh_subtrees_accepted= 0;
+        int bvh_objects_tested= 0;
+        std::vector<int> bvh_ids;
+        int visible_count= 0;
+        int false_culls= 0;
+        int extra= 0;
+        std::vector<unsigned char> flags(count);
+        for(int f= 0; f < frames; f++)
+        {
+            Transform mvp= projection * RotationY(360.f * float(f) / float(frames)) * RotationX(20);
+
+            auto start= std::chrono::high_resolution_clock::now();
+            std::vector<int> reference;
+            for(int i= 0; i < count; i++)
+                if(visible(pmin[i], pmax[i], mvp))
+                    reference.push_back(i);
+            reference_time+= elapsed_ms(start);
+
+            start= std::chrono::high_resolution_clock::now();
+            int n= culler.cull(mvp);
+            culler_time+= elapsed_ms(start);
+
+            start= std::chrono::high_resolution_clock::now();
+            int m= culler.cull(mvp, ids.data(), int(ids.size()));
+            culler_ids_time+= elapsed_ms(start);
+
+            start= std::chrono::high_resolution_clock::now();
+            int b= bvh.cull(mvp, bvh_ids);
+            bvh_time+= elapsed_ms(start);
+            bvh_nodes_visited+= bvh.stats().nodes_visited;
+            bvh_subtrees_accepted+= bvh.stats().subtrees_accepted;
+            bvh_objects_tested+= bvh.stats().objects_tested;
+
+            // verifie les objets et les commandes de dessin
+            n= culler.cull(mvp);
+            std::fill(flags.begin(), flags.end(), 0);
+            for(int i= 0; i < n; i++)
+            {
+                const DrawElementsIndirectCommand& command= culler.draw_commands()[i];
+                int id= culler.visible_ids()[i];
+                if(command.first_index != unsigned(id) * 3 || command.index_count != 3 || command.instance_count != 1 || command.base_vertex != 0 || command.instance_base != 0)
+                    false_culls++;
+                flags[id]= 1;
+            }
+
+            for(int i= 0; i < count; i++)
+            {
+                bool exact= visible_exact(pmin[i], pmax[i], mvp);
+                if(exact && !flags[i]) false_culls++;
+                if(!exact && flags[i]) extra++;
+            }
+            visible_count+= n;
+
+            int expected= 0;
+            for(int i= 0; i < count; i+= 2)
+                expected+= flags[i];
+            if(m != expected)
+                false_culls++;
+
+            // le bvh ne doit pas rejeter d'objet visible
+            std::fill(flags.begin(), flags.end(), 0);
+            for(int i= 0; i < b; i++)
+                flags[bvh_ids[i]]= 1;
+            for(int i= 0; i < count; i++)
+                if(!flags[i] && visible_exact(pmin[i], pmax[i], mvp))
+                    false_culls++;
+        }
+
+        printf("%d objects, %d frames, %.1f%% visible, %d false culls, %d boxes touching the frustum kept\n", count, frames,
+            100.f * float(visible_count) / float(frames) / float(count), false_culls, extra);
+        printf("  scalar       %8.3fms/frame\n", reference_time / frames);
+        printf("  culler       %8.3fms/frame\n", culler_time / frames);
+        printf("  culler ids   %8.3fms/frame, %d objects\n", culler_ids_time / frames, int(ids.size()));
+        printf("  bvh          %8.3fms/frame, build %.3fms, %d nodes, %d visited, %d subtrees accepted, %d objects tested\n", bvh_time / frames, bvh_build_time,
+            bvh.node_count(), bvh_nodes_visited / frames, bvh_subtrees_accepted / frames, bvh_objects_tested / frames);
+    }
+
+    return 0;
+}
@@ -0,0 +1,174 @@
+//! \file bench_hiz.cpp construit la pyramide de profondeur utilisee par le test d'occultation sur cpu (cf HiZPyramid et TP2::occlusion_cull_cpu()) en 1080p et en 4K et verifie qu'elle est conservative.
+// utilisation : bench_hiz [iterations], par defaut 50 constructions par resolution.
+// ne necessite pas de contexte openGL.
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "TPs/from_scratch/hiz_pyramid.h"
+
+
+static float elapsed_ms( const std::chrono::high_resolution_clock::time_point& start )
+{
+    auto stop= std::chrono::high_resolution_clock::now();
+    return float(std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count()) / 1000;
+}
+
+//! construction precedente de la pyramide : un vector par niveau alloue a chaque appel, reduction scalaire, la derniere ligne / colonne des niveaux impairs est ignoree.
+static std::vector<std::vector<float>> legacy_mipmaps( const std::vector<float>& depth, int width, int height, std::vector<std::pair<int, int>>& sizes )
+{
+    std::vector<std::vector<float>> mipmaps;
+    mipmaps.push_back(depth);
+    sizes.push_back(std::make_pair(width, height));
+
+    int level= 0;
+    while(width > 4 && height > 4)
+    {
+        int w= std::max(1, width / 2);
+        int h= std::max(1, height / 2);
+
+        mipmaps.push_back(std::vector<float>(w * h));
+        sizes.push_back(std::make_pair(w, h));
+
+        const std::vector<float>& previous= mipmaps[level];
+        std::vector<float>& mipmap= mipmaps[level +1];
+        for(int y= 0; y < h; y++)
+        for(int x= 0; x < w; x++)
+            mipmap[y * w + x]= std::max(std::max(previous[2*x + 2*y * width], previous[2*x +1 + 2*y * width]),
+                std::max(previous[2*x + (2*y +1) * width], previous[2*x +1 + (2*y +1) * width]));
+
+        width= w;
+        height= h;
+        level++;
+    }
+
+    return mipmaps;
+}
+
+//! zbuffer synthetique : des rectangles a des profondeurs aleatoires devant le plan far.
+static std::vector<float> make_depth( const int width, const int height )
+{
+    std::vector<float> depth(width * height, 1.f);
+    std::default_random_engine rng(width * height);
+    std::uniform_real_distribution<float> u(0, 1);
+    for(int i= 0; i < 2000; i++)
+    {
+        int x0= int(u(rng) * width);
+        int y0= int(u(rng) * height);
+        int x1= std::min(width, x0 + 1 + int(u(rng) * width / 8));
+        int y1= std::min(height, y0 + 1 + int(u(rng) * height / 8));
+        float z= u(rng);
+        for(int y= y0; y < y1; y++)
+        for(int x= x0; x < x1; x++)
+            depth[y * width + x]= std::min(depth[y * width + x], z);
+    }
+
+    // pixels isoles plus loins que leurs voisins, sur les bords impairs en particulier
+    for(int i= 0; i < 1000; i++)
+        depth[int(u(rng) * (width * height -1))]= 1.f;
+    for(int y= 0; y < height; y++)
+        depth[y * width + width -1]= u(rng);
+    for(int x= 0; x < width; x++)
+        depth[(height -1) * width + x]= u(rng);
+
+    return depth;
+}
+
+//! nombre de pixels du niveau 0 plus loin que le texel qui les couvre : le test d'occultation pourrait eliminer un objet visible derriere ces pixels.
+template< typename Level >
+static long long count_non_conservative( const std::vector<float>& depth, const int width, const int height, const int levels, const Level& level )
+{
+    long long errors= 0;
+    for(int l= 1; l < levels; l++)
+    {
+        int w, h;
+        const float *data= level(l, w, h);
+        for(int y= 0; y < height; y++)
+        for(int x= 0; x < width; x++)
+        {
+            int tx= std::min(x >> l, w -1);
+            int ty= std::min(y >> l, h -1);
+            if(data[ty * w + tx] < depth[y * width + x])
+                errors++;
+        }
+    }
+
+    return errors;
+}
+
+static void bench( const int width, const int height, const int iterations )
+{
+    std::vector<float> depth= make_depth(width, height);
+    printf("%dx%d:\n", width, height);
+
+    // reference
+    std::vector<std::pair<int, int>> sizes;
+    std::vector<std::vector<float>> legacy= legacy_mipmaps(depth, width, height, sizes);
+
+    auto start= std::chrono::high_resolution_clock::now();
+    for(int i= 0; i < iterations; i++)
+    {
+        std::vector<std::pair<int, int>> tmp;
+        legacy= legacy_mipmaps(depth, width, height, tmp);
+    }
+    float time= elapsed_ms(start) / float(iterations);
+
+    long long errors= count_non_conservative(depth, width, height, int(legacy.size()),
+        [&]( const int l, int& w, int& h ) { w= sizes[l].first; h= sizes[l].second; return legacy[l].data(); });
+    printf("  %-36s %8.3fms, %d levels, %lld non conservative texels\n", "legacy (alloc + scalar)", time, int(legacy.size()), errors);
+
+    HiZPyramid pyramid(width, height);
+    int threads= 1;
+#ifdef _OPENMP
+    threads= omp_get_max_threads();
+#endif
+
+    struct Config { int threads; int levels_per_pass; };
+    const Config configs[]= { {1, 1}, {1, 2}, {threads, 1}, {threads, 2}, {threads, 3} };
+    for(const Config& config : configs)
+    {
+#ifdef _OPENMP
+        omp_set_num_threads(config.threads);
+#endif
+        pyramid.set_levels_per_pass(config.levels_per_pass);
+
+        // le zbuffer est relu directement dans le niveau 0, seule la reduction est mesuree
+        pyramid.build(depth, width, height);
+        start= std::chrono::high_resolution_clock::now();
+        for(int i= 0; i < iterations; i++)
+            pyramid.build();
+        time= elapsed_ms(start) / float(iterations);
+
+        errors= count_non_conservative(depth, width, height, pyramid.level_count(),
+            [&]( const int l, int& w, int& h ) { w= pyramid.width(l); h= pyramid.height(l); return pyramid.level(l); });
+
+        char name[128];
+        sprintf(name, "HiZPyramid %2d threads, %d levels/pass", config.threads, config.levels_per_pass);
+        printf("  %-36s %8.3fms, %d levels, %lld non conservative texels\n", name, time, pyramid.level_count(), errors);
+    }
+
+#ifdef _OPENMP
+    omp_set_num_threads(threads);
+#endif
+}
+
+int main( int argc, char **argv )
+{
+    int iterations= 50;
+    if(argc > 1) iterations= std::max(1, atoi(argv[1]));
+
+    bench(1920, 1080, iterations);
+    bench(3840, 2160, iterations);
+    // dimensions impaires a tous les niveaux
+    bench(1917, 1079, iterations);
+
+    return 0;
+}
@@ -0,0 +1,138 @@
+//! \file bench_ktx2.cpp chargement de textures ktx2 : decompression zstd et transcodage, sequentiel ou en parallele.
+// utilisation : bench_ktx2 [fichiers ktx2 basis (etc1s / uastc)...]
+//  - cree un ensemble de textures synthetiques pre-calculees (cf ktx2_bake.h) et compare leur chargement sur 1 thread, par niveau en parallele et par texture en parallele,
+//  - transcode les fichiers basis passes en argument sur 1 thread et sur tous les coeurs, cf transcode_ktx2().
+// ne necessite pas de contexte openGL.
+
+#include <cstdio>
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "tutos/ktx2/ktx2.h"
+#include "tutos/ktx2/ktx2_bake.h"
+
+
+static float elapsed_ms( const std::chrono::high_resolution_clock::time_point& start )
+{
+    auto stop= std::chrono::high_resolution_clock::now();
+    return float(std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count()) / 1000;
+}
+
+//! image synthetique, differente pour chaque texture.
+static std::vector<uint8_t> make_image( const int width, const int height, const int seed )
+{
+    std::vector<uint8_t> pixels(size_t(width) * height * 4);
+    for(int y= 0; y < height; y++)
+    for(int x= 0; x < width; x++)
+    {
+        uint8_t *p= pixels.data() + (size_t(y) * width + x) * 4;
+        p[0]= uint8_t(128 + 127 * std::sin(x * 0.01f + seed) * std::cos(y * 0.013f));
+        p[1]= uint8_t((x * y + seed * 977) >> 10);
+        p[2]= uint8_t((x ^ y) + seed);
+        p[3]= 255;
+    }
+
+    return pixels;
+}
+
+static void bench_baked( const int count, const int size, const int iterations )
+{
+    int threads= 1;
+#ifdef _OPENMP
+    threads= omp_get_max_threads();
+#endif
+
+    printf("%d baked textures %dx%d, BC1 + zstd, %d threads:\n", count, size, size, threads);
+
+    std::vector<std::string> filenames;
+    size_t bytes= 0;
+    for(int i= 0; i < count; i++)
+    {
+        std::vector<uint8_t> image= make_image(size, size, i);
+        KTX2Texture texture= bake_ktx2_texture(image.data(), size, size, 4, KTX2_USAGE_COLOR_SRGB);
+
+        char filename[64];
+        sprintf(filename, "bench_ktx2_%02d.ktx2", i);
+        if(!write_ktx2(filename, texture, 0, KTX2_USAGE_COLOR_SRGB))
+            return;
+
+        filenames.push_back(filename);
+        bytes+= texture.size();
+    }
+
+    // chargement de l'ensemble : sequentiel, niveaux en parallele, textures en parallele
+    for(int mode= 0; mode < 3; mode++)
+    {
+        std::vector<KTX2Texture> textures(count);
+        auto start= std::chrono::high_resolution_clock::now();
+        for(int k= 0; k < iterations; k++)
+        {
+            if(mode == 2)
+            {
+            #pragma omp parallel for schedule(dynamic, 1)
+                for(int i= 0; i < count; i++)
+                    read_ktx2(filenames[i].c_str(), textures[i], nullptr, nullptr, false);
+            }
+            else
+            {
+                for(int i= 0; i < count; i++)
+                    read_ktx2(filenames[i].c_str(), textures[i], nullptr, nullptr, mode == 1);
+            }
+        }
+        float time= elapsed_ms(start) / float(iterations);
+
+        const char *names[]= { "sequential", "parallel levels", "parallel textures" };
+        printf("  %-20s %8.2fms, %.0fMB/s\n", names[mode], time, bytes / (1024.0 * 1024.0) / (time / 1000));
+    }
+
+    for(const std::string& filename : filenames)
+        remove(filename.c_str());
+}
+
+static void bench_basis( const char *filename, const int iterations )
+{
+    int threads= 1;
+#ifdef _OPENMP
+    threads= omp_get_max_threads();
+#endif
+
+    const basist::transcoder_texture_format formats[]= { basist::transcoder_texture_format::cTFBC7_RGBA, basist::transcoder_texture_format::cTFASTC_4x4_RGBA };
+    const char *names[]= { "BC7", "ASTC 4x4" };
+    for(int f= 0; f < 2; f++)
+    {
+        for(int t : { 1, threads })
+        {
+            KTX2TranscodedTexture texture;
+            auto start= std::chrono::high_resolution_clock::now();
+            bool code= true;
+            for(int k= 0; k < iterations && code; k++)
+                code= transcode_ktx2(filename, formats[f], texture, t);
+            float time= elapsed_ms(start) / float(iterations);
+
+            if(!code)
+                return;
+
+            printf("  %s: %dx%d, %d levels, %d layers, %d faces -> %-8s %2d threads %8.2fms\n", filename, texture.width, texture.height,
+                texture.levels, texture.layers, texture.faces, names[f], t, time);
+        }
+    }
+}
+
+int main( int argc, char **argv )
+{
+    bench_baked(16, 2048, 5);
+
+    if(argc > 1)
+        printf("basis textures:\n");
+    for(int i= 1; i < argc; i++)
+        bench_basis(argv[i], 5);
+
+    return 0;
+}
@@ -0,0 +1,145 @@
+//! \file bench_lods.cpp construit les niveaux de details des groupes de triangles d'un objet (cf TPs/from_scratch/mesh_lods.h) et compare le nombre de triangles dessines avec et sans la selection des niveaux de details, pour plusieurs seuils d'erreur en pixels.
+// utilisation : bench_lods [scene.obj] [views], par defaut data/occlusion_culling_demo.obj, 64 points de vue.
+// ne necessite pas de contexte openGL.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cfloat>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <vector>
+
+#include "vec.h"
+#include "mat.h"
+#include "mesh.h"
+#include "wavefront_fast.h"
+#include "mesh_cache.h"
+
+#include "TPs/from_scratch/frustum_culler.h"
+#include "TPs/from_scratch/mesh_lods.h"
+
+
+static float elapsed_ms( const std::chrono::high_resolution_clock::time_point& start )
+{
+    auto stop= std::chrono::high_resolution_clock::now();
+    return float(std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count()) / 1000;
+}
+
+int main( int argc, char **argv )
+{
+    const char *filename= "data/occlusion_culling_demo.obj";
+    int views= 64;
+    if(argc > 1) filename= argv[1];
+    if(argc > 2) views= atoi(argv[2]);
+
+    Mesh mesh;
+    std::vector<TriangleGroup> groups;
+    if(!read_mesh_cache(filename, mesh, groups))
+    {
+        mesh= read_mesh_fast_parallel(filename);
+        groups= mesh.groups();
+    }
+    if(mesh.positions().size() == 0)
+        return 1;
+
+    auto start= std::chrono::high_resolution_clock::now();
+    LODChain chain= LODBuilder::build(mesh, groups);
+    float build_time= elapsed_ms(start);
+
+    // erreur et nombre de triangles de chaque niveau de chaque groupe, le niveau 0 est le groupe complet
+    const int levels= LODBuilder::MAX_LEVELS + 1;
+    std::vector<float> errors(groups.size() * (levels + 1), FLT_MAX);
+    std::vector<int> counts(groups.size() * levels, 0);
+    for(unsigned g= 0; g < groups.size(); g++)
+    {
+        errors[g * (levels + 1)]= 0;
+        counts[g * levels]= groups[g].n / 3;
+    }
+
+    int simplified_groups= 0;
+    int level_triangles[levels]= { mesh.triangle_count() };
+    for(const MeshLOD& lod : chain.lods)
+    {
+        errors[lod.group * (levels + 1) + lod.level]= lod.error;
+        counts[lod.group * levels + lod.level]= lod.n / 3;
+        level_triangles[lod.level]+= lod.n / 3;
+        if(lod.level == 1)
+            simplified_groups++;
+    }
+
+    printf("%s: %d triangles, %d groups, %d simplified groups, %d levels, build %.1fms\n", filename,
+        mesh.triangle_count(), int(groups.size()), simplified_groups, int(chain.lods.size()), build_time);
+    for(int l= 1; l < levels; l++)
+        printf("  level %d: %d triangles\n", l, level_triangles[l]);
+
+    // englobants des groupes, le cache de TP2 est indexe
+    const std::vector<vec3>& positions= mesh.positions();
+    const std::vector<unsigned int>& indices= mesh.indices();
+    FrustumCuller culler;
+    culler.resize(groups.size());
+    std::vector<Point> centers(groups.size());
+    std::vector<float> radius(groups.size());
+    Point scene_min(FLT_MAX, FLT_MAX, FLT_MAX);
+    Point scene_max(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for(unsigned g= 0; g < groups.size(); g++)
+    {
+        Point pmin(FLT_MAX, FLT_MAX, FLT_MAX);
+        Point pmax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        for(int i= groups[g].first; i < groups[g].first + groups[g].n; i++)
+        {
+            Point p= positions[indices.empty() ? i : indices[i]];
+            pmin= min(pmin, p);
+            pmax= max(pmax, p);
+        }
+
+        culler.set_object(g, pmin, pmax, groups[g].first, groups[g].n);
+        centers[g]= center(pmin, pmax);
+        radius[g]= distance(pmin, pmax) / 2;
+        scene_min= min(scene_min, pmin);
+        scene_max= max(scene_max, pmax);
+    }
+
+    // points de vue aleatoires au dessus de la scene, 1920x1080
+    Vector extent= scene_max - scene_min;
+    float diagonal= length(extent);
+    std::default_random_engine rng(1);
+    std::uniform_real_distribution<float> u(0.1f, 0.9f);
+    Transform projection= Perspective(45, 16.f / 9.f, diagonal / 1000, diagonal * 2);
+    float projection_scale= projection.m[1][1] * 1080 / 2;
+
+    const float thresholds[]= { 0.5f, 1, 2, 4 };
+    long long full_triangles= 0;
+    long long lod_triangles[4]= { };
+    for(int v= 0; v < views; v++)
+    {
+        Point from= scene_min + Vector(u(rng) * extent.x, u(rng) * extent.y, u(rng) * extent.z);
+        Point to= scene_min + Vector(u(rng) * extent.x, u(rng) * extent.y, u(rng) * extent.z);
+        Transform mvp= projection * Lookat(from, to, Vector(0, 1, 0));
+
+        int n= culler.cull(mvp);
+        for(int i= 0; i < n; i++)
+        {
+            int g= culler.visible_ids()[i];
+            full_triangles+= groups[g].n / 3;
+
+            // meme selection que TP2 : le niveau le plus grossier dont l'erreur projetee est sous le seuil
+            float d= std::max(distance(centers[g], from) - radius[g], 1.0e-4f);
+            for(int t= 0; t < 4; t++)
+            {
+                int level= 0;
+                while(level + 1 < levels && errors[g * (levels + 1) + level + 1] * projection_scale <= thresholds[t] * d)
+                    level++;
+
+                lod_triangles[t]+= counts[g * levels + level];
+            }
+        }
+    }
+
+    printf("  triangles drawn per view, full resolution        %10.0f\n", double(full_triangles) / views);
+    for(int t= 0; t < 4; t++)
+        printf("  triangles drawn per view, LOD threshold %.1fpx   %10.0f (%5.1f%% less)\n", thresholds[t], double(lod_triangles[t]) / views,
+            full_triangles > 0 ? 100.0 * (1.0 - double(lod_triangles[t]) / double(full_triangles)) : 0.0);
+
+    return 0;
+}
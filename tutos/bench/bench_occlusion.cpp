@@ -0,0 +1,259 @@
+
+//! \file bench_occlusion.cpp compare le test d'occultation sur une pyramide de profondeur (hi-z, cf TP2::occlusion_cull_cpu()) et sur un zbuffer basse resolution calcule par le cpu, cf OcclusionRasterizer.
+// utilisation : bench_occlusion [scene.obj] [views] [triangle budget], par defaut data/occlusion_culling_demo.obj, 64 points de vue, 100000 triangles.
+// ne necessite pas de contexte openGL.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cfloat>
+#include <cmath>
+#include <random>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+#include "vec.h"
+#include "mat.h"
+#include "mesh.h"
+#include "wavefront_fast.h"
+#include "mesh_cache.h"
+
+#include "TPs/from_scratch/occlusion_rasterizer.h"
+
+
+//! resolution du zbuffer de reference, et de la pyramide hi-z, c'est le zbuffer que la version gpu relit.
+const int width= 1280;
+const int height= 720;
+
+static float elapsed_ms( const std::chrono::high_resolution_clock::time_point& start )
+{
+    auto stop= std::chrono::high_resolution_clock::now();
+    return float(std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count()) / 1000;
+}
+
+//! pyramide de profondeur, chaque niveau conserve la profondeur max des 2x2 pixels du niveau precedent.
+struct DepthPyramid
+{
+    std::vector<std::vector<float>> levels;
+    std::vector<std::pair<int, int>> sizes;
+
+    void build( const std::vector<float>& depth, const int w, const int h )
+    {
+        levels.assign(1, depth);
+        sizes.assign(1, std::make_pair(w, h));
+        while(sizes.back().first > 1 || sizes.back().second > 1)
+        {
+            int pw= sizes.back().first;
+            int ph= sizes.back().second;
+            int lw= std::max(1, pw / 2);
+            int lh= std::max(1, ph / 2);
+            const std::vector<float>& previous= levels.back();
+
+            std::vector<float> level(lw * lh);
+            for(int y= 0; y < lh; y++)
+            for(int x= 0; x < lw; x++)
+            {
+                // les colonnes / lignes impaires sont integrees au dernier pixel
+                int x1= (x == lw -1) ? pw -1 : 2*x +1;
+                int y1= (y == lh -1) ? ph -1 : 2*y +1;
+                float z= 0;
+                for(int py= 2*y; py <= y1; py++)
+                for(int px= 2*x; px <= x1; px++)
+                    z= std::max(z, previous[py * pw + px]);
+                level[y * lw + x]= z;
+            }
+
+            levels.push_back(level);
+            sizes.push_back(std::make_pair(lw, lh));
+        }
+    }
+
+    //! meme selection du niveau et meme test que TP2::occlusion_cull_cpu(), renvoie true si l'englobant est visible.
+    bool test_box( const Point& pmin, const Point& pmax, const Transform& mvp ) const
+    {
+        Point smin(FLT_MAX, FLT_MAX, FLT_MAX);
+        Point smax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        for(unsigned i= 0; i < 8; i++)
+        {
+            vec4 p= mvp(vec4(i & 1 ? pmax.x : pmin.x, i & 2 ? pmax.y : pmin.y, i & 4 ? pmax.z : pmin.z, 1));
+            if(p.z < -p.w)
+                // l'englobant traverse le plan near, TP2 le considere visible sur tout l'ecran
+                return true;
+
+            Point s((p.x / p.w * 0.5f + 0.5f) * width, (p.y / p.w * 0.5f + 0.5f) * height, p.z / p.w * 0.5f + 0.5f);
+            smin= min(smin, s);
+            smax= max(smax, s);
+        }
+
+        if(smax.x < 0 || smax.y < 0 || smin.x > width || smin.y > height || smin.z > 1)
+            return false;
+
+        smin= max(smin, Point(0, 0, -FLT_MAX));
+        smax= min(smax, Point(width -1, height -1, FLT_MAX));
+
+        int level= 0;
+        float extent= std::max(smax.x - smin.x, smax.y - smin.y);
+        if(extent > 4)
+            level= int(std::log2(std::ceil(extent / 4)));
+        level= std::min(level, int(levels.size()) -1);
+        float scale= 1.f / float(1 << level);
+
+        int lw= sizes[level].first;
+        int lh= sizes[level].second;
+        int x0= std::min(int(std::floor(smin.x * scale)), lw -1);
+        int x1= std::min(int(std::ceil(smax.x * scale)), lw -1);
+        int y0= std::min(int(std::floor(smin.y * scale)), lh -1);
+        int y1= std::min(int(std::ceil(smax.y * scale)), lh -1);
+        for(int y= y0; y <= y1; y++)
+        for(int x= x0; x <= x1; x++)
+            if(levels[level][y * lw + x] >= smin.z)
+                return true;
+
+        return false;
+    }
+};
+
+//! resultats d'une methode de test, cumules sur tous les points de vue.
+struct Stats
+{
+    const char *name;
+    int culled;
+    int false_culled;
+    float time;
+};
+
+static void print_stats( const Stats& stats, const int tested, const int views )
+{
+    printf("  %-24s culled %6.2f%%, false culls %d (%.3f%%), %8.3fms/view\n", stats.name,
+        100.f * float(stats.culled) / float(std::max(1, tested)), stats.false_culled, 100.f * float(stats.false_culled) / float(std::max(1, tested)),
+        stats.time / float(views));
+}
+
+
+int main( int argc, char **argv )
+{
+    const char *filename= "data/occlusion_culling_demo.obj";
+    int views= 64;
+    int budget= 100000;
+    if(argc > 1) filename= argv[1];
+    if(argc > 2) views= atoi(argv[2]);
+    if(argc > 3) budget= atoi(argv[3]);
+
+    Mesh mesh;
+    std::vector<TriangleGroup> groups;
+    if(!read_mesh_cache(filename, mesh, groups))
+    {
+        mesh= read_mesh_fast_parallel(filename);
+        groups= mesh.groups();
+    }
+    if(mesh.positions().size() == 0)
+        return 1;
+
+    const std::vector<vec3>& positions= mesh.positions();
+    const std::vector<unsigned int>& indices= mesh.indices();
+
+    // englobants des groupes, comme TP2::compute_bounding_boxes_of_groups()
+    std::vector<Point> bmin(groups.size(), Point(FLT_MAX, FLT_MAX, FLT_MAX));
+    std::vector<Point> bmax(groups.size(), Point(-FLT_MAX, -FLT_MAX, -FLT_MAX));
+    Point scene_min(FLT_MAX, FLT_MAX, FLT_MAX);
+    Point scene_max(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    int triangles= 0;
+    for(unsigned g= 0; g < groups.size(); g++)
+    {
+        for(int i= groups[g].first; i < groups[g].first + groups[g].n; i++)
+        {
+            Point p= positions[indices.empty() ? i : indices[i]];
+            bmin[g]= min(bmin[g], p);
+            bmax[g]= max(bmax[g], p);
+        }
+        scene_min= min(scene_min, bmin[g]);
+        scene_max= max(scene_max, bmax[g]);
+        triangles+= groups[g].n / 3;
+    }
+
+    std::vector<int> all_groups(groups.size());
+    for(unsigned g= 0; g < groups.size(); g++)
+        all_groups[g]= g;
+
+    std::vector<int> occluders= OcclusionRasterizer::select_occluders(positions, indices, groups, budget);
+    int occluder_triangles= 0;
+    for(int g : occluders)
+        occluder_triangles+= groups[g].n / 3;
+
+    printf("%s: %d triangles, %d groups, %d occluders, %d occluder triangles\n", filename, triangles, int(groups.size()), int(occluders.size()), occluder_triangles);
+
+    // zbuffer de reference, tous les triangles a la resolution de l'image
+    OcclusionRasterizer reference(width, height);
+    OcclusionRasterizer software;
+    DepthPyramid pyramid;
+
+    Stats stats_hiz= { "hi-z (full z-buffer)", 0, 0, 0 };
+    Stats stats_software= { "software occluders", 0, 0, 0 };
+    int tested= 0;
+    int reference_culled= 0;
+    float reference_time= 0;
+    float pyramid_time= 0;
+
+    // points de vue aleatoires a l'interieur de la scene
+    Vector extent= scene_max - scene_min;
+    float diagonal= length(extent);
+    std::default_random_engine rng(1);
+    std::uniform_real_distribution<float> u(0.1f, 0.9f);
+    Transform projection= Perspective(45, float(width) / float(height), diagonal / 1000, diagonal * 2);
+
+    std::vector<unsigned char> visible(groups.size());
+    for(int v= 0; v < views; v++)
+    {
+        Point from= scene_min + Vector(u(rng) * extent.x, u(rng) * extent.y, u(rng) * extent.z);
+        Point to= scene_min + Vector(u(rng) * extent.x, u(rng) * extent.y, u(rng) * extent.z);
+        Transform mvp= projection * Lookat(from, to, Vector(0, 1, 0));
+
+        // reference : englobants testes contre la profondeur exacte de toute la scene
+        auto start= std::chrono::high_resolution_clock::now();
+        reference.clear();
+        reference.rasterize(positions, indices, groups, all_groups, mvp);
+        reference_time+= elapsed_ms(start);
+
+        // les groupes en dehors du frustum sont aussi elimines par les 3 tests, les pourcentages les comptent
+        for(unsigned g= 0; g < groups.size(); g++)
+            visible[g]= reference.test_box(bmin[g], bmax[g], mvp);
+
+        // hi-z : meme test que la version gpu, le temps de rendu et de relecture du zbuffer n'est pas compte
+        start= std::chrono::high_resolution_clock::now();
+        pyramid.build(reference.depth_buffer(), reference.width(), reference.height());
+        pyramid_time+= elapsed_ms(start);
+
+        start= std::chrono::high_resolution_clock::now();
+        std::vector<unsigned char> hiz(groups.size());
+        for(unsigned g= 0; g < groups.size(); g++)
+            hiz[g]= pyramid.test_box(bmin[g], bmax[g], mvp);
+        stats_hiz.time+= elapsed_ms(start);
+
+        // cpu : zbuffer basse resolution des occultants
+        start= std::chrono::high_resolution_clock::now();
+        software.clear();
+        software.rasterize(positions, indices, groups, occluders, mvp);
+        std::vector<unsigned char> cpu(groups.size());
+#pragma omp parallel for schedule(dynamic, 64)
+        for(int g= 0; g < int(groups.size()); g++)
+            cpu[g]= software.test_box(bmin[g], bmax[g], mvp);
+        stats_software.time+= elapsed_ms(start);
+
+        for(unsigned g= 0; g < groups.size(); g++)
+        {
+            tested++;
+            if(!visible[g]) reference_culled++;
+            if(!hiz[g]) { stats_hiz.culled++; if(visible[g]) stats_hiz.false_culled++; }
+            if(!cpu[g]) { stats_software.culled++; if(visible[g]) stats_software.false_culled++; }
+        }
+    }
+
+    printf("%d views, %d boxes tested\n", views, tested);
+    printf("  %-24s culled %6.2f%%, %8.3fms/view (%dx%d, all triangles)\n", "reference", 100.f * float(reference_culled) / float(std::max(1, tested)), reference_time / float(views), width, height);
+    print_stats(stats_hiz, tested, views);
+    printf("    + %.3fms/view to build the pyramid, + render and readback on the gpu\n", pyramid_time / float(views));
+    print_stats(stats_software, tested, views);
+    printf("    %dx%d depth buffer, rasterize + test\n", software.width(), software.height());
+
+    return 0;
+}
@@ -0,0 +1,180 @@
+
+//! \file bench_tlas.cpp compare la reconstruction complete, refit() et update() pour mettre a jour un bvh d'instances animees, cf tutos/bvh.h.
+// utilisation : bench_tlas [frames] [threshold], par defaut 100 images, threshold 1.5. mesure 1k, 10k et 100k instances.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <random>
+#include <chrono>
+#include <vector>
+
+#include "vec.h"
+#include "mat.h"
+
+#include "../bvh.h"
+
+
+//! intersection avec une instance.
+struct Hit
+{
+    float t;
+    int instance_id;
+
+    Hit( ) : t(FLT_MAX), instance_id(-1) {}
+
+    operator bool( ) const { return instance_id != -1; }
+};
+
+//! instance d'un objet, represente par son englobant, seul le bvh des instances est mesure.
+struct Instance
+{
+    BBox object_bounds;
+    BBox world_bounds;
+    int instance_id;
+
+    Instance( const BBox& bounds, const Transform& model, const int id ) : object_bounds(bounds), world_bounds(), instance_id(id) { update(model); }
+
+    void update( const Transform& model )
+    {
+        world_bounds= BBox( model(object_bounds.pmin) );
+        for(unsigned i= 1; i < 8; i++)
+        {
+            Point p= object_bounds.pmin;
+            if(i & 1) p.x= object_bounds.pmax.x;
+            if(i & 2) p.y= object_bounds.pmax.y;
+            if(i & 4) p.z= object_bounds.pmax.z;
+            world_bounds.insert( model(p) );
+        }
+    }
+
+    BBox bounds( ) const { return world_bounds; }
+
+    Hit intersect( const Ray& ray, const float htmax ) const
+    {
+        Hit hit;
+        Vector invd= Vector(1 / ray.d.x, 1 / ray.d.y, 1 / ray.d.z);
+        if(BBoxHit h= world_bounds.intersect(ray, invd, htmax))
+        {
+            hit.t= h.tmin;
+            hit.instance_id= instance_id;
+        }
+        return hit;
+    }
+};
+
+typedef BVHT<Instance> TLAS;
+
+
+//! trajectoire d'une instance : position initiale, vitesse et rotation, rebondit sur les bords de la scene.
+struct Motion
+{
+    Point p;
+    Vector v;
+    float angle;
+    float speed;
+};
+
+static float elapsed_ms( const std::chrono::high_resolution_clock::time_point& start )
+{
+    auto stop= std::chrono::high_resolution_clock::now();
+    return float(std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count()) / 1000;
+}
+
+// mesure le temps de calcul de rayons aleatoires, pour verifier que le cout de l'arbre correspond bien au temps de parcours
+static float trace( const TLAS& bvh, const float extent, const int n )
+{
+    std::default_random_engine rng;
+    std::uniform_real_distribution<float> u(-extent, extent);
+
+    auto start= std::chrono::high_resolution_clock::now();
+    int hits= 0;
+    for(int i= 0; i < n; i++)
+    {
+        Point o(u(rng), u(rng), u(rng));
+        Point e(u(rng), u(rng), u(rng));
+        if(bvh.intersect(Ray(o, e)))
+            hits++;
+    }
+    return elapsed_ms(start);
+}
+
+
+int main( int argc, char **argv )
+{
+    int frames= 100;
+    float threshold= 1.5f;
+    if(argc > 1) frames= atoi(argv[1]);
+    if(argc > 2) threshold= float(atof(argv[2]));
+
+    for(int count : { 1000, 10000, 100000 })
+    {
+        // repartit les instances dans un cube, densite constante
+        float extent= 2 * std::cbrt(float(count));
+        std::default_random_engine rng(count);
+        std::uniform_real_distribution<float> u(-1, 1);
+
+        std::vector<Motion> motions(count);
+        std::vector<Instance> instances;
+        instances.reserve(count);
+        BBox object(Point(-0.5f, -0.5f, -0.5f), Point(0.5f, 0.5f, 0.5f));
+        for(int i= 0; i < count; i++)
+        {
+            Motion& m= motions[i];
+            m.p= Point(u(rng) * extent, u(rng) * extent, u(rng) * extent);
+            m.v= Vector(u(rng), u(rng), u(rng)) * 0.1f;
+            m.angle= 0;
+            m.speed= u(rng) * 5;
+
+            instances.push_back( Instance(object, Translation(Vector(m.p)), i) );
+        }
+
+        TLAS rebuild;
+        TLAS refit;
+        TLAS update;
+        rebuild.build(instances);
+        refit.build(instances);
+        update.build(instances);
+        float initial_cost= rebuild.cost();
+
+        float rebuild_time= 0;
+        float refit_time= 0;
+        float update_time= 0;
+        int updated= 0;
+        for(int f= 0; f < frames; f++)
+        {
+            // anime les instances
+            for(int i= 0; i < count; i++)
+            {
+                Motion& m= motions[i];
+                m.p= m.p + m.v;
+                if(std::abs(m.p.x) > extent) m.v.x= -m.v.x;
+                if(std::abs(m.p.y) > extent) m.v.y= -m.v.y;
+                if(std::abs(m.p.z) > extent) m.v.z= -m.v.z;
+                m.angle+= m.speed;
+
+                instances[i].update( Translation(Vector(m.p)) * RotationY(m.angle) );
+            }
+
+            auto start= std::chrono::high_resolution_clock::now();
+            rebuild.build(instances);
+            rebuild_time+= elapsed_ms(start);
+
+            start= std::chrono::high_resolution_clock::now();
+            refit.refit(instances);
+            refit_time+= elapsed_ms(start);
+
+            start= std::chrono::high_resolution_clock::now();
+            updated+= update.update(instances, threshold);
+            update_time+= elapsed_ms(start);
+        }
+
+        printf("%d instances, %d frames, initial cost %.2f\n", count, frames, initial_cost);
+        printf("  rebuild %8.3fms/frame, cost %6.2f, trace %.1fms\n", rebuild_time / frames, rebuild.cost(), trace(rebuild, extent, 100000));
+        printf("  refit   %8.3fms/frame, cost %6.2f, trace %.1fms\n", refit_time / frames, refit.cost(), trace(refit, extent, 100000));
+        printf("  update  %8.3fms/frame, cost %6.2f, trace %.1fms, %.1f%% instances rebuilt per frame\n", update_time / frames, update.cost(), trace(update, extent, 100000),
+            100.f * float(updated) / float(frames) / float(count));
+    }
+
+    return 0;
+}
@@ -0,0 +1,64 @@
+//! \file bench_vcache.cpp optimise l'ordre des triangles et des sommets d'un objet indexe (cf mesh_optimizer.h) et simule le cache de sommets transformes avant et apres.
+// utilisation : bench_vcache [scene.obj] [cache size], par defaut data/occlusion_culling_demo.obj, cache de 16 sommets.
+// ne necessite pas de contexte openGL.
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <vector>
+
+#include "mesh.h"
+#include "wavefront_fast.h"
+#include "mesh_optimizer.h"
+
+
+static float elapsed_ms( const std::chrono::high_resolution_clock::time_point& start )
+{
+    auto stop= std::chrono::high_resolution_clock::now();
+    return float(std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count()) / 1000;
+}
+
+static void print_stats( const char *name, const Mesh& mesh, const std::vector<TriangleGroup>& groups, const int cache_size )
+{
+    VertexCacheStats fifo= vertex_cache_stats(mesh, groups, cache_size, false);
+    VertexCacheStats lru= vertex_cache_stats(mesh, groups, cache_size * 2, true);
+    printf("  %-28s fifo %2d: acmr %.3f atvr %.3f, lru %2d: acmr %.3f atvr %.3f\n", name,
+        cache_size, fifo.acmr, fifo.atvr, cache_size * 2, lru.acmr, lru.atvr);
+}
+
+int main( int argc, char **argv )
+{
+    const char *filename= "data/occlusion_culling_demo.obj";
+    int cache_size= VERTEX_CACHE_SIZE;
+    if(argc > 1) filename= argv[1];
+    if(argc > 2) cache_size= atoi(argv[2]);
+
+    Mesh mesh= read_indexed_mesh_fast_parallel(filename);
+    if(mesh.positions().size() == 0 || mesh.indices().empty())
+        return 1;
+
+    std::vector<TriangleGroup> groups= mesh.groups();
+    printf("%s: %d triangles, %d vertices, %d groups\n", filename, mesh.triangle_count(), int(mesh.positions().size()), int(groups.size()));
+    print_stats("file order", mesh, groups, cache_size);
+
+    Mesh tipsify= mesh;
+    auto start= std::chrono::high_resolution_clock::now();
+    optimize_vertex_cache(tipsify, groups, cache_size, false);
+    float time= elapsed_ms(start);
+    print_stats("vertex cache", tipsify, groups, cache_size);
+    printf("  %.1fms\n", time);
+
+    start= std::chrono::high_resolution_clock::now();
+    optimize_vertex_cache(mesh, groups, cache_size, true);
+    time= elapsed_ms(start);
+    print_stats("vertex cache + overdraw", mesh, groups, cache_size);
+    printf("  %.1fms\n", time);
+
+    start= std::chrono::high_resolution_clock::now();
+    optimize_vertex_fetch(mesh);
+    time= elapsed_ms(start);
+    print_stats("+ vertex fetch", mesh, groups, cache_size);
+    printf("  %.1fms, %d vertices\n", time, int(mesh.positions().size()));
+
+    return 0;
+}
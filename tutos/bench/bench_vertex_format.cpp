@@ -0,0 +1,56 @@
+//! \file bench_vertex_format.cpp compresse les attributs des sommets d'un objet (cf vertex_format.h) et affiche la taille des buffers et les erreurs de compression.
+// utilisation : bench_vertex_format [scene.obj], par defaut data/occlusion_culling_demo.obj.
+// ne necessite pas de contexte openGL.
+
+#include <cstdio>
+#include <chrono>
+
+#include "mesh.h"
+#include "wavefront_fast.h"
+#include "vertex_format.h"
+
+
+static float elapsed_ms( const std::chrono::high_resolution_clock::time_point& start )
+{
+    auto stop= std::chrono::high_resolution_clock::now();
+    return float(std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count()) / 1000;
+}
+
+int main( int argc, char **argv )
+{
+    const char *filename= "data/occlusion_culling_demo.obj";
+    if(argc > 1) filename= argv[1];
+
+    Mesh mesh= read_indexed_mesh_fast_parallel(filename);
+    if(mesh.positions().size() == 0)
+        return 1;
+
+    const int n= mesh.vertex_count();
+    printf("%s: %d vertices, %d indices, texcoords %d, normals %d, colors %d\n", filename, n, mesh.index_count(),
+        int(mesh.has_texcoord()), int(mesh.has_normal()), int(mesh.has_color()));
+
+    auto start= std::chrono::high_resolution_clock::now();
+    VertexFormatError error= vertex_format_error(mesh);
+    float time= elapsed_ms(start);
+
+    VertexQuantization quantization= compute_vertex_quantization(mesh);
+    float diagonal= length(Vector(quantization.position_scale));
+
+    printf("  float  %6.1f bytes per vertex, %8.2fMB\n", float(error.float_size) / n, error.float_size / (1024.0 * 1024.0));
+    printf("  packed %6.1f bytes per vertex, %8.2fMB (%.1f%% less, %.1f%% less with the index buffer)\n", float(error.packed_size) / n, error.packed_size / (1024.0 * 1024.0),
+        100.0 * (1.0 - double(error.packed_size) / double(error.float_size)),
+        100.0 * (1.0 - double(error.packed_size + mesh.index_buffer_size()) / double(error.float_size + mesh.index_buffer_size())));
+    printf("  position error: max %g, mean %g (%.2g / %.2g of the diagonal)\n", error.position_max, error.position_mean,
+        error.position_max / diagonal, error.position_mean / diagonal);
+    if(mesh.has_normal())
+        printf("  normal error: max %.3f degrees, mean %.3f degrees\n", error.normal_max, error.normal_mean);
+    if(mesh.has_texcoord())
+        printf("  texcoord error: max %g, mean %g, texcoords in [%g %g]x[%g %g]\n", error.texcoord_max, error.texcoord_mean,
+            quantization.texcoord_offset.x, quantization.texcoord_offset.x + quantization.texcoord_scale.x,
+            quantization.texcoord_offset.y, quantization.texcoord_offset.y + quantization.texcoord_scale.y);
+    if(mesh.has_color())
+        printf("  color error: max %g\n", error.color_max);
+    printf("  %.1fms\n", time);
+
+    return 0;
+}
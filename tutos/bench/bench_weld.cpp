@@ -0,0 +1,186 @@
+
+//! \file bench_weld.cpp compare std::map, VertexMap et weld_vertices() pour construire l'index buffer d'un objet wavefront.
+// utilisation : bench_weld [threads] [fichier.obj ...], par defaut data/bigguy.obj. par exemple : bench_weld 8 data/bigguy.obj bistro/exterior.obj
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctype.h>
+
+#include <chrono>
+#include <map>
+#include <vector>
+
+#include "vertex_map.h"
+#include "wavefront_fast.h"
+
+
+// relit les indices des sommets des faces, triangulees en eventail, comme read_indexed_mesh().
+static bool read_vertices( const char *filename, std::vector<VertexKey>& vertices )
+{
+    FILE *in= fopen(filename, "rb");
+    if(in == nullptr)
+        return false;
+
+    int positions= 0;
+    int texcoords= 0;
+    int normals= 0;
+    int material= -1;
+    std::vector<VertexKey> face;
+
+    char line[4096];
+    while(fgets(line, sizeof(line), in))
+    {
+        if(line[0] == 'v' && line[1] == ' ') positions++;
+        else if(line[0] == 'v' && line[1] == 't') texcoords++;
+        else if(line[0] == 'v' && line[1] == 'n') normals++;
+        else if(strncmp(line, "usemtl", 6) == 0) material++;     // pas besoin des noms, uniquement de changer de matiere...
+        else if(line[0] == 'f' && line[1] == ' ')
+        {
+            face.clear();
+            for(char *str= line +1; *str; )
+            {
+                while(*str && isspace(*str)) str++;
+                if(*str == 0) break;
+
+                int idx[3]= { 0, 0, 0 };
+                for(int k= 0; k < 3; k++)
+                {
+                    if(*str == '/') str++;
+                    if(*str == '-' || isdigit(*str)) idx[k]= int(strtol(str, &str, 10));
+                    if(*str != '/') break;
+                }
+
+                int p= (idx[0] < 0) ? positions + idx[0] : idx[0] -1;
+                int t= (idx[1] < 0) ? texcoords + idx[1] : idx[1] -1;
+                int n= (idx[2] < 0) ? normals + idx[2] : idx[2] -1;
+                face.push_back( VertexKey(material, p, t, n) );
+
+                while(*str && !isspace(*str)) str++;
+            }
+
+            for(int v= 2; v < int(face.size()); v++)
+            {
+                vertices.push_back(face[0]);
+                vertices.push_back(face[v -1]);
+                vertices.push_back(face[v]);
+            }
+        }
+    }
+
+    fclose(in);
+    return true;
+}
+
+// ordre lexicographique, comme l'ancienne version de read_indexed_mesh()
+struct vertex_less
+{
+    bool operator() ( const VertexKey& a, const VertexKey& b ) const
+    {
+        if(a.material != b.material) return a.material < b.material;
+        if(a.position != b.position) return a.position < b.position;
+        if(a.texcoord != b.texcoord) return a.texcoord < b.texcoord;
+        return a.normal < b.normal;
+    }
+};
+
+static float elapsed_ms( const std::chrono::high_resolution_clock::time_point& start )
+{
+    auto stop= std::chrono::high_resolution_clock::now();
+    return float(std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count()) / 1000;
+}
+
+
+int main( int argc, char **argv )
+{
+    int threads= 0;
+    int first= 1;
+    if(argc > 1 && isdigit(argv[1][0]))
+    {
+        threads= atoi(argv[1]);
+        first= 2;
+    }
+
+    std::vector<const char *> filenames;
+    for(int i= first; i < argc; i++)
+        filenames.push_back(argv[i]);
+    if(filenames.empty())
+        filenames.push_back("data/bigguy.obj");
+
+    int errors= 0;
+    for(const char *filename : filenames)
+    {
+        std::vector<VertexKey> vertices;
+        if(!read_vertices(filename, vertices))
+        {
+            printf("[error] loading '%s'...\n", filename);
+            errors++;
+            continue;
+        }
+        printf("'%s': %d vertices\n", filename, int(vertices.size()));
+
+        // std::map
+        std::vector<unsigned int> map_indices;
+        int map_count= 0;
+        {
+            auto start= std::chrono::high_resolution_clock::now();
+
+            std::map<VertexKey, int, vertex_less> remap;
+            map_indices.reserve(vertices.size());
+            for(const VertexKey& vertex : vertices)
+            {
+                auto found= remap.insert( std::make_pair(vertex, int(remap.size())) );
+                map_indices.push_back(found.first->second);
+            }
+            map_count= int(remap.size());
+
+            printf("  std::map      %8.1fms, %d unique vertices\n", elapsed_ms(start), map_count);
+        }
+
+        // VertexMap
+        std::vector<unsigned int> hash_indices;
+        {
+            auto start= std::chrono::high_resolution_clock::now();
+
+            VertexMap remap;
+            hash_indices.reserve(vertices.size());
+            for(const VertexKey& vertex : vertices)
+                hash_indices.push_back(remap.insert(vertex).first);
+
+            printf("  VertexMap     %8.1fms, %d unique vertices\n", elapsed_ms(start), int(remap.size()));
+        }
+
+        // weld_vertices
+        std::vector<unsigned int> weld_indices;
+        {
+            auto start= std::chrono::high_resolution_clock::now();
+
+            std::vector<int> unique;
+            int count= weld_vertices(vertices, weld_indices, unique, threads);
+
+            printf("  weld_vertices %8.1fms, %d unique vertices\n", elapsed_ms(start), count);
+        }
+
+        if(hash_indices != map_indices || weld_indices != map_indices)
+        {
+            printf("[error] different index buffers...\n");
+            errors++;
+        }
+
+        // chargement complet
+        {
+            auto start= std::chrono::high_resolution_clock::now();
+            Mesh mesh= read_indexed_mesh_fast(filename);
+            printf("  read_indexed_mesh_fast          %8.1fms\n", elapsed_ms(start));
+            mesh.release();
+        }
+        {
+            auto start= std::chrono::high_resolution_clock::now();
+            Mesh mesh= read_indexed_mesh_fast_parallel(filename, threads);
+            printf("  read_indexed_mesh_fast_parallel %8.1fms\n", elapsed_ms(start));
+            mesh.release();
+        }
+    }
+
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,1282 @@
+
+#ifndef _BVH_H
+#define _BVH_H
+
+//! \file bvh.h bvh parametre par le type des primitives, construction SAH parallele, cf tuto_bvh2.cpp et tuto_bvh2_gltf_brdf.cpp
+
+#include <algorithm>
+#include <chrono>
+#include <utility>
+#include <vector>
+#include <cassert>
+#include <cfloat>
+
+#if defined(__SSE__) || defined(_M_X64)
+    #include <immintrin.h>
+#endif
+
+#include "vec.h"
+
+
+//! rayon.
+struct Ray
+{
+    Point o;            // origine
+    float pad;
+    Vector d;           // direction
+    float tmax;         // tmax= 1 ou \inf, le rayon est un segment ou une demi droite infinie
+
+    Ray( const Point& _o, const Point& _e ) :  o(_o), d(Vector(_o, _e)), tmax(1) {} // segment, t entre 0 et 1
+    Ray( const Point& _o, const Vector& _d ) :  o(_o), d(_d), tmax(FLT_MAX) {}  // demi droite, t entre 0 et \inf
+    Ray( const Point& _o, const Vector& _d, const float _tmax ) :  o(_o), d(_d), tmax(_tmax) {} // explicite
+};
+
+//! paquet de 8 rayons, ranges par axe (SoA), cf BVHT::intersect( RayPacket8& ) et BVHT::occluded( RayPacket8& ).
+struct alignas(32) RayPacket8
+{
+    static const int SIZE= 8;
+
+    float ox[SIZE], oy[SIZE], oz[SIZE];     // origines
+    float dx[SIZE], dy[SIZE], dz[SIZE];     // directions
+    float tmax[SIZE];   // extremites des rayons, modifiees par BVHT::intersect()
+    int mask;           // rayons valides, bit i pour le rayon i
+
+    RayPacket8( ) : mask(0) {}
+
+    //! place le rayon i dans le paquet.
+    void set( const int i, const Ray& ray )
+    {
+        assert(i >= 0 && i < SIZE);
+        ox[i]= ray.o.x; oy[i]= ray.o.y; oz[i]= ray.o.z;
+        dx[i]= ray.d.x; dy[i]= ray.d.y; dz[i]= ray.d.z;
+        tmax[i]= ray.tmax;
+        mask|= 1 << i;
+    }
+
+    //! renvoie le rayon i du paquet.
+    Ray ray( const int i ) const { return Ray(Point(ox[i], oy[i], oz[i]), Vector(dx[i], dy[i], dz[i]), tmax[i]); }
+};
+
+//! intersection avec une boite / un englobant.
+struct BBoxHit
+{
+    float tmin, tmax;
+
+    BBoxHit() : tmin(FLT_MAX), tmax(-FLT_MAX) {}
+    BBoxHit( const float _tmin, const float _tmax ) : tmin(_tmin), tmax(_tmax) {}
+
+    operator bool( ) const { return tmin <= tmax; }   // renvoie vrai si l'intersection est definie / existe
+};
+
+
+//! boite englobante.
+struct BBox
+{
+    Point pmin, pmax;
+
+    BBox( ) : pmin(), pmax() {}
+
+    BBox( const Point& p ) : pmin(p), pmax(p) {}
+    BBox( const BBox& box ) : pmin(box.pmin), pmax(box.pmax) {}
+    BBox( const BBox& a, const BBox& b ) : pmin(min(a.pmin, b.pmin)), pmax(max(a.pmax, b.pmax)) {}
+    BBox& operator= ( const BBox& box ) = default;
+
+    BBox& insert( const Point& p ) { pmin= min(pmin, p); pmax= max(pmax, p); return *this; }
+    BBox& insert( const BBox& box ) { pmin= min(pmin, box.pmin); pmax= max(pmax, box.pmax); return *this; }
+
+    float centroid( const int axis ) const { return (pmin(axis) + pmax(axis)) / 2; }
+    Point centroid( ) const { return (pmin + pmax) / 2; }
+
+    //! aire de la boite, cf SAH.
+    float area( ) const
+    {
+        Vector d(pmin, pmax);
+        return 2 * d.x*d.y + 2 * d.x*d.z + 2 * d.y*d.z;
+    }
+
+    BBoxHit intersect( const Ray& ray, const Vector& invd, const float htmax ) const
+    {
+        Point rmin= pmin;
+        Point rmax= pmax;
+        if(ray.d.x < 0) std::swap(rmin.x, rmax.x);
+        if(ray.d.y < 0) std::swap(rmin.y, rmax.y);
+        if(ray.d.z < 0) std::swap(rmin.z, rmax.z);
+        Vector dmin= (rmin - ray.o) * invd;
+        Vector dmax= (rmax - ray.o) * invd;
+
+        float tmin= std::max(dmin.z, std::max(dmin.y, std::max(dmin.x, 0.f)));
+        float tmax= std::min(dmax.z, std::min(dmax.y, std::min(dmax.x, htmax)));
+        return BBoxHit(tmin, tmax);
+    }
+};
+
+//! boite vide, cf BBox::insert().
+inline BBox EmptyBox( )
+{
+    BBox box;
+    box.pmin= Point(FLT_MAX, FLT_MAX, FLT_MAX);
+    box.pmax= Point(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    return box;
+}
+
+
+//! construction de l'arbre / BVH.
+struct Node
+{
+    BBox bounds;
+    int left;
+    int right;
+
+    bool internal( ) const { return right > 0; }                        // renvoie vrai si le noeud est un noeud interne
+    int internal_left( ) const { assert(internal()); return left; }     // renvoie le fils gauche du noeud interne
+    int internal_right( ) const { assert(internal()); return right; }   // renvoie le fils droit
+
+    bool leaf( ) const { return right < 0; }                            // renvoie vrai si le noeud est une feuille
+    int leaf_begin( ) const { assert(leaf()); return -left; }           // renvoie le premier objet de la feuille
+    int leaf_end( ) const { assert(leaf()); return -right; }            // renvoie le dernier objet
+};
+
+//! creation d'un noeud interne.
+inline Node make_node( const BBox& bounds, const int left, const int right )
+{
+    Node node { bounds, left, right };
+    assert(node.internal());    // verifie que c'est bien un noeud...
+    return node;
+}
+
+//! creation d'une feuille.
+inline Node make_leaf( const BBox& bounds, const int begin, const int end )
+{
+    Node node { bounds, -begin, -end };
+    assert(node.leaf());        // verifie que c'est bien une feuille...
+    return node;
+}
+
+
+/*! bvh parametre par le type des primitives, cf triangle et instance...
+    T doit fournir `BBox bounds( ) const` et `Hit intersect( const Ray& ray, const float htmax ) const`, Hit est le type de l'intersection renvoye par T.
+
+    build() construit l'arbre en minimisant le SAH, avec un histogramme de 16 cellules par axe, cf \ref sah. les sous arbres sont construits en parallele (taches openMP).
+    build_midpoint() construit l'arbre en coupant l'englobant des centres au milieu de son axe le plus etire, comme dans la version precedente, pour comparer.
+
+    cost() et build_time() renvoient le cout de l'arbre et le temps de construction.
+
+    lorsque les primitives se deplacent, les instances animees par exemple, refit() recalcule les englobants sans modifier la structure de l'arbre. le cout de
+    l'arbre augmente avec les deplacements, update() reconstruit aussi les sous arbres dont le cout depasse threshold fois le cout mesure lors de leur construction.
+    refit() et update() ne sont disponibles qu'apres build().
+
+    apres la construction, l'arbre binaire est aussi transforme en arbre a 4 fils (SSE) ou 8 fils (AVX), cf WideNode. les englobants des fils d'un noeud
+    sont ranges par axe (SoA) pour les tester en meme temps, intersect() parcourt cet arbre sans recursion, avec une pile, et visite les fils du plus proche au plus loin.
+
+    les rayons coherents, les rayons primaires d'un bloc de pixels par exemple, peuvent etre testes par paquets de 8, cf RayPacket8 : chaque noeud n'est visite qu'une
+    fois pour tous les rayons du paquet qui touchent son englobant. occluded() s'arrete sur la premiere intersection, pour les rayons d'ombre.
+    les versions qui prennent un tableau de rayons (flux) regroupent les rayons de meme octant de direction avant de construire les paquets.
+*/
+template < typename T >
+struct BVHT
+{
+    //! type de l'intersection avec une primitive.
+    typedef decltype( std::declval<const T&>().intersect(std::declval<const Ray&>(), 0.f) ) Hit;
+
+#ifdef __AVX__
+    static const int WIDTH= 8;
+#else
+    static const int WIDTH= 4;
+#endif
+
+    //! noeud a WIDTH fils, englobants des fils ranges par axe. count[k] > 0 : feuille, primitives [child[k] .. child[k] + count[k]), count[k] == 0 : noeud child[k], count[k] < 0 : pas de fils.
+    struct alignas(32) WideNode
+    {
+        float bounds[6][WIDTH];     // xmin, ymin, zmin, xmax, ymax, zmax de chaque fils
+        int child[WIDTH];
+        int count[WIDTH];
+    };
+
+    //! construit un bvh pour l'ensemble de primitives, minimise le SAH. les feuilles contiennent au plus leaf_max primitives.
+    int build( const std::vector<T>& _primitives, const int leaf_max= 4 )
+    {
+        auto start= std::chrono::high_resolution_clock::now();
+
+        max_leaf= std::max(1, leaf_max);
+        int n= int(_primitives.size());
+        nodes.clear();
+        primitives.clear();
+        root= -1;
+        if(n == 0)
+            return root;
+
+        // englobants et centres des primitives, ne sont calcules qu'une seule fois
+        refs.resize(n);
+    #pragma omp parallel for
+        for(int i= 0; i < n; i++)
+        {
+            BBox bounds= _primitives[i].bounds();
+            refs[i]= { bounds, bounds.centroid(), i };
+        }
+
+        // au plus 2n -1 noeuds, alloues a l'avance pour les construire en parallele
+        nodes.resize(2*n -1);
+        node_count= 1;
+        root= 0;
+
+    #pragma omp parallel
+    #pragma omp single
+        build_sah(root, 0, n);
+
+        nodes.resize(node_count);
+
+        // re-organise les primitives dans l'ordre des feuilles
+        primitives.resize(n, _primitives[0]);
+        ids.resize(n);
+        boxes.resize(n);
+    #pragma omp parallel for
+        for(int i= 0; i < n; i++)
+        {
+            primitives[i]= _primitives[refs[i].id];
+            ids[i]= refs[i].id;
+            boxes[i]= refs[i].bounds;
+        }
+
+        refs.clear();
+        refs.shrink_to_fit();
+
+        // cout de chaque sous arbre, reference pour update()
+        garbage= 0;
+        refit_nodes();
+        build_costs= costs;
+
+        build_wide();
+
+        auto stop= std::chrono::high_resolution_clock::now();
+        time= std::chrono::duration<float, std::milli>(stop - start).count();
+        return root;
+    }
+
+    //! construit un bvh pour l'ensemble de primitives, coupe l'englobant des centres au milieu, 1 primitive par feuille.
+    int build_midpoint( const std::vector<T>& _primitives )
+    {
+        auto start= std::chrono::high_resolution_clock::now();
+
+        primitives= _primitives;  // copie les primitives pour les trier
+        nodes.clear();          // efface les noeuds
+        nodes.reserve(primitives.size());
+        root= -1;
+
+        // construit l'arbre...
+        if(primitives.size())
+            root= build_midpoint(0, primitives.size());
+
+        // les primitives sont triees directement, refit() n'est pas disponible...
+        ids.clear();
+        garbage= 0;
+        boxes.resize(primitives.size());
+        for(unsigned i= 0; i < primitives.size(); i++)
+            boxes[i]= primitives[i].bounds();
+        refit_nodes();
+        build_costs= costs;
+
+        build_wide();
+
+        auto stop= std::chrono::high_resolution_clock::now();
+        time= std::chrono::duration<float, std::milli>(stop - start).count();
+        return root;
+    }
+
+    //! renvoie le cout de l'arbre, cf \ref sah : 2 tests rayon/englobant par noeud interne visite + 1 test rayon/primitive par primitive des feuilles visitees.
+    float cost( ) const
+    {
+        if(root < 0)
+            return 0;
+
+        return costs[root];
+    }
+
+    //! renvoie le temps de la derniere construction ou mise a jour, cf refit() et update(), en ms.
+    float build_time( ) const { return time; }
+
+    //! renvoie le nombre de noeuds et de feuilles de l'arbre, y compris les noeuds des sous arbres remplaces par update().
+    int size( ) const { return int(nodes.size()); }
+
+    /*! recalcule les englobants apres le deplacement des primitives, la structure de l'arbre ne change pas.
+        _primitives contient les memes primitives que pour build(), dans le meme ordre. renvoie le cout de l'arbre, cf cost().
+    */
+    float refit( const std::vector<T>& _primitives )
+    {
+        auto start= std::chrono::high_resolution_clock::now();
+
+        assert(ids.size() == primitives.size());
+        assert(_primitives.size() == primitives.size());
+        if(root < 0)
+            return 0;
+
+        const int n= int(primitives.size());
+    #pragma omp parallel for
+        for(int i= 0; i < n; i++)
+        {
+            primitives[i]= _primitives[ids[i]];
+            boxes[i]= primitives[i].bounds();
+        }
+
+        refit_nodes();
+        refit_wide();
+
+        auto stop= std::chrono::high_resolution_clock::now();
+        time= std::chrono::duration<float, std::milli>(stop - start).count();
+        return cost();
+    }
+
+    /*! refit(), puis reconstruit les sous arbres dont le cout depasse threshold fois leur cout initial. reconstruit l'arbre complet si la racine
+        est trop degradee, ou si trop de noeuds ont ete remplaces. renvoie le nombre de primitives des sous arbres reconstruits.
+    */
+    int update( const std::vector<T>& _primitives, const float threshold= 1.5f )
+    {
+        auto start= std::chrono::high_resolution_clock::now();
+
+        refit(_primitives);
+        if(root < 0)
+            return 0;
+
+        std::vector<int> subtrees;
+        select_subtrees(root, threshold, subtrees);
+        if(subtrees.empty())
+            return 0;
+
+        const int n= int(primitives.size());
+        if(subtrees[0] == root || garbage > n)
+        {
+            build(_primitives, max_leaf);
+            return n;
+        }
+
+        int count= 0;
+        for(int index : subtrees)
+            count+= rebuild_subtree(index);
+
+        // recalcule les couts des ancetres, et les couts de reference des nouveaux sous arbres
+        refit_nodes();
+        for(int index : subtrees)
+            reset_costs(index);
+
+        build_wide();
+
+        auto stop= std::chrono::high_resolution_clock::now();
+        time= std::chrono::duration<float, std::milli>(stop - start).count();
+        return count;
+    }
+
+    //! intersection avec un rayon, entre 0 et htmax
+    Hit intersect( const Ray& ray, const float htmax ) const
+    {
+        Hit hit;
+        hit.t= htmax;
+        if(root < 0)
+            return hit;
+
+        Vector invd= Vector(1 / ray.d.x, 1 / ray.d.y, 1 / ray.d.z);
+        if(wide_stack > STACK_MAX)
+            // arbre trop profond pour la pile, parcours recursif de l'arbre binaire
+            intersect(root, ray, invd, hit);
+        else
+            intersect_wide(ray, invd, hit);
+        return hit;
+    }
+
+    //! intersection avec un rayon, entre 0 et ray.tmax
+    Hit intersect( const Ray& ray ) const { return intersect(ray, ray.tmax); }
+
+    //! intersection avec un paquet de rayons, hits[i] est l'intersection du rayon i, si elle existe. packet.tmax est modifie.
+    void intersect( RayPacket8& packet, Hit hits[RayPacket8::SIZE] ) const
+    {
+        for(int i= 0; i < RayPacket8::SIZE; i++)
+        {
+            hits[i]= Hit();
+            hits[i].t= packet.tmax[i];
+        }
+
+        traverse_packet(packet, hits, false);
+    }
+
+    //! renvoie le masque des rayons du paquet qui touchent une primitive, s'arrete sur la premiere intersection de chaque rayon.
+    int occluded( RayPacket8& packet ) const
+    {
+        Hit hits[RayPacket8::SIZE];
+        for(int i= 0; i < RayPacket8::SIZE; i++)
+            hits[i].t= packet.tmax[i];
+
+        return traverse_packet(packet, hits, true);
+    }
+
+    //! intersection avec un ensemble de rayons, regroupes par octant de direction et testes par paquets.
+    void intersect( const std::vector<Ray>& rays, std::vector<Hit>& hits ) const
+    {
+        hits.resize(rays.size());
+
+        std::vector<int> order= sort_octants(rays);
+        for(unsigned i= 0; i < order.size(); i+= RayPacket8::SIZE)
+        {
+            int n= std::min(int(order.size() - i), RayPacket8::SIZE);
+
+            RayPacket8 packet;
+            for(int k= 0; k < n; k++)
+                packet.set(k, rays[order[i+k]]);
+
+            Hit packet_hits[RayPacket8::SIZE];
+            intersect(packet, packet_hits);
+            for(int k= 0; k < n; k++)
+                hits[order[i+k]]= packet_hits[k];
+        }
+    }
+
+    //! renvoie pour chaque rayon s'il touche une primitive, cf occluded( RayPacket8& ). renvoie le nombre de rayons occultes.
+    int occluded( const std::vector<Ray>& rays, std::vector<bool>& occlusions ) const
+    {
+        occlusions.assign(rays.size(), false);
+
+        int count= 0;
+        std::vector<int> order= sort_octants(rays);
+        for(unsigned i= 0; i < order.size(); i+= RayPacket8::SIZE)
+        {
+            int n= std::min(int(order.size() - i), RayPacket8::SIZE);
+
+            RayPacket8 packet;
+            for(int k= 0; k < n; k++)
+                packet.set(k, rays[order[i+k]]);
+
+            int mask= occluded(packet);
+            for(int k= 0; k < n; k++)
+            {
+                if(mask & (1 << k))
+                {
+                    occlusions[order[i+k]]= true;
+                    count++;
+                }
+            }
+        }
+
+        return count;
+    }
+
+protected:
+    struct Ref
+    {
+        BBox bounds;
+        Point centroid;
+        int id;
+    };
+
+    struct Bucket
+    {
+        BBox bounds;
+        int n;
+
+        Bucket( ) : bounds(EmptyBox()), n(0) {}
+    };
+
+    static const int BUCKETS_MAX= 16;
+    static const int STACK_MAX= 256;
+
+    std::vector<Node> nodes;
+    std::vector<T> primitives;
+    int root= -1;
+    float time= 0;
+
+    // arbre a WIDTH fils, la racine est wide_nodes[0]
+    std::vector<WideNode> wide_nodes;
+    std::vector<int> wide_refs; // noeud binaire de chaque fils des noeuds a WIDTH fils, cf refit_wide()
+    int wide_stack= 0;          // taille de la pile necessaire au parcours
+
+    // mise a jour, cf refit() et update()
+    std::vector<int> ids;       // indice de chaque primitive dans le tableau transmis a build()
+    std::vector<BBox> boxes;    // englobant de chaque primitive
+    std::vector<float> costs;   // cout de chaque sous arbre
+    std::vector<float> build_costs;     // cout de chaque sous arbre apres sa construction
+    int garbage= 0;             // nombre de noeuds remplaces par update()
+
+    // construction SAH
+    std::vector<Ref> refs;
+    int node_count= 0;
+    int max_leaf= 4;
+
+    // construit le noeud index, et ses fils, pour les primitives [begin .. end)
+    void build_sah( const int index, const int begin, const int end )
+    {
+        assert(end > begin);
+
+        BBox bounds= EmptyBox();
+        BBox cbounds= EmptyBox();
+        for(int i= begin; i < end; i++)
+        {
+            bounds.insert(refs[i].bounds);
+            cbounds.insert(refs[i].centroid);
+        }
+
+        const int n= end - begin;
+        if(n == 1)
+        {
+            nodes[index]= make_leaf(bounds, begin, end);
+            return;
+        }
+
+        // compare le cout de la repartition sur chaque axe et garde le meilleur...
+        float area= bounds.area();
+        int min_axis= -1;
+        int min_index= -1;
+        float min_cost= FLT_MAX;
+        for(int axis= 0; axis < 3; axis++)
+        {
+            float cmin= cbounds.pmin(axis);
+            float cmax= cbounds.pmax(axis);
+            if(cmax <= cmin)
+                continue;       // tous les centres sont confondus sur cet axe
+
+            Bucket buckets[BUCKETS_MAX];
+            for(int i= begin; i < end; i++)
+            {
+                int k= bucket(refs[i].centroid(axis), cmin, cmax);
+                buckets[k].bounds.insert(refs[i].bounds);
+                buckets[k].n++;
+            }
+
+            // englobants des cellules [k .. n), de droite a gauche
+            BBox right_bounds[BUCKETS_MAX];
+            int right_n[BUCKETS_MAX];
+            BBox right= EmptyBox();
+            int rn= 0;
+            for(int k= BUCKETS_MAX -1; k > 0; k--)
+            {
+                right.insert(buckets[k].bounds);
+                rn+= buckets[k].n;
+                right_bounds[k]= right;
+                right_n[k]= rn;
+            }
+
+            // evalue chaque repartition : cellules [0 .. k) dans le fils gauche, [k .. n) dans le fils droit
+            BBox left= EmptyBox();
+            int ln= 0;
+            for(int k= 1; k < BUCKETS_MAX; k++)
+            {
+                left.insert(buckets[k -1].bounds);
+                ln+= buckets[k -1].n;
+                if(ln == 0 || right_n[k] == 0)
+                    continue;
+
+                float cost= 2
+                    + left.area() / area * ln
+                    + right_bounds[k].area() / area * right_n[k];
+                if(cost < min_cost)
+                {
+                    min_cost= cost;
+                    min_axis= axis;
+                    min_index= k;
+                }
+            }
+        }
+
+        // une feuille est moins chere que la meilleure repartition ?
+        if(n <= max_leaf && (min_axis == -1 || n <= min_cost))
+        {
+            nodes[index]= make_leaf(bounds, begin, end);
+            return;
+        }
+
+        // repartir les primitives
+        int m= begin;
+        if(min_axis != -1)
+        {
+            float cmin= cbounds.pmin(min_axis);
+            float cmax= cbounds.pmax(min_axis);
+            Ref *p= std::partition(refs.data() + begin, refs.data() + end,
+                [&]( const Ref& ref ) { return bucket(ref.centroid(min_axis), cmin, cmax) < min_index; } );
+            m= int(std::distance(refs.data(), p));
+        }
+
+        if(m == begin || m == end)  // si la repartition echoue, couper arbitrairement
+            m= (begin + end) / 2;
+
+        // les fils sont voisins dans le tableau de noeuds
+        int left;
+    #pragma omp atomic capture
+        { left= node_count; node_count+= 2; }
+        int right= left +1;
+        nodes[index]= make_node(bounds, left, right);
+
+        // construit les gros sous arbres en parallele, les taches sont terminees a la fin de la region parallele, cf build()
+        if(m - begin > 4096)
+        {
+        #pragma omp task
+            build_sah(left, begin, m);
+        }
+        else
+            build_sah(left, begin, m);
+
+        build_sah(right, m, end);
+    }
+
+    static int bucket( const float c, const float cmin, const float cmax )
+    {
+        int k= int(BUCKETS_MAX * (c - cmin) / (cmax - cmin));
+        // attention aux calculs sur les floats... verifier que k est bien un indice de cellule
+        return std::clamp(k, 0, BUCKETS_MAX -1);
+    }
+
+    int build_midpoint( const int begin, const int end )
+    {
+        if(end - begin < 2)
+        {
+            // inserer une feuille et renvoyer son indice
+            int index= nodes.size();
+            nodes.push_back( make_leaf( primitive_bounds(begin, end), begin, end ) );
+            return index;
+        }
+
+        // axe le plus etire de l'englobant des centres des englobants des primitives...
+        BBox cbounds= centroid_bounds(begin, end);
+        Vector d= Vector(cbounds.pmin, cbounds.pmax);
+        int axis;
+        if(d.x > d.y && d.x > d.z)  // x plus grand que y et z ?
+            axis= 0;
+        else if(d.y > d.z)          // y plus grand que z ? (et que x implicitement)
+            axis= 1;
+        else                        // x et y ne sont pas les plus grands...
+            axis= 2;
+
+        // coupe l'englobant au milieu
+        float cut= cbounds.centroid(axis);
+
+        // repartit les primitives
+        T *pm= std::partition(primitives.data() + begin, primitives.data() + end,
+            [axis, cut]( const T& primitive )
+            {
+                return primitive.bounds().centroid(axis) < cut;
+            }
+        );
+        int m= std::distance(primitives.data(), pm);
+
+        // la repartition peut echouer, et toutes les primitives sont dans la meme moitiee de l'englobant
+        // forcer quand meme un decoupage en 2 ensembles
+        if(m == begin || m == end)
+            m= (begin + end) / 2;
+        assert(m != begin);
+        assert(m != end);
+
+        // construire le fils gauche, les primitives se trouvent dans [begin .. m)
+        int left= build_midpoint(begin, m);
+
+        // on recommence pour le fils droit, les primitives se trouvent dans [m .. end)
+        int right= build_midpoint(m, end);
+
+        // construire le noeud et renvoyer son indice
+        int index= nodes.size();
+        nodes.push_back( make_node( BBox(nodes[left].bounds, nodes[right].bounds), left, right ) );
+        return index;
+    }
+
+    // englobant des primitives
+    BBox primitive_bounds( const int begin, const int end )
+    {
+        BBox bbox= primitives[begin].bounds();
+        for(int i= begin +1; i < end; i++)
+            bbox.insert(primitives[i].bounds());
+
+        return bbox;
+    }
+
+    // englobant des centres des primitives
+    BBox centroid_bounds( const int begin, const int end )
+    {
+        BBox bbox= primitives[begin].bounds().centroid();
+        for(int i= begin +1; i < end; i++)
+            bbox.insert(primitives[i].bounds().centroid());
+
+        return bbox;
+    }
+
+    // transforme l'arbre binaire en arbre a WIDTH fils
+    void build_wide( )
+    {
+        wide_nodes.clear();
+        wide_refs.clear();
+        wide_stack= 0;
+        if(root < 0)
+            return;
+
+        wide_nodes.reserve(nodes.size() / (WIDTH -1) +1);
+        wide_refs.reserve(wide_nodes.capacity() * WIDTH);
+        int depth= 0;
+        build_wide(root, depth);
+
+        // chaque niveau empile au plus WIDTH-1 fils en plus de celui qui est visite
+        wide_stack= depth * (WIDTH -1) +1;
+    }
+
+    // construit le noeud a WIDTH fils qui remplace le noeud binaire index et ses descendants les plus gros. renvoie son indice.
+    int build_wide( const int index, int& depth )
+    {
+        // remplace le plus gros fils interne par ses 2 fils, tant qu'il reste de la place
+        int children[WIDTH]= { index };
+        int n= 1;
+        while(n < WIDTH)
+        {
+            int best= -1;
+            float best_area= -1;
+            for(int i= 0; i < n; i++)
+            {
+                const Node& node= nodes[children[i]];
+                if(node.internal() && node.bounds.area() > best_area)
+                {
+                    best= i;
+                    best_area= node.bounds.area();
+                }
+            }
+            if(best == -1)
+                break;
+
+            const Node& node= nodes[children[best]];
+            children[best]= node.internal_left();
+            children[n++]= node.internal_right();
+        }
+
+        int w= int(wide_nodes.size());
+        wide_nodes.emplace_back();
+        for(int i= 0; i < WIDTH; i++)
+            wide_refs.push_back( (i < n) ? children[i] : -1 );
+
+        WideNode wide;
+        int child_depth= 0;
+        for(int i= 0; i < WIDTH; i++)
+        {
+            if(i >= n)
+            {
+                // pas de fils, englobant vide, ne sera jamais touche
+                for(int axis= 0; axis < 3; axis++)
+                {
+                    wide.bounds[axis][i]= FLT_MAX;
+                    wide.bounds[axis +3][i]= -FLT_MAX;
+                }
+                wide.child[i]= -1;
+                wide.count[i]= -1;
+                continue;
+            }
+
+            const Node& node= nodes[children[i]];
+            for(int axis= 0; axis < 3; axis++)
+            {
+                wide.bounds[axis][i]= node.bounds.pmin(axis);
+                wide.bounds[axis +3][i]= node.bounds.pmax(axis);
+            }
+
+            if(node.leaf())
+            {
+                wide.child[i]= node.leaf_begin();
+                wide.count[i]= node.leaf_end() - node.leaf_begin();
+            }
+            else
+            {
+                int d= 0;
+                wide.child[i]= build_wide(children[i], d);
+                wide.count[i]= 0;
+                child_depth= std::max(child_depth, d);
+            }
+        }
+
+        wide_nodes[w]= wide;
+        depth= child_depth +1;
+        return w;
+    }
+
+    // recopie les englobants des noeuds binaires dans les noeuds a WIDTH fils, la structure de l'arbre ne change pas.
+    void refit_wide( )
+    {
+        const int n= int(wide_nodes.size());
+    #pragma omp parallel for
+        for(int w= 0; w < n; w++)
+        {
+            WideNode& wide= wide_nodes[w];
+            for(int i= 0; i < WIDTH; i++)
+            {
+                int index= wide_refs[w * WIDTH + i];
+                if(index < 0)
+                    continue;
+
+                const BBox& bounds= nodes[index].bounds;
+                for(int axis= 0; axis < 3; axis++)
+                {
+                    wide.bounds[axis][i]= bounds.pmin(axis);
+                    wide.bounds[axis +3][i]= bounds.pmax(axis);
+                }
+            }
+        }
+    }
+
+    // recalcule les englobants et les couts des noeuds a partir des englobants des primitives, cf boxes.
+    void refit_nodes( )
+    {
+        costs.resize(nodes.size());
+        if(root < 0)
+            return;
+
+    #pragma omp parallel
+    #pragma omp single
+        refit_node(root, 0);
+    }
+
+    void refit_node( const int index, const int depth )
+    {
+        Node& node= nodes[index];
+        if(node.leaf())
+        {
+            BBox bounds= boxes[node.leaf_begin()];
+            for(int i= node.leaf_begin() +1; i < node.leaf_end(); i++)
+                bounds.insert(boxes[i]);
+
+            node.bounds= bounds;
+            costs[index]= float(node.leaf_end() - node.leaf_begin());
+            return;
+        }
+
+        const int left= node.internal_left();
+        const int right= node.internal_right();
+        if(depth < 6)
+        {
+        #pragma omp task
+            refit_node(left, depth +1);
+            refit_node(right, depth +1);
+        #pragma omp taskwait
+        }
+        else
+        {
+            refit_node(left, depth +1);
+            refit_node(right, depth +1);
+        }
+
+        // meme cout que cost(), pour le sous arbre
+        node.bounds= BBox(nodes[left].bounds, nodes[right].bounds);
+        float area= node.bounds.area();
+        if(area > 0)
+            costs[index]= 2 + (nodes[left].bounds.area() * costs[left] + nodes[right].bounds.area() * costs[right]) / area;
+        else
+            costs[index]= 2 + costs[left] + costs[right];
+    }
+
+    // selectionne les sous arbres a reconstruire : les plus petits sous arbres degrades dont les fils ne sont pas degrades.
+    void select_subtrees( const int index, const float threshold, std::vector<int>& subtrees ) const
+    {
+        const Node& node= nodes[index];
+        if(node.leaf() || costs[index] <= threshold * build_costs[index])
+            return;
+
+        bool degraded= false;
+        for(int child : { node.internal_left(), node.internal_right() })
+        {
+            if(nodes[child].internal() && costs[child] > threshold * build_costs[child])
+            {
+                select_subtrees(child, threshold, subtrees);
+                degraded= true;
+            }
+        }
+
+        // la degradation vient de la repartition des primitives entre les fils, reconstruire le sous arbre
+        if(!degraded)
+            subtrees.push_back(index);
+    }
+
+    // reconstruit le sous arbre index, les nouveaux noeuds sont ajoutes a la fin du tableau. renvoie le nombre de primitives du sous arbre.
+    int rebuild_subtree( const int index )
+    {
+        // les primitives d'un sous arbre sont voisines, entre la premiere feuille du fils gauche et la derniere feuille du fils droit
+        int first= index;
+        while(nodes[first].internal())
+            first= nodes[first].internal_left();
+        int last= index;
+        while(nodes[last].internal())
+            last= nodes[last].internal_right();
+
+        const int begin= nodes[first].leaf_begin();
+        const int end= nodes[last].leaf_end();
+        const int n= end - begin;
+
+        garbage+= subtree_size(index) -1;
+
+        refs.resize(primitives.size());
+        for(int i= begin; i < end; i++)
+            refs[i]= { boxes[i], boxes[i].centroid(), i };
+
+        node_count= int(nodes.size());
+        nodes.resize(node_count + 2*n -2);
+
+    #pragma omp parallel
+    #pragma omp single
+        build_sah(index, begin, end);
+
+        nodes.resize(node_count);
+
+        // re-organise les primitives du sous arbre dans l'ordre des feuilles
+        std::vector<T> tmp_primitives;
+        std::vector<int> tmp_ids;
+        tmp_primitives.reserve(n);
+        tmp_ids.reserve(n);
+        for(int i= begin; i < end; i++)
+        {
+            tmp_primitives.push_back(primitives[refs[i].id]);
+            tmp_ids.push_back(ids[refs[i].id]);
+        }
+
+        for(int i= begin; i < end; i++)
+        {
+            primitives[i]= tmp_primitives[i - begin];
+            ids[i]= tmp_ids[i - begin];
+            boxes[i]= refs[i].bounds;
+        }
+
+        refs.clear();
+        return n;
+    }
+
+    int subtree_size( const int index ) const
+    {
+        const Node& node= nodes[index];
+        if(node.leaf())
+            return 1;
+        return 1 + subtree_size(node.internal_left()) + subtree_size(node.internal_right());
+    }
+
+    void reset_costs( const int index )
+    {
+        build_costs.resize(costs.size());
+        build_costs[index]= costs[index];
+
+        const Node& node= nodes[index];
+        if(node.internal())
+        {
+            reset_costs(node.internal_left());
+            reset_costs(node.internal_right());
+        }
+    }
+
+    // intersection du rayon avec les englobants des fils d'un noeud. renvoie le masque des fils touches et leur distance.
+    static int intersect_children( const WideNode& node, const float org[3], const float invd[3], const int near[3], const int far[3], const float htmax, float tmin[WIDTH] )
+    {
+    #if defined(__AVX__)
+        __m256 vtmin= _mm256_setzero_ps();
+        __m256 vtmax= _mm256_set1_ps(htmax);
+        for(int axis= 0; axis < 3; axis++)
+        {
+            __m256 o= _mm256_set1_ps(org[axis]);
+            __m256 d= _mm256_set1_ps(invd[axis]);
+            __m256 t0= _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.bounds[near[axis]]), o), d);
+            __m256 t1= _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.bounds[far[axis]]), o), d);
+            vtmin= _mm256_max_ps(t0, vtmin);
+            vtmax= _mm256_min_ps(t1, vtmax);
+        }
+        _mm256_store_ps(tmin, vtmin);
+        return _mm256_movemask_ps(_mm256_cmp_ps(vtmin, vtmax, _CMP_LE_OQ));
+
+    #elif defined(__SSE__) || defined(_M_X64)
+        __m128 vtmin= _mm_setzero_ps();
+        __m128 vtmax= _mm_set1_ps(htmax);
+        for(int axis= 0; axis < 3; axis++)
+        {
+            __m128 o= _mm_set1_ps(org[axis]);
+            __m128 d= _mm_set1_ps(invd[axis]);
+            __m128 t0= _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[near[axis]]), o), d);
+            __m128 t1= _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[far[axis]]), o), d);
+            vtmin= _mm_max_ps(t0, vtmin);
+            vtmax= _mm_min_ps(t1, vtmax);
+        }
+        _mm_store_ps(tmin, vtmin);
+        return _mm_movemask_ps(_mm_cmple_ps(vtmin, vtmax));
+
+    #else
+        int mask= 0;
+        for(int i= 0; i < WIDTH; i++)
+        {
+            float t0= 0;
+            float t1= htmax;
+            for(int axis= 0; axis < 3; axis++)
+            {
+                t0= std::max((node.bounds[near[axis]][i] - org[axis]) * invd[axis], t0);
+                t1= std::min((node.bounds[far[axis]][i] - org[axis]) * invd[axis], t1);
+            }
+            tmin[i]= t0;
+            if(t0 <= t1)
+                mask|= 1 << i;
+        }
+        return mask;
+    #endif
+    }
+
+    // parcours de l'arbre a WIDTH fils, avec une pile, fils les plus proches d'abord
+    void intersect_wide( const Ray& ray, const Vector& invd, Hit& hit ) const
+    {
+        struct Entry
+        {
+            int child;
+            int count;
+            float t;
+        };
+
+        const float org[3]= { ray.o.x, ray.o.y, ray.o.z };
+        const float inv[3]= { invd.x, invd.y, invd.z };
+        // englobants a tester en premier sur chaque axe, pmin ou pmax selon la direction du rayon
+        const int near[3]= { ray.d.x < 0 ? 3 : 0, ray.d.y < 0 ? 4 : 1, ray.d.z < 0 ? 5 : 2 };
+        const int far[3]= { ray.d.x < 0 ? 0 : 3, ray.d.y < 0 ? 1 : 4, ray.d.z < 0 ? 2 : 5 };
+
+        Entry stack[STACK_MAX];
+        int top= 0;
+        stack[top++]= { 0, 0, 0 };
+        while(top > 0)
+        {
+            Entry entry= stack[--top];
+            if(entry.t > hit.t)
+                continue;       // une intersection plus proche a ete trouvee depuis
+
+            if(entry.count > 0)
+            {
+                // feuille
+                for(int i= entry.child; i < entry.child + entry.count; i++)
+                    if(Hit h= primitives[i].intersect(ray, hit.t))
+                        hit= h;
+                continue;
+            }
+
+            const WideNode& node= wide_nodes[entry.child];
+            alignas(32) float tmin[WIDTH];
+            int mask= intersect_children(node, org, inv, near, far, hit.t, tmin);
+
+            // trie les fils touches, du plus loin au plus proche...
+            Entry children[WIDTH];
+            int n= 0;
+            for(int k= 0; k < WIDTH; k++)
+            {
+                if((mask & (1 << k)) == 0)
+                    continue;
+
+                Entry child= { node.child[k], node.count[k], tmin[k] };
+                int i= n++;
+                for(; i > 0 && children[i -1].t < child.t; i--)
+                    children[i]= children[i -1];
+                children[i]= child;
+            }
+
+            // ... et les empile, le plus proche sera visite en premier
+            for(int i= 0; i < n; i++)
+                stack[top++]= children[i];
+        }
+    }
+
+    // regroupe les rayons par octant de direction, tri par denombrement, conserve l'ordre des rayons d'un octant
+    static std::vector<int> sort_octants( const std::vector<Ray>& rays )
+    {
+        auto octant= []( const Ray& ray ) { return (ray.d.x < 0 ? 1 : 0) | (ray.d.y < 0 ? 2 : 0) | (ray.d.z < 0 ? 4 : 0); };
+
+        int offsets[9]= { };
+        for(const Ray& ray : rays)
+            offsets[octant(ray) +1]++;
+        for(int i= 1; i < 9; i++)
+            offsets[i]+= offsets[i -1];
+
+        std::vector<int> order(rays.size());
+        for(unsigned i= 0; i < rays.size(); i++)
+            order[offsets[octant(rays[i])]++]= int(i);
+
+        return order;
+    }
+
+    // intersection d'un paquet de rayons avec l'englobant d'un fils. renvoie le masque des rayons qui le touchent, et la plus petite distance.
+    static int intersect_child( const WideNode& node, const int k, const float org[3][RayPacket8::SIZE], const float invd[3][RayPacket8::SIZE],
+        const float htmax[RayPacket8::SIZE], float& tnear )
+    {
+    #if defined(__AVX__)
+        __m256 vtmin= _mm256_setzero_ps();
+        __m256 vtmax= _mm256_load_ps(htmax);
+        for(int axis= 0; axis < 3; axis++)
+        {
+            __m256 o= _mm256_load_ps(org[axis]);
+            __m256 d= _mm256_load_ps(invd[axis]);
+            __m256 t0= _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.bounds[axis][k]), o), d);
+            __m256 t1= _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.bounds[axis +3][k]), o), d);
+            // la direction des rayons n'est pas connue, le plus petit est l'entree dans la boite...
+            vtmin= _mm256_max_ps(_mm256_min_ps(t0, t1), vtmin);
+            vtmax= _mm256_min_ps(_mm256_max_ps(t0, t1), vtmax);
+        }
+        int mask= _mm256_movemask_ps(_mm256_cmp_ps(vtmin, vtmax, _CMP_LE_OQ));
+
+        alignas(32) float tmin[RayPacket8::SIZE];
+        _mm256_store_ps(tmin, vtmin);
+    #else
+        int mask= 0;
+        float tmin[RayPacket8::SIZE];
+        for(int i= 0; i < RayPacket8::SIZE; i++)
+        {
+            float t0= 0;
+            float t1= htmax[i];
+            for(int axis= 0; axis < 3; axis++)
+            {
+                float a= (node.bounds[axis][k] - org[axis][i]) * invd[axis][i];
+                float b= (node.bounds[axis +3][k] - org[axis][i]) * invd[axis][i];
+                t0= std::max(std::min(a, b), t0);
+                t1= std::min(std::max(a, b), t1);
+            }
+            tmin[i]= t0;
+            if(t0 <= t1)
+                mask|= 1 << i;
+        }
+    #endif
+
+        tnear= FLT_MAX;
+        for(int i= 0; i < RayPacket8::SIZE; i++)
+            if(mask & (1 << i))
+                tnear= std::min(tnear, tmin[i]);
+
+        return mask;
+    }
+
+    // parcours de l'arbre a WIDTH fils par un paquet de rayons. chaque entree de la pile conserve les rayons qui touchent le noeud.
+    // any : s'arrete sur la premiere intersection de chaque rayon. renvoie le masque des rayons qui touchent une primitive.
+    int traverse_packet( RayPacket8& packet, Hit hits[RayPacket8::SIZE], const bool any ) const
+    {
+        int found= 0;
+        int active= packet.mask;
+        if(root < 0 || active == 0)
+            return found;
+
+        if(wide_stack > STACK_MAX)
+        {
+            // arbre trop profond pour la pile, rayon par rayon
+            for(int i= 0; i < RayPacket8::SIZE; i++)
+            {
+                if((active & (1 << i)) == 0)
+                    continue;
+
+                Ray ray= packet.ray(i);
+                Vector invd= Vector(1 / ray.d.x, 1 / ray.d.y, 1 / ray.d.z);
+                intersect(root, ray, invd, hits[i]);
+                packet.tmax[i]= hits[i].t;
+                if(hits[i])
+                    found|= 1 << i;
+            }
+            return found;
+        }
+
+        alignas(32) float org[3][RayPacket8::SIZE];
+        alignas(32) float invd[3][RayPacket8::SIZE];
+        alignas(32) float htmax[RayPacket8::SIZE];
+        for(int i= 0; i < RayPacket8::SIZE; i++)
+        {
+            org[0][i]= packet.ox[i]; org[1][i]= packet.oy[i]; org[2][i]= packet.oz[i];
+            invd[0][i]= 1 / packet.dx[i]; invd[1][i]= 1 / packet.dy[i]; invd[2][i]= 1 / packet.dz[i];
+            // les rayons inactifs ne touchent rien
+            htmax[i]= (active & (1 << i)) ? packet.tmax[i] : -1;
+        }
+
+        struct Entry
+        {
+            int child;
+            int count;
+            int mask;       // rayons qui touchent l'englobant
+            float t;        // plus petite distance
+        };
+
+        Entry stack[STACK_MAX];
+        int top= 0;
+        stack[top++]= { 0, 0, active, 0 };
+        while(top > 0)
+        {
+            Entry entry= stack[--top];
+            int mask= entry.mask & active;
+
+            // retire les rayons qui ont trouve une intersection plus proche que l'englobant depuis...
+            float tfar= -1;
+            for(int i= 0; i < RayPacket8::SIZE; i++)
+                if(mask & (1 << i))
+                    tfar= std::max(tfar, htmax[i]);
+            if(mask == 0 || entry.t > tfar)
+                continue;
+
+            if(entry.count > 0)
+            {
+                // feuille, teste les primitives avec chaque rayon du paquet
+                for(int i= 0; i < RayPacket8::SIZE; i++)
+                {
+                    if((mask & (1 << i)) == 0)
+                        continue;
+
+                    Ray ray= packet.ray(i);
+                    for(int p= entry.child; p < entry.child + entry.count; p++)
+                    {
+                        if(Hit h= primitives[p].intersect(ray, htmax[i]))
+                        {
+                            hits[i]= h;
+                            htmax[i]= h.t;
+                            found|= 1 << i;
+                            if(any)
+                                break;
+                        }
+                    }
+                }
+
+                if(any)
+                {
+                    // les rayons occultes sont termines
+                    active&= ~found;
+                    if(active == 0)
+                        break;
+                }
+                continue;
+            }
+
+            // trie les fils touches par au moins un rayon, du plus loin au plus proche...
+            const WideNode& node= wide_nodes[entry.child];
+            Entry children[WIDTH];
+            int n= 0;
+            for(int k= 0; k < WIDTH; k++)
+            {
+                if(node.count[k] < 0)
+                    continue;
+
+                float tnear;
+                int child_mask= intersect_child(node, k, org, invd, htmax, tnear) & mask;
+                if(child_mask == 0)
+                    continue;
+
+                Entry child= { node.child[k], node.count[k], child_mask, tnear };
+                int i= n++;
+                for(; i > 0 && children[i -1].t < child.t; i--)
+                    children[i]= children[i -1];
+                children[i]= child;
+            }
+
+            // ... et les empile, le plus proche sera visite en premier
+            for(int i= 0; i < n; i++)
+                stack[top++]= children[i];
+        }
+
+        for(int i= 0; i < RayPacket8::SIZE; i++)
+            if(found & (1 << i))
+                packet.tmax[i]= htmax[i];
+
+        return found;
+    }
+
+    // intersection et parcours simple
+    void intersect( const int index, const Ray& ray, const Vector& invd, Hit& hit ) const
+    {
+        const Node& node= nodes[index];
+        if(node.bounds.intersect(ray, invd, hit.t))
+        {
+            if(node.leaf())
+            {
+                for(int i= node.leaf_begin(); i < node.leaf_end(); i++)
+                    if(Hit h= primitives[i].intersect(ray, hit.t))
+                        hit= h;
+            }
+            else // if(node.internal())
+            {
+                intersect(node.internal_left(), ray, invd, hit);
+                intersect(node.internal_right(), ray, invd, hit);
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,185 @@
+
+//! \file bake_textures.cpp pre-calcule les textures d'un objet : mipmaps, compression BC1 / BC3 / BC5 / BC7 et cache ktx2 a cote de chaque image, cf ktx2_bake.h.
+// utilisation : bake_textures scene.obj|materials.mtl [--bc7] [--force]
+//      --bc7 : compresse les couleurs en BC7 au lieu de BC1 / BC3, meilleure qualite, 2 fois plus gros que BC1.
+//      --force : reconstruit les caches meme s'ils sont a jour.
+// compare ensuite le chargement des images png / jpg et des caches ktx2 : temps de chargement et taille des textures dans la memoire de la carte graphique.
+// ne necessite pas de contexte openGL.
+
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "files.h"
+#include "image_io.h"
+#include "mesh_cache.h"
+#include "wavefront.h"
+
+#include "ktx2_bake.h"
+
+
+static float elapsed_ms( const std::chrono::high_resolution_clock::time_point& start )
+{
+    auto stop= std::chrono::high_resolution_clock::now();
+    return float(std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count()) / 1000;
+}
+
+static const char *usage_name( const KTX2Usage usage )
+{
+    switch(usage)
+    {
+        case KTX2_USAGE_COLOR_SRGB: return "srgb";
+        case KTX2_USAGE_COLOR_LINEAR: return "linear";
+        case KTX2_USAGE_NORMAL_MAP: return "normal";
+    }
+    return "";
+}
+
+static const char *format_name( const BCFormat format )
+{
+    switch(format)
+    {
+        case BC_FORMAT_BC1: return "BC1";
+        case BC_FORMAT_BC3: return "BC3";
+        case BC_FORMAT_BC5: return "BC5";
+        case BC_FORMAT_BC7: return "BC7";
+    }
+    return "";
+}
+
+static Materials load_materials( const char *filename )
+{
+    std::string name= filename;
+    if(name.size() > 4 && name.compare(name.size() - 4, 4, ".mtl") == 0)
+        return read_materials(filename);
+
+    Mesh mesh;
+    std::vector<TriangleGroup> groups;
+    if(!read_mesh_cache(filename, mesh, groups))
+        mesh= read_mesh(filename);
+    return mesh.materials();
+}
+
+int main( int argc, char **argv )
+{
+    if(argc < 2)
+    {
+        printf("usage: %s scene.obj|materials.mtl [--bc7] [--force]\n", argv[0]);
+        return 1;
+    }
+
+    bool bc7= false;
+    bool force= false;
+    for(int i= 2; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--bc7") == 0) bc7= true;
+        else if(strcmp(argv[i], "--force") == 0) force= true;
+    }
+
+    Materials materials= load_materials(argv[1]);
+    if(materials.filename_count() == 0)
+    {
+        printf("no textures in '%s'...\n", argv[1]);
+        return 1;
+    }
+
+    // utilisation de chaque texture, d'apres les matieres qui la referencent. la couleur de base est prioritaire.
+    std::vector<int> usages(materials.filename_count(), -1);
+    for(const Material& material : materials.materials)
+    {
+        const std::pair<int, KTX2Usage> slots[]= {
+            { material.diffuse_texture, KTX2_USAGE_COLOR_SRGB },
+            { material.emission_texture, KTX2_USAGE_COLOR_SRGB },
+            { material.specular_texture, KTX2_USAGE_COLOR_LINEAR },
+            { material.ns_texture, KTX2_USAGE_COLOR_LINEAR },
+            { material.normal_map, KTX2_USAGE_NORMAL_MAP } };
+
+        for(const auto& slot : slots)
+            if(slot.first != -1 && usages[slot.first] == -1)
+                usages[slot.first]= slot.second;
+    }
+
+    int threads= 1;
+#ifdef _OPENMP
+    threads= omp_get_max_threads();
+#endif
+    printf("baking %d textures, %d threads...\n", materials.filename_count(), threads);
+
+    // pre-calcul : les images sont traitees une par une, les blocs de chaque niveau sont compresses en parallele
+    auto start= std::chrono::high_resolution_clock::now();
+    int baked= 0;
+    int up_to_date= 0;
+    for(int i= 0; i < materials.filename_count(); i++)
+    {
+        if(usages[i] == -1)
+            continue;
+
+        const char *filename= materials.filename(i);
+        KTX2Usage usage= KTX2Usage(usages[i]);
+
+        KTX2Texture texture;
+        if(!force && read_ktx2_cache(filename, usage, texture))
+        {
+            up_to_date++;
+            continue;
+        }
+
+        auto texture_start= std::chrono::high_resolution_clock::now();
+        ImageData image= read_image_data(filename);
+        if(image.pixels.empty())
+            continue;
+
+        texture= bake_ktx2_texture(image.pixels.data(), image.width, image.height, image.channels, usage, bc7);
+        if(!write_ktx2_cache(filename, usage, texture))
+            continue;
+
+        printf("  %s: %dx%d %s %s, %d levels, %.1fms\n", filename, image.width, image.height, usage_name(usage), format_name(texture.format),
+            int(texture.levels.size()), elapsed_ms(texture_start));
+        baked++;
+    }
+    printf("%d textures baked, %d up to date, %.1fs\n\n", baked, up_to_date, elapsed_ms(start) / 1000);
+
+    // comparaison : chargement des images + mipmaps rgba8 (glGenerateMipmap) vs chargement des caches ktx2
+    float image_time= 0;
+    float ktx2_time= 0;
+    size_t image_bytes= 0;
+    size_t ktx2_bytes= 0;
+    int count= 0;
+    for(int i= 0; i < materials.filename_count(); i++)
+    {
+        if(usages[i] == -1)
+            continue;
+
+        const char *filename= materials.filename(i);
+
+        auto image_start= std::chrono::high_resolution_clock::now();
+        ImageData image= read_image_data(filename);
+        image_time+= elapsed_ms(image_start);
+
+        auto ktx2_start= std::chrono::high_resolution_clock::now();
+        KTX2Texture texture;
+        bool code= read_ktx2_cache(filename, KTX2Usage(usages[i]), texture);
+        ktx2_time+= elapsed_ms(ktx2_start);
+
+        if(image.pixels.empty() || !code)
+            continue;
+
+        image_bytes+= rgba8_mipmapped_size(image.width, image.height);
+        ktx2_bytes+= texture.size();
+        count++;
+    }
+
+    printf("%d textures:\n", count);
+    printf("  %-12s load %8.1fms, vram %8.1fMB (rgba8 + mipmaps)\n", "png/jpg", image_time, image_bytes / (1024.0 * 1024.0));
+    printf("  %-12s load %8.1fms, vram %8.1fMB\n", "ktx2", ktx2_time, ktx2_bytes / (1024.0 * 1024.0));
+    if(ktx2_time > 0 && ktx2_bytes > 0)
+        printf("  x%.1f faster, x%.1f smaller\n", image_time / ktx2_time, double(image_bytes) / double(ktx2_bytes));
+
+    return 0;
+}
@@ -0,0 +1,634 @@
+
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#include "bc_encoder.h"
+
+
+namespace {
+
+template< typename T >
+T clamp( const T x, const T a, const T b )
+{
+    return std::min(std::max(x, a), b);
+}
+
+// axe principal des n couleurs de dimension C : moyenne et vecteur propre principal de la covariance, par iterations de la puissance.
+template< int C >
+void principal_axis( const float colors[16][C], float mean[C], float axis[C] )
+{
+    for(int c= 0; c < C; c++)
+    {
+        mean[c]= 0;
+        for(int i= 0; i < 16; i++)
+            mean[c]+= colors[i][c];
+        mean[c]/= 16;
+    }
+
+    float covariance[C][C]= { };
+    for(int i= 0; i < 16; i++)
+    for(int a= 0; a < C; a++)
+    for(int b= 0; b < C; b++)
+        covariance[a][b]+= (colors[i][a] - mean[a]) * (colors[i][b] - mean[b]);
+
+    // direction initiale : la diagonale de l'englobant
+    for(int c= 0; c < C; c++)
+    {
+        float cmin= colors[0][c];
+        float cmax= colors[0][c];
+        for(int i= 1; i < 16; i++)
+        {
+            cmin= std::min(cmin, colors[i][c]);
+            cmax= std::max(cmax, colors[i][c]);
+        }
+        axis[c]= cmax - cmin;
+    }
+
+    for(int iteration= 0; iteration < 8; iteration++)
+    {
+        float next[C]= { };
+        for(int a= 0; a < C; a++)
+        for(int b= 0; b < C; b++)
+            next[a]+= covariance[a][b] * axis[b];
+
+        float length= 0;
+        for(int c= 0; c < C; c++)
+            length= std::max(length, std::abs(next[c]));
+        if(length == 0)
+            break;
+
+        for(int c= 0; c < C; c++)
+            axis[c]= next[c] / length;
+    }
+}
+
+// extremites de l'axe principal qui englobent les couleurs du bloc
+template< int C >
+void axis_endpoints( const float colors[16][C], float e0[C], float e1[C] )
+{
+    float mean[C], axis[C];
+    principal_axis<C>(colors, mean, axis);
+
+    float tmin= 0, tmax= 0;
+    for(int i= 0; i < 16; i++)
+    {
+        float t= 0;
+        for(int c= 0; c < C; c++)
+            t+= (colors[i][c] - mean[c]) * axis[c];
+        tmin= std::min(tmin, t);
+        tmax= std::max(tmax, t);
+    }
+
+    float length2= 0;
+    for(int c= 0; c < C; c++)
+        length2+= axis[c] * axis[c];
+    if(length2 > 0)
+    {
+        tmin/= length2;
+        tmax/= length2;
+    }
+
+    for(int c= 0; c < C; c++)
+    {
+        e0[c]= clamp(mean[c] + axis[c] * tmax, 0.f, 255.f);
+        e1[c]= clamp(mean[c] + axis[c] * tmin, 0.f, 255.f);
+    }
+}
+
+// moindres carres : extremites e0, e1 qui minimisent l'erreur des pixels, avec les poids de e0 de chaque pixel.
+// renvoie false si le systeme est singulier (un seul poids utilise).
+template< int C >
+bool fit_endpoints( const float colors[16][C], const float weights[16], float e0[C], float e1[C] )
+{
+    float aa= 0, ab= 0, bb= 0;
+    float ax[C]= { }, bx[C]= { };
+    for(int i= 0; i < 16; i++)
+    {
+        float a= weights[i];
+        float b= 1 - a;
+        aa+= a * a;
+        ab+= a * b;
+        bb+= b * b;
+        for(int c= 0; c < C; c++)
+        {
+            ax[c]+= a * colors[i][c];
+            bx[c]+= b * colors[i][c];
+        }
+    }
+
+    float det= aa * bb - ab * ab;
+    if(std::abs(det) < 1e-6f)
+        return false;
+
+    for(int c= 0; c < C; c++)
+    {
+        e0[c]= clamp((ax[c] * bb - bx[c] * ab) / det, 0.f, 255.f);
+        e1[c]= clamp((bx[c] * aa - ax[c] * ab) / det, 0.f, 255.f);
+    }
+    return true;
+}
+
+
+// BC1
+uint16_t pack565( const float c[3] )
+{
+    int r= clamp(int(std::lround(c[0] * 31 / 255)), 0, 31);
+    int g= clamp(int(std::lround(c[1] * 63 / 255)), 0, 63);
+    int b= clamp(int(std::lround(c[2] * 31 / 255)), 0, 31);
+    return uint16_t((r << 11) | (g << 5) | b);
+}
+
+void unpack565( const uint16_t v, int c[3] )
+{
+    int r= (v >> 11) & 31;
+    int g= (v >> 5) & 63;
+    int b= v & 31;
+    c[0]= (r << 3) | (r >> 2);
+    c[1]= (g << 2) | (g >> 4);
+    c[2]= (b << 3) | (b >> 2);
+}
+
+// palette du mode 4 couleurs, utilise par BC3 quelque soit l'ordre des couleurs
+void bc1_palette( const uint16_t c0, const uint16_t c1, const bool four_colors, int palette[4][4] )
+{
+    unpack565(c0, palette[0]);
+    unpack565(c1, palette[1]);
+    palette[0][3]= 255;
+    palette[1][3]= 255;
+    for(int c= 0; c < 3; c++)
+    {
+        if(four_colors)
+        {
+            palette[2][c]= (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c]= (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        else
+        {
+            palette[2][c]= (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c]= 0;
+        }
+    }
+    palette[2][3]= 255;
+    palette[3][3]= four_colors ? 255 : 0;
+}
+
+// construit le bloc avec les couleurs c0 et c1, renvoie l'erreur et le poids de c0 de chaque pixel
+float bc1_try( const float colors[16][3], uint16_t c0, uint16_t c1, uint8_t block[8], float weights[16] )
+{
+    // mode 4 couleurs : c0 > c1
+    if(c0 < c1)
+        std::swap(c0, c1);
+
+    int palette[4][4];
+    bc1_palette(c0, c1, true, palette);
+    const float palette_weights[4]= { 1, 0, 2.f / 3, 1.f / 3 };
+
+    uint32_t indices= 0;
+    float error= 0;
+    for(int i= 0; i < 16; i++)
+    {
+        int best= 0;
+        float best_error= 1e30f;
+        for(int k= 0; k < 4; k++)
+        {
+            float e= 0;
+            for(int c= 0; c < 3; c++)
+                e+= (colors[i][c] - palette[k][c]) * (colors[i][c] - palette[k][c]);
+            if(e < best_error)
+            {
+                best_error= e;
+                best= k;
+            }
+        }
+
+        indices|= uint32_t(best) << (2*i);
+        weights[i]= palette_weights[best];
+        error+= best_error;
+    }
+
+    block[0]= c0 & 0xff;
+    block[1]= c0 >> 8;
+    block[2]= c1 & 0xff;
+    block[3]= c1 >> 8;
+    memcpy(block + 4, &indices, 4);
+    return error;
+}
+
+void encode_bc1_colors( const float colors[16][3], uint8_t block[8] )
+{
+    float e0[3], e1[3];
+    axis_endpoints<3>(colors, e0, e1);
+
+    // rapproche les extremites pour tenir compte de la quantification
+    for(int c= 0; c < 3; c++)
+    {
+        float inset= (e0[c] - e1[c]) / 16;
+        e0[c]-= inset;
+        e1[c]+= inset;
+    }
+
+    float weights[16];
+    float error= bc1_try(colors, pack565(e0), pack565(e1), block, weights);
+
+    // ajuste les extremites sur les indices choisis
+    for(int iteration= 0; iteration < 2; iteration++)
+    {
+        if(!fit_endpoints<3>(colors, weights, e0, e1))
+            break;
+
+        uint8_t candidate[8];
+        float candidate_weights[16];
+        float candidate_error= bc1_try(colors, pack565(e0), pack565(e1), candidate, candidate_weights);
+        if(candidate_error >= error)
+            break;
+
+        error= candidate_error;
+        memcpy(block, candidate, 8);
+        memcpy(weights, candidate_weights, sizeof(weights));
+    }
+}
+
+
+// BC4
+void decode_bc4( const uint8_t block[8], uint8_t values[16] )
+{
+    int a0= block[0];
+    int a1= block[1];
+    int palette[8]= { a0, a1 };
+    if(a0 > a1)
+    {
+        for(int i= 2; i < 8; i++)
+            palette[i]= ((8 - i) * a0 + (i - 1) * a1) / 7;
+    }
+    else
+    {
+        for(int i= 2; i < 6; i++)
+            palette[i]= ((6 - i) * a0 + (i - 1) * a1) / 5;
+        palette[6]= 0;
+        palette[7]= 255;
+    }
+
+    uint64_t indices= 0;
+    memcpy(&indices, block + 2, 6);
+    for(int i= 0; i < 16; i++)
+        values[i]= uint8_t(palette[(indices >> (3*i)) & 7]);
+}
+
+
+// BC7 mode 6
+const int bc7_weights4[16]= { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// quantifie une extremite sur 7 bits par canal + 1 bit partage
+void bc7_quantize_endpoint( const float e[4], int q[4], int& pbit )
+{
+    float best_error= 1e30f;
+    for(int p= 0; p < 2; p++)
+    {
+        int candidate[4];
+        float error= 0;
+        for(int c= 0; c < 4; c++)
+        {
+            candidate[c]= clamp(int(std::lround((e[c] - p) / 2)), 0, 127);
+            float v= float(candidate[c] * 2 + p);
+            error+= (v - e[c]) * (v - e[c]);
+        }
+
+        if(error < best_error)
+        {
+            best_error= error;
+            pbit= p;
+            for(int c= 0; c < 4; c++)
+                q[c]= candidate[c];
+        }
+    }
+}
+
+struct BitWriter
+{
+    uint8_t *data;
+    int position;
+
+    void write( const uint32_t value, const int bits )
+    {
+        for(int i= 0; i < bits; i++, position++)
+            if((value >> i) & 1)
+                data[position >> 3]|= uint8_t(1 << (position & 7));
+    }
+};
+
+struct BitReader
+{
+    const uint8_t *data;
+    int position;
+
+    uint32_t read( const int bits )
+    {
+        uint32_t value= 0;
+        for(int i= 0; i < bits; i++, position++)
+            value|= uint32_t((data[position >> 3] >> (position & 7)) & 1) << i;
+        return value;
+    }
+};
+
+// construit le bloc avec les extremites e0 et e1, renvoie l'erreur et le poids de e0 de chaque pixel
+float bc7_try( const float colors[16][4], const float e0[4], const float e1[4], uint8_t block[16], float weights[16] )
+{
+    int q[2][4], pbits[2];
+    bc7_quantize_endpoint(e0, q[0], pbits[0]);
+    bc7_quantize_endpoint(e1, q[1], pbits[1]);
+
+    int endpoints[2][4];
+    for(int k= 0; k < 2; k++)
+    for(int c= 0; c < 4; c++)
+        endpoints[k][c]= (q[k][c] << 1) | pbits[k];
+
+    int palette[16][4];
+    for(int i= 0; i < 16; i++)
+    for(int c= 0; c < 4; c++)
+        palette[i][c]= ((64 - bc7_weights4[i]) * endpoints[0][c] + bc7_weights4[i] * endpoints[1][c] + 32) >> 6;
+
+    int indices[16];
+    float error= 0;
+    for(int i= 0; i < 16; i++)
+    {
+        float best_error= 1e30f;
+        for(int k= 0; k < 16; k++)
+        {
+            float e= 0;
+            for(int c= 0; c < 4; c++)
+                e+= (colors[i][c] - palette[k][c]) * (colors[i][c] - palette[k][c]);
+            if(e < best_error)
+            {
+                best_error= e;
+                indices[i]= k;
+            }
+        }
+        error+= best_error;
+    }
+
+    // le bit de poids fort de l'index du premier pixel est implicite et nul : echange les extremites si necessaire
+    if(indices[0] >= 8)
+    {
+        std::swap(q[0], q[1]);
+        std::swap(pbits[0], pbits[1]);
+        for(int i= 0; i < 16; i++)
+            indices[i]= 15 - indices[i];
+    }
+
+    for(int i= 0; i < 16; i++)
+        weights[i]= 1 - bc7_weights4[indices[i]] / 64.f;
+
+    memset(block, 0, 16);
+    BitWriter writer= { block, 0 };
+    writer.write(1 << 6, 7);
+    for(int c= 0; c < 4; c++)
+    {
+        writer.write(q[0][c], 7);
+        writer.write(q[1][c], 7);
+    }
+    writer.write(pbits[0], 1);
+    writer.write(pbits[1], 1);
+    writer.write(indices[0], 3);
+    for(int i= 1; i < 16; i++)
+        writer.write(indices[i], 4);
+    assert(writer.position == 128);
+
+    return error;
+}
+
+}   // namespace
+
+
+int bc_block_size( const BCFormat format )
+{
+    return format == BC_FORMAT_BC1 ? 8 : 16;
+}
+
+size_t bc_image_size( const BCFormat format, const int width, const int height )
+{
+    return size_t((width + 3) / 4) * size_t((height + 3) / 4) * bc_block_size(format);
+}
+
+void encode_bc1_block( const uint8_t pixels[16][4], uint8_t block[8] )
+{
+    float colors[16][3];
+    for(int i= 0; i < 16; i++)
+    for(int c= 0; c < 3; c++)
+        colors[i][c]= pixels[i][c];
+
+    encode_bc1_colors(colors, block);
+}
+
+void encode_bc4_block( const uint8_t values[16], uint8_t block[8] )
+{
+    int vmin= values[0];
+    int vmax= values[0];
+    for(int i= 1; i < 16; i++)
+    {
+        vmin= std::min(vmin, int(values[i]));
+        vmax= std::max(vmax, int(values[i]));
+    }
+
+    memset(block, 0, 8);
+    block[0]= uint8_t(vmax);
+    block[1]= uint8_t(vmin);
+    if(vmax == vmin)
+        // mode 6 valeurs, l'index 0 est la valeur
+        return;
+
+    // mode 8 valeurs : a0 > a1, index 0 : a0, index 1 : a1, index i : ((8-i) a0 + (i-1) a1) / 7
+    uint64_t indices= 0;
+    for(int i= 0; i < 16; i++)
+    {
+        int p= int(std::lround(float(values[i] - vmin) * 7 / float(vmax - vmin)));
+        int index= (p == 7) ? 0 : (p == 0) ? 1 : 8 - p;
+        indices|= uint64_t(index) << (3*i);
+    }
+    memcpy(block + 2, &indices, 6);
+}
+
+void encode_bc3_block( const uint8_t pixels[16][4], uint8_t block[16] )
+{
+    uint8_t alpha[16];
+    for(int i= 0; i < 16; i++)
+        alpha[i]= pixels[i][3];
+
+    encode_bc4_block(alpha, block);
+    encode_bc1_block(pixels, block + 8);
+}
+
+void encode_bc5_block( const uint8_t pixels[16][4], uint8_t block[16] )
+{
+    uint8_t red[16], green[16];
+    for(int i= 0; i < 16; i++)
+    {
+        red[i]= pixels[i][0];
+        green[i]= pixels[i][1];
+    }
+
+    encode_bc4_block(red, block);
+    encode_bc4_block(green, block + 8);
+}
+
+void encode_bc7_block( const uint8_t pixels[16][4], uint8_t block[16] )
+{
+    float colors[16][4];
+    for(int i= 0; i < 16; i++)
+    for(int c= 0; c < 4; c++)
+        colors[i][c]= pixels[i][c];
+
+    float e0[4], e1[4];
+    axis_endpoints<4>(colors, e0, e1);
+
+    float weights[16];
+    float error= bc7_try(colors, e0, e1, block, weights);
+
+    // ajuste les extremites sur les indices choisis
+    for(int iteration= 0; iteration < 2; iteration++)
+    {
+        if(!fit_endpoints<4>(colors, weights, e0, e1))
+            break;
+
+        uint8_t candidate[16];
+        float candidate_weights[16];
+        float candidate_error= bc7_try(colors, e0, e1, candidate, candidate_weights);
+        if(candidate_error >= error)
+            break;
+
+        error= candidate_error;
+        memcpy(block, candidate, 16);
+        memcpy(weights, candidate_weights, sizeof(weights));
+    }
+}
+
+void decode_bc_block( const BCFormat format, const uint8_t *block, uint8_t pixels[16][4] )
+{
+    if(format == BC_FORMAT_BC1 || format == BC_FORMAT_BC3)
+    {
+        const uint8_t *color= (format == BC_FORMAT_BC1) ? block : block + 8;
+        uint16_t c0= uint16_t(color[0] | (color[1] << 8));
+        uint16_t c1= uint16_t(color[2] | (color[3] << 8));
+
+        int palette[4][4];
+        bc1_palette(c0, c1, format == BC_FORMAT_BC3 || c0 > c1, palette);
+
+        uint32_t indices;
+        memcpy(&indices, color + 4, 4);
+        for(int i= 0; i < 16; i++)
+        for(int c= 0; c < 4; c++)
+            pixels[i][c]= uint8_t(palette[(indices >> (2*i)) & 3][c]);
+
+        if(format == BC_FORMAT_BC3)
+        {
+            uint8_t alpha[16];
+            decode_bc4(block, alpha);
+            for(int i= 0; i < 16; i++)
+                pixels[i][3]= alpha[i];
+        }
+    }
+    else if(format == BC_FORMAT_BC5)
+    {
+        uint8_t red[16], green[16];
+        decode_bc4(block, red);
+        decode_bc4(block + 8, green);
+        for(int i= 0; i < 16; i++)
+        {
+            pixels[i][0]= red[i];
+            pixels[i][1]= green[i];
+            pixels[i][2]= 0;
+            pixels[i][3]= 255;
+        }
+    }
+    else
+    {
+        BitReader reader= { block, 0 };
+        if(reader.read(7) != (1 << 6))
+        {
+            // seul le mode 6 est produit par encode_bc7_block()
+            memset(pixels, 0, 16 * 4);
+            return;
+        }
+
+        int endpoints[2][4];
+        for(int c= 0; c < 4; c++)
+        {
+            endpoints[0][c]= int(reader.read(7)) << 1;
+            endpoints[1][c]= int(reader.read(7)) << 1;
+        }
+        int p0= int(reader.read(1));
+        int p1= int(reader.read(1));
+        for(int c= 0; c < 4; c++)
+        {
+            endpoints[0][c]|= p0;
+            endpoints[1][c]|= p1;
+        }
+
+        for(int i= 0; i < 16; i++)
+        {
+            int index= int(reader.read(i == 0 ? 3 : 4));
+            for(int c= 0; c < 4; c++)
+                pixels[i][c]= uint8_t(((64 - bc7_weights4[index]) * endpoints[0][c] + bc7_weights4[index] * endpoints[1][c] + 32) >> 6);
+        }
+    }
+}
+
+std::vector<uint8_t> encode_bc_image( const BCFormat format, const uint8_t *rgba, const int width, const int height )
+{
+    const int blocks_x= (width + 3) / 4;
+    const int blocks_y= (height + 3) / 4;
+    const int block_size= bc_block_size(format);
+    std::vector<uint8_t> blocks(size_t(blocks_x) * blocks_y * block_size);
+
+#pragma omp parallel for schedule(dynamic, 1)
+    for(int by= 0; by < blocks_y; by++)
+    for(int bx= 0; bx < blocks_x; bx++)
+    {
+        // repete les pixels du bord pour completer les blocs
+        uint8_t pixels[16][4];
+        for(int i= 0; i < 16; i++)
+        {
+            int x= std::min(bx * 4 + (i & 3), width - 1);
+            int y= std::min(by * 4 + (i >> 2), height - 1);
+            memcpy(pixels[i], rgba + (size_t(y) * width + x) * 4, 4);
+        }
+
+        uint8_t *block= blocks.data() + (size_t(by) * blocks_x + bx) * block_size;
+        switch(format)
+        {
+            case BC_FORMAT_BC1: encode_bc1_block(pixels, block); break;
+            case BC_FORMAT_BC3: encode_bc3_block(pixels, block); break;
+            case BC_FORMAT_BC5: encode_bc5_block(pixels, block); break;
+            case BC_FORMAT_BC7: encode_bc7_block(pixels, block); break;
+        }
+    }
+
+    return blocks;
+}
+
+std::vector<uint8_t> decode_bc_image( const BCFormat format, const uint8_t *blocks, const int width, const int height )
+{
+    const int blocks_x= (width + 3) / 4;
+    const int blocks_y= (height + 3) / 4;
+    const int block_size= bc_block_size(format);
+    std::vector<uint8_t> rgba(size_t(width) * height * 4);
+
+#pragma omp parallel for schedule(static)
+    for(int by= 0; by < blocks_y; by++)
+    for(int bx= 0; bx < blocks_x; bx++)
+    {
+        uint8_t pixels[16][4];
+        decode_bc_block(format, blocks + (size_t(by) * blocks_x + bx) * block_size, pixels);
+
+        for(int i= 0; i < 16; i++)
+        {
+            int x= bx * 4 + (i & 3);
+            int y= by * 4 + (i >> 2);
+            if(x < width && y < height)
+                memcpy(rgba.data() + (size_t(y) * width + x) * 4, pixels[i], 4);
+        }
+    }
+
+    return rgba;
+}
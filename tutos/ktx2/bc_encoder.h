@@ -0,0 +1,54 @@
+#ifndef _BC_ENCODER_H
+#define _BC_ENCODER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+/*! \file
+compression des textures par blocs de 4x4 pixels, formats BC1, BC3, BC5 et BC7 (cf GL_EXT_texture_compression_s3tc, GL_ARB_texture_compression_rgtc, GL_ARB_texture_compression_bptc).
+
+    - BC1 : couleur rgb, 8 octets par bloc, 2 couleurs 565 et 4 couleurs interpolees,
+    - BC3 : couleur rgb (BC1) + alpha (BC4), 16 octets par bloc,
+    - BC5 : 2 canaux independants (BC4 + BC4), 16 octets par bloc, pour les normal maps : x et y, z est reconstruit par le shader,
+    - BC7 : couleur rgba, 16 octets par bloc, uniquement le mode 6 : 2 couleurs rgba 7777 + 1 bit partage et 16 couleurs interpolees.
+
+les extremites sont estimees par l'axe principal des couleurs du bloc, puis ajustees par moindres carres sur les indices choisis.
+les pixels sont des rgba 8 bits, les canaux ne sont pas convertis : une texture srgb est compressee avec ses valeurs srgb, comme le fait la carte graphique.
+*/
+
+//! formats de compression.
+enum BCFormat
+{
+    BC_FORMAT_BC1= 0,
+    BC_FORMAT_BC3,
+    BC_FORMAT_BC5,
+    BC_FORMAT_BC7
+};
+
+//! taille d'un bloc de 4x4 pixels, en octets.
+int bc_block_size( const BCFormat format );
+//! taille d'une image de width x height pixels compressee, en octets.
+size_t bc_image_size( const BCFormat format, const int width, const int height );
+
+//! compresse un bloc de 4x4 pixels rgba 8 bits, ranges par lignes.
+void encode_bc1_block( const uint8_t pixels[16][4], uint8_t block[8] );
+//! compresse un seul canal d'un bloc de 4x4 pixels.
+void encode_bc4_block( const uint8_t values[16], uint8_t block[8] );
+void encode_bc3_block( const uint8_t pixels[16][4], uint8_t block[16] );
+void encode_bc5_block( const uint8_t pixels[16][4], uint8_t block[16] );
+void encode_bc7_block( const uint8_t pixels[16][4], uint8_t block[16] );
+
+//! decompresse un bloc, renvoie des pixels rgba 8 bits. les canaux absents du format sont 0 (b pour BC5) ou 255 (alpha).
+void decode_bc_block( const BCFormat format, const uint8_t *block, uint8_t pixels[16][4] );
+
+/*! compresse une image rgba 8 bits de width x height pixels, width * height * 4 octets. les blocs du bord sont completes en repetant les pixels du bord.
+    les lignes de blocs sont compressees en parallele.
+ */
+std::vector<uint8_t> encode_bc_image( const BCFormat format, const uint8_t *rgba, const int width, const int height );
+
+//! decompresse une image, renvoie width * height * 4 octets.
+std::vector<uint8_t> decode_bc_image( const BCFormat format, const uint8_t *blocks, const int width, const int height );
+
+#endif
@@ -1,110 +1,200 @@
 
+#include <cassert>
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
 #include <vector>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "glcore.h"
-#include "window.h"
+#include "files.h"
 
-#include "transcoder/basisu_transcoder.h"
 #include "ktx2.h"
 
-#include "image.h"
-#include "image_io.h"
 
-unsigned read_ktx2_texture( const int unit, const char *filename )
+bool transcode_ktx2( const void *data, const size_t size, const basist::transcoder_texture_format format, KTX2TranscodedTexture& texture, const int threads )
 {
-    FILE *in= fopen(filename, "rb");
-    if(in == nullptr)
+    assert(basist::basisu_transcoder_supports_ktx2() == true);
+    assert(basist::basisu_transcoder_supports_ktx2_zstd() == true);
+
+    // initialise les tables du transcodeur une seule fois, meme si plusieurs threads chargent des textures
+    static std::once_flag init_flag;
+    std::call_once(init_flag, basist::basisu_transcoder_init);
+
+    basist::ktx2_transcoder transcoder;
+    if(!transcoder.init(data, uint32_t(size)) || !transcoder.start_transcoding())
+        return false;
+
+    KTX2TranscodedTexture result;
+    result.width= int(transcoder.get_width());
+    result.height= int(transcoder.get_height());
+    result.levels= int(std::max(1u, transcoder.get_levels()));
+    result.layers= int(std::max(1u, transcoder.get_layers()));
+    result.faces= int(transcoder.get_faces());
+    result.srgb= (transcoder.get_dfd_transfer_func() == basist::KTX2_KHR_DF_TRANSFER_SRGB);
+    result.format= format;
+
+    // position de chaque image dans le buffer
+    bool uncompressed= basist::basis_transcoder_format_is_uncompressed(format);
+    size_t unit_size= basist::basis_get_bytes_per_block_or_pixel(format);
+    size_t offset= 0;
+    for(int level= 0; level < result.levels; level++)
+    for(int layer= 0; layer < result.layers; layer++)
+    for(int face= 0; face < result.faces; face++)
     {
-        printf("[error] loading ktx2 texture '%s'...\n", filename);
-        return 0;
+        basist::ktx2_image_level_info info;
+        if(!transcoder.get_image_level_info(info, level, layer, face))
+            return false;
+
+        size_t units= uncompressed ? size_t(info.m_orig_width) * info.m_orig_height : size_t(info.m_total_blocks);
+        result.images.push_back( KTX2TranscodedImage{ level, layer, face, int(info.m_orig_width), int(info.m_orig_height), offset, units * unit_size } );
+        offset+= units * unit_size;
     }
-    
-#if 0
-    size_t offset= 0;
-    size_t size= 1024*64;
-    std::vector<char> file(size);
-    while(true)
+    result.data.resize(offset);
+
+    // repartit les images entre les threads. chaque appel a transcode_image_level() decompresse (zstd) le niveau complet d'un fichier uastc :
+    // toutes les images d'un niveau sont transcodees par le meme thread. les images d'une video etc1s doivent etre transcodees dans l'ordre.
+    int images_per_task= 1;
+    if((transcoder.is_uastc() && transcoder.get_header().m_supercompression_scheme == basist::KTX2_SS_ZSTANDARD) || transcoder.is_video())
+        images_per_task= result.layers * result.faces;
+
+    int task_count= int(result.images.size()) / images_per_task;
+    int thread_count= threads;
+#ifdef _OPENMP
+    if(thread_count <= 0)
+        thread_count= omp_get_max_threads();
+#endif
+    thread_count= std::max(1, std::min(thread_count, task_count));
+
+    bool code= true;
+#pragma omp parallel num_threads(thread_count)
+    {
+        // etat du transcodeur propre a chaque thread
+        basist::ktx2_transcoder_state state;
+        state.clear();
+
+        // les taches sont ordonnees du niveau le plus grand au plus petit
+    #pragma omp for schedule(dynamic, 1)
+        for(int task= 0; task < task_count; task++)
+        for(int i= task * images_per_task; i < (task + 1) * images_per_task; i++)
+        {
+            const KTX2TranscodedImage& image= result.images[i];
+            if(!transcoder.transcode_image_level(image.level, image.layer, image.face,
+                result.data.data() + image.offset, uint32_t(image.size / unit_size), format,
+                0, 0, 0, -1, -1, &state))
+            {
+            #pragma omp atomic write
+                code= false;
+            }
+        }
+    }
+
+    if(!code)
+        return false;
+
+    texture= std::move(result);
+    return true;
+}
+
+bool transcode_ktx2( const char *filename, const basist::transcoder_texture_format format, KTX2TranscodedTexture& texture, const int threads )
+{
+    MappedFile file= map_file(filename);
+    if(file.data == nullptr)
     {
-        printf("[read buffer] offset %lu size %lu\n", offset, size);
-        size_t n= fread(file.data() + offset, 1, size - offset, in);
-        if(n == 0 || n < size - offset)
-            break;
-        
-        offset+= n;
-        size+= n;
-        file.resize(size);
+        printf("[error] loading ktx2 texture '%s'...\n", filename);
+        return false;
     }
-#else
-    fseek(in, 0, SEEK_END);
-    size_t size= ftell(in);
-    
-    fseek(in, 0, SEEK_SET);
-    
-    std::vector<char> file(size);
-    if(fread(file.data(), 1, size, in) != size)
+
+    bool code= transcode_ktx2(file.data, file.size, format, texture, threads);
+    unmap_file(file);
+
+    if(!code)
+        printf("[error] transcoding ktx2 texture '%s'...\n", filename);
+    return code;
+}
+
+unsigned read_ktx2_texture( const int unit, const char *filename )
+{
+    // format transcode : ASTC si la carte graphique le supporte, BC7 sinon, ou rgba non compresse
+    basist::transcoder_texture_format format= basist::transcoder_texture_format::cTFRGBA32;
+    if(GLEW_KHR_texture_compression_astc_ldr)
+        format= basist::transcoder_texture_format::cTFASTC_4x4_RGBA;
+    else if(GLEW_ARB_texture_compression_bptc)
+        format= basist::transcoder_texture_format::cTFBC7_RGBA;
+
+    KTX2TranscodedTexture texture;
+    if(!transcode_ktx2(filename, format, texture))
+        return 0;
+
+    printf("  %dx%d %d levels, %d layers, %d faces\n", texture.width, texture.height, texture.levels, texture.layers, texture.faces);
+
+    GLenum internal_format= texture.srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+    if(format == basist::transcoder_texture_format::cTFASTC_4x4_RGBA)
+        internal_format= texture.srgb ? GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR : GL_COMPRESSED_RGBA_ASTC_4x4_KHR;
+    else if(format == basist::transcoder_texture_format::cTFBC7_RGBA)
+        internal_format= texture.srgb ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM : GL_COMPRESSED_RGBA_BPTC_UNORM;
+    bool compressed= (format != basist::transcoder_texture_format::cTFRGBA32);
+
+    GLenum target= GL_TEXTURE_2D;
+    if(texture.faces == 6)
+        target= GL_TEXTURE_CUBE_MAP;
+    else if(texture.layers > 1)
+        target= GL_TEXTURE_2D_ARRAY;
+
+    if(texture.faces == 6 && texture.layers > 1)
     {
-        fclose(in);
-        printf("[error] reading '%s'...\n", filename);
+        printf("[error] ktx2 cubemap arrays are not supported '%s'...\n", filename);
         return 0;
     }
-#endif
-    
-    fclose(in);
-    
-    assert(basist::basisu_transcoder_supports_ktx2() == true);
-    assert(basist::basisu_transcoder_supports_ktx2_zstd() == true);
-    
-    basist::basisu_transcoder_init();
-    
-    basist::ktx2_transcoder transcoder;
-    transcoder.init(file.data(), file.size());
-    
-    printf("  %ux%u %u levels\n", transcoder.get_width(), transcoder.get_height(), transcoder.get_levels());
-    printf("  alpha %u, channels %u\n", transcoder.get_has_alpha(), transcoder.get_dfd_total_samples());
-    
-    printf("  mode etc1s %d, uastc %d\n", transcoder.is_etc1s(), transcoder.is_uastc());
-    basist::transcoder_texture_format format= basist::transcoder_texture_format::cTFASTC_4x4_RGBA;
-    
-    transcoder.start_transcoding();
-    
-    GLuint texture= 0;
-    glGenTextures(1, &texture);
+
+    GLuint id= 0;
+    glGenTextures(1, &id);
     glActiveTexture(GL_TEXTURE0 + unit);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    
-    for(unsigned level= 0; level <  transcoder.get_levels(); level++)
+    glBindTexture(target, id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    // les images d'un niveau sont contigues dans le buffer : toutes les couches d'un niveau sont transferees ensemble
+    int images_per_level= texture.layers * texture.faces;
+    for(int level= 0; level < texture.levels; level++)
     {
-        basist::ktx2_image_level_info level_info;
-        transcoder.get_image_level_info(level_info, level, 0, 0);
-        
-        printf("level %d: %u 4x4 blocks, %u bytes/block\n", level, level_info.m_total_blocks, basist::basis_get_bytes_per_block_or_pixel(format));
-        
-        // alloue un buffer pour decompresser la texture
-        std::vector<char> tmp(level_info.m_total_blocks * basist::basis_get_bytes_per_block_or_pixel(format));
-        
-        bool code= transcoder.transcode_image_level(level, /* layer */ 0, /* face */ 0, tmp.data(), tmp.size(), format);
-        assert(code);
-        
-        // todo srgb ou linear !
-        
-        // initialise la texture openGL
-        glCompressedTexImage2D(GL_TEXTURE_2D, level, GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR,
-            level_info.m_width, level_info.m_height, 0, tmp.size(), tmp.data());
-        
-        //~ {
-            //~ // export
-            //~ Image image(level_info.m_width, level_info.m_height);
-            //~ for(int y= 0; y < image.height(); y++)
-            //~ for(int x= 0; x < image.width(); x++)
-                //~ image(x, y)= Color(tmp[y/4 * level_info.m_num_blocks_x*16 + x/4*16]);
-            
-            //~ char exportname[1024];
-            //~ sprintf(exportname, "level%02d.png", level);
-            //~ write_image(image, exportname);
-        //~ }
+        const KTX2TranscodedImage& first= texture.images[level * images_per_level];
+        const uint8_t *data= texture.data.data() + first.offset;
+
+        if(target == GL_TEXTURE_2D_ARRAY)
+        {
+            size_t size= 0;
+            for(int i= 0; i < images_per_level; i++)
+                size+= texture.images[level * images_per_level + i].size;
+
+            if(compressed)
+                glCompressedTexImage3D(target, level, internal_format, first.width, first.height, texture.layers, 0, GLsizei(size), data);
+            else
+                glTexImage3D(target, level, internal_format, first.width, first.height, texture.layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+        }
+        else
+        {
+            for(int face= 0; face < texture.faces; face++)
+            {
+                const KTX2TranscodedImage& image= texture.images[level * images_per_level + face];
+                GLenum image_target= (target == GL_TEXTURE_CUBE_MAP) ? GLenum(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face) : target;
+
+                if(compressed)
+                    glCompressedTexImage2D(image_target, level, internal_format, image.width, image.height, 0, GLsizei(image.size), texture.data.data() + image.offset);
+                else
+                    glTexImage2D(image_target, level, internal_format, image.width, image.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, texture.data.data() + image.offset);
+            }
+        }
     }
-    
-    return texture;
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, texture.levels -1);
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, texture.levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    return id;
 }
 
 #if 0
@@ -113,12 +203,10 @@ int main( int argc, char **argv )
     const char *filename= "ivy.ktx";
     if(argc > 1)
         filename=argv[1];
-    
-    basist::basisu_transcoder_init();
-    
+
     Window w= create_window(1024,640, 4,3);
     Context c= create_context(w);
-    
+
     unsigned texture= read_ktx2_texture(0, filename);
     return 0;
 }
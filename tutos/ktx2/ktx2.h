@@ -2,6 +2,65 @@
 #ifndef _KTX2_TEXTURE_H
 #define _KTX2_TEXTURE_H
 
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "transcoder/basisu_transcoder.h"
+
+
+/*! \file
+textures ktx2 basis universal : etc1s ou uastc, supercompression zstd, transcodees dans un format compresse supporte par la carte graphique.
+
+transcode_ktx2() ne necessite pas de contexte openGL : les niveaux de mipmap, les couches et les faces sont decompresses et transcodes en parallele,
+directement dans un seul buffer, pret a etre copie dans la texture.
+\code
+KTX2TranscodedTexture texture;
+if(transcode_ktx2("data/ivy.ktx2", basist::transcoder_texture_format::cTFBC7_RGBA, texture))
+    for(const KTX2TranscodedImage& image : texture.images)
+        // image.size octets dans texture.data, a partir de image.offset
+\endcode
+*/
+
+//! une image transcodee : un niveau de mipmap d'une couche et d'une face.
+struct KTX2TranscodedImage
+{
+    int level;
+    int layer;
+    int face;
+    int width;
+    int height;
+    size_t offset;      //!< position des blocs dans KTX2TranscodedTexture::data.
+    size_t size;        //!< taille des blocs, en octets.
+};
+
+//! texture transcodee, sans contexte openGL.
+struct KTX2TranscodedTexture
+{
+    KTX2TranscodedTexture( ) : width(0), height(0), levels(0), layers(0), faces(0), srgb(false), format(basist::transcoder_texture_format::cTFRGBA32), data(), images() {}
+
+    int width;
+    int height;
+    int levels;
+    int layers;         //!< 1 pour une texture 2d.
+    int faces;          //!< 6 pour une cubemap, 1 sinon.
+    bool srgb;
+    basist::transcoder_texture_format format;
+
+    std::vector<uint8_t> data;                  //!< blocs de toutes les images.
+    std::vector<KTX2TranscodedImage> images;    //!< images rangees par niveau, puis par couche, puis par face, contigues dans data.
+};
+
+/*! decompresse et transcode toutes les images d'un fichier ktx2 deja charge, en parallele.
+    \param threads nombre de threads, 0 pour utiliser tous les coeurs, cf omp_get_max_threads().
+    renvoie false en cas d'erreur.
+ */
+bool transcode_ktx2( const void *data, const size_t size, const basist::transcoder_texture_format format, KTX2TranscodedTexture& texture, const int threads= 0 );
+
+//! charge un fichier ktx2 et transcode toutes ses images en parallele, cf transcode_ktx2( data, size, ... ).
+bool transcode_ktx2( const char *filename, const basist::transcoder_texture_format format, KTX2TranscodedTexture& texture, const int threads= 0 );
+
+//! charge un fichier ktx2 et cree une texture 2d, 2d array ou cubemap, transcodee en ASTC, BC7 ou rgba selon les extensions openGL disponibles. a detruire avec glDeleteTextures( ).
 unsigned read_ktx2_texture( const int unit, const char *filename );
 
 #endif
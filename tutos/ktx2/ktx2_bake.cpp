@@ -0,0 +1,602 @@
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#include "files.h"
+#include "zstd/zstd.h"
+#include "ktx2_bake.h"
+
+
+namespace {
+
+// format du fichier ktx2, cf https://registry.khronos.org/KTX/specs/2.0/ktxspec.v2.html
+// identifiant, entete, index des niveaux, descripteur de format (dfd), metadonnees (kvd), puis les niveaux, du plus petit au plus grand.
+const uint8_t ktx2_identifier[12]= { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+struct ktx2_header
+{
+    uint8_t identifier[12];
+    uint32_t vk_format;
+    uint32_t type_size;
+    uint32_t pixel_width;
+    uint32_t pixel_height;
+    uint32_t pixel_depth;
+    uint32_t layer_count;
+    uint32_t face_count;
+    uint32_t level_count;
+    uint32_t supercompression_scheme;
+
+    uint32_t dfd_offset;
+    uint32_t dfd_length;
+    uint32_t kvd_offset;
+    uint32_t kvd_length;
+    uint64_t sgd_offset;
+    uint64_t sgd_length;
+};
+
+struct ktx2_level_index
+{
+    uint64_t offset;
+    uint64_t length;
+    uint64_t uncompressed_length;
+};
+
+static_assert(sizeof(ktx2_header) == 80, "ktx2 header layout");
+static_assert(sizeof(ktx2_level_index) == 24, "ktx2 level index layout");
+
+const uint32_t KTX2_SUPERCOMPRESSION_NONE= 0;
+const uint32_t KTX2_SUPERCOMPRESSION_ZSTD= 2;
+
+const char *gkit_source_key= "gKitSource";
+
+// VkFormat des formats BC, unorm / srgb
+uint32_t vk_format( const BCFormat format, const bool srgb )
+{
+    switch(format)
+    {
+        case BC_FORMAT_BC1: return srgb ? 132 : 131;    // VK_FORMAT_BC1_RGB_SRGB_BLOCK / UNORM
+        case BC_FORMAT_BC3: return srgb ? 138 : 137;    // VK_FORMAT_BC3_SRGB_BLOCK / UNORM
+        case BC_FORMAT_BC5: return 141;                 // VK_FORMAT_BC5_UNORM_BLOCK
+        case BC_FORMAT_BC7: return srgb ? 146 : 145;    // VK_FORMAT_BC7_SRGB_BLOCK / UNORM
+    }
+    return 0;
+}
+
+bool bc_format( const uint32_t vk_format, BCFormat& format, bool& srgb )
+{
+    switch(vk_format)
+    {
+        case 131: format= BC_FORMAT_BC1; srgb= false; return true;
+        case 132: format= BC_FORMAT_BC1; srgb= true; return true;
+        case 137: format= BC_FORMAT_BC3; srgb= false; return true;
+        case 138: format= BC_FORMAT_BC3; srgb= true; return true;
+        case 141: format= BC_FORMAT_BC5; srgb= false; return true;
+        case 145: format= BC_FORMAT_BC7; srgb= false; return true;
+        case 146: format= BC_FORMAT_BC7; srgb= true; return true;
+    }
+    return false;
+}
+
+void append_u32( std::vector<uint8_t>& data, const uint32_t value )
+{
+    data.insert(data.end(), (const uint8_t *) &value, (const uint8_t *) &value + sizeof(value));
+}
+
+// descripteur de format : un bloc de base, un echantillon par partie du bloc compresse.
+std::vector<uint8_t> make_dfd( const BCFormat format, const bool srgb )
+{
+    struct Sample { uint32_t offset; uint32_t bits; uint32_t channel; };
+    Sample samples[2]= { };
+    int sample_count= 1;
+    uint32_t model= 0;
+    switch(format)
+    {
+        // KHR_DF_MODEL_BC1A, couleur
+        case BC_FORMAT_BC1: model= 128; samples[0]= {0, 64, 0}; break;
+        // KHR_DF_MODEL_BC3, alpha puis couleur
+        case BC_FORMAT_BC3: model= 130; samples[0]= {0, 64, 15}; samples[1]= {64, 64, 0}; sample_count= 2; break;
+        // KHR_DF_MODEL_BC5, rouge puis vert
+        case BC_FORMAT_BC5: model= 132; samples[0]= {0, 64, 0}; samples[1]= {64, 64, 1}; sample_count= 2; break;
+        // KHR_DF_MODEL_BC7, couleur
+        case BC_FORMAT_BC7: model= 134; samples[0]= {0, 128, 0}; break;
+    }
+
+    uint32_t block_size= 24 + 16 * uint32_t(sample_count);
+
+    std::vector<uint8_t> dfd;
+    append_u32(dfd, 4 + block_size);
+    append_u32(dfd, 0);                         // vendor khronos, descripteur de base
+    append_u32(dfd, 2 | (block_size << 16));    // version 2
+    // modele, primaires bt709, transfert lineaire ou srgb, alpha non premultiplie
+    append_u32(dfd, model | (1u << 8) | ((srgb ? 2u : 1u) << 16));
+    append_u32(dfd, 3 | (3 << 8));             // blocs de 4x4 pixels
+    append_u32(dfd, 0);                         // bytesPlane : 0 pour un fichier supercompresse
+    append_u32(dfd, 0);
+    for(int i= 0; i < sample_count; i++)
+    {
+        const Sample& sample= samples[i];
+        append_u32(dfd, sample.offset | ((sample.bits - 1) << 16) | (sample.channel << 24));
+        append_u32(dfd, 0);                     // position
+        append_u32(dfd, 0);                     // lower
+        append_u32(dfd, 0xFFFFFFFFu);           // upper
+    }
+
+    return dfd;
+}
+
+void append_key_value( std::vector<uint8_t>& kvd, const char *key, const std::string& value )
+{
+    uint32_t length= uint32_t(strlen(key) + 1 + value.size() + 1);
+    append_u32(kvd, length);
+    kvd.insert(kvd.end(), key, key + strlen(key) + 1);
+    kvd.insert(kvd.end(), value.c_str(), value.c_str() + value.size() + 1);
+    while(kvd.size() % 4)
+        kvd.push_back(0);
+}
+
+
+// filtrage des mipmaps
+float srgb_to_linear( const float x )
+{
+    return x <= 0.04045f ? x / 12.92f : std::pow((x + 0.055f) / 1.055f, 2.4f);
+}
+
+float linear_to_srgb( const float x )
+{
+    return x <= 0.0031308f ? x * 12.92f : 1.055f * std::pow(x, 1 / 2.4f) - 0.055f;
+}
+
+uint8_t quantize( const float x )
+{
+    return uint8_t(std::lround(std::min(std::max(x, 0.f), 1.f) * 255));
+}
+
+// pixels source couverts par un pixel du niveau suivant et leur contribution : surface couverte.
+// un niveau de dimension impaire 2n+1 est reduit a n pixels, chaque pixel couvre jusqu'a 4 pixels source, le premier et le dernier partiellement.
+struct Footprint
+{
+    int first;
+    int count;
+    float weights[4];
+};
+
+std::vector<Footprint> footprints( const int source_size, const int size )
+{
+    std::vector<Footprint> footprints(size);
+    float scale= float(source_size) / float(size);
+    for(int i= 0; i < size; i++)
+    {
+        float a= i * scale;
+        float b= (i + 1) * scale;
+        Footprint& footprint= footprints[i];
+        footprint.first= int(a);
+        footprint.count= 0;
+        for(int j= footprint.first; j < source_size && j < b && footprint.count < 4; j++)
+            footprint.weights[footprint.count++]= (std::min(b, float(j + 1)) - std::max(a, float(j))) / scale;
+    }
+
+    return footprints;
+}
+
+// niveau de mipmap non quantifie, rgba, dans l'espace de filtrage : lumiere lineaire ou normales
+struct FloatImage
+{
+    int width;
+    int height;
+    std::vector<float> pixels;
+};
+
+FloatImage downsample( const FloatImage& image, const KTX2Usage usage, const bool alpha )
+{
+    FloatImage level;
+    level.width= std::max(1, image.width / 2);
+    level.height= std::max(1, image.height / 2);
+    level.pixels.resize(size_t(level.width) * level.height * 4);
+
+    std::vector<Footprint> fx= footprints(image.width, level.width);
+    std::vector<Footprint> fy= footprints(image.height, level.height);
+
+#pragma omp parallel for schedule(static) if(size_t(level.width) * level.height >= 64*64)
+    for(int y= 0; y < level.height; y++)
+    for(int x= 0; x < level.width; x++)
+    {
+        float sum[4]= { };
+        float alpha_sum= 0;
+        for(int j= 0; j < fy[y].count; j++)
+        for(int i= 0; i < fx[x].count; i++)
+        {
+            const float *p= image.pixels.data() + (size_t(fy[y].first + j) * image.width + fx[x].first + i) * 4;
+            float w= fx[x].weights[i] * fy[y].weights[j];
+            // ponderation des couleurs par alpha : les pixels transparents ne deteignent pas sur leurs voisins
+            float wc= alpha ? w * p[3] : w;
+            for(int c= 0; c < 3; c++)
+                sum[c]+= wc * p[c];
+            alpha_sum+= wc;
+            sum[3]+= w * p[3];
+        }
+
+        float *q= level.pixels.data() + (size_t(y) * level.width + x) * 4;
+        for(int c= 0; c < 3; c++)
+            q[c]= alpha_sum > 0 ? sum[c] / alpha_sum : 0;
+        q[3]= sum[3];
+
+        if(usage == KTX2_USAGE_NORMAL_MAP)
+        {
+            float length= std::sqrt(q[0]*q[0] + q[1]*q[1] + q[2]*q[2]);
+            if(length > 0)
+                for(int c= 0; c < 3; c++)
+                    q[c]/= length;
+            else
+            {
+                q[0]= 0; q[1]= 0; q[2]= 1;
+            }
+        }
+    }
+
+    return level;
+}
+
+std::vector<uint8_t> quantize_level( const FloatImage& image, const KTX2Usage usage )
+{
+    std::vector<uint8_t> rgba(image.pixels.size());
+    for(size_t i= 0; i < image.pixels.size(); i+= 4)
+    {
+        for(int c= 0; c < 3; c++)
+        {
+            float v= image.pixels[i + c];
+            if(usage == KTX2_USAGE_COLOR_SRGB)
+                v= linear_to_srgb(v);
+            else if(usage == KTX2_USAGE_NORMAL_MAP)
+                v= v * 0.5f + 0.5f;
+            rgba[i + c]= quantize(v);
+        }
+        rgba[i + 3]= quantize(image.pixels[i + 3]);
+    }
+
+    return rgba;
+}
+
+}   // namespace
+
+
+size_t KTX2Texture::size( ) const
+{
+    size_t n= 0;
+    for(const KTX2Level& level : levels)
+        n+= level.data.size();
+    return n;
+}
+
+BCFormat ktx2_format( const KTX2Usage usage, const bool alpha, const bool bc7 )
+{
+    if(usage == KTX2_USAGE_NORMAL_MAP)
+        return BC_FORMAT_BC5;
+    if(bc7)
+        return BC_FORMAT_BC7;
+    return alpha ? BC_FORMAT_BC3 : BC_FORMAT_BC1;
+}
+
+size_t rgba8_mipmapped_size( const int width, const int height )
+{
+    size_t n= 0;
+    int w= width;
+    int h= height;
+    while(true)
+    {
+        n+= size_t(w) * h * 4;
+        if(w == 1 && h == 1)
+            break;
+        w= std::max(1, w / 2);
+        h= std::max(1, h / 2);
+    }
+    return n;
+}
+
+KTX2Texture bake_ktx2_texture( const uint8_t *pixels, const int width, const int height, const int channels, const KTX2Usage usage, const bool bc7 )
+{
+    // rgba 8 bits, les images en niveaux de gris sont repetees sur les 3 canaux
+    std::vector<uint8_t> rgba(size_t(width) * height * 4);
+    bool alpha= false;
+    for(size_t i= 0; i < size_t(width) * height; i++)
+    {
+        const uint8_t *p= pixels + i * channels;
+        uint8_t *q= rgba.data() + i * 4;
+        if(channels < 3)
+        {
+            q[0]= q[1]= q[2]= p[0];
+            q[3]= (channels == 2) ? p[1] : 255;
+        }
+        else
+        {
+            q[0]= p[0]; q[1]= p[1]; q[2]= p[2];
+            q[3]= (channels == 4) ? p[3] : 255;
+        }
+
+        if(q[3] < 255)
+            alpha= true;
+    }
+
+    KTX2Texture texture;
+    texture.width= width;
+    texture.height= height;
+    texture.format= ktx2_format(usage, alpha, bc7);
+    texture.srgb= (usage == KTX2_USAGE_COLOR_SRGB);
+
+    bool weighted= alpha && usage != KTX2_USAGE_NORMAL_MAP;
+
+    FloatImage image;
+    image.width= width;
+    image.height= height;
+    image.pixels.resize(rgba.size());
+    float srgb_table[256];
+    for(int i= 0; i < 256; i++)
+        srgb_table[i]= srgb_to_linear(i / 255.f);
+
+    for(size_t i= 0; i < rgba.size(); i+= 4)
+    {
+        for(int c= 0; c < 3; c++)
+        {
+            if(usage == KTX2_USAGE_COLOR_SRGB)
+                image.pixels[i + c]= srgb_table[rgba[i + c]];
+            else if(usage == KTX2_USAGE_NORMAL_MAP)
+                image.pixels[i + c]= rgba[i + c] / 255.f * 2 - 1;
+            else
+                image.pixels[i + c]= rgba[i + c] / 255.f;
+        }
+        image.pixels[i + 3]= rgba[i + 3] / 255.f;
+    }
+
+    // niveau 0 : les pixels de l'image, les autres niveaux sont filtres a partir du niveau precedent
+    texture.levels.push_back( KTX2Level{ width, height, encode_bc_image(texture.format, rgba.data(), width, height) } );
+    while(image.width > 1 || image.height > 1)
+    {
+        image= downsample(image, usage, weighted);
+
+        std::vector<uint8_t> level= quantize_level(image, usage);
+        texture.levels.push_back( KTX2Level{ image.width, image.height, encode_bc_image(texture.format, level.data(), image.width, image.height) } );
+    }
+
+    return texture;
+}
+
+
+bool write_ktx2( const char *filename, const KTX2Texture& texture, const size_t source_timestamp, const KTX2Usage usage, const int zstd_level )
+{
+    const int level_count= int(texture.levels.size());
+    if(level_count == 0)
+        return false;
+
+    // compresse les niveaux en parallele
+    std::vector<std::vector<uint8_t>> compressed(level_count);
+    bool code= true;
+#pragma omp parallel for schedule(dynamic, 1)
+    for(int i= 0; i < level_count; i++)
+    {
+        const std::vector<uint8_t>& data= texture.levels[i].data;
+        compressed[i].resize(ZSTD_compressBound(data.size()));
+        size_t size= ZSTD_compress(compressed[i].data(), compressed[i].size(), data.data(), data.size(), zstd_level);
+        if(ZSTD_isError(size))
+        {
+        #pragma omp critical
+            code= false;
+            size= 0;
+        }
+        compressed[i].resize(size);
+    }
+    if(!code)
+    {
+        printf("[error] compressing ktx2 '%s'...\n", filename);
+        return false;
+    }
+
+    std::vector<uint8_t> dfd= make_dfd(texture.format, texture.srgb);
+
+    char source[128];
+    sprintf(source, "%llu %d", (unsigned long long) source_timestamp, int(usage));
+    std::vector<uint8_t> kvd;
+    append_key_value(kvd, "KTXwriter", "gKit bake_textures");
+    append_key_value(kvd, gkit_source_key, source);
+
+    ktx2_header header= { };
+    memcpy(header.identifier, ktx2_identifier, sizeof(ktx2_identifier));
+    header.vk_format= vk_format(texture.format, texture.srgb);
+    header.type_size= 1;
+    header.pixel_width= texture.width;
+    header.pixel_height= texture.height;
+    header.face_count= 1;
+    header.level_count= level_count;
+    header.supercompression_scheme= KTX2_SUPERCOMPRESSION_ZSTD;
+    header.dfd_offset= uint32_t(sizeof(ktx2_header) + level_count * sizeof(ktx2_level_index));
+    header.dfd_length= uint32_t(dfd.size());
+    header.kvd_offset= header.dfd_offset + header.dfd_length;
+    header.kvd_length= uint32_t(kvd.size());
+
+    // les niveaux sont ranges du plus petit au plus grand, sans alignement pour un fichier supercompresse
+    std::vector<ktx2_level_index> index(level_count);
+    uint64_t offset= header.kvd_offset + header.kvd_length;
+    for(int i= level_count - 1; i >= 0; i--)
+    {
+        index[i].offset= offset;
+        index[i].length= compressed[i].size();
+        index[i].uncompressed_length= texture.levels[i].data.size();
+        offset+= compressed[i].size();
+    }
+
+    FILE *out= fopen(filename, "wb");
+    if(out == nullptr)
+    {
+        printf("[error] writing ktx2 '%s'...\n", filename);
+        return false;
+    }
+
+    code= fwrite(&header, sizeof(header), 1, out) == 1
+        && fwrite(index.data(), sizeof(ktx2_level_index), index.size(), out) == index.size()
+        && fwrite(dfd.data(), 1, dfd.size(), out) == dfd.size()
+        && fwrite(kvd.data(), 1, kvd.size(), out) == kvd.size();
+    for(int i= level_count - 1; code && i >= 0; i--)
+        code= fwrite(compressed[i].data(), 1, compressed[i].size(), out) == compressed[i].size();
+
+    fclose(out);
+    if(!code)
+    {
+        printf("[error] writing ktx2 '%s'...\n", filename);
+        remove(filename);
+        return false;
+    }
+
+    return true;
+}
+
+bool read_ktx2( const char *filename, KTX2Texture& texture, size_t *source_timestamp, KTX2Usage *usage, const bool parallel )
+{
+    MappedFile file= map_file(filename);
+    if(file.data == nullptr || file.size < sizeof(ktx2_header))
+    {
+        printf("[error] reading ktx2 '%s'...\n", filename);
+        unmap_file(file);
+        return false;
+    }
+
+    ktx2_header header;
+    memcpy(&header, file.data, sizeof(header));
+
+    BCFormat format;
+    bool srgb;
+    if(memcmp(header.identifier, ktx2_identifier, sizeof(ktx2_identifier)) != 0
+    || !bc_format(header.vk_format, format, srgb)
+    || header.pixel_width == 0 || header.pixel_height == 0 || header.pixel_depth > 1 || header.layer_count > 1 || header.face_count != 1
+    || header.level_count == 0 || header.level_count > 32
+    || (header.supercompression_scheme != KTX2_SUPERCOMPRESSION_NONE && header.supercompression_scheme != KTX2_SUPERCOMPRESSION_ZSTD)
+    || sizeof(ktx2_header) + header.level_count * sizeof(ktx2_level_index) > file.size
+    || uint64_t(header.kvd_offset) + header.kvd_length > file.size)
+    {
+        printf("[error] unsupported ktx2 '%s'...\n", filename);
+        unmap_file(file);
+        return false;
+    }
+
+    // metadonnees : cherche la cle gKitSource
+    size_t timestamp= 0;
+    int source_usage= -1;
+    for(uint32_t offset= 0; offset + 4 <= header.kvd_length; )
+    {
+        uint32_t length;
+        memcpy(&length, file.data + header.kvd_offset + offset, 4);
+        if(length > header.kvd_length - offset - 4)
+            break;
+
+        std::string entry(file.data + header.kvd_offset + offset + 4, length);
+        size_t end= entry.find('\0');
+        if(end != std::string::npos && entry.compare(0, end, gkit_source_key) == 0)
+        {
+            unsigned long long t= 0;
+            if(sscanf(entry.c_str() + end + 1, "%llu %d", &t, &source_usage) == 2)
+                timestamp= size_t(t);
+        }
+
+        offset+= 4 + ((length + 3) & ~3u);
+    }
+
+    KTX2Texture result;
+    result.width= int(header.pixel_width);
+    result.height= int(header.pixel_height);
+    result.format= format;
+    result.srgb= srgb;
+    result.levels.resize(header.level_count);
+
+    std::vector<ktx2_level_index> index(header.level_count);
+    memcpy(index.data(), file.data + sizeof(ktx2_header), header.level_count * sizeof(ktx2_level_index));
+
+    bool code= true;
+    for(uint32_t i= 0; i < header.level_count; i++)
+    {
+        KTX2Level& level= result.levels[i];
+        level.width= std::max(1, result.width >> i);
+        level.height= std::max(1, result.height >> i);
+        level.data.resize(bc_image_size(format, level.width, level.height));
+
+        if(index[i].offset > file.size || index[i].length > file.size - index[i].offset)
+            code= false;
+        else if(header.supercompression_scheme == KTX2_SUPERCOMPRESSION_NONE && index[i].length != level.data.size())
+            code= false;
+    }
+
+    // decompresse les niveaux en parallele, directement dans les blocs de chaque niveau
+    const int level_count= code ? int(header.level_count) : 0;
+#pragma omp parallel for schedule(dynamic, 1) if(parallel && level_count > 1)
+    for(int i= 0; i < level_count; i++)
+    {
+        KTX2Level& level= result.levels[i];
+        if(header.supercompression_scheme == KTX2_SUPERCOMPRESSION_ZSTD)
+        {
+            if(ZSTD_decompress(level.data.data(), level.data.size(), file.data + index[i].offset, index[i].length) != level.data.size())
+            {
+            #pragma omp atomic write
+                code= false;
+            }
+        }
+        else
+            memcpy(level.data.data(), file.data + index[i].offset, index[i].length);
+    }
+
+    unmap_file(file);
+    if(!code)
+    {
+        printf("[error] reading ktx2 '%s', corrupted level...\n", filename);
+        return false;
+    }
+
+    texture= std::move(result);
+    if(source_timestamp)
+        *source_timestamp= timestamp;
+    if(usage)
+        *usage= KTX2Usage(source_usage);
+    return true;
+}
+
+
+std::string ktx2_cache_filename( const std::string& filename )
+{
+    // ajoute un suffixe au nom complet : brick.png et brick.jpg ont des caches differents, 
+    // et un fichier brick.ktx2 (basis universal, cf ktx2.h) n'est pas ecrase par le cache.
+    return filename + ".bc.ktx2";
+}
+
+bool read_ktx2_cache( const char *filename, const KTX2Usage usage, KTX2Texture& texture, const bool parallel )
+{
+    std::string cache= ktx2_cache_filename(filename);
+    if(!exists(cache))
+        return false;
+
+    size_t source_timestamp= 0;
+    KTX2Usage source_usage;
+    KTX2Texture tmp;
+    if(!read_ktx2(cache.c_str(), tmp, &source_timestamp, &source_usage, parallel))
+        return false;
+
+    // l'image source a ete modifiee, ou le cache a ete construit pour une autre utilisation
+    if(source_timestamp != timestamp(filename) || source_usage != usage)
+    {
+        printf("ktx2 cache '%s' is out of date...\n", cache.c_str());
+        return false;
+    }
+
+    texture= std::move(tmp);
+    return true;
+}
+
+bool write_ktx2_cache( const char *filename, const KTX2Usage usage, const KTX2Texture& texture )
+{
+    size_t source_timestamp= timestamp(filename);
+    if(source_timestamp == 0)
+        return false;
+
+    std::string cache= ktx2_cache_filename(filename);
+    if(!write_ktx2(cache.c_str(), texture, source_timestamp, usage))
+        return false;
+
+    printf("writing ktx2 cache '%s'...\n", cache.c_str());
+    return true;
+}
@@ -0,0 +1,93 @@
+
+#ifndef _KTX2_BAKE_H
+#define _KTX2_BAKE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "bc_encoder.h"
+
+
+/*! \file
+pre-calcul des textures : chaine complete de mipmaps filtree sur cpu, compression par blocs (cf bc_encoder.h) et stockage dans un fichier ktx2 compresse par zstd.
+
+le fichier ktx2 est un cache ecrit a cote de l'image source, il est invalide des que l'image est modifiee, cf timestamp(), comme mesh_cache.h.
+ne necessite pas de contexte openGL, cf ktx2_texture.h pour creer la texture.
+\code
+KTX2Texture texture;
+if(!read_ktx2_cache("data/textures/brick.png", KTX2_USAGE_COLOR_SRGB, texture))
+{
+    ImageData image= read_image_data("data/textures/brick.png");
+    texture= bake_ktx2_texture(image.pixels.data(), image.width, image.height, image.channels, KTX2_USAGE_COLOR_SRGB);
+    write_ktx2_cache("data/textures/brick.png", KTX2_USAGE_COLOR_SRGB, texture);
+}
+\endcode
+*/
+
+//! utilisation de la texture, determine le filtrage des mipmaps et le format de compression.
+enum KTX2Usage
+{
+    KTX2_USAGE_COLOR_SRGB= 0,   //!< couleur srgb, filtree en lumiere lineaire. BC1, ou BC3 si l'image est transparente.
+    KTX2_USAGE_COLOR_LINEAR,    //!< couleur ou donnees lineaires (specular, etc.). BC1 ou BC3.
+    KTX2_USAGE_NORMAL_MAP       //!< normales, renormalisees a chaque niveau. BC5 : x et y, z est reconstruit par le shader.
+};
+
+//! un niveau de mipmap compresse.
+struct KTX2Level
+{
+    int width;
+    int height;
+    std::vector<uint8_t> data;  //!< blocs compresses, cf bc_image_size().
+};
+
+//! texture compressee, tous les niveaux de mipmap, sans contexte openGL.
+struct KTX2Texture
+{
+    KTX2Texture( ) : width(0), height(0), format(BC_FORMAT_BC1), srgb(false), levels() {}
+
+    int width;
+    int height;
+    BCFormat format;
+    bool srgb;
+    std::vector<KTX2Level> levels;  //!< levels[0] : pleine resolution, le dernier niveau fait 1x1.
+
+    //! taille des blocs de tous les niveaux, en octets.
+    size_t size( ) const;
+};
+
+//! renvoie le format de compression utilise pour une image. bc7 : utilise BC7 au lieu de BC1 / BC3 pour les couleurs.
+BCFormat ktx2_format( const KTX2Usage usage, const bool alpha, const bool bc7= false );
+
+/*! construit la chaine complete de mipmaps d'une image 8 bits de 1 a 4 canaux et compresse tous les niveaux.
+    les niveaux sont filtres par une boite ponderee par la surface couverte, les dimensions impaires sont gerees.
+    chaque niveau est calcule a partir du niveau precedent non quantifie. la compression utilise tous les coeurs, cf encode_bc_image().
+ */
+KTX2Texture bake_ktx2_texture( const uint8_t *pixels, const int width, const int height, const int channels, const KTX2Usage usage, const bool bc7= false );
+
+//! renvoie la taille d'une texture rgba 8 bits avec ses mipmaps, comme la cree glGenerateMipmap(), pour comparer avec KTX2Texture::size().
+size_t rgba8_mipmapped_size( const int width, const int height );
+
+/*! ecrit un fichier ktx2, niveaux compresses par zstd (supercompression 2).
+    source_timestamp et usage sont stockes dans les metadonnees, cle "gKitSource", pour valider le cache.
+    renvoie false en cas d'erreur.
+ */
+bool write_ktx2( const char *filename, const KTX2Texture& texture, const size_t source_timestamp, const KTX2Usage usage, const int zstd_level= 10 );
+
+/*! relit un fichier ecrit par write_ktx2(). uniquement les formats produits par bake_ktx2_texture().
+    renvoie false en cas d'erreur, source_timestamp et usage sont remplis si les pointeurs ne sont pas nuls.
+    \param parallel decompresse les niveaux en parallele. false si plusieurs textures sont deja chargees en parallele, cf TextureStreamer.
+ */
+bool read_ktx2( const char *filename, KTX2Texture& texture, size_t *source_timestamp= nullptr, KTX2Usage *usage= nullptr, const bool parallel= true );
+
+//! renvoie le nom du cache d'une image. ktx2_cache_filename("data/brick.png") == "data/brick.png.bc.ktx2"
+std::string ktx2_cache_filename( const std::string& filename );
+
+//! charge le cache de l'image filename, s'il existe, s'il est a jour et s'il a ete construit pour la meme utilisation. renvoie false sinon.
+bool read_ktx2_cache( const char *filename, const KTX2Usage usage, KTX2Texture& texture, const bool parallel= true );
+
+//! ecrit le cache de l'image filename. renvoie false en cas d'erreur.
+bool write_ktx2_cache( const char *filename, const KTX2Usage usage, const KTX2Texture& texture );
+
+#endif
@@ -0,0 +1,59 @@
+
+#include <cstdio>
+
+#include "image_io.h"
+#include "ktx2_texture.h"
+
+
+GLenum ktx2_internal_format( const KTX2Texture& texture )
+{
+    switch(texture.format)
+    {
+        case BC_FORMAT_BC1: return texture.srgb ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case BC_FORMAT_BC3: return texture.srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case BC_FORMAT_BC5: return GL_COMPRESSED_RG_RGTC2;
+        case BC_FORMAT_BC7: return texture.srgb ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM : GL_COMPRESSED_RGBA_BPTC_UNORM;
+    }
+    return 0;
+}
+
+GLuint make_ktx2_texture( const int unit, const KTX2Texture& texture )
+{
+    if(texture.levels.empty())
+        return 0;
+
+    GLenum format= ktx2_internal_format(texture);
+
+    GLuint id= 0;
+    glGenTextures(1, &id);
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D, id);
+
+    for(int i= 0; i < int(texture.levels.size()); i++)
+    {
+        const KTX2Level& level= texture.levels[i];
+        glCompressedTexImage2D(GL_TEXTURE_2D, i, format, level.width, level.height, 0, GLsizei(level.data.size()), level.data.data());
+    }
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, int(texture.levels.size()) -1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return id;
+}
+
+GLuint read_baked_texture( const int unit, const char *filename, const KTX2Usage usage )
+{
+    KTX2Texture texture;
+    if(!read_ktx2_cache(filename, usage, texture))
+    {
+        ImageData image= read_image_data(filename);
+        if(image.pixels.empty())
+            return 0;
+
+        texture= bake_ktx2_texture(image.pixels.data(), image.width, image.height, image.channels, usage);
+        write_ktx2_cache(filename, usage, texture);
+    }
+
+    return make_ktx2_texture(unit, texture);
+}
@@ -0,0 +1,24 @@
+
+#ifndef _KTX2_BAKED_TEXTURE_H
+#define _KTX2_BAKED_TEXTURE_H
+
+#include "glcore.h"
+
+#include "ktx2_bake.h"
+
+
+//! \file
+//! textures openGL compressees (BC1, BC3, BC5, BC7) creees a partir des textures pre-calculees par bake_ktx2_texture(), cf ktx2_bake.h.
+
+//! renvoie le format interne openGL d'une texture compressee, GL_COMPRESSED_SRGB_S3TC_DXT1_EXT, GL_COMPRESSED_RG_RGTC2, etc.
+GLenum ktx2_internal_format( const KTX2Texture& texture );
+
+//! cree une texture openGL avec tous les niveaux de mipmap de texture, sans glGenerateMipmap(). a detruire avec glDeleteTextures( ).
+GLuint make_ktx2_texture( const int unit, const KTX2Texture& texture );
+
+/*! cree une texture a partir du cache ktx2 de l'image filename, cf read_ktx2_cache().
+    si le cache n'existe pas ou n'est plus a jour, l'image est chargee, compressee et le cache est ecrit.
+ */
+GLuint read_baked_texture( const int unit, const char *filename, const KTX2Usage usage );
+
+#endif
@@ -1,6 +1,9 @@
 
 //! \file tuto_bvh2.cpp bvh 2 niveaux et instances
 
+#include <cstdio>
+#include <cstring>
+#include <chrono>
 #include <algorithm>
 #include <vector>
 #include <cfloat>
@@ -14,19 +17,8 @@
 #include "mesh.h"
 #include "wavefront.h"
 
+#include "bvh.h"
 
-// rayon 
-struct Ray
-{
-    Point o;            // origine
-    float pad;
-    Vector d;           // direction
-    float tmax;
-    
-    Ray( const Point& _o, const Point& _e ) :  o(_o), d(Vector(_o, _e)), tmax(1) {}
-    Ray( const Point& _o, const Vector& _d ) :  o(_o), d(_d), tmax(FLT_MAX) {}
-    Ray( const Point& _o, const Vector& _d, const float _tmax ) :  o(_o), d(_d), tmax(_tmax) {}
-};
 
 // intersection avec un triangle
 struct Hit
@@ -43,213 +35,6 @@ struct Hit
     operator bool ( ) { return (triangle_id != -1); }
 };
 
-// intersection avec une boite / un englobant
-struct BBoxHit
-{
-    float tmin, tmax;
-    
-    BBoxHit() : tmin(FLT_MAX), tmax(-FLT_MAX) {}
-    BBoxHit( const float _tmin, const float _tmax ) : tmin(_tmin), tmax(_tmax) {}
-    
-    operator bool( ) const { return tmin <= tmax; }
-};
-
-
-// boite englobante
-struct BBox
-{
-    Point pmin, pmax;
-    
-    BBox( ) : pmin(), pmax() {}
-    
-    BBox( const Point& p ) : pmin(p), pmax(p) {}
-    BBox( const BBox& box ) : pmin(box.pmin), pmax(box.pmax) {}
-    BBox( const BBox& a, const BBox& b ) : pmin(min(a.pmin, b.pmin)), pmax(max(a.pmax, b.pmax)) {}
-    
-    BBox& insert( const Point& p ) { pmin= min(pmin, p); pmax= max(pmax, p); return *this; }
-    BBox& insert( const BBox& box ) { pmin= min(pmin, box.pmin); pmax= max(pmax, box.pmax); return *this; }
-    
-    float centroid( const int axis ) const { return (pmin(axis) + pmax(axis)) / 2; }
-    Point centroid( ) const { return (pmin + pmax) / 2; }
-    
-    BBoxHit intersect( const Ray& ray, const Vector& invd, const float htmax ) const
-    {
-        Point rmin= pmin;
-        Point rmax= pmax;
-        if(ray.d.x < 0) std::swap(rmin.x, rmax.x);
-        if(ray.d.y < 0) std::swap(rmin.y, rmax.y);
-        if(ray.d.z < 0) std::swap(rmin.z, rmax.z);
-        Vector dmin= (rmin - ray.o) * invd;
-        Vector dmax= (rmax - ray.o) * invd;
-        
-        float tmin= std::max(dmin.z, std::max(dmin.y, std::max(dmin.x, 0.f)));
-        float tmax= std::min(dmax.z, std::min(dmax.y, std::min(dmax.x, htmax)));
-        return BBoxHit(tmin, tmax);
-    }
-};
-
-
-// construction de l'arbre / BVH
-struct Node
-{
-    BBox bounds;
-    int left;
-    int right;
-    
-    bool internal( ) const { return right > 0; }                        // renvoie vrai si le noeud est un noeud interne
-    int internal_left( ) const { assert(internal()); return left; }     // renvoie le fils gauche du noeud interne 
-    int internal_right( ) const { assert(internal()); return right; }   // renvoie le fils droit
-    
-    bool leaf( ) const { return right < 0; }                            // renvoie vrai si le noeud est une feuille
-    int leaf_begin( ) const { assert(leaf()); return -left; }           // renvoie le premier objet de la feuille
-    int leaf_end( ) const { assert(leaf()); return -right; }            // renvoie le dernier objet
-};
-
-// creation d'un noeud interne
-Node make_node( const BBox& bounds, const int left, const int right )
-{
-    Node node { bounds, left, right };
-    assert(node.internal());    // verifie que c'est bien un noeud...
-    return node;
-}
-
-// creation d'une feuille
-Node make_leaf( const BBox& bounds, const int begin, const int end )
-{
-    Node node { bounds, -begin, -end };
-    assert(node.leaf());        // verifie que c'est bien une feuille...
-    return node;
-}
-
-
-// bvh parametre par le type des primitives, cf triangle et instance...
-template < typename T >
-struct BVHT
-{
-    // construit un bvh pour l'ensemble de primitives
-    int build( const std::vector<T>& _primitives )
-    {
-        primitives= _primitives;  // copie les primitives pour les trier
-        nodes.clear();          // efface les noeuds
-        nodes.reserve(primitives.size());
-        
-        // construit l'arbre... 
-        root= build(0, primitives.size());
-        return root;
-    }
-    
-    // intersection avec un rayon, entre 0 et htmax
-    Hit intersect( const Ray& ray, const float htmax ) const
-    {
-        Hit hit;
-        hit.t= htmax;
-        Vector invd= Vector(1 / ray.d.x, 1 / ray.d.y, 1 / ray.d.z);
-        intersect(root, ray, invd, hit);
-        return hit;
-    }
-    
-    // intersection avec un rayon, entre 0 et ray.tmax
-    Hit intersect( const Ray& ray ) const { return intersect(ray, ray.tmax); }
-    
-protected:
-    std::vector<Node> nodes;
-    std::vector<T> primitives;
-    int root;
-    
-    int build( const int begin, const int end )
-    {
-        if(end - begin < 2)
-        {
-            // inserer une feuille et renvoyer son indice
-            int index= nodes.size();
-            nodes.push_back( make_leaf( primitive_bounds(begin, end), begin, end ) );
-            return index;
-        }
-        
-        // axe le plus etire de l'englobant des centres des englobants des primitives... 
-        BBox cbounds= centroid_bounds(begin, end);
-        Vector d= Vector(cbounds.pmin, cbounds.pmax);
-        int axis;
-        if(d.x > d.y && d.x > d.z)  // x plus grand que y et z ?
-            axis= 0;
-        else if(d.y > d.z)          // y plus grand que z ? (et que x implicitement)
-            axis= 1;
-        else                        // x et y ne sont pas les plus grands...
-            axis= 2;
-
-        // coupe l'englobant au milieu
-        float cut= cbounds.centroid(axis);
-        
-        // repartit les primitives 
-        T *pm= std::partition(primitives.data() + begin, primitives.data() + end, 
-            [axis, cut]( const T& primitive ) 
-            { 
-                return primitive.bounds().centroid(axis) < cut; 
-            }
-        );
-        int m= std::distance(primitives.data(), pm);
-        
-        // la repartition peut echouer, et toutes les primitives sont dans la meme moitiee de l'englobant
-        // forcer quand meme un decoupage en 2 ensembles 
-        if(m == begin || m == end)
-            m= (begin + end) / 2;
-        assert(m != begin);
-        assert(m != end);
-        
-        // construire le fils gauche, les triangles se trouvent dans [begin .. m)
-        int left= build(begin, m);
-        
-        // on recommence pour le fils droit, les triangles se trouvent dans [m .. end)
-        int right= build(m, end);
-        
-        // construire le noeud et renvoyer son indice
-        int index= nodes.size();
-        nodes.push_back( make_node( BBox(nodes[left].bounds, nodes[right].bounds), left, right ) );
-        return index;
-    }
-    
-    // englobant des primitives
-    BBox primitive_bounds( const int begin, const int end )
-    {
-        BBox bbox= primitives[begin].bounds();
-        for(int i= begin +1; i < end; i++)
-            bbox.insert(primitives[i].bounds());
-        
-        return bbox;
-    }
-    
-    // englobant des centres des primitives
-    BBox centroid_bounds( const int begin, const int end )
-    {
-        BBox bbox= primitives[begin].bounds().centroid();
-        for(int i= begin +1; i < end; i++)
-            bbox.insert(primitives[i].bounds().centroid());
-        
-        return bbox;
-    }
-    
-    // intersection et parcours simple
-    void intersect( const int index, const Ray& ray, const Vector& invd, Hit& hit ) const
-    {
-        const Node& node= nodes[index];
-        if(node.bounds.intersect(ray, invd, hit.t))
-        {
-            if(node.leaf())
-            {
-                for(int i= node.leaf_begin(); i < node.leaf_end(); i++)
-                    if(Hit h= primitives[i].intersect(ray, hit.t))
-                        hit= h;
-            }
-            else // if(node.internal())
-            {
-                intersect(node.internal_left(), ray, invd, hit);
-                intersect(node.internal_right(), ray, invd, hit);
-            }
-        }
-    }
-};
-
-
 // triangle pour le bvh, cf fonction bounds() et intersect()
 struct Triangle
 {
@@ -302,16 +87,24 @@ typedef BVHT<Triangle> BLAS;
 struct Instance
 {
     Transform object_transform;
+    BBox object_bounds;
     BBox world_bounds;
     BVH *object_bvh;
     int instance_id;
     
     Instance( const BBox& bounds, const Transform& model, BVH& bvh, const int id ) :  
-        object_transform(Inverse(model)), world_bounds(transform(bounds, model)), 
+        object_transform(Inverse(model)), object_bounds(bounds), world_bounds(transform(bounds, model)), 
         object_bvh(&bvh),
         instance_id(id)
     {}
     
+    //! deplace l'instance, cf TLAS::refit() et TLAS::update() pour mettre a jour l'arbre.
+    void update( const Transform& model )
+    {
+        object_transform= Inverse(model);
+        world_bounds= transform(object_bounds, model);
+    }
+    
     BBox bounds( ) const { return world_bounds; }
     
     Hit intersect( const Ray &ray, const float htmax ) const
@@ -357,8 +150,18 @@ int main( int argc, char **argv )
     const char *mesh_filename= "data/robot.obj";
     const char *orbiter_filename= nullptr;
     
-    if(argc > 1) mesh_filename= argv[1];
-    if(argc > 2) orbiter_filename= argv[2];
+    // options : -packet trace les rayons par paquets de 8, -stream trace chaque ligne de l'image comme un flux de rayons, cf RayPacket8
+    int mode= 0;
+    std::vector<const char *> filenames;
+    for(int i= 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "-packet") == 0) mode= 1;
+        else if(strcmp(argv[i], "-stream") == 0) mode= 2;
+        else filenames.push_back(argv[i]);
+    }
+    
+    if(filenames.size() > 0) mesh_filename= filenames[0];
+    if(filenames.size() > 1) orbiter_filename= filenames[1];
     
     Mesh mesh= read_mesh(mesh_filename);
     if(mesh.triangle_count() == 0)
@@ -378,8 +181,13 @@ int main( int argc, char **argv )
             triangles.push_back( Triangle(data, triangles.size()) );
         }
         
-        // construit le bvh...
+        // construit le bvh... et compare avec la version precedente, coupe au milieu
+        BVH midpoint;
+        midpoint.build_midpoint(triangles);
+        printf("BLAS midpoint: %d nodes, cost %.2f, %.1fms\n", midpoint.size(), midpoint.cost(), midpoint.build_time());
+        
         bvh.build(triangles);
+        printf("BLAS sah: %d nodes, cost %.2f, %.1fms\n", bvh.size(), bvh.cost(), bvh.build_time());
     }
     
     // instancie l'objet
@@ -394,6 +202,7 @@ int main( int argc, char **argv )
         
         // construit le bvh...
         top_bvh.build(instances);
+        printf("TLAS sah: %d nodes, cost %.2f, %.1fms\n", top_bvh.size(), top_bvh.cost(), top_bvh.build_time());
     }
     
     // regle la camera
@@ -412,20 +221,72 @@ int main( int argc, char **argv )
     Transform viewport= Viewport(image.width(), image.height());
     Transform inv= Inverse(viewport * projection * view * model);
     
-    // calcule l'image en parallele avec openMP
-#pragma omp parallel for 
-    for(int y= 0; y < image.height(); y++)
-    for(int x= 0; x < image.width(); x++)
+    // genere le rayon pour le pixel x,y
+    auto primary= [&]( const int x, const int y )
     {
-        // genere le rayon pour le pixel x,y
         Point o= inv( Point(x, y, 0) ); // origine
         Point e= inv( Point(x, y, 1) ); // extremite
-        Ray ray(o, e);
-        
-        // intersections !
-        if(Hit hit= top_bvh.intersect(ray))
-            image(x, y)= Red(); // touche ! 
+        return Ray(o, e);
+    };
+    
+    auto start= std::chrono::high_resolution_clock::now();
+    
+    // calcule l'image en parallele avec openMP
+    if(mode == 0)
+    {
+    #pragma omp parallel for 
+        for(int y= 0; y < image.height(); y++)
+        for(int x= 0; x < image.width(); x++)
+        {
+            Ray ray= primary(x, y);
+            
+            // intersections !
+            if(Hit hit= top_bvh.intersect(ray))
+                image(x, y)= Red(); // touche ! 
+        }
     }
+    else if(mode == 1)
+    {
+        // paquets de 4x2 pixels
+    #pragma omp parallel for 
+        for(int y= 0; y < image.height(); y+= 2)
+        for(int x= 0; x < image.width(); x+= 4)
+        {
+            RayPacket8 packet;
+            for(int i= 0; i < RayPacket8::SIZE; i++)
+                if(x + i % 4 < image.width() && y + i / 4 < image.height())
+                    packet.set(i, primary(x + i % 4, y + i / 4));
+            
+            Hit hits[RayPacket8::SIZE];
+            top_bvh.intersect(packet, hits);
+            
+            for(int i= 0; i < RayPacket8::SIZE; i++)
+                if((packet.mask & (1 << i)) && hits[i])
+                    image(x + i % 4, y + i / 4)= Red();
+        }
+    }
+    else
+    {
+        // 1 flux de rayons par ligne
+    #pragma omp parallel for 
+        for(int y= 0; y < image.height(); y++)
+        {
+            std::vector<Ray> rays;
+            for(int x= 0; x < image.width(); x++)
+                rays.push_back( primary(x, y) );
+            
+            std::vector<Hit> hits;
+            top_bvh.intersect(rays, hits);
+            
+            for(int x= 0; x < image.width(); x++)
+                if(hits[x])
+                    image(x, y)= Red();
+        }
+    }
+    
+    auto stop= std::chrono::high_resolution_clock::now();
+    float time= std::chrono::duration<float, std::milli>(stop - start).count();
+    printf("render %.1fms, %.2f Mrays/s\n", time, float(image.width() * image.height()) / time / 1000);
     
     write_image(image, "render.png");
     return 0;
@@ -9,6 +9,7 @@
 #include "mat.h"
 #include "color.h"
 #include "image.h"
+#include "image_tiles.h"
 #include "image_io.h"
 #include "image_hdr.h"
 #include "orbiter.h"
@@ -151,10 +152,13 @@ int main( const int argc, const char **argv )
     
 auto start= std::chrono::high_resolution_clock::now();
     
-    // c'est parti, parcours tous les pixels de l'image
-    for(int y= 0; y < image.height(); y++)
-    for(int x= 0; x < image.width(); x++)
+    // c'est parti, parcours tous les pixels de l'image, par tuiles de 16x16 pixels reparties entre les threads, cf TileRenderer
+    TileRenderer renderer(image.width(), image.height(), 16);
+    renderer.render(image,
+        [&]( const int x, const int y, const int sample )
     {
+        Color color= Black();
+        
         // generer le rayon
         Point origine= inv(Point(x + .5f, y + .5f, 0));
         Point extremite= inv(Point(x + .5f, y + .5f, 1));
@@ -172,7 +176,7 @@ auto start= std::chrono::high_resolution_clock::now();
     #if 0
         if(hit)
             // coordonnees barycentriques de l'intersection
-            image(x, y)= Color(1 - hit.u - hit.v, hit.u, hit.v);
+            color= Color(1 - hit.u - hit.v, hit.u, hit.v);
     #endif
 
     #if 1
@@ -180,7 +184,7 @@ auto start= std::chrono::high_resolution_clock::now();
         {
             Vector n= normal(mesh, hit);
             // normale interpolee a l'intersection
-            image(x, y)= Color(std::abs(n.x), std::abs(n.y), std::abs(n.z));
+            color= Color(std::abs(n.x), std::abs(n.y), std::abs(n.z));
         }
     #endif
     
@@ -217,14 +221,15 @@ auto start= std::chrono::high_resolution_clock::now();
             float cos_theta= std::abs(dot(pn, normalize(l)));
             Color fr= diffuse_color(mesh, hit) / M_PI;
             
-            Color color= v * emission * fr * cos_theta / length2(l);
-            image(x, y)= Color(color, 1);
+            color= Color(v * emission * fr * cos_theta / length2(l), 1);
         }
     #endif
-    }
+        return color;
+    });
 auto stop= std::chrono::high_resolution_clock::now();
 int cpu= std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count();
 printf("%dms\n", cpu);
+renderer.print_stats();
     
     write_image(image, "render.png");
     write_image_hdr(image, "shadow.hdr");